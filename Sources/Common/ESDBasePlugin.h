@@ -32,6 +32,8 @@ public:
 	virtual void DeviceDidDisconnect(const std::string& inDeviceID) = 0;
 
 	virtual void SendToPlugin(const std::string& inAction, const std::string& inContext, const json &inPayload, const std::string& inDeviceID) = 0;
+
+	virtual void DidReceiveGlobalSettings(const json &inPayload) = 0;
 	
 protected:
 	ESDConnectionManager *mConnectionManager = nullptr;
@@ -12,6 +12,14 @@
 
 #include "ESDConnectionManager.h"
 #include "EPLJSONUtils.h"
+#include "ESDOutboundEncoder.h"
+
+// Reused by the encoded sends of each thread, so they don't allocate once it has grown
+static std::string& GetSendBuffer()
+{
+	thread_local std::string buffer;
+	return buffer;
+}
 
 
 void ESDConnectionManager::OnOpen(WebsocketClient* inClient, websocketpp::connection_hdl inConnectionHandler)
@@ -25,6 +33,9 @@ void ESDConnectionManager::OnOpen(WebsocketClient* inClient, websocketpp::connec
 
 	websocketpp::lib::error_code ec;
 	mWebsocket.send(mConnectionHandle, jsonObject.dump(), websocketpp::frame::opcode::text, ec);
+
+	// The plugin wide settings arrive with didReceiveGlobalSettings
+	GetGlobalSettings();
 }
 
 void ESDConnectionManager::OnFail(WebsocketClient* inClient, websocketpp::connection_hdl inConnectionHandler)
@@ -63,55 +74,72 @@ void ESDConnectionManager::OnMessage(websocketpp::connection_hdl, WebsocketClien
 {
 	if (inMsg != NULL && inMsg->get_opcode() == websocketpp::frame::opcode::text)
 	{
-		std::string message = inMsg->get_payload();
+		const std::string& message = inMsg->get_payload();
 		DebugPrint("OnMessage: %s\n", message.c_str());
 		
 		try
 		{
-			json receivedJson = json::parse(message);
-			
-			std::string event = EPLJSONUtils::GetStringByName(receivedJson, kESDSDKCommonEvent);
-			std::string context = EPLJSONUtils::GetStringByName(receivedJson, kESDSDKCommonContext);
-			std::string action = EPLJSONUtils::GetStringByName(receivedJson, kESDSDKCommonAction);
-			std::string deviceID = EPLJSONUtils::GetStringByName(receivedJson, kESDSDKCommonDevice);
-			json payload;
-			EPLJSONUtils::GetObjectByName(receivedJson, kESDSDKCommonPayload, payload);
-
-			if(event == kESDSDKEventKeyDown)
+			if (!mInbound.Parse(message))
 			{
-				mPlugin->KeyDownForAction(action, context, payload, deviceID);
+				LogMessage("Ignoring message that is not a json object: " + message);
+				return;
 			}
-			else if(event == kESDSDKEventKeyUp)
+
+			// Events without a handler are dropped without parsing their payload
+			auto handler = mEventHandlers.find(mInbound.GetEvent());
+			if (handler != mEventHandlers.end())
+				handler->second(mInbound);
+		}
+		catch (std::exception& e)
+		{
+			LogMessage("Failed to handle event " + mInbound.GetEvent() + ": " + e.what());
+		}
+		catch (...)
+		{
+			LogMessage("Failed to handle event " + mInbound.GetEvent());
+		}
+	}
+}
+
+void ESDConnectionManager::InitEventHandlers()
+{
+	mEventHandlers =
+	{
+		{ kESDSDKEventKeyDown, [this](const ESDInboundMessage& inMessage)
 			{
-				mPlugin->KeyUpForAction(action, context, payload, deviceID);
-			}
-			else if(event == kESDSDKEventWillAppear)
+				mPlugin->KeyDownForAction(inMessage.GetAction(), inMessage.GetContext(), inMessage.GetPayload(), inMessage.GetDevice());
+			} },
+		{ kESDSDKEventKeyUp, [this](const ESDInboundMessage& inMessage)
 			{
-				mPlugin->WillAppearForAction(action, context, payload, deviceID);
-			}
-			else if(event == kESDSDKEventWillDisappear)
+				mPlugin->KeyUpForAction(inMessage.GetAction(), inMessage.GetContext(), inMessage.GetPayload(), inMessage.GetDevice());
+			} },
+		{ kESDSDKEventWillAppear, [this](const ESDInboundMessage& inMessage)
 			{
-				mPlugin->WillDisappearForAction(action, context, payload, deviceID);
-			}
-			else if(event == kESDSDKEventDeviceDidConnect)
+				mPlugin->WillAppearForAction(inMessage.GetAction(), inMessage.GetContext(), inMessage.GetPayload(), inMessage.GetDevice());
+			} },
+		{ kESDSDKEventWillDisappear, [this](const ESDInboundMessage& inMessage)
 			{
-				json deviceInfo;
-				EPLJSONUtils::GetObjectByName(receivedJson, kESDSDKCommonDeviceInfo, deviceInfo);
-				mPlugin->DeviceDidConnect(deviceID, deviceInfo);
-			}
-			else if(event == kESDSDKEventDeviceDidDisconnect)
+				// The key is reset when it appears again, so its next updates must be sent
+				mOutbound.forgetContext(inMessage.GetContext());
+				mPlugin->WillDisappearForAction(inMessage.GetAction(), inMessage.GetContext(), inMessage.GetPayload(), inMessage.GetDevice());
+			} },
+		{ kESDSDKEventDeviceDidConnect, [this](const ESDInboundMessage& inMessage)
 			{
-				mPlugin->DeviceDidDisconnect(deviceID);
-			}
-			else if (event == kESDSDKEventSendToPlugin)
+				mPlugin->DeviceDidConnect(inMessage.GetDevice(), inMessage.GetDeviceInfo());
+			} },
+		{ kESDSDKEventDeviceDidDisconnect, [this](const ESDInboundMessage& inMessage)
 			{
-				mPlugin->SendToPlugin(action, context, payload, deviceID);
-			}
-		}
-		catch (...)
-		{
-		}
-	}
+				mPlugin->DeviceDidDisconnect(inMessage.GetDevice());
+			} },
+		{ kESDSDKEventSendToPlugin, [this](const ESDInboundMessage& inMessage)
+			{
+				mPlugin->SendToPlugin(inMessage.GetAction(), inMessage.GetContext(), inMessage.GetPayload(), inMessage.GetDevice());
+			} },
+		{ kESDSDKEventDidReceiveGlobalSettings, [this](const ESDInboundMessage& inMessage)
+			{
+				mPlugin->DidReceiveGlobalSettings(inMessage.GetPayload());
+			} },
+	};
 }
 
 ESDConnectionManager::ESDConnectionManager(
@@ -128,6 +156,8 @@ ESDConnectionManager::ESDConnectionManager(
 {
 	if (inPlugin != nullptr)
 		inPlugin->SetConnectionManager(this);
+
+	InitEventHandlers();
 }
 
 void ESDConnectionManager::Run()
@@ -175,8 +205,73 @@ void ESDConnectionManager::Run()
     }
 }
 
+void ESDConnectionManager::QueueOutbound(ESDOutboundCoalescer::message_t inMessage)
+{
+	// The first update after a flush schedules the next flush, later ones in the same interval are merged into it
+	if (mOutbound.submit(std::move(inMessage)))
+	{
+		mWebsocket.set_timer(OUTBOUND_FRAME_INTERVAL_MILLIS, [this](const websocketpp::lib::error_code& ec)
+		{
+			if (!ec)
+				FlushOutbound();
+			else
+				mOutbound.cancelFlush();
+		});
+	}
+}
+
+void ESDConnectionManager::FlushOutbound()
+{
+	for (const ESDOutboundCoalescer::message_t& message : mOutbound.takePending())
+	{
+		switch (message.kind)
+		{
+		case ESDOutboundCoalescer::TITLE:
+			SendTitle(message.value, message.context, message.target);
+			break;
+		case ESDOutboundCoalescer::IMAGE:
+			SendImage(message.value, message.context, message.target);
+			break;
+		case ESDOutboundCoalescer::STATE:
+			SendState(std::stoi(message.value), message.context);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+ESDOutboundCoalescer::stats_t ESDConnectionManager::GetOutboundStats() const
+{
+	return mOutbound.getStats();
+}
+
 void ESDConnectionManager::SetTitle(const std::string &inTitle, const std::string& inContext, ESDSDKTarget inTarget)
 {
+	QueueOutbound({ ESDOutboundCoalescer::TITLE, inContext, inTarget, inTitle });
+}
+
+void ESDConnectionManager::SetImage(const std::string &inBase64ImageString, const std::string& inContext, ESDSDKTarget inTarget)
+{
+	QueueOutbound({ ESDOutboundCoalescer::IMAGE, inContext, inTarget, inBase64ImageString });
+}
+
+void ESDConnectionManager::SetState(int inState, const std::string& inContext)
+{
+	QueueOutbound({ ESDOutboundCoalescer::STATE, inContext, kESDSDKTarget_HardwareAndSoftware, std::to_string(inState) });
+}
+
+void ESDConnectionManager::SendTitle(const std::string &inTitle, const std::string& inContext, ESDSDKTarget inTarget)
+{
+	websocketpp::lib::error_code ec;
+	std::string& buffer = GetSendBuffer();
+	if (ESDOutboundEncoder::EncodeSetTitle(buffer, inTitle, inContext, inTarget))
+	{
+		mWebsocket.send(mConnectionHandle, buffer, websocketpp::frame::opcode::text, ec);
+		return;
+	}
+
+	// Not valid UTF-8, let dump() report it as before
 	json jsonObject;
 
 	jsonObject[kESDSDKCommonEvent] = kESDSDKEventSetTitle;
@@ -187,12 +282,20 @@ void ESDConnectionManager::SetTitle(const std::string &inTitle, const std::strin
 	payload[kESDSDKPayloadTitle] = inTitle;
 	jsonObject[kESDSDKCommonPayload] = payload;
 	
-	websocketpp::lib::error_code ec;
 	mWebsocket.send(mConnectionHandle, jsonObject.dump(), websocketpp::frame::opcode::text, ec);
 }
 
-void ESDConnectionManager::SetImage(const std::string &inBase64ImageString, const std::string& inContext, ESDSDKTarget inTarget)
+void ESDConnectionManager::SendImage(const std::string &inBase64ImageString, const std::string& inContext, ESDSDKTarget inTarget)
 {
+	websocketpp::lib::error_code ec;
+	std::string& buffer = GetSendBuffer();
+	if (ESDOutboundEncoder::EncodeSetImage(buffer, inBase64ImageString, inContext, inTarget))
+	{
+		mWebsocket.send(mConnectionHandle, buffer, websocketpp::frame::opcode::text, ec);
+		return;
+	}
+
+	// Not valid UTF-8, let dump() report it as before
 	json jsonObject;
 
 	jsonObject[kESDSDKCommonEvent] = kESDSDKEventSetImage;
@@ -207,7 +310,6 @@ void ESDConnectionManager::SetImage(const std::string &inBase64ImageString, cons
 		payload[kESDSDKPayloadImage] = "data:image/png;base64," + inBase64ImageString;
 	jsonObject[kESDSDKCommonPayload] = payload;
 	
-	websocketpp::lib::error_code ec;
 	mWebsocket.send(mConnectionHandle, jsonObject.dump(), websocketpp::frame::opcode::text, ec);
 }
 
@@ -245,7 +347,18 @@ void ESDConnectionManager::SetSettings(const json &inSettings, const std::string
 	mWebsocket.send(mConnectionHandle, jsonObject.dump(), websocketpp::frame::opcode::text, ec);
 }
 
-void ESDConnectionManager::SetState(int inState, const std::string& inContext)
+void ESDConnectionManager::GetGlobalSettings()
+{
+	json jsonObject;
+
+	jsonObject[kESDSDKCommonEvent] = kESDSDKEventGetGlobalSettings;
+	jsonObject[kESDSDKCommonContext] = mPluginUUID;
+
+	websocketpp::lib::error_code ec;
+	mWebsocket.send(mConnectionHandle, jsonObject.dump(), websocketpp::frame::opcode::text, ec);
+}
+
+void ESDConnectionManager::SendState(int inState, const std::string& inContext)
 {
 	json jsonObject;
 	
@@ -299,6 +412,15 @@ void ESDConnectionManager::LogMessage(const std::string& inMessage)
 {
 	if(!inMessage.empty())
 	{
+		websocketpp::lib::error_code ec;
+		std::string& buffer = GetSendBuffer();
+		if (ESDOutboundEncoder::EncodeLogMessage(buffer, inMessage))
+		{
+			mWebsocket.send(mConnectionHandle, buffer, websocketpp::frame::opcode::text, ec);
+			return;
+		}
+
+		// Not valid UTF-8, let dump() report it as before
 		json jsonObject;
 
 		jsonObject[kESDSDKCommonEvent] = kESDSDKEventLogMessage;
@@ -307,7 +429,6 @@ void ESDConnectionManager::LogMessage(const std::string& inMessage)
 		payload[kESDSDKPayloadMessage] = inMessage;
 		jsonObject[kESDSDKCommonPayload] = payload;
 
-		websocketpp::lib::error_code ec;
 		mWebsocket.send(mConnectionHandle, jsonObject.dump(), websocketpp::frame::opcode::text, ec);
 	}
 }
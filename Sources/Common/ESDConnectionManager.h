@@ -13,6 +13,8 @@
 #pragma once
 
 #include "ESDBasePlugin.h"
+#include "ESDInboundMessage.h"
+#include "ESDOutboundCoalescer.h"
 #include "ESDSDKDefines.h"
 
 #include <websocketpp/config/asio_no_tls_client.hpp>
@@ -20,6 +22,9 @@
 #include <websocketpp/common/thread.hpp>
 #include <websocketpp/common/memory.hpp>
 
+#include <functional>
+#include <unordered_map>
+
 typedef websocketpp::config::asio_client::message_type::ptr message_ptr;
 typedef websocketpp::client<websocketpp::config::asio_client> WebsocketClient;
 
@@ -43,11 +48,18 @@ public:
 	void ShowAlertForContext(const std::string& inContext);
 	void ShowOKForContext(const std::string& inContext);
 	void SetSettings(const json &inSettings, const std::string& inContext);
+	void GetGlobalSettings();
 	void SetState(int inState, const std::string& inContext);
 	void SendToPropertyInspector(const std::string& inAction, const std::string& inContext, const json &inPayload);
 	void SwitchToProfile(const std::string& inDeviceID, const std::string& inProfileName);
 	void LogMessage(const std::string& inMessage);
 
+	// Number of title, image and state updates sent and dropped as redundant
+	ESDOutboundCoalescer::stats_t GetOutboundStats() const;
+
+	// Title, image and state updates of a key within this interval are merged into one message
+	static constexpr long OUTBOUND_FRAME_INTERVAL_MILLIS = 16;
+
 private:
 	
 	// Websocket callbacks
@@ -55,6 +67,16 @@ private:
 	void OnFail(WebsocketClient * inClient, websocketpp::connection_hdl inConnectionHandler);
 	void OnClose(WebsocketClient * inClient, websocketpp::connection_hdl inConnectionHandler);
 	void OnMessage(websocketpp::connection_hdl, WebsocketClient::message_ptr inMsg);
+
+	// Inbound events
+	void InitEventHandlers();
+
+	// Outbound updates
+	void QueueOutbound(ESDOutboundCoalescer::message_t inMessage);
+	void FlushOutbound();
+	void SendTitle(const std::string &inTitle, const std::string& inContext, ESDSDKTarget inTarget);
+	void SendImage(const std::string &inBase64ImageString, const std::string& inContext, ESDSDKTarget inTarget);
+	void SendState(int inState, const std::string& inContext);
 	
 	// Member variables
 	int mPort = 0;
@@ -63,5 +85,11 @@ private:
 	websocketpp::connection_hdl mConnectionHandle;
 	WebsocketClient mWebsocket;
 	ESDBasePlugin * mPlugin = nullptr;
+	ESDOutboundCoalescer mOutbound;
+
+	// Handlers keyed by event name, only used on the websocket thread
+	typedef std::function<void(const ESDInboundMessage& inMessage)> eventHandler_t;
+	std::unordered_map<std::string, eventHandler_t> mEventHandlers;
+	ESDInboundMessage mInbound;
 };
 
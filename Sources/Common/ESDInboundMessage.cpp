@@ -0,0 +1,281 @@
+//==============================================================================
+/**
+@file       ESDInboundMessage.cpp
+
+@brief      On-demand decoding of the events sent by the Stream Deck application
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "ESDInboundMessage.h"
+
+namespace
+{
+	void SkipWhitespace(const char*& ioPos, const char* inEnd)
+	{
+		while (ioPos < inEnd && (*ioPos == ' ' || *ioPos == '\t' || *ioPos == '\n' || *ioPos == '\r'))
+			ioPos++;
+	}
+
+	// ioPos is on the opening quote, and is moved past the closing quote
+	bool SkipString(const char*& ioPos, const char* inEnd)
+	{
+		for (ioPos++; ioPos < inEnd; ioPos++)
+		{
+			if (*ioPos == '\\')
+				ioPos++;
+			else if (*ioPos == '"')
+			{
+				ioPos++;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Moves past any value. Nested values are only matched by brackets, they are validated when parsed on demand.
+	bool SkipValue(const char*& ioPos, const char* inEnd)
+	{
+		if (ioPos >= inEnd)
+			return false;
+
+		if (*ioPos == '"')
+			return SkipString(ioPos, inEnd);
+
+		if (*ioPos == '{' || *ioPos == '[')
+		{
+			int depth = 0;
+			while (ioPos < inEnd)
+			{
+				const char c = *ioPos;
+				if (c == '"')
+				{
+					if (!SkipString(ioPos, inEnd))
+						return false;
+					continue;
+				}
+				if (c == '{' || c == '[')
+					depth++;
+				else if (c == '}' || c == ']')
+				{
+					if (--depth == 0)
+					{
+						ioPos++;
+						return true;
+					}
+				}
+				ioPos++;
+			}
+			return false;
+		}
+
+		// numbers, true, false and null
+		const char* start = ioPos;
+		while (ioPos < inEnd && *ioPos != ',' && *ioPos != '}' && *ioPos != ']' &&
+			*ioPos != ' ' && *ioPos != '\t' && *ioPos != '\n' && *ioPos != '\r')
+			ioPos++;
+		return ioPos > start;
+	}
+
+	void AppendUtf8(std::string& outString, unsigned int inCodepoint)
+	{
+		if (inCodepoint < 0x80)
+			outString += static_cast<char>(inCodepoint);
+		else if (inCodepoint < 0x800)
+		{
+			outString += static_cast<char>(0xC0 | (inCodepoint >> 6));
+			outString += static_cast<char>(0x80 | (inCodepoint & 0x3F));
+		}
+		else if (inCodepoint < 0x10000)
+		{
+			outString += static_cast<char>(0xE0 | (inCodepoint >> 12));
+			outString += static_cast<char>(0x80 | ((inCodepoint >> 6) & 0x3F));
+			outString += static_cast<char>(0x80 | (inCodepoint & 0x3F));
+		}
+		else
+		{
+			outString += static_cast<char>(0xF0 | (inCodepoint >> 18));
+			outString += static_cast<char>(0x80 | ((inCodepoint >> 12) & 0x3F));
+			outString += static_cast<char>(0x80 | ((inCodepoint >> 6) & 0x3F));
+			outString += static_cast<char>(0x80 | (inCodepoint & 0x3F));
+		}
+	}
+
+	bool ReadHex4(const char*& ioPos, const char* inEnd, unsigned int& outValue)
+	{
+		if (inEnd - ioPos < 4)
+			return false;
+		outValue = 0;
+		for (int i = 0; i < 4; i++, ioPos++)
+		{
+			const char c = *ioPos;
+			outValue <<= 4;
+			if (c >= '0' && c <= '9')
+				outValue |= c - '0';
+			else if (c >= 'a' && c <= 'f')
+				outValue |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F')
+				outValue |= c - 'A' + 10;
+			else
+				return false;
+		}
+		return true;
+	}
+
+	// ioPos is on the opening quote, and is moved past the closing quote
+	bool DecodeString(const char*& ioPos, const char* inEnd, std::string& outString)
+	{
+		outString.clear();
+		ioPos++;
+		while (ioPos < inEnd)
+		{
+			// copy runs without escapes in one go
+			const char* runStart = ioPos;
+			while (ioPos < inEnd && *ioPos != '"' && *ioPos != '\\')
+				ioPos++;
+			outString.append(runStart, ioPos - runStart);
+			if (ioPos >= inEnd)
+				return false;
+
+			if (*ioPos == '"')
+			{
+				ioPos++;
+				return true;
+			}
+
+			// escape sequence
+			if (++ioPos >= inEnd)
+				return false;
+			const char escaped = *ioPos++;
+			switch (escaped)
+			{
+			case '"': outString += '"'; break;
+			case '\\': outString += '\\'; break;
+			case '/': outString += '/'; break;
+			case 'b': outString += '\b'; break;
+			case 'f': outString += '\f'; break;
+			case 'n': outString += '\n'; break;
+			case 'r': outString += '\r'; break;
+			case 't': outString += '\t'; break;
+			case 'u':
+			{
+				unsigned int codepoint;
+				if (!ReadHex4(ioPos, inEnd, codepoint))
+					return false;
+				if (codepoint >= 0xD800 && codepoint <= 0xDBFF)
+				{
+					// a high surrogate must be followed by a low one
+					unsigned int low;
+					if (inEnd - ioPos < 2 || ioPos[0] != '\\' || ioPos[1] != 'u')
+						return false;
+					ioPos += 2;
+					if (!ReadHex4(ioPos, inEnd, low) || low < 0xDC00 || low > 0xDFFF)
+						return false;
+					codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+				}
+				else if (codepoint >= 0xDC00 && codepoint <= 0xDFFF)
+					return false;
+				AppendUtf8(outString, codepoint);
+				break;
+			}
+			default:
+				return false;
+			}
+		}
+		return false;
+	}
+}
+
+bool ESDInboundMessage::Parse(const std::string& inMessage)
+{
+	mEvent.clear();
+	mContext.clear();
+	mAction.clear();
+	mDevice.clear();
+	mPayload = std::string_view();
+	mDeviceInfo = std::string_view();
+
+	const char* pos = inMessage.data();
+	const char* end = pos + inMessage.size();
+
+	SkipWhitespace(pos, end);
+	if (pos >= end || *pos != '{')
+		return false;
+	pos++;
+	SkipWhitespace(pos, end);
+	if (pos < end && *pos == '}')
+		return true;
+
+	while (pos < end)
+	{
+		if (*pos != '"' || !DecodeString(pos, end, mKey))
+			return false;
+		SkipWhitespace(pos, end);
+		if (pos >= end || *pos != ':')
+			return false;
+		pos++;
+		SkipWhitespace(pos, end);
+
+		// a later duplicate key replaces an earlier one, like json::parse
+		std::string* stringField = nullptr;
+		std::string_view* objectField = nullptr;
+		if (mKey == kESDSDKCommonEvent)
+			stringField = &mEvent;
+		else if (mKey == kESDSDKCommonContext)
+			stringField = &mContext;
+		else if (mKey == kESDSDKCommonAction)
+			stringField = &mAction;
+		else if (mKey == kESDSDKCommonDevice)
+			stringField = &mDevice;
+		else if (mKey == kESDSDKCommonPayload)
+			objectField = &mPayload;
+		else if (mKey == kESDSDKCommonDeviceInfo)
+			objectField = &mDeviceInfo;
+
+		const char* valueStart = pos;
+		if (stringField != nullptr && pos < end && *pos == '"')
+		{
+			if (!DecodeString(pos, end, *stringField))
+				return false;
+		}
+		else
+		{
+			if (!SkipValue(pos, end))
+				return false;
+			if (stringField != nullptr)
+				stringField->clear();
+			if (objectField != nullptr)
+				*objectField = std::string_view(valueStart, pos - valueStart);
+		}
+
+		SkipWhitespace(pos, end);
+		if (pos >= end)
+			return false;
+		if (*pos == '}')
+			return true;
+		if (*pos != ',')
+			return false;
+		pos++;
+		SkipWhitespace(pos, end);
+	}
+	return false;
+}
+
+json ESDInboundMessage::GetPayload() const
+{
+	return ParseObject(mPayload);
+}
+
+json ESDInboundMessage::GetDeviceInfo() const
+{
+	return ParseObject(mDeviceInfo);
+}
+
+json ESDInboundMessage::ParseObject(std::string_view inValue)
+{
+	if (inValue.empty() || inValue.front() != '{')
+		return json();
+	return json::parse(inValue.data(), inValue.data() + inValue.size());
+}
@@ -0,0 +1,51 @@
+//==============================================================================
+/**
+@file       ESDInboundMessage.h
+
+@brief      On-demand decoding of the events sent by the Stream Deck application
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include "EPLJSONUtils.h"
+#include "ESDSDKDefines.h"
+
+#include <string>
+#include <string_view>
+
+class ESDInboundMessage
+{
+public:
+	// Finds the top level fields of a message without building a json object.
+	// Returns false if the message is not a json object. The message must outlive this object.
+	bool Parse(const std::string& inMessage);
+
+	// Empty if the field is missing or not a string, like EPLJSONUtils::GetStringByName
+	const std::string& GetEvent() const { return mEvent; }
+	const std::string& GetContext() const { return mContext; }
+	const std::string& GetAction() const { return mAction; }
+	const std::string& GetDevice() const { return mDevice; }
+
+	// Parsed on each call, so only handlers that use them pay for them.
+	// Null if the field is missing or not an object, like EPLJSONUtils::GetObjectByName leaves it.
+	json GetPayload() const;
+	json GetDeviceInfo() const;
+
+private:
+	static json ParseObject(std::string_view inValue);
+
+	std::string mEvent;
+	std::string mContext;
+	std::string mAction;
+	std::string mDevice;
+	// raw json of the fields that are parsed on demand
+	std::string_view mPayload;
+	std::string_view mDeviceInfo;
+
+	// reused for the keys while parsing
+	std::string mKey;
+};
@@ -0,0 +1,104 @@
+//==============================================================================
+/**
+@file       ESDOutboundCoalescer.cpp
+
+@brief      Drops redundant title, image and state updates and merges bursts of them
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "ESDOutboundCoalescer.h"
+
+/**
+ * Queue an update. An update that matches what the key already shows is dropped,
+ * and an update that replaces a pending one of the same kind merges with it.
+ *
+ * @param[in] message the update
+ * @return true if the caller must schedule a flush, i.e. this is the first pending update since the last flush
+ */
+bool ESDOutboundCoalescer::submit(message_t message)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	contextState_t& state = mContexts[message.context];
+	const std::optional<sentValue_t>& lastSent = state.lastSent[message.kind];
+	std::optional<message_t>& pending = state.pending[message.kind];
+
+	const bool matchesSent = lastSent && lastSent->target == message.target && lastSent->value == message.value;
+	if (pending)
+	{
+		// the pending update is replaced, and not needed at all if the key goes back to what it shows
+		mDropped++;
+		if (matchesSent)
+		{
+			mDropped++;
+			pending = std::nullopt;
+		}
+		else
+			pending = std::move(message);
+		return false;
+	}
+
+	if (matchesSent)
+	{
+		mDropped++;
+		return false;
+	}
+
+	mPendingOrder.push_back({ message.context, message.kind });
+	pending = std::move(message);
+	if (mFlushScheduled)
+		return false;
+	mFlushScheduled = true;
+	return true;
+}
+
+/**
+ * Take every pending update to send it, and remember them as what the keys show
+ *
+ * @return the updates, at most one per context and kind
+ */
+std::vector<ESDOutboundCoalescer::message_t> ESDOutboundCoalescer::takePending()
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	std::vector<message_t> messages;
+	messages.reserve(mPendingOrder.size());
+	for (const auto& key : mPendingOrder)
+	{
+		auto it = mContexts.find(key.first);
+		if (it == mContexts.end() || !it->second.pending[key.second])
+			continue;
+
+		message_t& message = *it->second.pending[key.second];
+		it->second.lastSent[key.second] = sentValue_t{ message.target, message.value };
+		messages.push_back(std::move(message));
+		it->second.pending[key.second] = std::nullopt;
+	}
+	mPendingOrder.clear();
+	mFlushScheduled = false;
+	mSent += messages.size();
+	return messages;
+}
+
+/**
+ * Forget the scheduled flush when its timer cannot fire. The updates stay pending,
+ * and the next update schedules a flush for them again.
+ */
+void ESDOutboundCoalescer::cancelFlush()
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	mFlushScheduled = false;
+}
+
+/**
+ * Forget what a key shows, e.g. when it disappears. The Stream Deck resets a key that appears again,
+ * so its next update must not be dropped.
+ *
+ * @param[in] context the key's context
+ */
+void ESDOutboundCoalescer::forgetContext(const std::string& context)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	mContexts.erase(context);
+}
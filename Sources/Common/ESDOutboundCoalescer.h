@@ -0,0 +1,83 @@
+//==============================================================================
+/**
+@file       ESDOutboundCoalescer.h
+
+@brief      Drops redundant title, image and state updates and merges bursts of them
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include "ESDSDKDefines.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class ESDOutboundCoalescer
+{
+public:
+	enum kind_t
+	{
+		TITLE,
+		IMAGE,
+		STATE,
+		KIND_COUNT
+	};
+
+	struct message_t
+	{
+		kind_t kind = TITLE;
+		std::string context;
+		ESDSDKTarget target = kESDSDKTarget_HardwareAndSoftware;
+		// the title, the image, or the state number
+		std::string value;
+	};
+
+	struct stats_t
+	{
+		uint64_t sent = 0;
+		uint64_t dropped = 0;
+	};
+
+	bool submit(message_t message);
+	std::vector<message_t> takePending();
+	void cancelFlush();
+	void forgetContext(const std::string& context);
+
+	stats_t getStats() const
+	{
+		return { mSent.load(), mDropped.load() };
+	}
+
+private:
+	struct sentValue_t
+	{
+		ESDSDKTarget target;
+		std::string value;
+	};
+
+	struct contextState_t
+	{
+		std::array<std::optional<sentValue_t>, KIND_COUNT> lastSent;
+		std::array<std::optional<message_t>, KIND_COUNT> pending;
+	};
+
+	std::mutex mMutex;
+	std::unordered_map<std::string, contextState_t> mContexts;
+	// order in which updates became pending, so a flush keeps the order of the first update of each key
+	std::vector<std::pair<std::string, kind_t>> mPendingOrder;
+	bool mFlushScheduled = false;
+
+	std::atomic<uint64_t> mSent = 0;
+	std::atomic<uint64_t> mDropped = 0;
+};
@@ -0,0 +1,175 @@
+//==============================================================================
+/**
+@file       ESDOutboundEncoder.cpp
+
+@brief      Encodes the frequent outbound events without building json objects
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "ESDOutboundEncoder.h"
+
+// json objects are std::maps, so dump() writes keys in sorted order. The keys below are written in that order.
+
+bool ESDOutboundEncoder::EncodeSetTitle(std::string& outBuffer, const std::string& inTitle, const std::string& inContext, ESDSDKTarget inTarget)
+{
+	outBuffer.clear();
+	outBuffer += "{\"" kESDSDKCommonContext "\":";
+	if (!AppendString(outBuffer, inContext))
+		return false;
+	outBuffer += ",\"" kESDSDKCommonEvent "\":\"" kESDSDKEventSetTitle "\",\"" kESDSDKCommonPayload "\":{\"" kESDSDKPayloadTarget "\":";
+	AppendInt(outBuffer, inTarget);
+	outBuffer += ",\"" kESDSDKPayloadTitle "\":";
+	if (!AppendString(outBuffer, inTitle))
+		return false;
+	outBuffer += "}}";
+	return true;
+}
+
+bool ESDOutboundEncoder::EncodeSetImage(std::string& outBuffer, const std::string& inBase64ImageString, const std::string& inContext, ESDSDKTarget inTarget)
+{
+	const char prefix[] = "data:image/png;base64,";
+	const size_t prefixLength = sizeof(prefix) - 1;
+
+	outBuffer.clear();
+	outBuffer += "{\"" kESDSDKCommonContext "\":";
+	if (!AppendString(outBuffer, inContext))
+		return false;
+	outBuffer += ",\"" kESDSDKCommonEvent "\":\"" kESDSDKEventSetImage "\",\"" kESDSDKCommonPayload "\":{\"" kESDSDKPayloadImage "\":";
+
+	// Same as SetImage used to do: the prefix is added unless the image is empty or already has it
+	const bool addPrefix = !inBase64ImageString.empty() && inBase64ImageString.compare(0, prefixLength, prefix) != 0;
+	if (!AppendString(outBuffer, inBase64ImageString, addPrefix ? prefix : ""))
+		return false;
+
+	outBuffer += ",\"" kESDSDKPayloadTarget "\":";
+	AppendInt(outBuffer, inTarget);
+	outBuffer += "}}";
+	return true;
+}
+
+bool ESDOutboundEncoder::EncodeLogMessage(std::string& outBuffer, const std::string& inMessage)
+{
+	outBuffer.clear();
+	outBuffer += "{\"" kESDSDKCommonEvent "\":\"" kESDSDKEventLogMessage "\",\"" kESDSDKCommonPayload "\":{\"" kESDSDKPayloadMessage "\":";
+	if (!AppendString(outBuffer, inMessage))
+		return false;
+	outBuffer += "}}";
+	return true;
+}
+
+// Quote and escape a string the way dump() does without ensure_ascii: only quotes, backslashes and
+// control characters are escaped, and other UTF-8 is copied as is. inPrefix is written unescaped after the opening quote.
+bool ESDOutboundEncoder::AppendString(std::string& outBuffer, const std::string& inValue, const char* inPrefix)
+{
+	static const char hexDigits[] = "0123456789abcdef";
+
+	outBuffer += '"';
+	outBuffer += inPrefix;
+	size_t i = 0;
+	while (i < inValue.size())
+	{
+		// copy runs that need no escaping in one go
+		size_t runEnd = i;
+		while (runEnd < inValue.size())
+		{
+			const unsigned char c = static_cast<unsigned char>(inValue[runEnd]);
+			if (c < 0x20 || c >= 0x80 || c == '"' || c == '\\')
+				break;
+			runEnd++;
+		}
+		if (runEnd > i)
+		{
+			outBuffer.append(inValue, i, runEnd - i);
+			i = runEnd;
+			continue;
+		}
+
+		const unsigned char byte = static_cast<unsigned char>(inValue[i]);
+		if (byte >= 0x80)
+		{
+			const size_t length = GetUtf8SequenceLength(inValue, i);
+			if (length == 0)
+				return false;
+			outBuffer.append(inValue, i, length);
+			i += length;
+			continue;
+		}
+
+		switch (byte)
+		{
+		case '"': outBuffer += "\\\""; break;
+		case '\\': outBuffer += "\\\\"; break;
+		case '\b': outBuffer += "\\b"; break;
+		case '\f': outBuffer += "\\f"; break;
+		case '\n': outBuffer += "\\n"; break;
+		case '\r': outBuffer += "\\r"; break;
+		case '\t': outBuffer += "\\t"; break;
+		default:
+		{
+			// the remaining control characters
+			const char escaped[] = { '\\', 'u', '0', '0', hexDigits[byte >> 4], hexDigits[byte & 0xF] };
+			outBuffer.append(escaped, sizeof(escaped));
+			break;
+		}
+		}
+		i++;
+	}
+	outBuffer += '"';
+	return true;
+}
+
+void ESDOutboundEncoder::AppendInt(std::string& outBuffer, int inValue)
+{
+	char digits[12];
+	size_t count = 0;
+	const bool negative = inValue < 0;
+	unsigned int value = negative ? 0u - static_cast<unsigned int>(inValue) : static_cast<unsigned int>(inValue);
+	do
+	{
+		digits[count++] = static_cast<char>('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+
+	if (negative)
+		outBuffer += '-';
+	while (count > 0)
+		outBuffer += digits[--count];
+}
+
+// Length of the well-formed UTF-8 sequence that starts at inIndex, or 0 if it is not well-formed.
+// Overlong forms, surrogates and code points above U+10FFFF are rejected, like dump() does.
+size_t ESDOutboundEncoder::GetUtf8SequenceLength(const std::string& inValue, size_t inIndex)
+{
+	const auto byteAt = [&](size_t offset) -> unsigned char
+	{
+		return (inIndex + offset < inValue.size()) ? static_cast<unsigned char>(inValue[inIndex + offset]) : 0;
+	};
+	const auto isContinuation = [](unsigned char byte)
+	{
+		return byte >= 0x80 && byte <= 0xBF;
+	};
+
+	const unsigned char lead = byteAt(0);
+	const unsigned char second = byteAt(1);
+	if (lead >= 0xC2 && lead <= 0xDF)
+		return isContinuation(second) ? 2 : 0;
+
+	if (lead >= 0xE0 && lead <= 0xEF)
+	{
+		const unsigned char low = (lead == 0xE0) ? 0xA0 : 0x80;
+		const unsigned char high = (lead == 0xED) ? 0x9F : 0xBF;
+		return (second >= low && second <= high && isContinuation(byteAt(2))) ? 3 : 0;
+	}
+
+	if (lead >= 0xF0 && lead <= 0xF4)
+	{
+		const unsigned char low = (lead == 0xF0) ? 0x90 : 0x80;
+		const unsigned char high = (lead == 0xF4) ? 0x8F : 0xBF;
+		return (second >= low && second <= high && isContinuation(byteAt(2)) && isContinuation(byteAt(3))) ? 4 : 0;
+	}
+
+	return 0;
+}
@@ -0,0 +1,32 @@
+//==============================================================================
+/**
+@file       ESDOutboundEncoder.h
+
+@brief      Encodes the frequent outbound events without building json objects
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include "ESDSDKDefines.h"
+
+#include <cstddef>
+#include <string>
+
+class ESDOutboundEncoder
+{
+public:
+	// Each encoder replaces the contents of outBuffer with the same bytes json::dump() produces for the event,
+	// and reuses its capacity. They return false if a string is not valid UTF-8, which dump() rejects.
+	static bool EncodeSetTitle(std::string& outBuffer, const std::string& inTitle, const std::string& inContext, ESDSDKTarget inTarget);
+	static bool EncodeSetImage(std::string& outBuffer, const std::string& inBase64ImageString, const std::string& inContext, ESDSDKTarget inTarget);
+	static bool EncodeLogMessage(std::string& outBuffer, const std::string& inMessage);
+
+private:
+	static bool AppendString(std::string& outBuffer, const std::string& inValue, const char* inPrefix = "");
+	static void AppendInt(std::string& outBuffer, int inValue);
+	static size_t GetUtf8SequenceLength(const std::string& inValue, size_t inIndex);
+};
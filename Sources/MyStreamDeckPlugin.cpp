@@ -8,41 +8,109 @@
 
 #include "MyStreamDeckPlugin.h"
 #include "Common/ESDConnectionManager.h"
+#include "Common/EPLJSONUtils.h"
 
 #include "Windows/ResourceUtils.hpp"
+#include "Windows/BandwidthBudget.h"
 #include "Windows/ClipboardUtils.hpp"
+#include "Windows/ProgressImages.h"
 #include "Windows/UrlUtils.h"
 #include "Windows/YoutubeDlUtils.h"
 
+#include <algorithm>
 
 
-MyStreamDeckPlugin::MyStreamDeckPlugin()
+
+MyStreamDeckPlugin::MyStreamDeckPlugin() :
+	mExecutor(PluginExecutor::DEFAULT_THREAD_COUNT, [this](const std::string& message)
+		{
+			if (mConnectionManager != nullptr)
+				mConnectionManager->LogMessage(message);
+		})
 {
 	mIsRunning = initYoutubeDl();
+	// render the progress bar frames up front, so the first progress update does not wait for them
+	ProgressImages::getInstance();
+	if (mIsRunning.load())
+	{
+		openJournal();
+		openArchive();
+	}
+	mScheduler = std::make_shared<DownloadScheduler>(mResults, mJournal, mArchive);
+	if (mJournal != nullptr)
+		resumeJournaledJobs();
 	mDlMonitor = std::thread(&MyStreamDeckPlugin::downloadMonitor, this);
 }
 
 MyStreamDeckPlugin::~MyStreamDeckPlugin()
 {
+	// finish the handlers that are running, the ones still queued are dropped. No timer fires after this.
+	mTimers.shutdown();
+	mExecutor.shutdown();
+
 	// send stop signal to UI thread
 	mIsRunning = false;
-	{
-		std::unique_lock<std::mutex>cvLk(mCvMutex);
-		mCv.notify_all();
-	}
+	mResults.notify();
 
 	if (mDlMonitor.joinable())
 	{
 		mDlMonitor.join();
 	}
 
-	std::unique_lock<std::mutex>lk(mVisibleContextsMutex);
-	for (const auto& dls : mActiveDownloads)
+	// let running downloads finish on their own
+	mScheduler->detach();
+	mScheduler = nullptr;
+}
+
+/**
+ * Open the job journal next to the plugin. Jobs are not journaled if it cannot be opened.
+ */
+void MyStreamDeckPlugin::openJournal()
+{
+	const std::string JOURNAL_FILE_NAME = "jobs.journal";
+	try
 	{
-		for (const auto& thd : dls.second.threads)
-		{
-			thd->detach();
-		}
+		mJournal = std::make_shared<JobJournal>(fileutils::getCurrentExeFolder().parent_path() / JOURNAL_FILE_NAME);
+	}
+	catch (std::runtime_error& e)
+	{
+		std::cerr << e.what() << std::endl;
+	}
+}
+
+/**
+ * Open the download archive next to the plugin. Media are downloaded again if it cannot be opened.
+ */
+void MyStreamDeckPlugin::openArchive()
+{
+	const std::string ARCHIVE_FILE_NAME = "download-archive.txt";
+	try
+	{
+		mArchive = std::make_shared<DownloadArchive>(fileutils::getCurrentExeFolder().parent_path() / ARCHIVE_FILE_NAME);
+	}
+	catch (std::runtime_error& e)
+	{
+		std::cerr << e.what() << std::endl;
+	}
+}
+
+/**
+ * Queue the jobs that did not finish in the last session again. A job whose processes are still running adopts them,
+ * otherwise yt-dlp continues its .part files, so what was downloaded before is not downloaded again.
+ */
+void MyStreamDeckPlugin::resumeJournaledJobs()
+{
+	// the journaled jobs keep their ids, so their records still match
+	DownloadJob::reserveJobIds(mJournal->getLastJobId());
+
+	// the jobs that were running go first, their processes are still running too
+	std::vector<JobJournal::entry_t> entries = mJournal->getUnfinished();
+	std::stable_partition(entries.begin(), entries.end(), [](const JobJournal::entry_t& entry) { return !entry.processes.empty(); });
+	for (const JobJournal::entry_t& entry : entries)
+	{
+		contextSettings_t settings{};
+		readPayload(settings, entry.settings);
+		submitDownloadTask(entry.url, settings, mContexts.intern(entry.context), false, std::nullopt, entry.jobId);
 	}
 }
 
@@ -68,81 +136,110 @@ bool MyStreamDeckPlugin::initYoutubeDl()
 }
 
 /**
- * Helper function for downloadMonitor to clean up download threads if all threads are completed.
+ * Helper function for downloadMonitor to clean up download counts if all jobs of a context are completed.
  *
  * @param[in] context the context to clean up
- * @param[in] lk the lock for mutex mVisibleContextsMutex
+ * @param[in] lk the lock for the mutex of the context's shard
  * @relatesalso downloadMonitor
  */
-void MyStreamDeckPlugin::cleanupDownloads(const std::string& context, const std::unique_lock<std::mutex> & lk)
+void MyStreamDeckPlugin::cleanupDownloads(const contextHandle_t context, const std::unique_lock<std::mutex> & lk)
 {
-	assert(lk.owns_lock());
-	assert(lk.mutex() == &mVisibleContextsMutex);
-
-	if (mActiveDownloads.find(context) != mActiveDownloads.end())
+	std::unordered_map<contextHandle_t, downloadData_t>& activeDownloads = mShards.getState(context, lk).activeDownloads;
+	if (activeDownloads.find(context) != activeDownloads.end())
 	{
-		// cleanup if all threads are done
-		bool allDone = true;
-		for (const auto& thd : mActiveDownloads.at(context).threads)
-		{
-			if (!thd->isComplete())
-			{
-				allDone = false;
-				break;
-			}
-		}
-		if (allDone)
-			mActiveDownloads.erase(context);
+		// cleanup if all jobs have reported back
+		const downloadData_t& dl = activeDownloads.at(context);
+		if (dl.successCount + dl.failureCount >= dl.submittedCount)
+			activeDownloads.erase(context);
 	}
 }
 
 /**
- * Helper function for downloadMonitor. Reads mResults queue and updates the data for contexts that are modified
+ * Helper function for downloadMonitor. Updates the data of the context of a result.
+ * Only the shard of that context is locked, and only while its data is updated.
  *
- * @param[in] lk the lock for mutex mVisibleContextsMutex
- * @return set of contexts that had something changed
+ * @param[in] result the result to apply
  * @relatesalso downloadMonitor
  */
-std::unordered_set <std::string> MyStreamDeckPlugin::getModifiedContexts(const std::unique_lock<std::mutex>& lk)
+void MyStreamDeckPlugin::applyResult(const DownloadJob::threadData_t& result)
 {
-	assert(lk.owns_lock());
-	assert(lk.mutex() == &mVisibleContextsMutex);
+	// progress is not journaled. A paused job is queued again after a restart like any other unfinished job.
+	if (mJournal != nullptr && result.status != DownloadJob::RUNNING)
+	{
+		bool written = true;
+		if (result.status == DownloadJob::PAUSED)
+			written = mJournal->recordState(result.jobId, "paused");
+		else if (result.status == DownloadJob::RESUMING)
+			written = mJournal->recordState(result.jobId, "resumed");
+		else
+			written = mJournal->recordDone(result.jobId);
+		if (!written && mConnectionManager != nullptr)
+			mConnectionManager->LogMessage("Error: cannot write job journal.");
+	}
 
-	std::unordered_set <std::string> modifiedContexts;
-	while (!mResults.empty())
 	{
-		DownloadThread::threadData_t threadData = mResults.front();
-		mResults.pop();
-		modifiedContexts.insert(threadData.context);
+		std::unique_lock<std::mutex>lk(mShards.get(result.context).mutex);
+		shardState_t& shard = mShards.getState(result.context, lk);
+		const auto download = shard.activeDownloads.find(result.context);
 
-		switch (threadData.status)
+		// progress updates and pauses don't change the job counts
+		if (result.status == DownloadJob::RUNNING)
 		{
-		case DownloadThread::UPDATED:
-			mIsUpdating = false;
-			mActiveDownloads.at(threadData.context).successCount++;
-			if (mConnectionManager != nullptr)
-				mConnectionManager->LogMessage("yt-dlp updated.");
-			break;
-		case DownloadThread::SUCCESS:
-			mActiveDownloads.at(threadData.context).successCount++;
-			break;
-		case DownloadThread::FAILED:
-			mActiveDownloads.at(threadData.context).failureCount++;
-			if (mConnectionManager != nullptr)
+			if (download != shard.activeDownloads.end())
 			{
-				mConnectionManager->LogMessage("Failed yt-dlp at context: " + threadData.context);
-				if (threadData.log)
-					mConnectionManager->LogMessage("Log: " + *threadData.log);
+				download->second.pauseStates.erase(result.jobId);
+				if (result.progress)
+					download->second.progress[result.jobId] = *result.progress;
 			}
-			break;
+			return;
+		}
+		if (result.status == DownloadJob::PAUSED || result.status == DownloadJob::RESUMING)
+		{
+			if (download != shard.activeDownloads.end())
+				download->second.pauseStates[result.jobId] = result.status;
+			return;
+		}
+
+		if (download != shard.activeDownloads.end())
+		{
+			download->second.progress.erase(result.jobId);
+			download->second.pauseStates.erase(result.jobId);
+			if (result.status == DownloadJob::FAILED)
+				download->second.failureCount++;
+			else
+				download->second.successCount++;
 		}
 
 		// update error message for this context if there are any
-		if (threadData.buttonMsg && mVisibleContexts.find(threadData.context) != mVisibleContexts.end())
-			mVisibleContexts.at(threadData.context).lastErrorMsg = threadData.buttonMsg;
+		contextData_t* contextData = findContext(result.context, lk);
+		if (result.buttonMsg && contextData != nullptr)
+			contextData->lastErrorMsg = result.buttonMsg;
 	}
+	mPendingJobs--;
 
-	return modifiedContexts;
+	if (result.resourceUsage && mConnectionManager != nullptr)
+	{
+		mConnectionManager->LogMessage("Job " + std::to_string(result.jobId) + " used " +
+			std::to_string(result.resourceUsage->peakMemoryBytes / (1024 * 1024)) + " MB peak memory, " +
+			std::to_string(result.resourceUsage->cpuTimeMillis) + " ms cpu time.");
+	}
+
+	switch (result.status)
+	{
+	case DownloadJob::UPDATED:
+		mIsUpdating = false;
+		if (mConnectionManager != nullptr)
+			mConnectionManager->LogMessage("yt-dlp updated.");
+		break;
+	case DownloadJob::FAILED:
+		if (mConnectionManager != nullptr)
+		{
+			mConnectionManager->LogMessage("Failed yt-dlp at context: " + mContexts.getString(result.context));
+			if (result.log)
+				mConnectionManager->LogMessage("Log: " + *result.log);
+		}
+		break;
+	}
 }
 
 /**
@@ -152,16 +249,21 @@ void MyStreamDeckPlugin::downloadMonitor()
 {
 	while (mIsRunning.load())
 	{
-		// wait for wake signal from threads
-		std::unique_lock<std::mutex>cvLk(mCvMutex);
-		mCv.wait(cvLk, [&] {return !mResults.empty(); });
+		// wait for results from the jobs, they never wait for this thread to push more
+		mResults.wait([&] {return !mIsRunning.load(); });
 
-		std::unique_lock<std::mutex>lk(mVisibleContextsMutex);
 		// set of contexts that changed
-		std::unordered_set <std::string> modifiedContexts = getModifiedContexts(lk);
+		std::unordered_set<contextHandle_t> modifiedContexts;
+		while (std::optional<DownloadJob::threadData_t> result = mResults.tryPop())
+		{
+			modifiedContexts.insert(result->context);
+			applyResult(*result);
+		}
 
+		// a key handler only waits while its own context is updated
 		for (const auto& context : modifiedContexts)
 		{
+			std::unique_lock<std::mutex>lk(mShards.get(context).mutex);
 			updateUI(context, lk);
 			cleanupDownloads(context, lk);
 		}
@@ -169,133 +271,354 @@ void MyStreamDeckPlugin::downloadMonitor()
 
 	if (mConnectionManager != nullptr)
 	{
+		const ESDOutboundCoalescer::stats_t stats = mConnectionManager->GetOutboundStats();
+		mConnectionManager->LogMessage("Button updates sent: " + std::to_string(stats.sent) + ", dropped as redundant: " + std::to_string(stats.dropped));
 		mConnectionManager->LogMessage("Shutting down mDlMonitor");
 	}
 }
 
 /**
- * Updates the title text of a button
+ * Format a byte count for the small button title, e.g. "1.5MB"
+ *
+ * @param[in] bytes the byte count
+ * @return the formatted string
+ */
+static std::string formatBytes(const double bytes)
+{
+	const char* units[] = { "B", "KB", "MB", "GB", "TB" };
+	double value = bytes;
+	size_t unit = 0;
+	while (value >= 1024 && unit < (sizeof(units) / sizeof(units[0])) - 1)
+	{
+		value /= 1024;
+		unit++;
+	}
+	char text[32];
+	snprintf(text, sizeof(text), (value < 10 && unit > 0) ? "%.1f%s" : "%.0f%s", value, units[unit]);
+	return text;
+}
+
+/**
+ * Helper function for updateUI. Sums up the progress of the running jobs of a context into two title lines.
+ *
+ * @param[in] progress the latest progress of each running job
+ * @return the progress text
+ * @relatesalso updateUI
+ */
+std::string MyStreamDeckPlugin::getProgressText(const std::unordered_map<uint64_t, downloadProgress_t>& progress)
+{
+	uint64_t downloadedBytes = 0;
+	double speed = 0;
+	std::optional<uint32_t> eta = std::nullopt;
+	for (const auto& job : progress)
+	{
+		downloadedBytes += job.second.downloadedBytes;
+		speed += job.second.speed.value_or(0);
+		if (job.second.eta)
+			eta = std::max(eta.value_or(0), *job.second.eta);
+	}
+
+	std::string text;
+	const std::optional<uint32_t> percent = getProgressPercent(progress);
+	if (percent)
+		text = std::to_string(*percent) + "%";
+	else
+		text = formatBytes(static_cast<double>(downloadedBytes));
+	if (speed > 0)
+		text += " " + formatBytes(speed) + "/s";
+
+	text += "\n";
+	if (eta)
+		text += "ETA " + std::to_string(*eta / 60) + ":" + (*eta % 60 < 10 ? "0" : "") + std::to_string(*eta % 60);
+	return text;
+}
+
+/**
+ * Sums up the progress of the running jobs of a context into a percentage
+ *
+ * @param[in] progress the latest progress of each running job
+ * @return the percentage, or nullopt if the size of a job is not known
+ */
+std::optional<uint32_t> MyStreamDeckPlugin::getProgressPercent(const std::unordered_map<uint64_t, downloadProgress_t>& progress)
+{
+	uint64_t downloadedBytes = 0;
+	uint64_t totalBytes = 0;
+	for (const auto& job : progress)
+	{
+		if (!job.second.totalBytes)
+			return std::nullopt;
+		downloadedBytes += job.second.downloadedBytes;
+		totalBytes += *job.second.totalBytes;
+	}
+
+	if (totalBytes == 0)
+		return std::nullopt;
+	return static_cast<uint32_t>(std::min<uint64_t>(100, downloadedBytes * 100 / totalBytes));
+}
+
+/**
+ * Helper function for updateUI. Shows the progress bar frame of the current progress, or the default image when there is none.
+ * Frames that did not change are not sent again, and a key changes frames at most every MIN_IMAGE_UPDATE_INTERVAL_MILLIS.
  *
  * @param[in] context the button's context
- * @param[in] lk the lock for mutex mVisibleContextsMutex
+ * @param[in] lk the lock for the mutex of the context's shard
+ * @relatesalso updateUI
  */
-void MyStreamDeckPlugin::updateUI(const std::string& inContext, const std::unique_lock<std::mutex>& lk)
+void MyStreamDeckPlugin::updateImage(const contextHandle_t context, const std::unique_lock<std::mutex>& lk)
 {
-	assert(lk.owns_lock());
-	assert(lk.mutex() == &mVisibleContextsMutex);
+	shardState_t& shard = mShards.getState(context, lk);
+	contextData_t& contextData = shard.visibleContexts.at(context);
+	std::optional<uint32_t> frame = std::nullopt;
+	if (contextData.settings->showProgressBar && shard.activeDownloads.find(context) != shard.activeDownloads.end())
+	{
+		const std::optional<uint32_t> percent = getProgressPercent(shard.activeDownloads.at(context).progress);
+		if (percent)
+			frame = ProgressImages::getFrameIndex(*percent);
+	}
+
+	if (frame == contextData.imageFrame)
+		return;
+
+	// only changes between two frames are rate limited, showing the first frame or going back to the default image is not.
+	// A skipped frame is caught up by the next progress update, which every running job publishes regularly.
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (frame && contextData.imageFrame && now - contextData.lastImageUpdate < std::chrono::milliseconds(MIN_IMAGE_UPDATE_INTERVAL_MILLIS))
+		return;
 
-	if (contextFound(inContext))
+	const std::shared_ptr<const std::unordered_set<std::string>> highResDevices = std::atomic_load(&mHighResDevices);
+	const bool highRes = highResDevices->find(contextData.deviceId) != highResDevices->end();
+	mConnectionManager->SetImage(frame ? ProgressImages::getInstance().getFrame(*frame, highRes) : "", mContexts.getString(context), kESDSDKTarget_HardwareAndSoftware);
+	contextData.imageFrame = frame;
+	contextData.lastImageUpdate = now;
+}
+
+// The Stream Deck events arrive on the websocket thread. They are only mapped to their handle here,
+// the work is done on mExecutor so a slow clipboard or drive never holds up the other events.
+
+void MyStreamDeckPlugin::KeyDownForAction(const std::string& inAction, const std::string& inContext, const json& inPayload, const std::string& inDeviceID)
+{
+	const contextHandle_t context = mContexts.find(inContext).value_or(ContextRegistry::INVALID_HANDLE);
+	mExecutor.post(context, [this, context]() { keyDown(context); });
+}
+
+void MyStreamDeckPlugin::KeyUpForAction(const std::string& inAction, const std::string& inContext, const json& inPayload, const std::string& inDeviceID)
+{
+	const contextHandle_t context = mContexts.find(inContext).value_or(ContextRegistry::INVALID_HANDLE);
+	mExecutor.post(context, [this, context, inPayload]() { keyUp(context, inPayload); });
+}
+
+void MyStreamDeckPlugin::WillAppearForAction(const std::string& inAction, const std::string& inContext, const json &inPayload, const std::string& inDeviceID)
+{
+	// the context string is only kept by mContexts
+	const contextHandle_t context = mContexts.intern(inContext);
+	mExecutor.post(context, [this, context, inPayload, inDeviceID]() { willAppear(context, inPayload, inDeviceID); });
+}
+
+void MyStreamDeckPlugin::WillDisappearForAction(const std::string& inAction, const std::string& inContext, const json &inPayload, const std::string& inDeviceID)
+{
+	const contextHandle_t context = mContexts.find(inContext).value_or(ContextRegistry::INVALID_HANDLE);
+	mExecutor.post(context, [this, context]() { willDisappear(context); });
+}
+
+void MyStreamDeckPlugin::DeviceDidConnect(const std::string& inDeviceID, const json &inDeviceInfo)
+{
+	// remember which devices get the double resolution progress bar
+	const int type = EPLJSONUtils::GetIntByName(inDeviceInfo, kESDSDKDeviceInfoType, kESDSDKDeviceType_StreamDeck);
+	const bool highRes = (type == kESDSDKDeviceType_StreamDeckXL || type == kESDSDKDeviceType_StreamDeckMobile);
+	mExecutor.post(ContextRegistry::INVALID_HANDLE, [this, inDeviceID, highRes]() { setHighResDevice(inDeviceID, highRes); });
+}
+
+void MyStreamDeckPlugin::DeviceDidDisconnect(const std::string& inDeviceID)
+{
+	mExecutor.post(ContextRegistry::INVALID_HANDLE, [this, inDeviceID]() { setHighResDevice(inDeviceID, false); });
+}
+
+void MyStreamDeckPlugin::SendToPlugin(const std::string& inAction, const std::string& inContext, const json &inPayload, const std::string& inDeviceID)
+{
+	const contextHandle_t context = mContexts.find(inContext).value_or(ContextRegistry::INVALID_HANDLE);
+	mExecutor.post(context, [this, context, inPayload]() { sendToPlugin(context, inPayload); });
+}
+
+void MyStreamDeckPlugin::DidReceiveGlobalSettings(const json &inPayload)
+{
+	mExecutor.post(ContextRegistry::INVALID_HANDLE, [this, inPayload]() { applyGlobalSettings(inPayload); });
+}
+
+/**
+ * Updates the title text and image of a button
+ *
+ * @param[in] context the button's context
+ * @param[in] lk the lock for the mutex of the context's shard
+ */
+void MyStreamDeckPlugin::updateUI(const contextHandle_t context, const std::unique_lock<std::mutex>& lk)
+{
+	contextData_t* contextData = findContext(context, lk);
+	if (contextData != nullptr)
 	{
+		std::unordered_map<contextHandle_t, downloadData_t>& activeDownloads = mShards.getState(context, lk).activeDownloads;
 		std::string label = "";
 		std::string errMsg = "\n";
-		if (mVisibleContexts.at(inContext).data.label)
-			label = *mVisibleContexts.at(inContext).data.label;
-		if (mVisibleContexts.at(inContext).lastErrorMsg)
-			errMsg = *mVisibleContexts.at(inContext).lastErrorMsg;
+		if (contextData->settings->label)
+			label = *contextData->settings->label;
+		if (contextData->lastErrorMsg)
+			errMsg = *contextData->lastErrorMsg;
 
-		uint32_t pendingThreads = 0;
-		if (mActiveDownloads.find(inContext) != mActiveDownloads.end())
+		uint32_t pendingJobs = 0;
+		if (activeDownloads.find(context) != activeDownloads.end())
 		{
-			uint32_t totalThreads = mActiveDownloads.at(inContext).threads.size();
-			uint32_t successfulThreads = mActiveDownloads.at(inContext).successCount;
-			uint32_t failedThreads = mActiveDownloads.at(inContext).failureCount;
-			pendingThreads = totalThreads - successfulThreads - failedThreads;
+			uint32_t totalJobs = activeDownloads.at(context).submittedCount;
+			uint32_t successfulJobs = activeDownloads.at(context).successCount;
+			uint32_t failedJobs = activeDownloads.at(context).failureCount;
+			pendingJobs = totalJobs - successfulJobs - failedJobs;
+
+			// live progress takes the place of the last message while downloads are running
+			const downloadData_t& dl = activeDownloads.at(context);
+			const auto isResuming = [](const auto& state) { return state.second == DownloadJob::RESUMING; };
+			if (std::any_of(dl.pauseStates.begin(), dl.pauseStates.end(), isResuming))
+				errMsg = "Resuming\n";
+			else if (!dl.pauseStates.empty())
+				errMsg = "Paused\n";
+			else if (!dl.progress.empty())
+				errMsg = getProgressText(dl.progress);
 		}
-		mConnectionManager->SetTitle(label + "\nPending: " + std::to_string(pendingThreads) + "\n" + errMsg, inContext, kESDSDKTarget_HardwareAndSoftware);
+		mConnectionManager->SetTitle(label + "\nPending: " + std::to_string(pendingJobs) + "\n" + errMsg, mContexts.getString(context), kESDSDKTarget_HardwareAndSoftware);
+		updateImage(context, lk);
 	}
 }
 
 /**
- * Creates a new download task thread
+ * Sets the message shown on a button and updates it
+ *
+ * @param[in] context the button's context
+ * @param[in] buttonMsg the message, nullopt clears it
+ */
+void MyStreamDeckPlugin::showButtonMessage(const contextHandle_t context, const std::optional<std::string>& buttonMsg)
+{
+	std::unique_lock<std::mutex>lk(mShards.get(context).mutex);
+	contextData_t* contextData = findContext(context, lk);
+	if (contextData == nullptr)
+		return;
+
+	contextData->lastErrorMsg = buttonMsg;
+	updateUI(context, lk);
+}
+
+/**
+ * Queues a new download task on the scheduler
  *
  * @param[in] url the url to download from
  * @param[in] data the metadata stored by the context
- * @param[in] inContext the button's context
+ * @param[in] context the button's context
  * @param[in] doUpdate update youtube-dl
- * @param[in] lk the lock for mutex mVisibleContextsMutex
+ * @param[in] buttonMsg the message to show on the button, set before the job can publish its own
+ * @param[in] jobId the id of the job if it was journaled already
  */
 void MyStreamDeckPlugin::submitDownloadTask(const std::string & url, const contextSettings_t & data,
-	const std::string& inContext, const bool doUpdate, const std::unique_lock<std::mutex>& lk)
+	const contextHandle_t context, const bool doUpdate, const std::optional<std::string>& buttonMsg,
+	const std::optional<uint64_t>& jobId)
 {
-	assert(lk.owns_lock());
-	assert(lk.mutex() == &mVisibleContextsMutex);
-
-	if (mActiveDownloads.find(inContext) == mActiveDownloads.end())
-		mActiveDownloads.insert({ inContext, {} });
-	std::shared_ptr<DownloadThread> dl = std::make_shared<DownloadThread>();
-	dl->start(url, data, inContext, doUpdate, mCvMutex, mCv, mResults);
-	mActiveDownloads.at(inContext).threads.push_back(std::move(dl));
+	std::unique_lock<std::mutex>lk(mShards.get(context).mutex);
+	contextData_t* contextData = findContext(context, lk);
+	if (contextData != nullptr)
+		contextData->lastErrorMsg = buttonMsg;
+
+	// count the job before submitting, a result can be published as soon as it is queued
+	mShards.getState(context, lk).activeDownloads[context].submittedCount++;
+	mPendingJobs++;
+	mScheduler->submit(url, data, context, doUpdate, jobId);
+	updateUI(context, lk);
 }
 
-void MyStreamDeckPlugin::KeyDownForAction(const std::string& inAction, const std::string& inContext, const json& inPayload, const std::string& inDeviceID)
+/**
+ * Starts the long press timer of a button, runs on mExecutor
+ *
+ * @param[in] context the button's context
+ */
+void MyStreamDeckPlugin::keyDown(const contextHandle_t context)
 {
-	std::unique_lock<std::mutex>lk(mVisibleContextsMutex);
-	if (!contextFound(inContext))
-		return;
-
-	mVisibleContexts.at(inContext).buttonTimer->stop();
+	std::shared_ptr<const contextSettings_t> data;
+	std::optional<TimerService::timerId_t> previousTimer;
+	{
+		std::unique_lock<std::mutex>lk(mShards.get(context).mutex);
+		contextData_t* contextData = findContext(context, lk);
+		if (contextData == nullptr)
+			return;
+		data = contextData->settings;
+		previousTimer = std::exchange(contextData->longPressTimer, std::nullopt);
+	}
+	if (previousTimer)
+		mTimers.cancel(*previousTimer);
 
-	// get output folder name
-	const std::filesystem::path folder = youtubedlutils::getOutputFolderName(mVisibleContexts.at(inContext).data.outputFolder);
+	// get output folder name, outside the shard lock since the lookup can be slow
+	const std::filesystem::path folder = youtubedlutils::getOutputFolderName(data->outputFolder);
 
-	// start timer that opens this folder once time is reached
+	// the folder is opened once the key is held for this long. The callback runs on the context's strand,
+	// so it is ordered with the key up: whichever comes first decides if the press was a long one.
 	const uint32_t LONG_PRESS_TIME_MILLIS = 500;
-	mVisibleContexts.at(inContext).buttonTimer->start(LONG_PRESS_TIME_MILLIS, [folder]()
+	const TimerService::timerId_t timer = mTimers.schedule(context, std::chrono::milliseconds(LONG_PRESS_TIME_MILLIS), [this, context, folder]()
 		{
-			if (std::filesystem::exists(folder))
-			{
-				fileutils::openFolder(folder);
-				return true;
-			}
-			else
-				return false;
+			openOutputFolder(context, folder);
 		});
+
+	std::unique_lock<std::mutex>lk(mShards.get(context).mutex);
+	contextData_t* contextData = findContext(context, lk);
+	if (contextData != nullptr)
+		contextData->longPressTimer = timer;
 }
 
+/**
+ * Opens the output folder of a button after a long press, runs on mExecutor
+ *
+ * @param[in] context the button's context
+ * @param[in] folder the folder to open
+ */
+void MyStreamDeckPlugin::openOutputFolder(const contextHandle_t context, const std::filesystem::path& folder)
+{
+	if (std::filesystem::exists(folder))
+		fileutils::openFolder(folder);
+	else
+	{
+		if (mConnectionManager != nullptr)
+			mConnectionManager->LogMessage("Error: cannot open folder: " + folder.string());
+		showButtonMessage(context, "Error: cannot\nopen folder");
+	}
+}
 
-void MyStreamDeckPlugin::KeyUpForAction(const std::string& inAction, const std::string& inContext, const json& inPayload, const std::string& inDeviceID)
+/**
+ * Starts a download of the url in the clipboard, unless the press was a long one. Runs on mExecutor.
+ *
+ * @param[in] context the button's context
+ * @param[in] inPayload the payload of the key up event
+ */
+void MyStreamDeckPlugin::keyUp(const contextHandle_t context, const json& inPayload)
 {
-	std::unique_lock<std::mutex>lk(mVisibleContextsMutex);
+	std::optional<TimerService::timerId_t> longPressTimer;
+	{
+		std::unique_lock<std::mutex>lk(mShards.get(context).mutex);
+		contextData_t* contextData = findContext(context, lk);
+		if (contextData == nullptr)
+			return;
+		longPressTimer = std::exchange(contextData->longPressTimer, std::nullopt);
+	}
 
-	if (!contextFound(inContext))
+	// If the long press timer already fired, the press was longer than LONG_PRESS_TIME_MILLIS and the
+	// folder is being opened. In this case don't execute anything, just return
+	if (longPressTimer && !mTimers.cancel(*longPressTimer))
 		return;
 
 	if (!mIsRunning.load())
 		return;
 
-	const contextSettings_t& data = mVisibleContexts.at(inContext).data;
-	std::optional<std::string>& lastErrorMsg = mVisibleContexts.at(inContext).lastErrorMsg;
-
-	// check if button timer completed
-	if (mVisibleContexts.at(inContext).buttonTimer != nullptr)
-	{
-		mVisibleContexts.at(inContext).buttonTimer->stop();
-
-		// If button press timer completed, it means the press was longer than LONG_PRESS_TIME_MILLIS
-		// This indicates that a long press was done and folder was opened. In this case don't execute anything, just return
-		if (mVisibleContexts.at(inContext).buttonTimer->isCompleted())
-			if (mVisibleContexts.at(inContext).buttonTimer->isSuccessful())
-				return;
-			else
-			{
-				mConnectionManager->LogMessage("Error: cannot open folder: " + youtubedlutils::getOutputFolderName(data.outputFolder));
-				lastErrorMsg = "Error: cannot\nopen folder";
-				updateUI(inContext, lk);
-				return;
-			}
-	}
-
 	// Cannot launch a new download if we are updating
 	if (mIsUpdating.load())
 	{
 		// double check if there are no active tasks, since update could have failed
-		if (mActiveDownloads.size() == 0)
+		if (mPendingJobs.load() == 0)
 			mIsUpdating = false;
 		else
 		{
 			mConnectionManager->LogMessage("Error: cannot start download, update in progress.");
-			lastErrorMsg = "Error: update\nin progress";
-			updateUI(inContext, lk);
+			showButtonMessage(context, "Error: update\nin progress");
 			return;
 		}
 	}
@@ -310,35 +633,38 @@ void MyStreamDeckPlugin::KeyUpForAction(const std::string& inAction, const std::
 	{
 		mConnectionManager->LogMessage("Invalid clipboard:");
 		mConnectionManager->LogMessage(e.what());
-		lastErrorMsg = "Invalid\nclipboard";
-		updateUI(inContext, lk);
+		showButtonMessage(context, "Invalid\nclipboard");
 		return;
 	}
 
+	// a link copied from a table cell or a text editor often comes with a line break
+	clipboardText = std::string(urlutils::trimWhitespace(clipboardText));
+
 	// check if clipboard text is a URL
-	if (!urlutils::isValidUrl(clipboardText.c_str()))
+	if (!urlutils::isValidUrl(clipboardText))
 	{
 		mConnectionManager->LogMessage("Invalid URL: " + clipboardText);
-		lastErrorMsg = "Invalid\nURL";
-		updateUI(inContext, lk);
+		showButtonMessage(context, "Invalid\nURL");
 		return;
 	}
 
 	// load settings
 	contextSettings_t settings{};
 	if (inPayload.find("settings") != inPayload.end())
-		readPayload(settings, inPayload["settings"], lk);
+		readPayload(settings, inPayload["settings"]);
 	else
 	{
 		mConnectionManager->LogMessage("KeyUpForAction Error: No Settings");
-		lastErrorMsg = "Failed to\nreceive settings";
-		updateUI(inContext, lk);
+		showButtonMessage(context, "Failed to\nreceive settings");
 		return;
 	}
-	// spawn a new download task
-	lastErrorMsg = std::nullopt; // clear error
-	submitDownloadTask(clipboardText, settings, inContext, false, lk);
-	updateUI(inContext, lk);
+
+	// journal the job before it is queued, so its end can never be journaled before it
+	const uint64_t jobId = DownloadJob::getNextJobId();
+	if (mJournal != nullptr && !mJournal->recordSubmit({ jobId, mContexts.getString(context), clipboardText, inPayload["settings"] }))
+		mConnectionManager->LogMessage("Error: cannot write job journal, the download is not resumed after a restart.");
+	// spawn a new download task, and clear the error
+	submitDownloadTask(clipboardText, settings, context, false, std::nullopt, jobId);
 }
 
 /**
@@ -346,13 +672,9 @@ void MyStreamDeckPlugin::KeyUpForAction(const std::string& inAction, const std::
  *
  * @param[out] data the data to update
  * @param[in] inPayload the json payload to read
- * @param[in] lk the lock for mutex mVisibleContextsMutex
  */
-void MyStreamDeckPlugin::readPayload(contextSettings_t& data, const json& inPayload, const std::unique_lock<std::mutex>& lk)
+void MyStreamDeckPlugin::readPayload(contextSettings_t& data, const json& inPayload)
 {
-	assert(lk.owns_lock());
-	assert(lk.mutex() == &mVisibleContextsMutex);
-
 	// helper to convert string to std::nullopt if it's empty
 	auto convertToNullIfEmpty = [](json data)
 	{
@@ -399,6 +721,38 @@ void MyStreamDeckPlugin::readPayload(contextSettings_t& data, const json& inPayl
 				data.attemptRedditDl = false;
 		if (inPayload.find("customCommand") != inPayload.end())
 			data.customCommand = convertToNullIfEmpty(inPayload["customCommand"]);
+		if (inPayload.find("maxParallelCommands") != inPayload.end())
+			data.maxParallelCommands = convertToUint32Option(convertToNullIfEmpty(inPayload["maxParallelCommands"]));
+		if (inPayload.find("progressDisplay") != inPayload.end())
+			data.showProgressBar = inPayload["progressDisplay"].get<std::string>() == "bar";
+		if (inPayload.find("skipDownloaded") != inPayload.end())
+			data.skipDownloaded = inPayload["skipDownloaded"].get<std::string>() != "off";
+		if (inPayload.find("childPriority") != inPayload.end())
+		{
+			const std::string priority = inPayload["childPriority"].get<std::string>();
+			if (priority == "normal")
+				data.childPriority = NORMAL_PRIORITY;
+			else if (priority == "idle")
+				data.childPriority = IDLE_PRIORITY;
+			else
+				data.childPriority = BELOW_NORMAL_PRIORITY;
+		}
+		if (inPayload.find("maxMemoryMB") != inPayload.end())
+			data.maxMemoryMB = convertToUint32Option(convertToNullIfEmpty(inPayload["maxMemoryMB"]));
+		if (inPayload.find("maxCpuPercent") != inPayload.end())
+			data.maxCpuPercent = convertToUint32Option(convertToNullIfEmpty(inPayload["maxCpuPercent"]));
+		if (inPayload.find("queuePriority") != inPayload.end())
+		{
+			const std::string priority = inPayload["queuePriority"].get<std::string>();
+			if (priority == "low")
+				data.queuePriority = LOW_QUEUE_PRIORITY;
+			else if (priority == "high")
+				data.queuePriority = HIGH_QUEUE_PRIORITY;
+			else
+				data.queuePriority = NORMAL_QUEUE_PRIORITY;
+		}
+		if (inPayload.find("queueWeight") != inPayload.end())
+			data.queueWeight = convertToUint32Option(convertToNullIfEmpty(inPayload["queueWeight"]));
 	}
 	catch (std::exception& e)
 	{
@@ -411,81 +765,141 @@ void MyStreamDeckPlugin::readPayload(contextSettings_t& data, const json& inPayl
 	}
 }
 
-void MyStreamDeckPlugin::WillAppearForAction(const std::string& inAction, const std::string& inContext, const json &inPayload, const std::string& inDeviceID)
+/**
+ * Applies the settings that are shared by all buttons, runs on mExecutor.
+ * A setting that is missing or empty goes back to its default.
+ *
+ * @param[in] inPayload the payload of the did receive global settings event
+ */
+void MyStreamDeckPlugin::applyGlobalSettings(const json& inPayload)
 {
-	// On key appearing, remember the context and store the settings
-	std::unique_lock<std::mutex>lk(mVisibleContextsMutex);
-	contextData_t newButtonData{};
+	json settings;
+	EPLJSONUtils::GetObjectByName(inPayload, kESDSDKPayloadSettings, settings);
+
+	// helper to read a number that the PI stores as a string
+	auto readUint32 = [&](const std::string& name) -> std::optional<uint32_t>
+	{
+		const std::string value = EPLJSONUtils::GetStringByName(settings, name);
+		if (value.empty())
+			return std::nullopt;
+		try
+		{
+			return static_cast<uint32_t>(std::stoul(value));
+		}
+		catch (std::exception&)
+		{
+			mConnectionManager->LogMessage("Invalid global setting " + name + ": " + value);
+			return std::nullopt;
+		}
+	};
+
+	mScheduler->setMaxConcurrent(readUint32("maxConcurrentDownloads").value_or(DownloadScheduler::DEFAULT_MAX_CONCURRENT));
+	mScheduler->setCoalesceWindow(readUint32("batchWindowMillis").value_or(DownloadScheduler::DEFAULT_COALESCE_WINDOW_MILLIS));
+	BandwidthBudget::getInstance().setLimit(static_cast<uint64_t>(readUint32("bandwidthLimitKBps").value_or(0)) * 1024);
+}
+
+/**
+ * Remembers a button that appeared and stores its settings, runs on mExecutor
+ *
+ * @param[in] context the button's context
+ * @param[in] inPayload the payload of the will appear event
+ * @param[in] inDeviceID the device the button is on
+ */
+void MyStreamDeckPlugin::willAppear(const contextHandle_t context, const json& inPayload, const std::string& inDeviceID)
+{
+	std::shared_ptr<contextSettings_t> settings = std::make_shared<contextSettings_t>();
 	if (inPayload.find("settings") != inPayload.end())
-		readPayload(newButtonData.data, inPayload["settings"], lk);
-	newButtonData.buttonTimer.reset(new TimerThread());
+		readPayload(*settings, inPayload["settings"]);
+
+	contextData_t newButtonData{};
+	newButtonData.settings = std::move(settings);
+	newButtonData.deviceId = inDeviceID;
 
 	if (!mIsRunning.load())
 		newButtonData.lastErrorMsg = "Error: Bad\nInitialization";
 
-	mVisibleContexts.emplace( inContext, std::move(newButtonData) );
+	std::unique_lock<std::mutex>lk(mShards.get(context).mutex);
+	mShards.getState(context, lk).visibleContexts.emplace(context, std::move(newButtonData));
 
-	updateUI(inContext, lk);
+	updateUI(context, lk);
 }
 
-void MyStreamDeckPlugin::WillDisappearForAction(const std::string& inAction, const std::string& inContext, const json &inPayload, const std::string& inDeviceID)
-{
-	// Remove the context
-	std::unique_lock<std::mutex>lk(mVisibleContextsMutex);
-	mVisibleContexts.erase(inContext);
-}
-
-void MyStreamDeckPlugin::DeviceDidConnect(const std::string& inDeviceID, const json &inDeviceInfo)
+/**
+ * Forgets a button that disappeared, runs on mExecutor. Its handle stays valid for results of jobs that are still running.
+ *
+ * @param[in] context the button's context
+ */
+void MyStreamDeckPlugin::willDisappear(const contextHandle_t context)
 {
-	// Nothing to do
+	std::unordered_map<contextHandle_t, contextData_t>::node_type removed;
+	{
+		std::unique_lock<std::mutex>lk(mShards.get(context).mutex);
+		removed = mShards.getState(context, lk).visibleContexts.extract(context);
+	}
+	if (!removed.empty() && removed.mapped().longPressTimer)
+		mTimers.cancel(*removed.mapped().longPressTimer);
 }
 
-void MyStreamDeckPlugin::DeviceDidDisconnect(const std::string& inDeviceID)
+/**
+ * Adds or removes a device from the devices with double resolution keys, runs on mExecutor
+ *
+ * @param[in] inDeviceID the device
+ * @param[in] highRes whether the device has double resolution keys
+ */
+void MyStreamDeckPlugin::setHighResDevice(const std::string& inDeviceID, const bool highRes)
 {
-	// Nothing to do
+	std::unique_lock<std::mutex>lk(mHighResDevicesMutex);
+	std::shared_ptr<std::unordered_set<std::string>> highResDevices = std::make_shared<std::unordered_set<std::string>>(*std::atomic_load(&mHighResDevices));
+	if (highRes)
+		highResDevices->insert(inDeviceID);
+	else
+		highResDevices->erase(inDeviceID);
+	std::atomic_store(&mHighResDevices, std::shared_ptr<const std::unordered_set<std::string>>(std::move(highResDevices)));
 }
 
 /**
  * Reads inPayload for commands from PI and runs them
  *
- * @param[in] inContext the context the payload belongs to
+ * @param[in] context the context the payload belongs to
+ * @param[in] data the settings of the context
  * @param[in] inPayload the json payload to read
- * @param[in] lk the lock for mutex mVisibleContextsMutex
  */
-void MyStreamDeckPlugin::runPICommands(const std::string& inContext, const json& inPayload, const std::unique_lock<std::mutex>& lk)
+void MyStreamDeckPlugin::runPICommands(const contextHandle_t context, const contextSettings_t& data, const json& inPayload)
 {
-	assert(lk.owns_lock());
-	assert(lk.mutex() == &mVisibleContextsMutex);
-
-	if (!contextFound(inContext))
-		return;
-
 	if (inPayload.find("command") != inPayload.end())
 	{
-		std::optional<std::string>& lastErrorMsg = mVisibleContexts.at(inContext).lastErrorMsg;
-
 		if (inPayload["command"] == "getSampleCommand")
 		{
 			// construct the command string and send it back to PI
 
 			json j;
-			const contextSettings_t& data = mVisibleContexts.at(inContext).data;
 			const std::filesystem::path exe = youtubedlutils::getDownloaderExePath(data.youtubeDlExePath);
 
 			// first grab all the cmds based on selected options
 			std::vector<std::string> cmds;
 			try
 			{
-				cmds = youtubedlutils::getCommandQueue("url",
+				// with several formats, the url is resolved once and the format commands load the info json
+				std::optional<std::string> infoJson = std::nullopt;
+				if (youtubedlutils::shouldResolve(data.downloadFormats))
+				{
+					infoJson = "info.json";
+					cmds.push_back(youtubedlutils::getResolveCommand("url", data.maxDownloads) + " > " + *infoJson);
+				}
+
+				std::vector<std::string> formatCmds = youtubedlutils::getCommandQueue("url",
 					data.outputFolder,
 					std::nullopt,
 					data.maxDownloads,
 					data.downloadFormats,
-					data.customCommand);
+					data.customCommand,
+					infoJson,
+					data.maxParallelCommands.value_or(1) > 1);
+				cmds.insert(cmds.end(), formatCmds.begin(), formatCmds.end());
 			}
 			catch (std::runtime_error &e)
 			{
-				mConnectionManager->LogMessage("Error: context " + inContext + " cannot get download command.");
+				mConnectionManager->LogMessage("Error: context " + mContexts.getString(context) + " cannot get download command.");
 				mConnectionManager->LogMessage(e.what());
 			}
 
@@ -498,51 +912,55 @@ void MyStreamDeckPlugin::runPICommands(const std::string& inContext, const json&
 			j["sampleCommand"] = allCmds;
 
 			// send
-			mConnectionManager->SendToPropertyInspector("", inContext, j);
+			mConnectionManager->SendToPropertyInspector("", mContexts.getString(context), j);
 		}
 		else if (inPayload["command"] == "update")
 		{
-			if (mActiveDownloads.size() > 0)
+			if (mPendingJobs.load() > 0)
 			{
-				lastErrorMsg = "youtube-dl\nin use.";
-				mConnectionManager->LogMessage("Error: context " + inContext + " requested update but jobs are still pending.");
+				showButtonMessage(context, "youtube-dl\nin use.");
+				mConnectionManager->LogMessage("Error: context " + mContexts.getString(context) + " requested update but jobs are still pending.");
 			}
 			else
 			{
-				contextSettings_t& data = mVisibleContexts.at(inContext).data;
 				mIsUpdating = true;
-				lastErrorMsg = "Updating\n";
-				submitDownloadTask("", data, inContext, true, lk);
+				submitDownloadTask("", data, context, true, "Updating\n");
 			}
 		}
 		else if (inPayload["command"] == "killContext")
 		{
-			mConnectionManager->LogMessage("Killing threads spawned by context: " + inContext);
-			lastErrorMsg = "Stopping\nDownloads";
-			if (mActiveDownloads.find(inContext) != mActiveDownloads.end())
-			{
-				for (const auto& thd : mActiveDownloads.at(inContext).threads)
-				{
-					thd->kill();
-				}
-			}
+			mConnectionManager->LogMessage("Killing jobs spawned by context: " + mContexts.getString(context));
+			showButtonMessage(context, "Stopping\nDownloads");
+			mScheduler->kill(context);
 		}
 		else if (inPayload["command"] == "killAll")
 		{
-			mConnectionManager->LogMessage("Killing all threads");
-			lastErrorMsg = "Stopping All\nDownloads";
-			for (const auto ctx : mActiveDownloads)
-			{
-				for (const auto& thd : ctx.second.threads)
-				{
-					thd->kill();
-				}
-			}
+			mConnectionManager->LogMessage("Killing all jobs");
+			showButtonMessage(context, "Stopping All\nDownloads");
+			mScheduler->killAll();
+		}
+		else if (inPayload["command"] == "pauseContext")
+		{
+			mConnectionManager->LogMessage("Pausing jobs spawned by context: " + mContexts.getString(context));
+			mScheduler->pause(context);
+		}
+		else if (inPayload["command"] == "pauseAll")
+		{
+			mConnectionManager->LogMessage("Pausing all jobs");
+			mScheduler->pauseAll();
+		}
+		else if (inPayload["command"] == "resumeContext")
+		{
+			mConnectionManager->LogMessage("Resuming jobs spawned by context: " + mContexts.getString(context));
+			mScheduler->resume(context);
+		}
+		else if (inPayload["command"] == "resumeAll")
+		{
+			mConnectionManager->LogMessage("Resuming all jobs");
+			mScheduler->resumeAll();
 		}
 		else if (inPayload["command"] == "openExeFolder")
 		{
-			const contextSettings_t& data = mVisibleContexts.at(inContext).data;
-
 			if (data.youtubeDlExePath)
 				fileutils::openFolder(youtubedlutils::getDownloaderExePath(data.youtubeDlExePath));
 			else
@@ -550,19 +968,38 @@ void MyStreamDeckPlugin::runPICommands(const std::string& inContext, const json&
 		}
 		else
 		{
-			mConnectionManager->LogMessage("Recieved unknown command: " + std::string(inPayload["command"]) + " in context: " + inContext);
+			mConnectionManager->LogMessage("Recieved unknown command: " + std::string(inPayload["command"]) + " in context: " + mContexts.getString(context));
 		}
 	}
 }
 
-void MyStreamDeckPlugin::SendToPlugin(const std::string& inAction, const std::string& inContext, const json &inPayload, const std::string& inDeviceID)
+/**
+ * Stores the settings sent by the PI and runs its commands, runs on mExecutor
+ *
+ * @param[in] context the button's context
+ * @param[in] inPayload the payload sent by the PI
+ */
+void MyStreamDeckPlugin::sendToPlugin(const contextHandle_t context, const json& inPayload)
 {
-	std::unique_lock<std::mutex>lk(mVisibleContextsMutex);
-	// on settings change, store the new settings
-	if (contextFound(inContext))
-		readPayload(mVisibleContexts.at(inContext).data, inPayload, lk);
+	std::shared_ptr<contextSettings_t> settings;
+	{
+		std::unique_lock<std::mutex>lk(mShards.get(context).mutex);
+		contextData_t* contextData = findContext(context, lk);
+		if (contextData == nullptr)
+			return;
+		settings = std::make_shared<contextSettings_t>(*contextData->settings);
+	}
 
-	runPICommands(inContext, inPayload, lk);
+	// on settings change, publish new settings. Handlers that already hold the old ones keep using them.
+	readPayload(*settings, inPayload);
+	{
+		std::unique_lock<std::mutex>lk(mShards.get(context).mutex);
+		contextData_t* contextData = findContext(context, lk);
+		if (contextData == nullptr)
+			return;
+		contextData->settings = settings;
+		updateUI(context, lk);
+	}
 
-	updateUI(inContext, lk);
+	runPICommands(context, *settings, inPayload);
 }
\ No newline at end of file
@@ -11,18 +11,24 @@
 
 #include "Common/ESDBasePlugin.h"
 #include "Windows/Common.h"
-#include "Windows/DownloadThread.h"
-#include "Windows/TimerThread.h"
+#include "Windows/ContextRegistry.h"
+#include "Windows/ContextShards.h"
+#include "Windows/DownloadArchive.h"
+#include "Windows/DownloadJob.h"
+#include "Windows/DownloadScheduler.h"
+#include "Windows/JobJournal.h"
+#include "Windows/PluginExecutor.h"
+#include "Windows/TimerService.h"
 #include <mutex>
 #include <atomic>
+#include <chrono>
 #include <optional>
-#include <queue>
 #include <unordered_map>
 #include <unordered_set>
 
 
-class DownloadThread;
-class TimerThread;
+class DownloadJob;
+class DownloadScheduler;
 
 class MyStreamDeckPlugin : public ESDBasePlugin
 {
@@ -42,48 +48,115 @@ public:
 	
 	void SendToPlugin(const std::string& inAction, const std::string& inContext, const json &inPayload, const std::string& inDeviceID) override;
 
+	void DidReceiveGlobalSettings(const json &inPayload) override;
+
 private:
 	
 	bool initYoutubeDl();
+	void openJournal();
+	void openArchive();
+	void resumeJournaledJobs();
 	
 	struct contextData_t
 	{
-		contextSettings_t data = {};
-		std::unique_ptr<TimerThread> buttonTimer = nullptr;
+		// replaced as a whole when the PI sends new settings, so handlers can keep using it after unlocking the shard
+		std::shared_ptr<const contextSettings_t> settings = std::make_shared<const contextSettings_t>();
+		// set from key down until key up, the folder is opened if it fires first
+		std::optional<TimerService::timerId_t> longPressTimer = std::nullopt;
 		std::optional<std::string> lastErrorMsg = std::nullopt;
+		std::string deviceId;
+		// progress bar frame that is shown on the key, nullopt while the default image is shown
+		std::optional<uint32_t> imageFrame = std::nullopt;
+		std::chrono::steady_clock::time_point lastImageUpdate = {};
 	};
-	std::mutex mVisibleContextsMutex;
-	std::unordered_map<std::string, contextData_t> mVisibleContexts;
-	
-	std::thread mDlMonitor;
-	std::atomic<bool> mIsRunning = false;
-	std::atomic<bool> mIsUpdating = false;
+	// at most 5 image updates per second for each key
+	static constexpr uint32_t MIN_IMAGE_UPDATE_INTERVAL_MILLIS = 200;
 
-	// data struct holding download threads per context
+	// data struct holding download job counts per context, the jobs themselves are owned by mScheduler
 	struct downloadData_t
 	{
-		std::vector<std::shared_ptr<DownloadThread>> threads = {};
+		uint32_t submittedCount = 0;
 		uint32_t successCount = 0;
 		uint32_t failureCount = 0;
+		// latest progress of each running job of the context, keyed by job id
+		std::unordered_map<uint64_t, downloadProgress_t> progress;
+		// jobs of the context that are PAUSED or RESUMING, keyed by job id
+		std::unordered_map<uint64_t, DownloadJob::status_t> pauseStates;
 	};
-	std::unordered_map <std::string, downloadData_t> mActiveDownloads;
 
-	// these are used for waking main thread for updates
-	std::mutex mCvMutex;
-	std::condition_variable mCv;
-	std::queue<DownloadThread::threadData_t> mResults;
+	// contexts of one shard. Downloads are kept until all their jobs reported back, even if the key disappeared.
+	struct shardState_t
+	{
+		std::unordered_map<contextHandle_t, contextData_t> visibleContexts;
+		std::unordered_map<contextHandle_t, downloadData_t> activeDownloads;
+	};
+
+	// context strings are interned when a key appears, the shards are keyed by the handles
+	ContextRegistry mContexts;
+	ContextShards<shardState_t> mShards;
+	// jobs of all contexts that did not report back yet
+	std::atomic<uint32_t> mPendingJobs = 0;
+
+	// devices with double resolution keys, replaced as a whole and read with std::atomic_load
+	std::mutex mHighResDevicesMutex;
+	std::shared_ptr<const std::unordered_set<std::string>> mHighResDevices = std::make_shared<const std::unordered_set<std::string>>();
+	
+	std::thread mDlMonitor;
+	std::atomic<bool> mIsRunning = false;
+	std::atomic<bool> mIsUpdating = false;
+
+	// results published by the jobs, the monitor thread sleeps on it until there are some
+	DownloadJob::resultQueue_t mResults;
+
+	std::shared_ptr<DownloadScheduler> mScheduler;
+	// jobs that did not finish are queued again when the plugin starts, nullptr if the journal cannot be opened.
+	// Shared with the jobs, which record their processes in it.
+	std::shared_ptr<JobJournal> mJournal;
+	// keys of every media downloaded by any button, the yt-dlp archive key followed by the formats and the output folder.
+	// nullptr if it cannot be opened.
+	std::shared_ptr<DownloadArchive> mArchive;
+
+	// runs the event handlers, so the websocket thread only parses and dispatches events. A handler that throws is logged.
+	PluginExecutor mExecutor;
+	// deadlines of all contexts, the callbacks run on mExecutor
+	TimerService mTimers{ mExecutor };
+
+	void keyDown(const contextHandle_t context);
+	void openOutputFolder(const contextHandle_t context, const std::filesystem::path& folder);
+	void keyUp(const contextHandle_t context, const json& inPayload);
+	void willAppear(const contextHandle_t context, const json& inPayload, const std::string& inDeviceID);
+	void willDisappear(const contextHandle_t context);
+	void setHighResDevice(const std::string& inDeviceID, const bool highRes);
+	void sendToPlugin(const contextHandle_t context, const json& inPayload);
+	void applyGlobalSettings(const json& inPayload);
 
-	void readPayload(contextSettings_t& data, const json& inPayload, const std::unique_lock<std::mutex>& lk);
-	void runPICommands(const std::string& inContext, const json& inPayload, const std::unique_lock<std::mutex>& lk);
+	void readPayload(contextSettings_t& data, const json& inPayload);
+	void runPICommands(const contextHandle_t context, const contextSettings_t& data, const json& inPayload);
 
 	void downloadMonitor();
-	void submitDownloadTask(const std::string& url, const contextSettings_t& data, const std::string& inContext, const bool doUpdate, const std::unique_lock<std::mutex>& lk);
-	void cleanupDownloads(const std::string& context, const std::unique_lock<std::mutex>& lk);
-	std::unordered_set <std::string> getModifiedContexts(const std::unique_lock<std::mutex>& lk);
-	void updateUI(const std::string & inContext, const std::unique_lock<std::mutex>& lk);
+	void applyResult(const DownloadJob::threadData_t& result);
+	void submitDownloadTask(const std::string& url, const contextSettings_t& data, const contextHandle_t context, const bool doUpdate,
+		const std::optional<std::string>& buttonMsg, const std::optional<uint64_t>& jobId = std::nullopt);
+	void cleanupDownloads(const contextHandle_t context, const std::unique_lock<std::mutex>& lk);
+	void showButtonMessage(const contextHandle_t context, const std::optional<std::string>& buttonMsg);
+	void updateUI(const contextHandle_t context, const std::unique_lock<std::mutex>& lk);
+	void updateImage(const contextHandle_t context, const std::unique_lock<std::mutex>& lk);
+	static std::string getProgressText(const std::unordered_map<uint64_t, downloadProgress_t>& progress);
+	static std::optional<uint32_t> getProgressPercent(const std::unordered_map<uint64_t, downloadProgress_t>& progress);
 
-	bool contextFound(const std::string& context)
+	/**
+	 * Get the data of a visible context
+	 *
+	 * @param[in] context the context handle
+	 * @param[in] lk the lock for the mutex of the context's shard
+	 * @return the data, or nullptr if the context is not visible
+	 */
+	contextData_t* findContext(const contextHandle_t context, const std::unique_lock<std::mutex>& lk)
 	{
-		return mConnectionManager != nullptr && mVisibleContexts.find(context) != mVisibleContexts.end();
+		std::unordered_map<contextHandle_t, contextData_t>& visibleContexts = mShards.getState(context, lk).visibleContexts;
+		const auto it = visibleContexts.find(context);
+		if (mConnectionManager == nullptr || it == visibleContexts.end())
+			return nullptr;
+		return &it->second;
 	}
 };
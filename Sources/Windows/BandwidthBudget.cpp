@@ -0,0 +1,208 @@
+//==============================================================================
+/**
+@file       BandwidthBudget.cpp
+
+@brief		Plugin wide download bandwidth limit that is shared fairly by the running transfers
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "pch.h"
+
+#include "BandwidthBudget.h"
+
+#include <algorithm>
+
+BandwidthBudget::Lease::Lease(Lease&& other) noexcept :
+	mBudget(other.mBudget), mId(other.mId), mRate(std::move(other.mRate))
+{
+	other.mBudget = nullptr;
+}
+
+BandwidthBudget::Lease& BandwidthBudget::Lease::operator=(Lease&& other) noexcept
+{
+	if (this != &other)
+	{
+		release();
+		mBudget = other.mBudget;
+		mId = other.mId;
+		mRate = std::move(other.mRate);
+		other.mBudget = nullptr;
+	}
+	return *this;
+}
+
+BandwidthBudget::Lease::~Lease()
+{
+	release();
+}
+
+/**
+ * Give the share back to the budget, so the next transfer that starts can use it
+ */
+void BandwidthBudget::Lease::release()
+{
+	if (mBudget != nullptr)
+		mBudget->release(mId);
+	mBudget = nullptr;
+}
+
+/**
+ * Get the budget shared by all download jobs and curl transfers
+ *
+ * @return the shared budget
+ */
+BandwidthBudget& BandwidthBudget::getInstance()
+{
+	static BandwidthBudget* budget = new BandwidthBudget();
+	return *budget;
+}
+
+/**
+ * Set the limit for all transfers together. The running transfers are given their new share at once.
+ *
+ * @param[in] bytesPerSecond the limit, 0 for no limit
+ */
+void BandwidthBudget::setLimit(const uint64_t bytesPerSecond)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	mLimit = bytesPerSecond;
+	rebalance(lk);
+}
+
+uint64_t BandwidthBudget::getLimit()
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	return mLimit;
+}
+
+/**
+ * Get a share of the budget for a transfer that is about to start.
+ * The limit is split equally between the running transfers, so the others give up part of their share to the new one.
+ *
+ * @param[in] owner id of the job the transfer belongs to, so its leases can be paused together
+ * @param[in] onRateChanged called when the share of the transfer changes later on, e.g. to restart a process with the new rate
+ * @return the lease, its rate is 0 if there is no limit
+ */
+BandwidthBudget::Lease BandwidthBudget::acquire(const uint64_t owner, rateChangedCallback_t onRateChanged)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	Lease lease;
+	lease.mBudget = this;
+	lease.mId = mNextId++;
+	lease.mRate = std::make_shared<std::atomic<uint64_t>>(0);
+
+	mRates.emplace(lease.mId, grant_t{ lease.mRate, owner, nullptr, false, false });
+	rebalance(lk);
+	// the holder starts with the rate it got, only later changes are reported
+	mRates[lease.mId].onRateChanged = std::move(onRateChanged);
+	return lease;
+}
+
+/**
+ * Pause or unpause the leases of a job. A paused lease is left out when the limit is split, so its share goes to the
+ * running transfers until the job is unpaused. A job is only unpaused once reserve() succeeded.
+ *
+ * @param[in] owner id of the job
+ * @param[in] paused true while the transfers of the job are paused
+ */
+void BandwidthBudget::setPaused(const uint64_t owner, const bool paused)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	for (auto& [id, grant] : mRates)
+	{
+		if (grant.owner == owner)
+		{
+			grant.paused = paused;
+			grant.reserved = false;
+		}
+	}
+	rebalance(lk);
+
+	// the rate of an unpaused lease may have changed while it was paused, which was not reported then
+	if (!paused)
+	{
+		for (auto& [id, grant] : mRates)
+		{
+			if (grant.owner == owner && grant.onRateChanged)
+				grant.onRateChanged();
+		}
+	}
+}
+
+/**
+ * Check if the paused leases of a job can be unpaused without crowding the budget below the minimum rate.
+ * Until then they count as running when the limit is split, so transfers that start in the meantime leave them a share.
+ *
+ * @param[in] owner id of the job
+ * @return true if the job can be unpaused without exceeding the limit
+ */
+bool BandwidthBudget::reserve(const uint64_t owner)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	uint64_t running = 0;
+	bool othersActive = false;
+	for (auto& [id, grant] : mRates)
+	{
+		if (grant.owner == owner && grant.paused)
+		{
+			grant.reserved = true;
+			running++;
+		}
+		else if (!grant.paused || grant.reserved)
+		{
+			running++;
+			othersActive = true;
+		}
+	}
+	rebalance(lk);
+	// with nothing else running, waiting would not free anything
+	return (mLimit == 0) || !othersActive || (running * MIN_RATE_BYTES <= mLimit);
+}
+
+/**
+ * Get the number of transfers that hold a share
+ *
+ * @return the number of leases
+ */
+size_t BandwidthBudget::getLeaseCount()
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	return mRates.size();
+}
+
+void BandwidthBudget::release(const uint64_t id)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	mRates.erase(id);
+	rebalance(lk);
+}
+
+/**
+ * Split the limit equally between the leases that are not paused, and tell the holders whose share changed.
+ * Paused leases keep their rate, they download nothing until they are unpaused.
+ *
+ * @param[in] lk the lock for mMutex
+ */
+void BandwidthBudget::rebalance(const std::unique_lock<std::mutex>& lk)
+{
+	size_t active = 0;
+	for (const auto& [id, grant] : mRates)
+	{
+		if (!grant.paused || grant.reserved)
+			active++;
+	}
+	if (active == 0)
+		return;
+
+	const uint64_t share = (mLimit > 0) ? std::max(mLimit / active, MIN_RATE_BYTES) : 0;
+	for (auto& [id, grant] : mRates)
+	{
+		if (grant.paused && !grant.reserved)
+			continue;
+		if (grant.rate->exchange(share) != share && grant.onRateChanged && !grant.paused)
+			grant.onRateChanged();
+	}
+}
@@ -0,0 +1,89 @@
+//==============================================================================
+/**
+@file       BandwidthBudget.h
+
+@brief		Plugin wide download bandwidth limit that is shared fairly by the running transfers
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+class BandwidthBudget
+{
+public:
+	// no transfer is throttled below this, so a crowded budget still makes progress
+	static constexpr uint64_t MIN_RATE_BYTES = 16 * 1024;
+
+	// called with the budget locked when the rate of a lease changed, it must not call into the budget
+	typedef std::function<void(void)> rateChangedCallback_t;
+
+	// share of the budget held by one yt-dlp process or curl transfer, it is given back when the lease is destroyed
+	class Lease
+	{
+	public:
+		Lease() = default;
+		Lease(Lease&& other) noexcept;
+		Lease& operator=(Lease&& other) noexcept;
+		~Lease();
+
+		Lease(const Lease&) = delete;
+		Lease& operator=(const Lease&) = delete;
+
+		// bytes per second the holder may download, 0 if there is no limit. It changes as other transfers start and finish.
+		uint64_t getRate() const
+		{
+			return (mRate != nullptr) ? mRate->load() : 0;
+		}
+
+		void release();
+	private:
+		friend class BandwidthBudget;
+
+		BandwidthBudget* mBudget = nullptr;
+		uint64_t mId = 0;
+		std::shared_ptr<std::atomic<uint64_t>> mRate = nullptr;
+	};
+
+	static BandwidthBudget& getInstance();
+
+	void setLimit(const uint64_t bytesPerSecond);
+	uint64_t getLimit();
+
+	Lease acquire(const uint64_t owner = 0, rateChangedCallback_t onRateChanged = nullptr);
+	void setPaused(const uint64_t owner, const bool paused);
+	bool reserve(const uint64_t owner);
+	size_t getLeaseCount();
+private:
+	struct grant_t
+	{
+		// shared with the lease, so the holder sees a new rate without asking the budget
+		std::shared_ptr<std::atomic<uint64_t>> rate;
+		// the job that holds the lease, 0 if it is not held by a job
+		uint64_t owner = 0;
+		rateChangedCallback_t onRateChanged = nullptr;
+		// a paused transfer downloads nothing, its share goes to the running transfers
+		bool paused = false;
+		// a paused transfer that waits to be unpaused, it already counts when the shares are split
+		bool reserved = false;
+	};
+
+	std::mutex mMutex;
+	// 0 for no limit
+	uint64_t mLimit = 0;
+	uint64_t mNextId = 1;
+	// rate granted to each lease that was not given back yet
+	std::unordered_map<uint64_t, grant_t> mRates;
+
+	void release(const uint64_t id);
+	void rebalance(const std::unique_lock<std::mutex>& lk);
+};
@@ -16,6 +16,9 @@
 #include <optional>
 #include <unordered_set>
 
+// compact handle of a button context, interned by ContextRegistry. 0 is never handed out.
+typedef uint32_t contextHandle_t;
+
 // the type of download to perform
 enum DL_TYPE
 {
@@ -24,6 +27,30 @@ enum DL_TYPE
 	VIDEO_ONLY
 };
 
+// priority class of the child processes of a download
+enum CHILD_PRIORITY
+{
+	NORMAL_PRIORITY,
+	BELOW_NORMAL_PRIORITY,
+	IDLE_PRIORITY
+};
+
+// order in which queued presses start, a high priority press may suspend a running low priority one
+enum QUEUE_PRIORITY
+{
+	LOW_QUEUE_PRIORITY,
+	NORMAL_QUEUE_PRIORITY,
+	HIGH_QUEUE_PRIORITY
+};
+
+// resources used by all child processes of a job
+struct resourceUsage_t
+{
+	uint64_t peakMemoryBytes = 0;
+	// user and kernel time of all processes together
+	uint64_t cpuTimeMillis = 0;
+};
+
 // settings sent by PI
 struct contextSettings_t
 {
@@ -34,4 +61,19 @@ struct contextSettings_t
 	std::unordered_set <DL_TYPE> downloadFormats = {};
 	std::optional<std::string> customCommand = std::nullopt;
 	bool attemptRedditDl = false;
+	// number of format commands of one press that may run at the same time, 1 or unset runs them sequentially
+	std::optional <uint32_t> maxParallelCommands = std::nullopt;
+	// show the download progress as a bar image on the key, in addition to the title text
+	bool showProgressBar = false;
+	// media in the plugin wide download archive are not downloaded again
+	bool skipDownloaded = true;
+	// the child processes run below normal priority unless changed, so they don't compete with games and streaming
+	CHILD_PRIORITY childPriority = BELOW_NORMAL_PRIORITY;
+	// memory cap of all child processes of one job together, unset for no cap
+	std::optional <uint32_t> maxMemoryMB = std::nullopt;
+	// cpu cap of all child processes of one job together, in percent of all cores, unset for no cap
+	std::optional <uint32_t> maxCpuPercent = std::nullopt;
+	QUEUE_PRIORITY queuePriority = NORMAL_QUEUE_PRIORITY;
+	// share of the job starts this button gets while other buttons of the same priority have jobs queued
+	std::optional <uint32_t> queueWeight = std::nullopt;
 };
\ No newline at end of file
@@ -0,0 +1,71 @@
+//==============================================================================
+/**
+@file       ContextRegistry.cpp
+
+@brief		Interns button context strings into compact handles
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "pch.h"
+
+#include "ContextRegistry.h"
+
+#include <stdexcept>
+
+/**
+ * Get the handle of a context, a new handle is handed out the first time a context is seen
+ *
+ * @param[in] context the context string sent by the Stream Deck application
+ * @return the handle of the context
+ */
+contextHandle_t ContextRegistry::intern(const std::string& context)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	const auto it = mHandles.find(context);
+	if (it != mHandles.end())
+		return it->second;
+
+	mStrings.push_back(context);
+	const contextHandle_t handle = static_cast<contextHandle_t>(mStrings.size());
+	mHandles.emplace(context, handle);
+	return handle;
+}
+
+/**
+ * Get the handle of a context that was interned before
+ *
+ * @param[in] context the context string sent by the Stream Deck application
+ * @return the handle, or nullopt if the context was never interned
+ */
+std::optional<contextHandle_t> ContextRegistry::find(const std::string& context)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	const auto it = mHandles.find(context);
+	if (it == mHandles.end())
+		return std::nullopt;
+	return it->second;
+}
+
+/**
+ * Get the context string of a handle, for calls to the Stream Deck application
+ *
+ * @param[in] handle the handle returned by intern
+ * @return the context string, valid for the lifetime of the registry
+ * @throws std::out_of_range if the handle was not handed out by this registry
+ */
+const std::string& ContextRegistry::getString(const contextHandle_t handle)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	if (handle == INVALID_HANDLE || handle > mStrings.size())
+		throw std::out_of_range("Unknown context handle: " + std::to_string(handle));
+	return mStrings[handle - 1];
+}
+
+size_t ContextRegistry::size()
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	return mStrings.size();
+}
@@ -0,0 +1,39 @@
+//==============================================================================
+/**
+@file       ContextRegistry.h
+
+@brief		Interns button context strings into compact handles
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include "Common.h"
+
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+class ContextRegistry
+{
+public:
+	static constexpr contextHandle_t INVALID_HANDLE = 0;
+
+	contextHandle_t intern(const std::string& context);
+	std::optional<contextHandle_t> find(const std::string& context);
+	const std::string& getString(const contextHandle_t handle);
+
+	size_t size();
+
+private:
+	std::mutex mMutex;
+	// handles are never released, so results that arrive after a button disappeared still map back to its context
+	std::unordered_map<std::string, contextHandle_t> mHandles;
+	// string of handle h is at index h - 1, a deque keeps the references returned by getString valid as it grows
+	std::deque<std::string> mStrings;
+};
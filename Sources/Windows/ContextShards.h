@@ -0,0 +1,63 @@
+//==============================================================================
+/**
+@file       ContextShards.h
+
+@brief		Per context state split into shards that are locked independently
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include "Common.h"
+
+#include <array>
+#include <cassert>
+#include <mutex>
+
+/**
+ * Holds one T per shard, each guarded by its own mutex. Context handles are handed out sequentially,
+ * so the first SHARD_COUNT contexts all get a shard of their own.
+ */
+template <typename T, size_t SHARD_COUNT = 64>
+class ContextShards
+{
+public:
+	// on separate cache lines, so threads that work on different shards do not slow each other down
+	struct alignas(64) shard_t
+	{
+		std::mutex mutex;
+		T state;
+	};
+
+	/**
+	 * Get the shard of a context. Its state may only be used while its mutex is locked.
+	 *
+	 * @param[in] context the context handle
+	 * @return the shard
+	 */
+	shard_t& get(const contextHandle_t context)
+	{
+		return mShards[context % SHARD_COUNT];
+	}
+
+	/**
+	 * Get the state of a context's shard
+	 *
+	 * @param[in] context the context handle
+	 * @param[in] lk the lock for the mutex of the context's shard
+	 * @return the state of the shard
+	 */
+	T& getState(const contextHandle_t context, const std::unique_lock<std::mutex>& lk)
+	{
+		shard_t& shard = get(context);
+		assert(lk.owns_lock());
+		assert(lk.mutex() == &shard.mutex);
+		return shard.state;
+	}
+
+private:
+	std::array<shard_t, SHARD_COUNT> mShards;
+};
@@ -11,9 +11,13 @@
 #include <curl\curl.h>
 
 #include "UrlUtils.h"
+#include "BandwidthBudget.h"
 
+#include <algorithm>
+#include <chrono>
 #include <string>
 #include <fstream>
+#include <thread>
 
 namespace curlutils
 {
@@ -72,6 +76,58 @@ namespace curlutils
 	}
 
 
+	// a transfer sleeps at most this long at once, so it notices soon when its share grows
+	static constexpr uint32_t MAX_PACING_SLEEP_MILLIS = 100;
+
+	// paces a transfer to the current rate of its lease, which changes as other transfers start and finish
+	struct pacing_t
+	{
+		const BandwidthBudget::Lease* bandwidth = nullptr;
+		// the rate the transfer was paced to since the last change
+		uint64_t rate = 0;
+		std::chrono::steady_clock::time_point since = std::chrono::steady_clock::now();
+		curl_off_t bytesSince = 0;
+	};
+
+	/**
+	 * Progress callback of a paced transfer, it holds the transfer back until its bytes fit into the rate of its lease
+	**/
+	static int paceTransfer(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+	{
+		pacing_t* pacing = static_cast<pacing_t*>(clientp);
+		const uint64_t rate = pacing->bandwidth->getRate();
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (rate != pacing->rate)
+		{
+			pacing->rate = rate;
+			pacing->since = now;
+			pacing->bytesSince = dlnow;
+			return 0;
+		}
+		if (rate == 0)
+			return 0;
+
+		const std::chrono::steady_clock::time_point due = pacing->since +
+			std::chrono::microseconds(static_cast<uint64_t>(dlnow - pacing->bytesSince) * 1000000 / rate);
+		if (due > now)
+			std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(due - now, std::chrono::milliseconds(MAX_PACING_SLEEP_MILLIS)));
+		return 0;
+	}
+
+	/**
+	 * Cap the receive rate of a transfer to its share of the plugin wide bandwidth limit.
+	 * The share is read again while the transfer runs, so it follows the budget when other transfers start or finish.
+	 *
+	 * @param[in] curl the transfer
+	 * @param[in] pacing the pacing state of the transfer, it must outlive the transfer
+	**/
+	static void setRateLimit(CURL* curl, pacing_t* pacing)
+	{
+		curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0);
+		curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, paceTransfer);
+		curl_easy_setopt(curl, CURLOPT_XFERINFODATA, static_cast<void*>(pacing));
+	}
+
 	/**
 	 * Download url as string
 	 *
@@ -89,13 +145,17 @@ namespace curlutils
 
 		curl = curl_easy_init();
 		curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/117.0.5938.132 Safari/537.36");
-		curl_easy_setopt(curl, CURLOPT_URL, url);
+		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
 		curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1);
 		curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10);
 
 		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, callback);
 		curl_easy_setopt(curl, CURLOPT_WRITEDATA, data);
 
+		BandwidthBudget::Lease bandwidth = BandwidthBudget::getInstance().acquire();
+		pacing_t pacing = { &bandwidth };
+		setRateLimit(curl, &pacing);
+
 		curl_easy_perform(curl);
 
 		long httpCode;
@@ -120,7 +180,7 @@ namespace curlutils
 		CURL* curl;
 
 		curl = curl_easy_init();
-		curl_easy_setopt(curl, CURLOPT_URL, url);
+		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
 		curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1);
 		curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10);
 
@@ -128,6 +188,10 @@ namespace curlutils
 		struct curlutils::MemoryStruct chunk;
 		curl_easy_setopt(curl, CURLOPT_WRITEDATA, static_cast<void*>(&chunk));
 
+		BandwidthBudget::Lease bandwidth = BandwidthBudget::getInstance().acquire();
+		pacing_t pacing = { &bandwidth };
+		setRateLimit(curl, &pacing);
+
 		CURLcode res = curl_easy_perform(curl);
 
 		if (res != CURLE_OK)
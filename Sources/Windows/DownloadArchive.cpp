@@ -0,0 +1,338 @@
+//==============================================================================
+/**
+@file       DownloadArchive.cpp
+
+@brief		Plugin wide archive of downloaded media. Each line is the yt-dlp archive key of a media,
+			followed by the formats and the output folder it was downloaded with.
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "pch.h"
+
+#include "DownloadArchive.h"
+#include "UrlCanonicalizer.h"
+#include "WindowsProcessUtils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+
+/**
+ * Remove the spaces and line break characters around a line of the archive
+ *
+ * @param[in] line the line
+ * @return the key on the line, empty for a blank line
+ */
+static std::string_view trimLine(std::string_view line)
+{
+	const size_t first = line.find_first_not_of(" \t\r");
+	if (first == std::string_view::npos)
+		return std::string_view();
+	return line.substr(first, line.find_last_not_of(" \t\r") - first + 1);
+}
+
+DownloadArchive::DownloadArchive(const std::filesystem::path& path) :
+	mPath(path)
+{
+	// appends always go to the end of the file, so the view never changes under the index
+	mFile = CreateFile(mPath.wstring().c_str(), GENERIC_READ | FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (mFile == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Cannot open download archive " + mPath.string() + ".\n" + windowsprocessutils::getLastErrorAsString());
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(mFile, &fileSize))
+	{
+		std::string error = windowsprocessutils::getLastErrorAsString();
+		close();
+		throw std::runtime_error("Cannot read download archive " + mPath.string() + ".\n" + error);
+	}
+
+	// an empty file cannot be mapped, and there is nothing to index
+	if (fileSize.QuadPart > 0)
+	{
+		mMapping = CreateFileMapping(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mMapping != NULL)
+			mView = static_cast<const char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+		if (mView == nullptr)
+		{
+			std::string error = windowsprocessutils::getLastErrorAsString();
+			close();
+			throw std::runtime_error("Cannot map download archive " + mPath.string() + ".\n" + error);
+		}
+		mViewSize = static_cast<size_t>(fileSize.QuadPart);
+		mNeedsLineBreak = (mView[mViewSize - 1] != '\n');
+	}
+
+	indexView();
+}
+
+DownloadArchive::~DownloadArchive()
+{
+	close();
+}
+
+/**
+ * Check if a media was downloaded before
+ *
+ * @param[in] key the line of the media, a key from getKey followed by the formats and the output folder
+ * @return true if the key is in the archive
+ */
+bool DownloadArchive::contains(const std::string& key)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	return containsLocked(key);
+}
+
+/**
+ * Add a downloaded media to the archive. The key is appended to the file right away.
+ *
+ * @param[in] key the line of the media, a key from getKey followed by the formats and the output folder
+ * @return false if the key cannot be written
+ */
+bool DownloadArchive::add(const std::string& key)
+{
+	const std::string_view trimmed = trimLine(key);
+	if (trimmed.empty() || trimmed.find('\n') != std::string_view::npos)
+		return false;
+
+	std::unique_lock<std::mutex> lk(mMutex);
+	if (containsLocked(trimmed))
+		return true;
+
+	std::string line = (mNeedsLineBreak ? "\n" : "") + std::string(trimmed) + "\n";
+	DWORD written = 0;
+	if (!WriteFile(mFile, line.data(), static_cast<DWORD>(line.size()), &written, NULL) || written != line.size())
+		return false;
+	mNeedsLineBreak = false;
+
+	mAdded.emplace(trimmed);
+	if (mSortedLines.size() + mAdded.size() > mBloomCapacity)
+		resizeBloom(mBloomCapacity * 2);
+	else
+		addToBloom(trimmed);
+	return true;
+}
+
+/**
+ * Get the number of keys in the archive
+ *
+ * @return the number of keys, a key that is in the file twice counts twice
+ */
+size_t DownloadArchive::size()
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	return mSortedLines.size() + mAdded.size();
+}
+
+/**
+ * Get the archive key of a media the way yt-dlp writes it to its --download-archive file
+ *
+ * @param[in] extractor the name of the yt-dlp extractor, e.g. Youtube
+ * @param[in] id the id of the media given by the extractor
+ * @return the key
+ */
+std::string DownloadArchive::getKey(const std::string& extractor, const std::string& id)
+{
+	std::string key = extractor;
+	std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return key + " " + id;
+}
+
+/**
+ * Get the archive key of a url without asking yt-dlp, for the sites where the id is part of the url
+ *
+ * @param[in] url the url of a single media
+ * @return the key, or nullopt if the url is not known or may be a playlist
+ */
+std::optional<std::string> DownloadArchive::getUrlKey(const std::string& url)
+{
+	// a video in a playlist downloads the playlist, so it has no id
+	const std::optional<canonicalUrl_t> canonical = UrlCanonicalizer::canonicalize(url);
+	if (!canonical || !canonical->extractor || !canonical->id)
+		return std::nullopt;
+	return getKey(*canonical->extractor, *canonical->id);
+}
+
+/**
+ * Get the archive key of a media from the info json that yt-dlp wrote for it
+ *
+ * @param[in] info the info json
+ * @return the key, or nullopt if the info is a playlist or has no id
+ */
+std::optional<std::string> DownloadArchive::getInfoKey(const json& info)
+{
+	if (!info.is_object() || info.value("_type", "video") == "playlist")
+		return std::nullopt;
+
+	auto extractor = info.find("extractor_key");
+	auto id = info.find("id");
+	if (extractor == info.end() || id == info.end() || !extractor->is_string() || !id->is_string())
+		return std::nullopt;
+	return getKey(extractor->get<std::string>(), id->get<std::string>());
+}
+
+/**
+ * Read the keys of an archive file that yt-dlp wrote, e.g. for a single command
+ *
+ * @param[in] path the archive file
+ * @return the keys, empty if the file does not exist
+ */
+std::unordered_set<std::string> DownloadArchive::readKeys(const std::filesystem::path& path)
+{
+	std::unordered_set<std::string> keys;
+	std::ifstream file(path, std::ios::binary);
+	std::string line;
+	while (std::getline(file, line))
+	{
+		const std::string_view key = trimLine(line);
+		if (!key.empty())
+			keys.emplace(key);
+	}
+	return keys;
+}
+
+/**
+ * Sort the lines of the view by their keys and build the bloom filter
+ */
+void DownloadArchive::indexView()
+{
+	for (size_t offset = 0; offset < mViewSize; )
+	{
+		const char* end = static_cast<const char*>(memchr(mView + offset, '\n', mViewSize - offset));
+		const size_t next = (end == nullptr) ? mViewSize : static_cast<size_t>(end - mView) + 1;
+		if (!getLine(offset).empty())
+			mSortedLines.push_back(offset);
+		offset = next;
+	}
+
+	std::sort(mSortedLines.begin(), mSortedLines.end(),
+		[this](const size_t a, const size_t b) { return getLine(a) < getLine(b); });
+
+	resizeBloom(std::max(MIN_BLOOM_CAPACITY, mSortedLines.size() * 2));
+}
+
+/**
+ * Get the key on a line of the view
+ *
+ * @param[in] offset the offset of the first character of the line
+ * @return the key, empty for a blank line
+ */
+std::string_view DownloadArchive::getLine(const size_t offset) const
+{
+	const char* end = static_cast<const char*>(memchr(mView + offset, '\n', mViewSize - offset));
+	const size_t length = (end == nullptr) ? mViewSize - offset : static_cast<size_t>(end - (mView + offset));
+	return trimLine(std::string_view(mView + offset, length));
+}
+
+/**
+ * Check if a key is in the archive, called with mMutex held
+ *
+ * @param[in] key the key
+ * @return true if the key is in the archive
+ */
+bool DownloadArchive::containsLocked(const std::string_view key) const
+{
+	if (!mayContain(key))
+		return false;
+	if (mAdded.count(std::string(key)) > 0)
+		return true;
+
+	auto it = std::lower_bound(mSortedLines.begin(), mSortedLines.end(), key,
+		[this](const size_t offset, const std::string_view value) { return getLine(offset) < value; });
+	return (it != mSortedLines.end()) && (getLine(*it) == key);
+}
+
+/**
+ * Rebuild the bloom filter for more keys, with every key of the archive
+ *
+ * @param[in] capacity the number of keys the filter is sized for
+ */
+void DownloadArchive::resizeBloom(const size_t capacity)
+{
+	mBloomCapacity = capacity;
+	mBloomBits.assign((capacity * BLOOM_BITS_PER_KEY + 63) / 64, 0);
+	for (const size_t offset : mSortedLines)
+		addToBloom(getLine(offset));
+	for (const auto& key : mAdded)
+		addToBloom(key);
+}
+
+/**
+ * Set the bits of a key in the bloom filter
+ *
+ * @param[in] key the key
+ */
+void DownloadArchive::addToBloom(const std::string_view key)
+{
+	// the hashes are derived from two, which is as good as independent hashes for a bloom filter
+	const uint64_t bitCount = mBloomBits.size() * 64;
+	const uint64_t h1 = hash(key, 0);
+	const uint64_t h2 = hash(key, h1) | 1;
+	for (uint32_t i = 0; i < BLOOM_HASH_COUNT; i++)
+	{
+		const uint64_t bit = (h1 + i * h2) % bitCount;
+		mBloomBits[bit / 64] |= (uint64_t(1) << (bit % 64));
+	}
+}
+
+/**
+ * Check the bits of a key in the bloom filter
+ *
+ * @param[in] key the key
+ * @return false if the key is certainly not in the archive
+ */
+bool DownloadArchive::mayContain(const std::string_view key) const
+{
+	const uint64_t bitCount = mBloomBits.size() * 64;
+	const uint64_t h1 = hash(key, 0);
+	const uint64_t h2 = hash(key, h1) | 1;
+	for (uint32_t i = 0; i < BLOOM_HASH_COUNT; i++)
+	{
+		const uint64_t bit = (h1 + i * h2) % bitCount;
+		if ((mBloomBits[bit / 64] & (uint64_t(1) << (bit % 64))) == 0)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Unmap the view and close the file
+ */
+void DownloadArchive::close()
+{
+	if (mView != nullptr)
+		UnmapViewOfFile(mView);
+	if (mMapping != NULL)
+		CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+	mView = nullptr;
+	mMapping = NULL;
+	mFile = INVALID_HANDLE_VALUE;
+}
+
+/**
+ * FNV-1a hash of a key, mixed with a seed
+ *
+ * @param[in] key the key
+ * @param[in] seed the seed
+ * @return the hash
+ */
+uint64_t DownloadArchive::hash(const std::string_view key, const uint64_t seed)
+{
+	uint64_t h = 14695981039346656037ull ^ seed;
+	for (const char c : key)
+	{
+		h ^= static_cast<unsigned char>(c);
+		h *= 1099511628211ull;
+	}
+	// spread the low entropy of short keys over all bits
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	return h;
+}
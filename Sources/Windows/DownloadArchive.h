@@ -0,0 +1,85 @@
+//==============================================================================
+/**
+@file       DownloadArchive.h
+
+@brief		Plugin wide archive of downloaded media. Each line is the yt-dlp archive key of a media,
+			followed by the formats and the output folder it was downloaded with.
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "../Vendor/json/src/json.hpp"
+using json = nlohmann::json;
+
+class DownloadArchive
+{
+public:
+	// bits of the bloom filter per key. With BLOOM_HASH_COUNT hashes about 1% of the keys that are not archived
+	// have to be looked up in the file.
+	static constexpr uint32_t BLOOM_BITS_PER_KEY = 10;
+	static constexpr uint32_t BLOOM_HASH_COUNT = 7;
+	// the bloom filter is sized for at least this many keys, it is rebuilt twice as big once it is full
+	static constexpr size_t MIN_BLOOM_CAPACITY = 1024;
+
+	/**
+	 * Open the archive and index its keys. The file is mapped, so its keys are not copied into memory.
+	 *
+	 * @param[in] path the archive file, created if it does not exist
+	 * @throws runtime_error if the archive cannot be opened
+	 */
+	DownloadArchive(const std::filesystem::path& path);
+	~DownloadArchive();
+
+	DownloadArchive(const DownloadArchive&) = delete;
+	DownloadArchive& operator=(const DownloadArchive&) = delete;
+
+	bool contains(const std::string& key);
+	bool add(const std::string& key);
+	size_t size();
+
+	static std::string getKey(const std::string& extractor, const std::string& id);
+	static std::optional<std::string> getUrlKey(const std::string& url);
+	static std::optional<std::string> getInfoKey(const json& info);
+	static std::unordered_set<std::string> readKeys(const std::filesystem::path& path);
+private:
+	const std::filesystem::path mPath;
+
+	std::mutex mMutex;
+	// opened for reading and appending. The view holds the file as it was opened, later keys are only in mAdded.
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = NULL;
+	const char* mView = nullptr;
+	size_t mViewSize = 0;
+	// offsets of the lines in the view, sorted by their keys, so a key is found with a binary search
+	std::vector<size_t> mSortedLines;
+	std::unordered_set<std::string> mAdded;
+	// the last line of the file has no line break yet, e.g. after a crash or an edit by hand
+	bool mNeedsLineBreak = false;
+
+	// most lookups of keys that are not archived end here, without touching the view
+	std::vector<uint64_t> mBloomBits;
+	size_t mBloomCapacity = 0;
+
+	void indexView();
+	std::string_view getLine(const size_t offset) const;
+	bool containsLocked(const std::string_view key) const;
+	void resizeBloom(const size_t capacity);
+	void addToBloom(const std::string_view key);
+	bool mayContain(const std::string_view key) const;
+	void close();
+
+	static uint64_t hash(const std::string_view key, const uint64_t seed);
+};
@@ -0,0 +1,1491 @@
+//==============================================================================
+/**
+@file       DownloadJob.cpp
+
+@brief		A single youtube-dl download request, executed by the DownloadScheduler
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "pch.h"
+
+#include "DownloadJob.h"
+#include "BandwidthBudget.h"
+#include "YoutubeDlUtils.h"
+#include "RedditDlUtils.h"
+#include "CurlUtils.hpp"
+#include "WindowsProcessUtils.h"
+#include "ProcessWaiter.h"
+#include "FileUtils.h"
+#include "OutputReader.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <future>
+#include <queue>
+#include <unordered_set>
+
+/**
+ * Helper function to update mData, move it to results, and exit download process
+ *
+ * @param[in] logMsg optional message to log
+ * @param[in] errMsg optional message to display on the button
+ * @param[in] newState the final state of this job
+ */
+void DownloadJob::exitDownloadProcess(const std::optional<std::string>& logMsg,
+	const std::optional<std::string>& errMsg,
+	const status_t newState)
+{
+	std::unique_lock<std::mutex>lk(mDataMutex);
+
+	// Each job must publish exactly one result, otherwise the pending count of the context goes out of sync.
+	assert(mExited == false);
+	if (mExited)
+		return;
+	mExited = true;
+
+	// update mData;
+	if (logMsg)
+		mData.log = *logMsg;
+	if (errMsg)
+		mData.buttonMsg = *errMsg;
+	mData.status = newState;
+
+	mState = newState;
+
+	// publish if not detached. The context and job id are plain values, so they stay valid after the move.
+	{
+		std::unique_lock<std::mutex>cmdLk(mCommandMutex);
+		flags_t flag = mCommand.load();
+		if (flag != DETACH)
+		{
+			// every waiter counts the result as the end of its own press
+			for (const auto& waiter : mWaiters)
+			{
+				threadData_t waiterData = mData;
+				waiterData.context = waiter.context;
+				waiterData.jobId = waiter.jobId;
+				mResults.push(std::move(waiterData));
+			}
+			if (!mOwnerDetached)
+				mResults.push(std::move(mData));
+		}
+	}
+}
+
+/**
+ * Attach another press of the same download to this job. Its context gets a copy of every result of the job,
+ * under its own job id.
+ *
+ * @param[in] context handle of the button context of the press
+ * @param[in] jobId the id of the press, e.g. the id it was journaled with
+ * @return false if the job was killed or already published its final result, the press has to run on its own then
+ */
+bool DownloadJob::attach(const contextHandle_t context, const uint64_t jobId)
+{
+	std::unique_lock<std::mutex>lk(mDataMutex);
+	// a killed job publishes a failure, which is not what the new press asked for
+	if (mExited || mKilled.load())
+		return false;
+	mWaiters.push_back({ context, jobId });
+	return true;
+}
+
+/**
+ * Check if this job publishes its results to a context, as the job of the context or as a job it is attached to
+ *
+ * @param[in] context handle of the button context
+ * @return true if the context gets the results of this job
+ */
+bool DownloadJob::hasContext(const contextHandle_t context)
+{
+	std::unique_lock<std::mutex>lk(mDataMutex);
+	if (!mOwnerDetached && mData.context == context)
+		return true;
+	return std::any_of(mWaiters.begin(), mWaiters.end(), [&](const waiter_t& waiter) { return waiter.context == context; });
+}
+
+/**
+ * Get the contexts this job publishes its results to
+ *
+ * @return the context of the job, followed by the contexts attached to it
+ */
+std::vector<contextHandle_t> DownloadJob::getContexts()
+{
+	std::unique_lock<std::mutex>lk(mDataMutex);
+	std::vector<contextHandle_t> contexts;
+	if (!mOwnerDetached)
+		contexts.push_back(mData.context);
+	for (const auto& waiter : mWaiters)
+		contexts.push_back(waiter.context);
+	return contexts;
+}
+
+/**
+ * Stop publishing the results of this job to a context whose button was killed, while the job keeps running
+ * for the other contexts it serves. The presses of the context get a cancelled result right away.
+ *
+ * @param[in] context handle of the button context
+ * @return true if no other context gets the results of this job, the job has to be killed then
+ */
+bool DownloadJob::detachContext(const contextHandle_t context)
+{
+	std::unique_lock<std::mutex>lk(mDataMutex);
+	const bool ownerStays = !mOwnerDetached && mData.context != context;
+	const bool waiterStays = std::any_of(mWaiters.begin(), mWaiters.end(), [&](const waiter_t& waiter) { return waiter.context != context; });
+	// a killed job publishes its failure to the context itself
+	if (mExited || !(ownerStays || waiterStays))
+		return true;
+
+	std::vector<uint64_t> jobIds;
+	if (!mOwnerDetached && mData.context == context)
+	{
+		mOwnerDetached = true;
+		jobIds.push_back(mData.jobId);
+	}
+	for (auto it = mWaiters.begin(); it != mWaiters.end();)
+	{
+		if (it->context == context)
+		{
+			jobIds.push_back(it->jobId);
+			it = mWaiters.erase(it);
+		}
+		else
+			it++;
+	}
+
+	std::unique_lock<std::mutex>cmdLk(mCommandMutex);
+	if (mCommand.load() == DETACH)
+		return false;
+	for (const uint64_t jobId : jobIds)
+	{
+		threadData_t cancelledData;
+		cancelledData.log = "Download killed, the job keeps running for other buttons: " + mUrl;
+		cancelledData.buttonMsg = (mDoUpdate ? std::string("Update") : std::string("Download")) + "\ncancelled";
+		cancelledData.status = FAILED;
+		cancelledData.context = context;
+		cancelledData.jobId = jobId;
+		mResults.push(std::move(cancelledData));
+	}
+	return false;
+}
+
+/**
+ * Cancel a job that is still waiting in the scheduler queue. Publishes a failure result.
+ */
+void DownloadJob::cancel()
+{
+	status_t testVal = QUEUED;
+	if (!mState.compare_exchange_strong(testVal, STOPPING))
+		return;
+
+	exitDownloadProcess("Download cancelled before it started: " + mUrl,
+		(mDoUpdate ? std::string("Update") : std::string("Download")) + "\ncancelled", FAILED);
+}
+
+/**
+ * Check if this job may share a youtube-dl process with other jobs.
+ * Updates, reddit downloads and custom commands always run on their own.
+ *
+ * @return true if the job can be batched
+ */
+bool DownloadJob::isBatchable() const
+{
+	// a job that adopts processes waits for them first, a batch would not wait
+	return !mDoUpdate && !mSettings.attemptRedditDl && !mSettings.downloadFormats.empty() &&
+		(!mSettings.customCommand || mSettings.customCommand->empty()) && mAdopted.empty();
+}
+
+/**
+ * Check if two jobs produce the same youtube-dl commands apart from their urls, so they can run as one batch
+ *
+ * @param[in] other the other job
+ * @return true if both jobs can share a batch
+ */
+bool DownloadJob::canBatchWith(const DownloadJob& other) const
+{
+	const contextSettings_t& a = mSettings;
+	const contextSettings_t& b = other.mSettings;
+	return isBatchable() && other.isBatchable() &&
+		a.youtubeDlExePath == b.youtubeDlExePath &&
+		a.outputFolder == b.outputFolder &&
+		a.maxDownloads == b.maxDownloads &&
+		a.downloadFormats == b.downloadFormats &&
+		a.maxParallelCommands == b.maxParallelCommands &&
+		// the batch runs in the job object of its lead
+		a.childPriority == b.childPriority &&
+		a.maxMemoryMB == b.maxMemoryMB &&
+		a.maxCpuPercent == b.maxCpuPercent &&
+		a.queuePriority == b.queuePriority;
+}
+
+/**
+ * Hand a queued job over to the batch of another job. The batch lead publishes the result of this job.
+ *
+ * @param[in] batchLead the job that runs the batch
+ * @return false if the job was already started or cancelled
+ */
+bool DownloadJob::joinBatch(const std::shared_ptr<DownloadJob>& batchLead)
+{
+	status_t testVal = QUEUED;
+	if (!mState.compare_exchange_strong(testVal, SETUP))
+		return false;
+
+	std::unique_lock<std::mutex> lk{ mCommandMutex };
+	mBatchLead = batchLead;
+	return true;
+}
+
+/**
+ * Kill this job. A job that runs its own processes stops them right away. The jobs of a batch share
+ * the processes of the batch lead, so those only stop once every job of the batch was killed.
+ * Until then a killed job of a batch is reported as cancelled when the batch ends.
+ */
+void DownloadJob::kill()
+{
+	std::shared_ptr<DownloadJob> batchLead = nullptr;
+	{
+		std::unique_lock<std::mutex> lk{ mCommandMutex };
+		mKilled = true;
+		batchLead = mBatchLead.lock();
+	}
+	if (batchLead != nullptr)
+		batchLead->killIfBatchKilled();
+	else
+		killIfBatchKilled();
+}
+
+/**
+ * Stop the processes of this job if this job and every job batched into it were killed
+ */
+void DownloadJob::killIfBatchKilled()
+{
+	std::unique_lock<std::mutex> lk{ mCommandMutex };
+	if (!mKilled.load() || std::any_of(mBatch.begin(), mBatch.end(),
+		[](const std::shared_ptr<DownloadJob>& job) { return !job->mKilled.load(); }))
+		return;
+
+	mCommand = KILL;
+	// the whole process tree is in the job, so this stops ffmpeg as well
+	if ((mState.load() == RUNNING || isPaused()) && mProcessJob != nullptr)
+		mProcessJob->terminate(0);
+}
+
+/**
+ * Check if the output folder exists. std::filesystem can throw an error, so catch that too.
+ *
+ * @return the log and button messages if the folder is not usable
+ */
+std::optional<std::pair<std::string, std::string>> DownloadJob::checkOutputFolder() const
+{
+	try
+	{
+		if (mSettings.outputFolder && !std::filesystem::exists(*mSettings.outputFolder))
+			return std::make_pair("Invalid output folder: " + *mSettings.outputFolder, std::string("Missing\noutput folder"));
+	}
+	catch (std::filesystem::filesystem_error& e)
+	{
+		return std::make_pair("Output folder filesystem error: " + *mSettings.outputFolder + "\n" + std::string(e.what()),
+			std::string("Invalid\noutput folder"));
+	}
+	return std::nullopt;
+}
+
+/**
+ * Launch the youtube-dl processes for this job. Blocks until done, and is called from a scheduler worker thread.
+ *
+ * @param[in] batch queued jobs that can be batched with this one. Their urls are downloaded by the same processes,
+ *                  and this job publishes their results.
+ */
+void DownloadJob::run(const std::vector<std::shared_ptr<DownloadJob>>& batch)
+{
+	status_t testVal = QUEUED;
+	if (!mState.compare_exchange_strong(testVal, SETUP))
+		return;
+
+	if (!mAdopted.empty())
+		adoptProcesses();
+
+	// the media was downloaded before, by this button or by another one
+	if (isArchived(DownloadArchive::getUrlKey(mUrl)))
+	{
+		exitDownloadProcess("Already downloaded: " + mUrl, std::string("Already\nhave"), SUCCESS);
+		return;
+	}
+
+	std::vector<std::shared_ptr<DownloadJob>> archived;
+	{
+		// a kill only stops the batch once it sees every job of it
+		std::unique_lock<std::mutex> lk{ mCommandMutex };
+		for (const auto& job : batch)
+		{
+			if (job.get() == this || !canBatchWith(*job))
+				continue;
+			if (job->isArchived(DownloadArchive::getUrlKey(job->mUrl)))
+				archived.push_back(job);
+			else if (job->joinBatch(shared_from_this()))
+				mBatch.push_back(job);
+		}
+	}
+	// an archived job finishes right away instead of joining
+	for (const auto& job : archived)
+		job->run();
+	if (!mBatch.empty())
+	{
+		// the jobs may have been killed before they joined
+		killIfBatchKilled();
+		runBatch();
+		return;
+	}
+
+	const std::string& url = mUrl;
+	const contextSettings_t& data = mSettings;
+	const bool doUpdate = mDoUpdate;
+
+	// the commands run up to maxParallelCommands at a time
+	uint32_t maxParallel = 1;
+	if (!doUpdate && data.maxParallelCommands)
+		maxParallel = std::clamp<uint32_t>(*data.maxParallelCommands, 1, MAX_PARALLEL_COMMANDS);
+
+	// construct command strings
+	std::vector<std::string> cmds;
+	try
+	{
+		if (doUpdate)
+			cmds.push_back(" --update");
+		else
+		{
+			cmds = youtubedlutils::getCommandQueue(url, data.outputFolder, std::nullopt, data.maxDownloads, data.downloadFormats, data.customCommand,
+				std::nullopt, maxParallel > 1);
+		}
+	}
+	catch (std::runtime_error& e)
+	{
+		exitDownloadProcess("Download failed building commands:\n" + std::string(e.what()),
+			(doUpdate ? std::string("Update") : std::string("Download")) + "\nfailed", FAILED);
+		return;
+	}
+
+	// check if output folder exists
+	if (!doUpdate)
+	{
+		if (auto folderError = checkOutputFolder())
+		{
+			exitDownloadProcess(folderError->first, folderError->second, FAILED);
+			return;
+		}
+	}
+
+	// try to download reddit link
+	if (!doUpdate && data.attemptRedditDl)
+	{
+		bool success = false;
+		std::string errMsg;
+		try
+		{
+			mState = RUNNING;
+			const std::string postId = redditdlutils::downloadRedditContent(url, youtubedlutils::getOutputFolderName(data.outputFolder));
+			if (usesArchive())
+				mArchive->add(getArchiveKey(DownloadArchive::getKey("reddit", postId)));
+			success = true;
+		}
+		catch (std::exception& e)
+		{
+			errMsg = "Image download failed:\n" + std::string(e.what());
+		}
+
+		// if image dl was successful, no need to call youtube-dl, just exit as success
+		if (success == true)
+		{
+			mState = STOPPING;
+			exitDownloadProcess(std::nullopt, std::nullopt, SUCCESS);
+			return;
+		}
+		else if (cmds.size() == 0)
+		{
+			// if we are only trying to download images and are not calling youtube-dl, but we failed,
+			// then return error messages
+			mState = STOPPING;
+			exitDownloadProcess(errMsg,
+				"Image download\nfailed", FAILED);
+			return;
+		}
+	}
+
+	const std::filesystem::path exePath = youtubedlutils::getDownloaderExePath(data.youtubeDlExePath);
+	mState = RUNNING;
+
+	// extract the url once and let every format command load the result, instead of each one extracting it again
+	std::optional<std::filesystem::path> infoJsonPath = std::nullopt;
+	if (!doUpdate && youtubedlutils::shouldResolve(data.downloadFormats))
+	{
+		infoJsonPath = resolveInfoJson(exePath);
+		if (infoJsonPath)
+			cmds = youtubedlutils::getCommandQueue(url, data.outputFolder, std::nullopt, data.maxDownloads, data.downloadFormats, data.customCommand,
+				infoJsonPath->string(), maxParallel > 1);
+	}
+
+	// the url did not tell which media it is, but the extracted metadata does
+	if (infoJsonPath && !DownloadArchive::getUrlKey(url) && mArchive != nullptr && data.skipDownloaded)
+	{
+		std::optional<std::string> infoKey = std::nullopt;
+		try
+		{
+			std::ifstream infoJsonFile(*infoJsonPath);
+			infoKey = DownloadArchive::getInfoKey(json::parse(infoJsonFile));
+		}
+		catch (json::exception&)
+		{
+			infoKey = std::nullopt;
+		}
+
+		if (isArchived(infoKey))
+		{
+			mState = STOPPING;
+			std::error_code ec;
+			std::filesystem::remove(*infoJsonPath, ec);
+			exitDownloadProcess("Already downloaded: " + url, std::string("Already\nhave"), SUCCESS);
+			return;
+		}
+	}
+
+	// only the format commands are archived, a custom command may download anything
+	const std::vector<std::filesystem::path> archivePaths = addArchiveArgs(cmds, data.downloadFormats.size());
+	std::vector<commandResult_t> commandResults = runCommands(cmds, exePath, maxParallel);
+	mState = STOPPING;
+	archiveDownloaded(archivePaths);
+
+	if (infoJsonPath)
+	{
+		std::error_code ec;
+		std::filesystem::remove(*infoJsonPath, ec);
+	}
+
+	exitWithCommandResults(commandResults, getResourceUsage());
+}
+
+/**
+ * Publish the final result of this job from the results of its youtube-dl commands
+ *
+ * @param[in] commandResults the result of each command that was started
+ * @param[in] resourceUsage the resources used by the processes that ran the commands
+ */
+void DownloadJob::exitWithCommandResults(const std::vector<commandResult_t>& commandResults,
+	const std::optional<resourceUsage_t>& resourceUsage)
+{
+	const bool doUpdate = mDoUpdate;
+
+	// collect the failures of each command
+	std::string failureLog;
+	const commandResult_t* firstFailure = nullptr;
+	uint32_t failureCount = 0;
+	for (const auto& result : commandResults)
+	{
+		if (result.success)
+			continue;
+		failureCount++;
+		if (firstFailure == nullptr)
+			firstFailure = &result;
+		failureLog += "yt-dlp failed:" + result.cmd + "\n" + result.error.value_or("") + "\n";
+	}
+
+	{
+		std::unique_lock<std::mutex>lk(mDataMutex);
+		mData.commandResults = commandResults;
+		mData.resourceUsage = resourceUsage;
+	}
+
+	if (doUpdate)
+		if (failureCount > 0)
+			exitDownloadProcess(failureLog, firstFailure->buttonMsg, FAILED);
+		else if (mCommand.load() != KILL)
+			exitDownloadProcess("yt-dlp updated.", "Update\nfinished", UPDATED);
+		else
+			exitDownloadProcess("Warning! yt-dlp update was interrupted.", "Update\ninterrupted", FAILED);
+	else if (failureCount == 0)
+		exitDownloadProcess(std::nullopt, std::nullopt, SUCCESS);
+	else if (failureCount == static_cast<uint32_t>(commandResults.size()))
+		exitDownloadProcess(failureLog, firstFailure->buttonMsg, FAILED);
+	else
+		exitDownloadProcess(failureLog, std::to_string(failureCount) + "/" + std::to_string(commandResults.size()) + " formats\nfailed", FAILED);
+}
+
+/**
+ * Download the urls of this job and of every batched job with one youtube-dl process per format.
+ * The outcome of each url is read back from the done files and published to the job it came from.
+ */
+void DownloadJob::runBatch()
+{
+	const contextSettings_t& data = mSettings;
+
+	// every job of the batch, this job first
+	std::vector<DownloadJob*> jobs = { this };
+	for (const auto& job : mBatch)
+		jobs.push_back(job.get());
+
+	if (auto folderError = checkOutputFolder())
+	{
+		for (DownloadJob* job : jobs)
+			job->exitDownloadProcess(folderError->first, folderError->second, FAILED);
+		return;
+	}
+
+	// yt-dlp strips the lines of the batch file, so the done file holds the trimmed urls
+	auto trim = [](const std::string& s)
+	{
+		const size_t first = s.find_first_not_of(" \t\r\n");
+		if (first == std::string::npos)
+			return std::string();
+		return s.substr(first, s.find_last_not_of(" \t\r\n") - first + 1);
+	};
+
+	std::vector<std::filesystem::path> tempFiles;
+	auto removeTempFiles = [&]()
+	{
+		std::error_code ec;
+		for (const auto& path : tempFiles)
+			std::filesystem::remove(path, ec);
+	};
+
+	uint32_t maxParallel = 1;
+	if (data.maxParallelCommands)
+		maxParallel = std::clamp<uint32_t>(*data.maxParallelCommands, 1, MAX_PARALLEL_COMMANDS);
+
+	// write the batch file and build one command per format, each with its own done file
+	std::vector<std::string> cmds;
+	try
+	{
+		const std::filesystem::path batchFilePath = fileutils::getTempFilePath(".batch.txt");
+		tempFiles.push_back(batchFilePath);
+		std::ofstream batchFile(batchFilePath);
+		for (DownloadJob* job : jobs)
+			batchFile << trim(job->mUrl) << "\n";
+		batchFile.close();
+		if (!batchFile)
+			throw std::runtime_error("Cannot write batch file: " + batchFilePath.string());
+
+		for (const auto& format : data.downloadFormats)
+		{
+			const std::filesystem::path doneFilePath = fileutils::getTempFilePath(".done.txt");
+			tempFiles.push_back(doneFilePath);
+			cmds.push_back(youtubedlutils::getBatchCommand(batchFilePath.string(), doneFilePath.string(), data.outputFolder, data.maxDownloads, format,
+				maxParallel > 1 && data.downloadFormats.size() > 1));
+		}
+	}
+	catch (std::exception& e)
+	{
+		removeTempFiles();
+		for (DownloadJob* job : jobs)
+			job->exitDownloadProcess("Download failed building batch commands:\n" + std::string(e.what()), "Download\nfailed", FAILED);
+		return;
+	}
+
+	const std::vector<std::filesystem::path> archivePaths = addArchiveArgs(cmds, cmds.size());
+	for (DownloadJob* job : jobs)
+		job->mState = RUNNING;
+	std::vector<commandResult_t> commandResults = runCommands(cmds, youtubedlutils::getDownloaderExePath(data.youtubeDlExePath), maxParallel);
+	for (DownloadJob* job : jobs)
+		job->mState = STOPPING;
+	archiveDownloaded(archivePaths);
+
+	// the commands are started in order, so the started ones line up with the first done files
+	std::vector<std::unordered_set<std::string>> doneUrls(commandResults.size());
+	for (size_t i = 0; i < commandResults.size(); i++)
+	{
+		std::ifstream doneFile(tempFiles[i + 1]);
+		std::string line;
+		while (std::getline(doneFile, line))
+			doneUrls[i].insert(trim(line));
+	}
+	removeTempFiles();
+
+	// the jobs of a batch share the processes, so each one reports what the whole batch used
+	const std::optional<resourceUsage_t> resourceUsage = getResourceUsage();
+
+	// a command fails as a whole if any of its urls failed, so judge each url by the done files instead
+	for (DownloadJob* job : jobs)
+	{
+		const std::string url = trim(job->mUrl);
+		// the other jobs kept the process running, but this press asked to stop
+		if (job->mKilled.load())
+		{
+			job->exitDownloadProcess("Download killed in batch: " + url, std::string("Download\ncancelled"), FAILED);
+			continue;
+		}
+
+		std::vector<commandResult_t> jobResults = commandResults;
+		for (size_t i = 0; i < jobResults.size(); i++)
+		{
+			commandResult_t& result = jobResults[i];
+			result.success = (doneUrls[i].count(url) > 0);
+			if (result.success)
+			{
+				result.error = std::nullopt;
+				result.buttonMsg = std::nullopt;
+			}
+			else
+			{
+				result.error = "Not downloaded by batch: " + url + "\n" + result.error.value_or("");
+				if (!result.buttonMsg)
+					result.buttonMsg = "Download\nfailed";
+			}
+		}
+		job->exitWithCommandResults(jobResults, resourceUsage);
+	}
+}
+
+/**
+ * Get the key a media is archived with by this job. A media only counts as downloaded
+ * in the formats and to the output folder it was downloaded with.
+ *
+ * @param[in] mediaKey the archive key of the media, from DownloadArchive::getKey
+ * @return the key followed by the formats and the output folder of this job
+ */
+std::string DownloadJob::getArchiveKey(const std::string& mediaKey) const
+{
+	return mediaKey + " " + youtubedlutils::getFormatsKey(mSettings.downloadFormats) + " " +
+		youtubedlutils::getOutputFolderKey(mSettings.outputFolder);
+}
+
+/**
+ * Check if a media is in the archive and this job skips archived media
+ *
+ * @param[in] key the archive key of the media, nullopt if it is not known
+ * @return true if the media does not have to be downloaded
+ */
+bool DownloadJob::isArchived(const std::optional<std::string>& key) const
+{
+	return usesArchive() && mSettings.skipDownloaded && key && mArchive->contains(getArchiveKey(*key));
+}
+
+/**
+ * Let the first commands record the media they download, each in an archive file of its own.
+ * The shared archive is not passed to yt-dlp, otherwise the second format of a media would be skipped.
+ *
+ * @param[in,out] cmds the commands
+ * @param[in] count the number of commands to archive
+ * @return the archive files of the commands, empty if the job does not record what it downloads
+ */
+std::vector<std::filesystem::path> DownloadJob::addArchiveArgs(std::vector<std::string>& cmds, const size_t count) const
+{
+	std::vector<std::filesystem::path> archivePaths;
+	if (!usesArchive())
+		return archivePaths;
+
+	try
+	{
+		for (size_t i = 0; i < count && i < cmds.size(); i++)
+			archivePaths.push_back(fileutils::getTempFilePath(".archive.txt"));
+	}
+	catch (std::filesystem::filesystem_error&)
+	{
+		return {};
+	}
+
+	for (size_t i = 0; i < archivePaths.size(); i++)
+		cmds[i] += youtubedlutils::getArchiveArgs(archivePaths[i].string());
+	return archivePaths;
+}
+
+/**
+ * Add the media that every command downloaded to the shared archive, and delete the archive files of the commands
+ *
+ * @param[in] archivePaths the archive files of the commands, from addArchiveArgs
+ */
+void DownloadJob::archiveDownloaded(const std::vector<std::filesystem::path>& archivePaths)
+{
+	if (archivePaths.empty())
+		return;
+
+	// a media is only complete once each of its formats was downloaded
+	std::unordered_set<std::string> keys = DownloadArchive::readKeys(archivePaths[0]);
+	for (size_t i = 1; i < archivePaths.size(); i++)
+	{
+		const std::unordered_set<std::string> formatKeys = DownloadArchive::readKeys(archivePaths[i]);
+		for (auto it = keys.begin(); it != keys.end(); )
+			it = (formatKeys.count(*it) > 0) ? std::next(it) : keys.erase(it);
+	}
+	for (const auto& key : keys)
+		mArchive->add(getArchiveKey(key));
+
+	std::error_code ec;
+	for (const auto& path : archivePaths)
+		std::filesystem::remove(path, ec);
+}
+
+/**
+ * Extract the metadata of the url once and write it to a temporary info json file.
+ * Any failure is not reported, the format commands then fall back to extracting the url themselves.
+ *
+ * @param[in] exePath path to the downloader exe
+ * @return path to the info json, or nullopt if the url could not be resolved
+ */
+std::optional<std::filesystem::path> DownloadJob::resolveInfoJson(const std::filesystem::path& exePath)
+{
+	std::filesystem::path infoJsonPath;
+	try
+	{
+		infoJsonPath = fileutils::getTempFilePath(".info.json");
+	}
+	catch (std::filesystem::filesystem_error&)
+	{
+		return std::nullopt;
+	}
+
+	// the child writes the json straight into the file, so the handle has to be inheritable
+	SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+	HANDLE hFile = CreateFile(infoJsonPath.wstring().c_str(), GENERIC_WRITE, FILE_SHARE_READ, &sa,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return std::nullopt;
+
+	bool success = false;
+	bool closed = false;
+	PROCESS_INFORMATION pi = {};
+	try
+	{
+		{
+			std::unique_lock<std::mutex> lk{ mCommandMutex };
+			if (mCommand.load() == KILL)
+				throw std::runtime_error("Job was killed before resolving.");
+
+			// placed in the job like a download, so a kill terminates it too
+			pi = windowsprocessutils::startProcess(exePath, youtubedlutils::getResolveCommand(mUrl, mSettings.maxDownloads), hFile,
+				NULL, getProcessJob(lk));
+			if (mSuspended)
+				mProcessJob->suspend();
+		}
+
+		ProcessWaiter::getInstance().wait(pi.hProcess);
+
+		// throws if the exit code is not 0
+		closed = true;
+		windowsprocessutils::closeProcess(pi);
+
+		LARGE_INTEGER size = {};
+		success = GetFileSizeEx(hFile, &size) && size.QuadPart > 0 && mCommand.load() != KILL;
+	}
+	catch (std::exception&)
+	{
+		success = false;
+		if (pi.hProcess != NULL && !closed)
+		{
+			TerminateProcess(pi.hProcess, 1);
+			CloseHandle(pi.hProcess);
+			CloseHandle(pi.hThread);
+		}
+	}
+	CloseHandle(hFile);
+
+	if (!success)
+	{
+		std::error_code ec;
+		std::filesystem::remove(infoJsonPath, ec);
+		return std::nullopt;
+	}
+	return infoJsonPath;
+}
+
+/**
+ * Run a list of independent youtube-dl commands. A failed command does not stop the others.
+ * The output of each command is captured through a pipe and parsed for progress on the output reader thread.
+ *
+ * @param[in] cmds the commands to run
+ * @param[in] exePath path to the downloader exe
+ * @param[in] maxParallel the maximum number of commands running at the same time, 1 runs them sequentially
+ * @return the result of each command that was started, in the same order as cmds
+ */
+std::vector<DownloadJob::commandResult_t> DownloadJob::runCommands(const std::vector<std::string>& cmds,
+	const std::filesystem::path& exePath, const uint32_t maxParallel)
+{
+	typedef std::chrono::steady_clock steadyClock_t;
+
+	std::vector<commandResult_t> results(cmds.size());
+	std::vector<bool> started(cmds.size(), false);
+
+	// records a command failure with a button message based on the exception type
+	auto recordFailure = [&](const size_t index, const std::exception_ptr& error)
+	{
+		results[index].success = false;
+		try
+		{
+			std::rethrow_exception(error);
+		}
+		catch (std::filesystem::filesystem_error& e)
+		{
+			results[index].error = e.what();
+			results[index].buttonMsg = "Invalid path to\nyt-dlp.exe";
+		}
+		catch (std::invalid_argument& e)
+		{
+			results[index].error = e.what();
+			results[index].buttonMsg = "Missing\nyt-dlp.exe";
+		}
+		catch (std::exception& e)
+		{
+			results[index].error = e.what();
+			results[index].buttonMsg = (mDoUpdate ? std::string("Update") : std::string("Download")) + "\nfailed";
+		}
+	};
+
+	{
+		std::unique_lock<std::mutex> lk(mProgressMutex);
+		mCommandProgress.assign(cmds.size(), {});
+	}
+
+	// a command is done once its process exited and its output pipe is drained, in any order
+	struct commandState_t
+	{
+		std::unique_ptr<ProgressParser> parser = nullptr;
+		OutputReader::pipeId_t pipeId = 0;
+		uint32_t outstanding = 0;
+		std::optional<steadyClock_t::time_point> drainDeadline = std::nullopt;
+		bool pipeCancelled = false;
+		// share of the plugin wide bandwidth limit, held until the process exits
+		BandwidthBudget::Lease bandwidth;
+		// the rate the running process was started with
+		uint64_t startedRate = 0;
+		// the running process, it is terminated and started again with --continue when its share changed
+		std::optional<PROCESS_INFORMATION> process = std::nullopt;
+		bool restarting = false;
+		// file the output goes to instead of a pipe, if the process is journaled
+		std::optional<std::filesystem::path> outputPath = std::nullopt;
+		// files of the processes that were restarted, removed once the command is done
+		std::vector<std::filesystem::path> staleOutputPaths;
+	};
+	std::vector<commandState_t> states(cmds.size());
+
+	// process exits, closed pipes and changed shares of the bandwidth limit, filled by other threads
+	struct event_t
+	{
+		size_t index;
+		std::optional<PROCESS_INFORMATION> exitedProcess;
+		bool rateChanged = false;
+	};
+	std::mutex finishedMutex;
+	std::condition_variable finishedCv;
+	std::queue<event_t> finished;
+	auto pushEvent = [&](event_t ev)
+	{
+		std::unique_lock<std::mutex> finishedLk(finishedMutex);
+		finished.push(ev);
+		finishedCv.notify_all();
+	};
+
+	// start the process of a command with the current share of the bandwidth limit, a restarted one continues the
+	// partial files of the process it replaces
+	auto startProcess = [&](const size_t index, const std::unique_lock<std::mutex>& lk)
+	{
+		commandState_t& state = states[index];
+		PROCESS_INFORMATION pi = {};
+		try
+		{
+			ProgressParser* parser = state.parser.get();
+			auto onData = [this, parser, index](const char* data, const size_t size)
+			{
+				if (parser->feed(data, size))
+					onProgress(index, parser->getProgress());
+			};
+			auto onClosed = [&pushEvent, index]() { pushEvent({ index, std::nullopt }); };
+
+			OutputReader::pipe_t pipe;
+			if (isJournaled())
+			{
+				// a pipe breaks once the plugin exits, a file can still be written by a process that is adopted later
+				if (state.outputPath)
+					state.staleOutputPaths.push_back(*state.outputPath);
+				state.outputPath = fileutils::getTempFilePath(".output.txt");
+				pipe = OutputReader::getInstance().openFile(*state.outputPath, onData, onClosed, true);
+			}
+			else
+				pipe = OutputReader::getInstance().openPipe(onData, onClosed);
+			state.pipeId = pipe.id;
+			state.outstanding++;
+
+			state.startedRate = state.bandwidth.getRate();
+			const std::string cmd = (state.restarting ? " --continue" : "") +
+				youtubedlutils::getRateLimitArgs(state.startedRate) + cmds[index];
+
+			// stdout and stderr share the pipe, the child only holds the write end
+			try
+			{
+				pi = windowsprocessutils::startProcess(exePath, cmd, pipe.childEnd, pipe.childEnd, getProcessJob(lk));
+			}
+			catch (std::exception&)
+			{
+				OutputReader::closeChildEnd(pipe.childEnd);
+				throw;
+			}
+			OutputReader::closeChildEnd(pipe.childEnd);
+			if (mSuspended)
+				mProcessJob->suspend();
+			if (state.outputPath)
+				recordProcess(pi, *state.outputPath);
+
+			ProcessWaiter::getInstance().watch(pi.hProcess, [&pushEvent, index, pi]() { pushEvent({ index, pi }); });
+			state.outstanding++;
+			state.process = pi;
+		}
+		catch (std::exception&)
+		{
+			// don't leave a child running that nobody waits for
+			if (pi.hProcess != NULL)
+			{
+				TerminateProcess(pi.hProcess, 1);
+				CloseHandle(pi.hProcess);
+				CloseHandle(pi.hThread);
+			}
+			throw;
+		}
+	};
+
+	size_t next = 0;
+	uint32_t active = 0;
+	while (true)
+	{
+		// start commands until the limit is reached
+		while (active < maxParallel && next < cmds.size())
+		{
+			std::unique_lock<std::mutex> lk{ mCommandMutex };
+			// a kill may have arrived while the job was running, don't start anything new
+			if (mCommand.load() == KILL)
+				break;
+
+			const size_t index = next++;
+			commandState_t& state = states[index];
+			results[index].cmd = cmds[index];
+			started[index] = true;
+
+			try
+			{
+				state.parser = std::make_unique<ProgressParser>();
+				// yt-dlp cannot change its rate once it runs, so it is restarted when its share changes
+				if (!mDoUpdate)
+					state.bandwidth = BandwidthBudget::getInstance().acquire(mData.jobId,
+						[&pushEvent, index]() { pushEvent({ index, std::nullopt, true }); });
+				if (isPaused())
+					BandwidthBudget::getInstance().setPaused(mData.jobId, true);
+				startProcess(index, lk);
+			}
+			catch (std::exception&)
+			{
+				state.bandwidth.release();
+				recordFailure(index, std::current_exception());
+				// a file is read until it is cancelled, a pipe is closed by closing the write end
+				if (state.outputPath && state.outstanding > 0)
+					OutputReader::getInstance().cancel(state.pipeId);
+				// the pipe still reports its close, so the command stays active until then
+				if (state.outstanding > 0)
+					active++;
+				continue;
+			}
+
+			active++;
+		}
+
+		if (active == 0)
+			break;
+
+		// wait for any child to exit or any pipe to close. A pipe that stays open too long is cancelled.
+		event_t ev;
+		{
+			std::unique_lock<std::mutex> finishedLk(finishedMutex);
+			while (finished.empty())
+			{
+				std::optional<steadyClock_t::time_point> nextDeadline = std::nullopt;
+				for (auto& state : states)
+				{
+					if (!state.drainDeadline || state.pipeCancelled)
+						continue;
+					if (*state.drainDeadline <= steadyClock_t::now())
+					{
+						state.pipeCancelled = true;
+						OutputReader::getInstance().cancel(state.pipeId);
+					}
+					else if (!nextDeadline || *state.drainDeadline < *nextDeadline)
+						nextDeadline = state.drainDeadline;
+				}
+				if (nextDeadline)
+					finishedCv.wait_until(finishedLk, *nextDeadline);
+				else
+					finishedCv.wait(finishedLk);
+			}
+			ev = finished.front();
+			finished.pop();
+		}
+
+		commandState_t& state = states[ev.index];
+		if (ev.rateChanged)
+		{
+			// the process keeps running at the rate it started with until it is replaced
+			if (state.process && !state.restarting && mCommand.load() != KILL &&
+				needsRestart(state.startedRate, state.bandwidth.getRate()))
+			{
+				state.restarting = true;
+				TerminateProcess(state.process->hProcess, 1);
+			}
+			continue;
+		}
+
+		if (ev.exitedProcess && state.restarting && mCommand.load() != KILL)
+		{
+			state.process = std::nullopt;
+			try
+			{
+				windowsprocessutils::closeProcess(*ev.exitedProcess);
+			}
+			catch (std::exception&)
+			{
+				// it was terminated on purpose
+			}
+			// what the terminated process still had to say is of no use, its grandchildren may hold the pipe open
+			OutputReader::getInstance().cancel(state.pipeId);
+			try
+			{
+				std::unique_lock<std::mutex> lk{ mCommandMutex };
+				startProcess(ev.index, lk);
+			}
+			catch (std::exception&)
+			{
+				recordFailure(ev.index, std::current_exception());
+				state.bandwidth.release();
+			}
+			state.restarting = false;
+		}
+		else if (ev.exitedProcess)
+		{
+			state.process = std::nullopt;
+			try
+			{
+				windowsprocessutils::closeProcess(*ev.exitedProcess);
+				results[ev.index].success = true;
+			}
+			catch (std::exception&)
+			{
+				recordFailure(ev.index, std::current_exception());
+			}
+			// a file holds all of the output once the process exited, only a pipe can be held open by a grandchild
+			if (state.outputPath)
+				OutputReader::getInstance().cancel(state.pipeId);
+			else
+				state.drainDeadline = steadyClock_t::now() + std::chrono::milliseconds(PIPE_DRAIN_TIMEOUT_MILLIS);
+			state.bandwidth.release();
+		}
+
+		if (--state.outstanding > 0)
+			continue;
+		active--;
+
+		if (state.outputPath)
+			state.staleOutputPaths.push_back(*state.outputPath);
+		for (const auto& path : state.staleOutputPaths)
+		{
+			std::error_code ec;
+			std::filesystem::remove(path, ec);
+		}
+
+		// the output is complete now, add what youtube-dl said about the failure
+		if (!results[ev.index].success && state.parser)
+		{
+			std::optional<std::string> lastError = state.parser->getLastError();
+			if (lastError)
+				results[ev.index].error = results[ev.index].error.value_or("") + "\n" + *lastError;
+		}
+	}
+
+	// commands skipped because of a kill are not reported
+	std::vector<commandResult_t> startedResults;
+	for (size_t i = 0; i < cmds.size(); i++)
+	{
+		if (started[i])
+			startedResults.push_back(std::move(results[i]));
+	}
+	return startedResults;
+}
+
+/**
+ * Check if a yt-dlp process should be restarted because its share of the bandwidth limit changed.
+ * A process over its share is always restarted, one under it only if the gain is worth starting over the extraction.
+ *
+ * @param[in] startedRate the rate the process was started with, 0 for no limit
+ * @param[in] rate the current share, 0 for no limit
+ * @return true if the process should be restarted with the current share
+ */
+bool DownloadJob::needsRestart(const uint64_t startedRate, const uint64_t rate)
+{
+	if (rate == startedRate)
+		return false;
+	if (startedRate == 0 || (rate != 0 && rate < startedRate))
+		return true;
+	return (rate == 0) || (rate >= startedRate + startedRate * RESTART_RATE_INCREASE_PERCENT / 100);
+}
+
+/**
+ * Wait for the processes of this job that the last session of the plugin left running, and show their progress.
+ * They are placed in the job object of this job, so they can be killed and paused like the processes it starts.
+ * The job then runs as usual, yt-dlp skips the formats they finished and continues their partial files.
+ */
+void DownloadJob::adoptProcesses()
+{
+	mState = RUNNING;
+	{
+		std::unique_lock<std::mutex> lk(mProgressMutex);
+		mCommandProgress.assign(mAdopted.size(), {});
+	}
+
+	struct adoptedProcess_t
+	{
+		HANDLE process = NULL;
+		std::unique_ptr<ProgressParser> parser = nullptr;
+		std::optional<OutputReader::pipeId_t> fileId = std::nullopt;
+		std::promise<void> closed;
+	};
+	std::vector<adoptedProcess_t> adopted(mAdopted.size());
+	for (size_t index = 0; index < mAdopted.size(); index++)
+	{
+		// a process that exited or whose id was reused is left alone
+		adoptedProcess_t& process = adopted[index];
+		process.process = windowsprocessutils::openProcess(mAdopted[index].processId, mAdopted[index].creationTime);
+		if (process.process == NULL)
+			continue;
+
+		{
+			std::unique_lock<std::mutex> lk{ mCommandMutex };
+			try
+			{
+				getProcessJob(lk);
+				mProcessJob->adopt(process.process);
+				if (mCommand.load() == KILL)
+					mProcessJob->terminate(0);
+				else if (mSuspended)
+					mProcessJob->suspend();
+			}
+			catch (std::runtime_error&)
+			{
+				// without a job object the process is still waited for, it just cannot be paused
+			}
+		}
+
+		// the file still holds the output from before the restart, so the progress picks up where it was
+		process.parser = std::make_unique<ProgressParser>();
+		ProgressParser* parser = process.parser.get();
+		std::promise<void>* closed = &process.closed;
+		try
+		{
+			OutputReader::pipe_t file = OutputReader::getInstance().openFile(mAdopted[index].outputPath,
+				[this, parser, index](const char* data, const size_t size)
+				{
+					if (parser->feed(data, size))
+						onProgress(index, parser->getProgress());
+				},
+				[closed]() { closed->set_value(); }, false);
+			process.fileId = file.id;
+		}
+		catch (std::runtime_error&)
+		{
+			// the progress is not shown, the process is still waited for
+		}
+	}
+
+	for (auto& process : adopted)
+	{
+		if (process.process == NULL)
+			continue;
+		try
+		{
+			ProcessWaiter::getInstance().wait(process.process);
+		}
+		catch (std::runtime_error&)
+		{
+			WaitForSingleObject(process.process, INFINITE);
+		}
+		CloseHandle(process.process);
+
+		if (process.fileId)
+		{
+			OutputReader::getInstance().cancel(*process.fileId);
+			process.closed.get_future().wait();
+		}
+	}
+
+	for (const auto& process : mAdopted)
+	{
+		std::error_code ec;
+		std::filesystem::remove(process.outputPath, ec);
+	}
+	mJournal->recordProcessesExited(mData.jobId);
+
+	status_t testVal = RUNNING;
+	mState.compare_exchange_strong(testVal, SETUP);
+}
+
+/**
+ * Record a process of this job in the journal, for this job and for every job batched into it.
+ * A process that cannot be recorded is not adopted after a restart, the job then starts it again.
+ *
+ * @param[in] pi the process
+ * @param[in] outputPath the file the process writes its output to
+ */
+void DownloadJob::recordProcess(const PROCESS_INFORMATION& pi, const std::filesystem::path& outputPath)
+{
+	const JobJournal::process_t process = { pi.dwProcessId, windowsprocessutils::getCreationTime(pi.hProcess), outputPath.string() };
+	mJournal->recordProcess(mData.jobId, process);
+	for (const auto& job : mBatch)
+		mJournal->recordProcess(job->mData.jobId, process);
+}
+
+/**
+ * Suspend the process tree of this job, so its scheduler slot can be used by another job.
+ * yt-dlp picks up where it was once resumed, its partial files are kept.
+ *
+ * @return false if the job has no process running that could be suspended
+ */
+bool DownloadJob::suspend()
+{
+	std::unique_lock<std::mutex> lk{ mCommandMutex };
+	if (mState.load() != RUNNING || mProcessJob == nullptr || mCommand.load() == KILL)
+		return false;
+	mSuspended = mProcessJob->suspend();
+	return mSuspended;
+}
+
+/**
+ * Resume the process tree of this job after suspend() or pause(). The bandwidth share of a paused job may be in use
+ * by transfers that started in the meantime, it stays suspended until they left enough of the limit for it.
+ *
+ * @param[in] force resume even if that exceeds the bandwidth limit, e.g. when nothing would resume the job later
+ * @return false if the job stays suspended
+ */
+bool DownloadJob::resume(const bool force)
+{
+	if (isPaused() && !BandwidthBudget::getInstance().reserve(mData.jobId) && !force)
+		return false;
+
+	{
+		std::unique_lock<std::mutex> lk{ mCommandMutex };
+		mSuspended = false;
+		if (mProcessJob != nullptr)
+			mProcessJob->resume();
+	}
+
+	if (isPaused())
+	{
+		// leave the paused state first, so a process that starts in between takes a share that is not paused
+		setRunState(RUNNING);
+		BandwidthBudget::getInstance().setPaused(mData.jobId, false);
+	}
+	return true;
+}
+
+/**
+ * Pause this job and the jobs batched into it at the request of the user. The processes are suspended
+ * and the bandwidth share of the job goes to the transfers that start in the meantime.
+ * yt-dlp continues from its .part files once resumed, so nothing that was downloaded is lost.
+ *
+ * @return false if the job has no process running that could be paused
+ */
+bool DownloadJob::pause()
+{
+	// a job that waits for a slot after a resume is still suspended
+	if (mState.load() == RESUMING)
+	{
+		setRunState(PAUSED);
+		// it may have been waiting for its bandwidth share
+		BandwidthBudget::getInstance().setPaused(mData.jobId, true);
+		return true;
+	}
+
+	if (!suspend())
+		return false;
+	setRunState(PAUSED);
+	BandwidthBudget::getInstance().setPaused(mData.jobId, true);
+	return true;
+}
+
+/**
+ * Mark a paused job as resumed by the user. It stays suspended until resume() is called.
+ */
+void DownloadJob::markResuming()
+{
+	if (mState.load() == PAUSED)
+		setRunState(RESUMING);
+}
+
+/**
+ * Move this job and the jobs batched into it between RUNNING, PAUSED and RESUMING, and publish the new state.
+ * Jobs that are already stopping keep their state.
+ *
+ * @param[in] newState the new state
+ */
+void DownloadJob::setRunState(const status_t newState)
+{
+	std::vector<DownloadJob*> jobs = { this };
+	for (const auto& job : mBatch)
+		jobs.push_back(job.get());
+
+	for (DownloadJob* job : jobs)
+	{
+		status_t currState = job->mState.load();
+		bool changed = false;
+		while (!changed && (currState == RUNNING || currState == PAUSED || currState == RESUMING))
+			changed = job->mState.compare_exchange_weak(currState, newState);
+		if (changed)
+			job->publishState(newState);
+	}
+}
+
+/**
+ * Get the job object that holds the processes of this job, it is created by the first call
+ *
+ * @param[in] lk the lock for mCommandMutex
+ * @return handle to the job object
+ * @throws runtime_error if the job object cannot be created with the limits of the settings
+ */
+HANDLE DownloadJob::getProcessJob(const std::unique_lock<std::mutex>& lk)
+{
+	assert(lk.owns_lock() && lk.mutex() == &mCommandMutex);
+	if (mProcessJob == nullptr)
+	{
+		mProcessJob = std::make_unique<ProcessJob>(ProcessJob::getLimits(mSettings));
+		// a journaled process is adopted again when the plugin restarts, so it keeps running even if the plugin crashes
+		if (mCommand.load() == DETACH || isJournaled())
+			mProcessJob->setKillOnClose(false);
+	}
+	return mProcessJob->getHandle();
+}
+
+/**
+ * Get the resources used by the processes of this job so far
+ *
+ * @return the usage, or nullopt if no process was started
+ */
+std::optional<resourceUsage_t> DownloadJob::getResourceUsage()
+{
+	std::unique_lock<std::mutex> lk{ mCommandMutex };
+	if (mProcessJob == nullptr)
+		return std::nullopt;
+	return mProcessJob->getUsage();
+}
+
+/**
+ * Store the latest progress of a command, and publish the progress of the job if the last update is old enough.
+ * Called on the output reader thread.
+ *
+ * @param[in] index the index of the command
+ * @param[in] progress the progress of the command
+ */
+void DownloadJob::onProgress(const size_t index, const downloadProgress_t& progress)
+{
+	downloadProgress_t total;
+	{
+		std::unique_lock<std::mutex> lk(mProgressMutex);
+		if (index >= mCommandProgress.size())
+			return;
+		mCommandProgress[index] = progress;
+
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now - mLastProgressPublish < std::chrono::milliseconds(PROGRESS_PUBLISH_INTERVAL_MILLIS))
+			return;
+		mLastProgressPublish = now;
+
+		// the commands of a job run side by side, so add up their progress and wait for the slowest
+		bool totalKnown = true;
+		uint64_t totalBytes = 0;
+		for (const auto& commandProgress : mCommandProgress)
+		{
+			total.downloadedBytes += commandProgress.downloadedBytes;
+			if (commandProgress.totalBytes)
+				totalBytes += *commandProgress.totalBytes;
+			else if (commandProgress.downloadedBytes > 0)
+				totalKnown = false;
+			if (commandProgress.speed)
+				total.speed = total.speed.value_or(0) + *commandProgress.speed;
+			if (commandProgress.eta)
+				total.eta = std::max(total.eta.value_or(0), *commandProgress.eta);
+		}
+		if (totalKnown && totalBytes > 0)
+			total.totalBytes = totalBytes;
+	}
+
+	// the jobs of a batch share the processes, so they share the progress too
+	publishProgress(total);
+	for (const auto& job : mBatch)
+		job->publishProgress(total);
+}
+
+/**
+ * Publish the progress of this job to the results queue, unless the final result is already out
+ *
+ * @param[in] progress the progress of the job
+ */
+void DownloadJob::publishProgress(const downloadProgress_t& progress)
+{
+	// a paused job keeps showing that it is paused
+	if (isPaused())
+		return;
+	publishState(RUNNING, progress);
+}
+
+/**
+ * Publish a state of this job that is not final to the results queue, unless the final result is already out
+ *
+ * @param[in] status RUNNING, PAUSED or RESUMING
+ * @param[in] progress the progress of the job, if it changed
+ */
+void DownloadJob::publishState(const status_t status, const std::optional<downloadProgress_t>& progress)
+{
+	std::unique_lock<std::mutex>lk(mDataMutex);
+	if (mExited)
+		return;
+
+	threadData_t stateData;
+	stateData.status = status;
+	stateData.context = mData.context;
+	stateData.jobId = mData.jobId;
+	stateData.progress = progress;
+
+	std::unique_lock<std::mutex>cmdLk(mCommandMutex);
+	if (mCommand.load() == DETACH)
+		return;
+	for (const auto& waiter : mWaiters)
+	{
+		threadData_t waiterData = stateData;
+		waiterData.context = waiter.context;
+		waiterData.jobId = waiter.jobId;
+		mResults.push(std::move(waiterData));
+	}
+	if (!mOwnerDetached)
+		mResults.push(std::move(stateData));
+}
+
+/**
+ * Get a unique id for a new job
+ *
+ * @return the id
+ */
+uint64_t DownloadJob::getNextJobId()
+{
+	return getJobIdCounter()++;
+}
+
+/**
+ * Make sure new jobs get ids above the ones used before, e.g. by the jobs of the last session
+ *
+ * @param[in] lastJobId the highest id that is already in use
+ */
+void DownloadJob::reserveJobIds(const uint64_t lastJobId)
+{
+	std::atomic<uint64_t>& counter = getJobIdCounter();
+	uint64_t nextJobId = counter.load();
+	while (nextJobId <= lastJobId && !counter.compare_exchange_weak(nextJobId, lastJobId + 1))
+		;
+}
+
+std::atomic<uint64_t>& DownloadJob::getJobIdCounter()
+{
+	static std::atomic<uint64_t> nextJobId = 1;
+	return nextJobId;
+}
@@ -0,0 +1,296 @@
+//==============================================================================
+/**
+@file       DownloadJob.h
+
+@brief		A single youtube-dl download request, executed by the DownloadScheduler
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+#include "Common.h"
+#include "DownloadArchive.h"
+#include "JobJournal.h"
+#include "MpscQueue.h"
+#include "ProcessJob.h"
+#include "ProgressParser.h"
+
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "../Vendor/json/src/json.hpp"
+using json = nlohmann::json;
+
+class DownloadJob : public std::enable_shared_from_this<DownloadJob>
+{
+public:
+	enum flags_t
+	{
+		CONTINUE,
+		DETACH,
+		KILL,
+	};
+
+	enum status_t
+	{
+		NEW,
+		QUEUED,
+		SETUP,
+		RUNNING,
+		// suspended by the user, the processes keep their partial downloads
+		PAUSED,
+		// resumed by the user, but still suspended until the scheduler has a slot for it
+		RESUMING,
+		STOPPING,
+		FAILED,
+		SUCCESS,
+		UPDATED,
+		UNKNOWN,
+	};
+
+	// result of a single youtube-dl invocation within a job
+	struct commandResult_t
+	{
+		std::string cmd = "";
+		bool success = false;
+		std::optional<std::string> error = std::nullopt;
+		std::optional<std::string> buttonMsg = std::nullopt;
+	};
+
+	// published once with the final status, with status RUNNING whenever the progress changed,
+	// and with status PAUSED or RESUMING when the job is paused or resumed
+	struct threadData_t
+	{
+		std::optional<std::string> buttonMsg = std::nullopt;
+		std::optional<std::string> log = std::nullopt;
+		status_t status = UNKNOWN;
+		contextHandle_t context = 0;
+		uint64_t jobId = 0;
+		std::optional<downloadProgress_t> progress = std::nullopt;
+		std::vector<commandResult_t> commandResults = {};
+		// resources used by the child processes, set in the final result if any process was started
+		std::optional<resourceUsage_t> resourceUsage = std::nullopt;
+	};
+	// results are moved in by the jobs and taken out by the plugin's monitor thread
+	typedef MpscQueue<threadData_t> resultQueue_t;
+
+	// upper bound for the per job maxParallelCommands setting
+	static constexpr uint32_t MAX_PARALLEL_COMMANDS = 8;
+	// progress is published at most this often per job
+	static constexpr uint32_t PROGRESS_PUBLISH_INTERVAL_MILLIS = 500;
+	// how long the output pipe may stay open after the process exited, a grandchild can hold it open
+	static constexpr uint32_t PIPE_DRAIN_TIMEOUT_MILLIS = 2000;
+	// a yt-dlp process is restarted when its share of the bandwidth limit grew by this much, it always is when it shrank
+	static constexpr uint32_t RESTART_RATE_INCREASE_PERCENT = 50;
+
+	/**
+	 * Create a download job. The job does nothing until it is run by a scheduler worker.
+	 *
+	 * @param[in] url the url to download from
+	 * @param[in] data the metadata stored by the context
+	 * @param[in] inContext handle of the button context for this job
+	 * @param[in] doUpdate update youtube-dl
+	 * @param[in] results the queue to place finished results data
+	 * @param[in] jobId the id of the job if it was taken with getNextJobId() already, e.g. to journal the job
+	 * @param[in] journal the journal the processes of the job are recorded in, so they can be adopted after a restart
+	 * @param[in] archive the archive of downloaded media, the job is skipped if its media is in it
+	 */
+	DownloadJob(const std::string& url, const contextSettings_t& data, const contextHandle_t inContext, const bool doUpdate,
+		resultQueue_t& results, const std::optional<uint64_t>& jobId = std::nullopt, const std::shared_ptr<JobJournal>& journal = nullptr,
+		const std::shared_ptr<DownloadArchive>& archive = nullptr) :
+		mUrl(url), mSettings(data), mDoUpdate(doUpdate),
+		mResults(results), mJournal(journal), mArchive(archive)
+	{
+		mData.context = inContext;
+		mData.jobId = jobId ? *jobId : getNextJobId();
+		if (isJournaled())
+			mAdopted = mJournal->getProcesses(mData.jobId);
+	}
+
+	~DownloadJob()
+	{
+		kill();
+	}
+
+	/**
+	 * Mark the job as waiting in the scheduler queue
+	 *
+	 * @return false if the job was already queued or started
+	 */
+	bool queue()
+	{
+		status_t testVal = NEW;
+		return mState.compare_exchange_strong(testVal, QUEUED);
+	}
+
+	void run(const std::vector<std::shared_ptr<DownloadJob>>& batch = {});
+	void cancel();
+
+	bool isBatchable() const;
+	bool canBatchWith(const DownloadJob& other) const;
+
+	bool attach(const contextHandle_t context, const uint64_t jobId);
+	bool hasContext(const contextHandle_t context);
+	std::vector<contextHandle_t> getContexts();
+	bool detachContext(const contextHandle_t context);
+
+	void detach()
+	{
+		std::unique_lock<std::mutex> lk{ mCommandMutex };
+		mCommand = DETACH;
+		// a detached job is left running when the plugin exits
+		if (mProcessJob != nullptr)
+			mProcessJob->setKillOnClose(false);
+	}
+
+	void kill();
+
+	bool suspend();
+	bool resume(const bool force = false);
+	bool pause();
+	void markResuming();
+
+	bool isPaused() const
+	{
+		status_t currState = mState.load();
+		return (currState == PAUSED) || (currState == RESUMING);
+	}
+
+	bool isQueued() const
+	{
+		return mState.load() == QUEUED;
+	}
+
+	bool isComplete()
+	{
+		status_t currState = mState.load();
+		return (currState == SUCCESS) || (currState == FAILED) || (currState == UPDATED);
+	}
+
+	contextHandle_t getContext() const
+	{
+		return mData.context;
+	}
+
+	uint64_t getJobId() const
+	{
+		return mData.jobId;
+	}
+
+	const std::string& getUrl() const
+	{
+		return mUrl;
+	}
+
+	bool isUpdate() const
+	{
+		return mDoUpdate;
+	}
+
+	static uint64_t getNextJobId();
+	static void reserveJobIds(const uint64_t lastJobId);
+private:
+	// request parameters
+	const std::string mUrl;
+	const contextSettings_t mSettings;
+	const bool mDoUpdate;
+
+	// current download state
+	std::atomic<status_t> mState = NEW;
+
+	// command to exit download loop
+	std::mutex mCommandMutex;
+	std::atomic<flags_t> mCommand = CONTINUE;
+	// holds every child process of the job and their children, created when the first process starts
+	std::unique_ptr<ProcessJob> mProcessJob;
+	// set while the scheduler has the job suspended, processes that start in the meantime are suspended right away
+	bool mSuspended = false;
+	// the job that runs the process shared with this job, if this job was batched into another one
+	std::weak_ptr<DownloadJob> mBatchLead;
+	// the press of this job was killed. A process shared by a batch keeps running until every job of the batch was killed.
+	std::atomic<bool> mKilled = false;
+
+	// another press of the same download, attached to this job instead of running its own
+	struct waiter_t
+	{
+		contextHandle_t context = 0;
+		uint64_t jobId = 0;
+	};
+
+	std::mutex mDataMutex;
+	threadData_t mData;
+	bool mExited = false;
+	std::vector<waiter_t> mWaiters;
+	// the button of the job was killed while presses of other buttons wait for the job, it gets no more results
+	bool mOwnerDetached = false;
+
+	// latest progress of each command, updated by the output reader thread
+	std::mutex mProgressMutex;
+	std::vector<downloadProgress_t> mCommandProgress;
+	std::chrono::steady_clock::time_point mLastProgressPublish;
+
+	// where finished results are published
+	resultQueue_t& mResults;
+
+	// where the processes of this job are recorded, null if they are not
+	const std::shared_ptr<JobJournal> mJournal;
+	// processes of this job that the last session of the plugin left running, they are waited for before the job runs
+	std::vector<JobJournal::process_t> mAdopted;
+
+	// where the media downloaded by this job are recorded, null if they are not
+	const std::shared_ptr<DownloadArchive> mArchive;
+
+	// jobs whose urls are downloaded by this job's processes
+	std::vector<std::shared_ptr<DownloadJob>> mBatch;
+
+	bool joinBatch(const std::shared_ptr<DownloadJob>& batchLead);
+	void runBatch();
+	void killIfBatchKilled();
+
+	bool isJournaled() const
+	{
+		return (mJournal != nullptr) && !mDoUpdate;
+	}
+	void adoptProcesses();
+	void recordProcess(const PROCESS_INFORMATION& pi, const std::filesystem::path& outputPath);
+
+	bool usesArchive() const
+	{
+		return (mArchive != nullptr) && !mDoUpdate;
+	}
+	std::string getArchiveKey(const std::string& mediaKey) const;
+	bool isArchived(const std::optional<std::string>& key) const;
+	std::vector<std::filesystem::path> addArchiveArgs(std::vector<std::string>& cmds, const size_t count) const;
+	void archiveDownloaded(const std::vector<std::filesystem::path>& archivePaths);
+
+	std::optional<std::pair<std::string, std::string>> checkOutputFolder() const;
+	std::optional<std::filesystem::path> resolveInfoJson(const std::filesystem::path& exePath);
+
+	std::vector<commandResult_t> runCommands(const std::vector<std::string>& cmds,
+		const std::filesystem::path& exePath, const uint32_t maxParallel);
+	static bool needsRestart(const uint64_t startedRate, const uint64_t rate);
+
+	void exitDownloadProcess(const std::optional<std::string>& logMsg,
+		const std::optional<std::string>& errMsg,
+		const status_t newState);
+	void exitWithCommandResults(const std::vector<commandResult_t>& commandResults,
+		const std::optional<resourceUsage_t>& resourceUsage);
+
+	HANDLE getProcessJob(const std::unique_lock<std::mutex>& lk);
+	std::optional<resourceUsage_t> getResourceUsage();
+
+	void onProgress(const size_t index, const downloadProgress_t& progress);
+	void publishProgress(const downloadProgress_t& progress);
+	void publishState(const status_t status, const std::optional<downloadProgress_t>& progress = std::nullopt);
+	void setRunState(const status_t newState);
+
+	static std::atomic<uint64_t>& getJobIdCounter();
+};
@@ -0,0 +1,618 @@
+//==============================================================================
+/**
+@file       DownloadScheduler.cpp
+
+@brief		Pool of worker threads that runs queued DownloadJobs
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "pch.h"
+
+#include "DownloadScheduler.h"
+#include "UrlCanonicalizer.h"
+#include "YoutubeDlUtils.h"
+
+#include <algorithm>
+
+DownloadScheduler::DownloadScheduler(DownloadJob::resultQueue_t& results, const std::shared_ptr<JobJournal>& journal,
+	const std::shared_ptr<DownloadArchive>& archive) :
+	mResults(results), mJournal(journal), mArchive(archive)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	for (uint32_t i = 0; i < WORKER_COUNT; i++)
+		spawnWorker();
+}
+
+DownloadScheduler::~DownloadScheduler()
+{
+	{
+		std::unique_lock<std::mutex> lk(mMutex);
+		mStopping = true;
+		for (const auto& pending : mPending)
+			pending.job->cancel();
+		mPending.clear();
+		for (const auto& job : mCancelled)
+			job->cancel();
+		mCancelled.clear();
+		for (const auto& batch : mRunning)
+			for (const auto& job : batch.jobs)
+				job->kill();
+		mWorkCv.notify_all();
+	}
+
+	// workers that were detached are no longer joinable
+	for (auto& thd : mWorkers)
+	{
+		if (thd.joinable())
+			thd.join();
+	}
+	for (auto& thd : mRetiredWorkers)
+	{
+		if (thd.joinable())
+			thd.join();
+	}
+}
+
+/**
+ * Queue a new download job. It runs as soon as a worker is free and the concurrency cap allows it.
+ * Jobs that can be batched wait for the coalescing window first, so that jobs submitted shortly after
+ * with the same settings share their youtube-dl process.
+ * Ready jobs start by priority, and within a priority by weighted fair queueing between the contexts.
+ * A press of a download that is already queued or running is attached to that job instead,
+ * so two processes never write the same file.
+ *
+ * @param[in] url the url to download from
+ * @param[in] data the metadata stored by the context
+ * @param[in] inContext handle of the button's context
+ * @param[in] doUpdate update youtube-dl
+ * @param[in] jobId the id of the job if it was taken already, e.g. to journal the job
+ */
+void DownloadScheduler::submit(const std::string& url, const contextSettings_t& data, const contextHandle_t inContext, const bool doUpdate,
+	const std::optional<uint64_t>& jobId)
+{
+	std::shared_ptr<DownloadJob> job = std::make_shared<DownloadJob>(url, data, inContext, doUpdate, mResults, jobId, mJournal, mArchive);
+	job->queue();
+
+	std::unique_lock<std::mutex> lk(mMutex);
+	if (mStopping)
+	{
+		job->detach();
+		return;
+	}
+
+	if (!doUpdate)
+	{
+		const std::string inFlightKey = getInFlightKey(url, data);
+		// a job that already published its result does not take waiters, the press runs on its own then
+		auto it = mInFlight.find(inFlightKey);
+		std::shared_ptr<DownloadJob> inFlight = (it != mInFlight.end()) ? it->second.lock() : nullptr;
+		if (inFlight != nullptr && inFlight->attach(inContext, job->getJobId()))
+			return;
+		mInFlight[inFlightKey] = job;
+	}
+
+	std::chrono::steady_clock::time_point readyAt = std::chrono::steady_clock::now();
+	if (job->isBatchable())
+		readyAt += std::chrono::milliseconds(mCoalesceWindowMillis.load());
+	mPending.push_back({ std::move(job), readyAt, data.queuePriority, mClock.stamp(inContext, data.queueWeight.value_or(1)) });
+	mWorkCv.notify_one();
+}
+
+/**
+ * Set how long batchable jobs wait for other jobs with the same settings before they start
+ *
+ * @param[in] millis the window in milliseconds, 0 starts jobs right away. Clamped to MAX_COALESCE_WINDOW_MILLIS.
+ */
+void DownloadScheduler::setCoalesceWindow(const uint32_t millis)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	mCoalesceWindowMillis = std::min(millis, MAX_COALESCE_WINDOW_MILLIS);
+}
+
+/**
+ * Set the maximum number of jobs that may run at the same time
+ *
+ * @param[in] maxConcurrent the new cap, clamped to [1, WORKER_COUNT]
+ */
+void DownloadScheduler::setMaxConcurrent(const uint32_t maxConcurrent)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	mMaxConcurrent = std::clamp<uint32_t>(maxConcurrent, 1, WORKER_COUNT);
+	// raising the cap may allow preempted and queued jobs to start
+	resumePreempted();
+	mWorkCv.notify_all();
+}
+
+/**
+ * Kill all running jobs and cancel all queued jobs of a context. Jobs that other contexts wait for keep running for them.
+ *
+ * @param[in] context handle of the button's context
+ */
+void DownloadScheduler::kill(const contextHandle_t context)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	// a job that other contexts wait for keeps running for them
+	for (auto it = mPending.begin(); it != mPending.end();)
+	{
+		if (it->job->hasContext(context) && it->job->detachContext(context))
+		{
+			mCancelled.push_back(std::move(it->job));
+			it = mPending.erase(it);
+		}
+		else
+			it++;
+	}
+	// a batch keeps its process running for the jobs that were not killed
+	for (const auto& batch : mRunning)
+	{
+		for (const auto& job : batch.jobs)
+		{
+			if (job->hasContext(context) && job->detachContext(context))
+				job->kill();
+		}
+	}
+	mWorkCv.notify_one();
+}
+
+/**
+ * Kill all running jobs and cancel all queued jobs
+ */
+void DownloadScheduler::killAll()
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	for (auto& pending : mPending)
+		mCancelled.push_back(std::move(pending.job));
+	mPending.clear();
+	for (const auto& batch : mRunning)
+		for (const auto& job : batch.jobs)
+			job->kill();
+	mWorkCv.notify_one();
+}
+
+/**
+ * Pause the running jobs of a context. Their slots go to other jobs until they are resumed.
+ * A batch shares its process between the jobs of several buttons, it is only paused once every one of them asked.
+ *
+ * @param[in] context handle of the button's context
+ */
+void DownloadScheduler::pause(const contextHandle_t context)
+{
+	pauseBatches(context);
+}
+
+/**
+ * Pause all running jobs
+ */
+void DownloadScheduler::pauseAll()
+{
+	pauseBatches(std::nullopt);
+}
+
+/**
+ * Resume the paused jobs of a context. They continue as soon as there is a free slot.
+ *
+ * @param[in] context handle of the button's context
+ */
+void DownloadScheduler::resume(const contextHandle_t context)
+{
+	resumeBatches(context);
+}
+
+/**
+ * Resume all paused jobs
+ */
+void DownloadScheduler::resumeAll()
+{
+	resumeBatches(std::nullopt);
+}
+
+/**
+ * Stop scheduling and let running jobs finish on their own without reporting back.
+ * Queued jobs are dropped. The scheduler keeps itself alive until the last worker exits.
+ */
+void DownloadScheduler::detach()
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	mStopping = true;
+	for (const auto& pending : mPending)
+		pending.job->detach();
+	mPending.clear();
+	for (const auto& job : mCancelled)
+		job->detach();
+	mCancelled.clear();
+	// nothing would resume a preempted or paused batch anymore
+	for (auto& batch : mRunning)
+	{
+		for (const auto& job : batch.jobs)
+			job->detach();
+		if (batch.preempted || batch.paused)
+			batch.jobs.front()->resume(true);
+		batch.preempted = false;
+		batch.paused = false;
+	}
+
+	if (mLiveWorkers > 0)
+		mPtr = shared_from_this();
+	for (auto& thd : mWorkers)
+		thd.detach();
+	for (auto& thd : mRetiredWorkers)
+		thd.detach();
+	mRetiredWorkers.clear();
+	mWorkCv.notify_all();
+}
+
+/**
+ * Get the number of jobs that are queued or running
+ *
+ * @return the job count
+ */
+uint32_t DownloadScheduler::getJobCount()
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	size_t count = mPending.size();
+	for (const auto& batch : mRunning)
+		count += batch.jobs.size();
+	return static_cast<uint32_t>(count);
+}
+
+/**
+ * Start another worker thread, called with mMutex held. Workers that retired since the last spawn are joined,
+ * they only had to unlock the mutex to finish.
+ */
+void DownloadScheduler::spawnWorker()
+{
+	for (auto& thd : mRetiredWorkers)
+	{
+		if (thd.joinable())
+			thd.join();
+	}
+	mRetiredWorkers.clear();
+	mWorkers.emplace_back(&DownloadScheduler::worker, this);
+	mLiveWorkers++;
+	mIdleWorkers++;
+}
+
+/**
+ * Worker thread function. Takes jobs from the pending queue while under the concurrency cap and runs them.
+ * A started job takes every queued job with the same settings along into its batch.
+ * At the cap, a job may still start by suspending a running batch of a lower priority.
+ * A worker stays with its batch while the batch is preempted or paused, so the pool keeps one worker idle
+ * for the slots those batches free. Once the pool has more than WORKER_COUNT workers, a worker that becomes idle
+ * while another one is idle as well retires, so the pool shrinks back after the preempted and paused batches are done.
+ */
+void DownloadScheduler::worker()
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	bool retired = false;
+	while (true)
+	{
+		// wait for a cancellation, or for a job that is ready while under the cap or that can preempt a running one
+		auto readyIt = mPending.end();
+		while (!mStopping && mCancelled.empty())
+		{
+			if (mPending.empty())
+			{
+				mWorkCv.wait(lk);
+				continue;
+			}
+
+			std::chrono::steady_clock::time_point nextReadyAt = std::chrono::steady_clock::time_point::max();
+			readyIt = selectReady(std::chrono::steady_clock::now(), nextReadyAt);
+			if (readyIt == mPending.end())
+			{
+				mWorkCv.wait_until(lk, nextReadyAt);
+				continue;
+			}
+			if (getActiveCount() < mMaxConcurrent.load() || preemptFor(readyIt->priority))
+				break;
+			// wait for a running batch to finish
+			readyIt = mPending.end();
+			mWorkCv.wait(lk);
+		}
+		if (mStopping)
+			break;
+
+		// cancelled jobs are not counted against the cap
+		if (!mCancelled.empty())
+		{
+			std::vector<std::shared_ptr<DownloadJob>> cancelled;
+			cancelled.swap(mCancelled);
+			lk.unlock();
+			for (const auto& job : cancelled)
+				job->cancel();
+			lk.lock();
+			continue;
+		}
+
+		mClock.advance(readyIt->finishTag);
+		const QUEUE_PRIORITY priority = readyIt->priority;
+		std::vector<std::shared_ptr<DownloadJob>> batch = { readyIt->job };
+		std::vector<pendingJob_t> taken = { std::move(*readyIt) };
+		mPending.erase(readyIt);
+		for (auto it = mPending.begin(); it != mPending.end() && batch.size() < MAX_BATCH_SIZE;)
+		{
+			if (batch.front()->canBatchWith(*it->job))
+			{
+				batch.push_back(it->job);
+				taken.push_back(std::move(*it));
+				it = mPending.erase(it);
+			}
+			else
+				it++;
+		}
+		auto runningIt = mRunning.insert(mRunning.end(), runningBatch_t{ batch, priority });
+		mIdleWorkers--;
+		if (mIdleWorkers == 0)
+			spawnWorker();
+
+		lk.unlock();
+		batch.front()->run({ batch.begin() + 1, batch.end() });
+		lk.lock();
+		mIdleWorkers++;
+
+		// reap the batch record, the results have already been published by the jobs themselves
+		mRunning.erase(runningIt);
+		// a job that finished right away, e.g. with media that was downloaded before, did not run its batch
+		for (auto& pending : taken)
+		{
+			if (!pending.job->isQueued())
+				continue;
+			if (mStopping)
+				pending.job->cancel();
+			else
+				mPending.push_back(std::move(pending));
+		}
+		pruneInFlight();
+		resumePreempted();
+		mWorkCv.notify_one();
+
+		if (mLiveWorkers > WORKER_COUNT && mIdleWorkers > 1)
+		{
+			retired = true;
+			break;
+		}
+	}
+
+	// a retired worker hands its thread to the next spawn or the destructor, which join it
+	if (retired)
+	{
+		mIdleWorkers--;
+		auto it = std::find_if(mWorkers.begin(), mWorkers.end(),
+			[](const std::thread& thd) { return thd.get_id() == std::this_thread::get_id(); });
+		if (it != mWorkers.end())
+		{
+			mRetiredWorkers.push_back(std::move(*it));
+			mWorkers.erase(it);
+		}
+	}
+
+	// if detached, the last worker out releases the scheduler
+	mLiveWorkers--;
+	std::shared_ptr<DownloadScheduler> self = nullptr;
+	if (mLiveWorkers == 0)
+		self = std::move(mPtr);
+	lk.unlock();
+}
+
+/**
+ * Get the key that identifies presses of the same download, so they can share one job.
+ * Links to the same media, and formats and output folders that only differ in their spelling get the same key.
+ *
+ * @param[in] url the url to download from
+ * @param[in] data the metadata stored by the context
+ * @return the key
+ */
+std::string DownloadScheduler::getInFlightKey(const std::string& url, const contextSettings_t& data)
+{
+	const std::optional<canonicalUrl_t> canonical = UrlCanonicalizer::canonicalize(url);
+	std::string key = canonical ? canonical->url : url;
+
+	key += "\n" + youtubedlutils::getFormatsKey(data.downloadFormats);
+	key += "\n" + std::to_string(data.maxDownloads.value_or(1)) + (data.attemptRedditDl ? " reddit" : "");
+	key += "\n" + data.customCommand.value_or("");
+	return key + "\n" + youtubedlutils::getOutputFolderKey(data.outputFolder);
+}
+
+/**
+ * Forget the in-flight jobs that published their final result, called with mMutex held
+ */
+void DownloadScheduler::pruneInFlight()
+{
+	for (auto it = mInFlight.begin(); it != mInFlight.end();)
+	{
+		std::shared_ptr<DownloadJob> job = it->second.lock();
+		if (job == nullptr || job->isComplete())
+			it = mInFlight.erase(it);
+		else
+			it++;
+	}
+}
+
+/**
+ * Get the number of running batches that count against the cap, called with mMutex held
+ *
+ * @return the number of batches that are neither preempted nor paused
+ */
+uint32_t DownloadScheduler::getActiveCount() const
+{
+	return static_cast<uint32_t>(std::count_if(mRunning.begin(), mRunning.end(),
+		[](const runningBatch_t& batch) { return !batch.preempted && !batch.paused; }));
+}
+
+/**
+ * Find the pending job that should start next, called with mMutex held
+ *
+ * @param[in] now the current time
+ * @param[out] nextReadyAt lowered to the time the next job that is not ready yet becomes ready
+ * @return the ready job with the highest priority and lowest finish tag, or mPending.end() if none is ready
+ */
+std::deque<DownloadScheduler::pendingJob_t>::iterator DownloadScheduler::selectReady(const std::chrono::steady_clock::time_point now,
+	std::chrono::steady_clock::time_point& nextReadyAt)
+{
+	auto best = mPending.end();
+	for (auto it = mPending.begin(); it != mPending.end(); it++)
+	{
+		if (it->readyAt > now)
+		{
+			nextReadyAt = std::min(nextReadyAt, it->readyAt);
+			continue;
+		}
+		if (best == mPending.end() || it->priority > best->priority ||
+			(it->priority == best->priority && it->finishTag < best->finishTag))
+			best = it;
+	}
+	return best;
+}
+
+/**
+ * Suspend a running batch with a lower priority, so its slot can be used. The lowest priority batch
+ * that started last is suspended first. Called with mMutex held.
+ *
+ * @param[in] priority the priority of the job that wants to start
+ * @return true if a batch was suspended
+ */
+bool DownloadScheduler::preemptFor(const QUEUE_PRIORITY priority)
+{
+	for (int lower = LOW_QUEUE_PRIORITY; lower < priority; lower++)
+	{
+		for (auto it = mRunning.rbegin(); it != mRunning.rend(); it++)
+		{
+			// a batch that has no process yet, e.g. during an image download, cannot be suspended
+			if (!it->preempted && !it->paused && it->priority == lower && it->jobs.front()->suspend())
+			{
+				it->preempted = true;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/**
+ * Resume preempted batches while under the cap, the highest priority and earliest started first.
+ * A batch stays suspended while a queued job has a higher priority, and a batch that was paused
+ * stays suspended while its bandwidth share is in use. Called with mMutex held.
+ */
+void DownloadScheduler::resumePreempted()
+{
+	std::unordered_set<const runningBatch_t*> waiting;
+	while (getActiveCount() < mMaxConcurrent.load())
+	{
+		auto next = mRunning.end();
+		for (auto it = mRunning.begin(); it != mRunning.end(); it++)
+		{
+			if (it->preempted && !waiting.count(&*it) && (next == mRunning.end() || it->priority > next->priority))
+				next = it;
+		}
+		if (next == mRunning.end())
+			return;
+
+		const bool higherPending = std::any_of(mPending.begin(), mPending.end(),
+			[&](const pendingJob_t& pending) { return pending.priority > next->priority; });
+		if (higherPending)
+			return;
+
+		// it is tried again once a batch finishes and gives its share back
+		if (!next->jobs.front()->resume())
+		{
+			waiting.insert(&*next);
+			continue;
+		}
+		next->preempted = false;
+	}
+}
+
+/**
+ * Check if a batch has a job of a context
+ *
+ * @param[in] batch the running batch
+ * @param[in] context handle of the button's context, nullopt matches every batch
+ * @return true if the batch has a job of the context
+ */
+static bool hasContext(const std::vector<std::shared_ptr<DownloadJob>>& batch, const std::optional<contextHandle_t>& context)
+{
+	if (!context)
+		return true;
+	return std::any_of(batch.begin(), batch.end(),
+		[&](const std::shared_ptr<DownloadJob>& job) { return job->hasContext(*context); });
+}
+
+/**
+ * Get the contexts a batch publishes its results to
+ *
+ * @param[in] batch the running batch
+ * @return the contexts of the jobs and of the presses attached to them
+ */
+static std::unordered_set<contextHandle_t> getContexts(const std::vector<std::shared_ptr<DownloadJob>>& batch)
+{
+	std::unordered_set<contextHandle_t> contexts;
+	for (const auto& job : batch)
+	{
+		const std::vector<contextHandle_t> jobContexts = job->getContexts();
+		contexts.insert(jobContexts.begin(), jobContexts.end());
+	}
+	return contexts;
+}
+
+/**
+ * Pause the running batches of a context, or all running batches.
+ * A batch that also serves other contexts keeps running until they asked to pause as well.
+ *
+ * @param[in] context handle of the button's context, nullopt for all batches
+ */
+void DownloadScheduler::pauseBatches(const std::optional<contextHandle_t>& context)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	for (auto& batch : mRunning)
+	{
+		if (batch.paused || !hasContext(batch.jobs, context))
+			continue;
+
+		const std::unordered_set<contextHandle_t> served = getContexts(batch.jobs);
+		if (context)
+			batch.pausedBy.insert(*context);
+		else
+			batch.pausedBy.insert(served.begin(), served.end());
+		if (!std::all_of(served.begin(), served.end(), [&](const contextHandle_t servedContext) { return batch.pausedBy.count(servedContext) > 0; }))
+			continue;
+
+		// a batch that has no process yet, e.g. during an image download, cannot be paused
+		if (batch.jobs.front()->pause())
+		{
+			batch.paused = true;
+			batch.preempted = false;
+		}
+	}
+	// the freed slots go to preempted and queued jobs
+	resumePreempted();
+	mWorkCv.notify_all();
+}
+
+/**
+ * Resume the paused batches of a context, or all paused batches.
+ * They wait for a free slot like preempted batches, so the cap still holds.
+ *
+ * @param[in] context handle of the button's context, nullopt for all batches
+ */
+void DownloadScheduler::resumeBatches(const std::optional<contextHandle_t>& context)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	for (auto& batch : mRunning)
+	{
+		if (!hasContext(batch.jobs, context))
+			continue;
+		if (context)
+			batch.pausedBy.erase(*context);
+		else
+			batch.pausedBy.clear();
+		if (!batch.paused)
+			continue;
+		batch.paused = false;
+		batch.preempted = true;
+		batch.jobs.front()->markResuming();
+	}
+	resumePreempted();
+}
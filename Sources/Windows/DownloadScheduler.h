@@ -0,0 +1,142 @@
+//==============================================================================
+/**
+@file       DownloadScheduler.h
+
+@brief		Pool of worker threads that runs queued DownloadJobs
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+#include "DownloadJob.h"
+#include "FairQueueClock.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class DownloadScheduler : public std::enable_shared_from_this<DownloadScheduler>
+{
+public:
+	// number of worker threads the pool starts with, this is also the upper bound of the concurrency cap.
+	// Preempted and paused batches keep their workers, so the pool grows while they hold every worker and shrinks back after.
+	static constexpr uint32_t WORKER_COUNT = 8;
+	static constexpr uint32_t DEFAULT_MAX_CONCURRENT = 4;
+	// upper bound of urls that share one youtube-dl process
+	static constexpr uint32_t MAX_BATCH_SIZE = 16;
+	static constexpr uint32_t DEFAULT_COALESCE_WINDOW_MILLIS = 250;
+	static constexpr uint32_t MAX_COALESCE_WINDOW_MILLIS = 5000;
+
+	/**
+	 * Create the scheduler and spawn its worker threads
+	 *
+	 * @param[in] results the queue to place finished results data
+	 * @param[in] journal the journal the processes of the jobs are recorded in, null if they are not recorded
+	 * @param[in] archive the archive of downloaded media, null if media are downloaded again
+	 */
+	DownloadScheduler(DownloadJob::resultQueue_t& results, const std::shared_ptr<JobJournal>& journal = nullptr,
+		const std::shared_ptr<DownloadArchive>& archive = nullptr);
+	~DownloadScheduler();
+
+	void submit(const std::string& url, const contextSettings_t& data, const contextHandle_t inContext, const bool doUpdate,
+		const std::optional<uint64_t>& jobId = std::nullopt);
+
+	void setMaxConcurrent(const uint32_t maxConcurrent);
+	uint32_t getMaxConcurrent() const
+	{
+		return mMaxConcurrent.load();
+	}
+
+	void setCoalesceWindow(const uint32_t millis);
+
+	void kill(const contextHandle_t context);
+	void killAll();
+	void pause(const contextHandle_t context);
+	void pauseAll();
+	void resume(const contextHandle_t context);
+	void resumeAll();
+	void detach();
+
+	uint32_t getJobCount();
+private:
+	struct pendingJob_t
+	{
+		std::shared_ptr<DownloadJob> job;
+		// the job is not started before this time, so later presses with the same settings can join its batch
+		std::chrono::steady_clock::time_point readyAt;
+		QUEUE_PRIORITY priority = NORMAL_QUEUE_PRIORITY;
+		// among the ready jobs of the highest priority, the one with the lowest tag starts first
+		double finishTag = 0;
+	};
+
+	struct runningBatch_t
+	{
+		// the first job runs the batch
+		std::vector<std::shared_ptr<DownloadJob>> jobs;
+		QUEUE_PRIORITY priority = NORMAL_QUEUE_PRIORITY;
+		// suspended so a higher priority job could start, or resumed by the user and waiting for a slot.
+		// It is not counted against the cap.
+		bool preempted = false;
+		// suspended by the user, it is not counted against the cap and stays suspended until resumed by the user
+		bool paused = false;
+		// contexts that asked to pause the batch, it is only paused once every context it serves asked
+		std::unordered_set<contextHandle_t> pausedBy;
+	};
+
+	// pointer to self which is used to keep alive if detached
+	std::shared_ptr<DownloadScheduler> mPtr = nullptr;
+
+	std::mutex mMutex;
+	std::condition_variable mWorkCv;
+	std::deque<pendingJob_t> mPending;
+	// batches currently being run by a worker, in the order they started. Removed as soon as the batch finishes.
+	std::list<runningBatch_t> mRunning;
+	// orders the pending jobs of the contexts by their weights
+	FairQueueClock mClock;
+	// queued jobs that were killed, a worker publishes their results so callers never block on the results queue
+	std::vector<std::shared_ptr<DownloadJob>> mCancelled;
+	// queued and running jobs by the download they do, so a repeated press attaches to the job instead of
+	// starting a second process on the same files
+	std::unordered_map<std::string, std::weak_ptr<DownloadJob>> mInFlight;
+	std::atomic<uint32_t> mMaxConcurrent = DEFAULT_MAX_CONCURRENT;
+	std::atomic<uint32_t> mCoalesceWindowMillis = DEFAULT_COALESCE_WINDOW_MILLIS;
+	bool mStopping = false;
+
+	std::vector<std::thread> mWorkers;
+	// workers that left the pool after it grew, joined by the next spawn
+	std::vector<std::thread> mRetiredWorkers;
+	uint32_t mLiveWorkers = 0;
+	// workers that are not running a batch
+	uint32_t mIdleWorkers = 0;
+
+	// where finished results are published
+	DownloadJob::resultQueue_t& mResults;
+	// shared with the jobs, which may outlive the plugin when the scheduler is detached
+	const std::shared_ptr<JobJournal> mJournal;
+	const std::shared_ptr<DownloadArchive> mArchive;
+
+	void worker();
+	void spawnWorker();
+
+	void pruneInFlight();
+	uint32_t getActiveCount() const;
+	std::deque<pendingJob_t>::iterator selectReady(const std::chrono::steady_clock::time_point now,
+		std::chrono::steady_clock::time_point& nextReadyAt);
+	bool preemptFor(const QUEUE_PRIORITY priority);
+	void resumePreempted();
+	void pauseBatches(const std::optional<contextHandle_t>& context);
+	void resumeBatches(const std::optional<contextHandle_t>& context);
+
+	static std::string getInFlightKey(const std::string& url, const contextSettings_t& data);
+};
@@ -0,0 +1,83 @@
+//==============================================================================
+/**
+@file       EventCount.cpp
+
+@brief		Lets a consumer sleep until producers signal it, without a mutex on the producer side
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "pch.h"
+
+#include "EventCount.h"
+
+#ifdef _WIN32
+#pragma comment(lib, "Synchronization.lib") // for WaitOnAddress
+#else
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// the os waits on the address of the atomic as if it was a plain integer
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "atomic must have the size of its value");
+
+/**
+ * Announce that the calling thread is about to sleep. The caller must check its condition again afterwards.
+ *
+ * @return the key to pass to commitWait
+ */
+uint32_t EventCount::prepareWait()
+{
+	// seq_cst pairs with the fence in notify: either notify sees the waiter, or the caller sees the condition
+	mWaiters.fetch_add(1, std::memory_order_seq_cst);
+	return mEpoch.load(std::memory_order_seq_cst);
+}
+
+/**
+ * Leave without sleeping, because the condition became true after prepareWait
+ */
+void EventCount::cancelWait()
+{
+	mWaiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/**
+ * Sleep until notify is called after the matching prepareWait. Returns right away if it already was.
+ *
+ * @param[in] key the key returned by prepareWait
+ */
+void EventCount::commitWait(const uint32_t key)
+{
+	// the os call may also return spuriously, which is why the epoch is checked again
+	while (mEpoch.load(std::memory_order_seq_cst) == key)
+	{
+#ifdef _WIN32
+		uint32_t compare = key;
+		WaitOnAddress(&mEpoch, &compare, sizeof(compare), INFINITE);
+#else
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&mEpoch), FUTEX_WAIT_PRIVATE, key, nullptr, nullptr, 0);
+#endif
+	}
+	mWaiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/**
+ * Wake all sleeping consumers. Call after making the condition true.
+ */
+void EventCount::notify()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (mWaiters.load(std::memory_order_relaxed) == 0)
+		return;
+
+	mEpoch.fetch_add(1, std::memory_order_seq_cst);
+#ifdef _WIN32
+	WakeByAddressAll(&mEpoch);
+#else
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&mEpoch), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#endif
+}
@@ -0,0 +1,34 @@
+//==============================================================================
+/**
+@file       EventCount.h
+
+@brief		Lets a consumer sleep until producers signal it, without a mutex on the producer side
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * A consumer checks its condition between prepareWait and commitWait, and only sleeps if the condition
+ * still does not hold. Producers make the condition true and then call notify, which costs one fence and
+ * a load while nobody sleeps. The sleep itself is a futex style wait on the epoch counter.
+ */
+class EventCount
+{
+public:
+	uint32_t prepareWait();
+	void cancelWait();
+	void commitWait(const uint32_t key);
+
+	void notify();
+
+private:
+	std::atomic<uint32_t> mEpoch = 0;
+	std::atomic<uint32_t> mWaiters = 0;
+};
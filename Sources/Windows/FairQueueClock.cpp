@@ -0,0 +1,54 @@
+//==============================================================================
+/**
+@file       FairQueueClock.cpp
+
+@brief		Virtual clock of a weighted fair queue, with one flow per button context
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "pch.h"
+
+#include "FairQueueClock.h"
+
+#include <algorithm>
+
+/**
+ * Get the finish tag of a new job. Jobs are dispatched in order of their tags, so a context that queued
+ * many jobs only gets its weighted share of the starts while other contexts have jobs waiting.
+ *
+ * @param[in] flow the context that queued the job
+ * @param[in] weight the weight of the context, clamped to [1, MAX_WEIGHT]
+ * @return the finish tag
+ */
+double FairQueueClock::stamp(const contextHandle_t flow, const uint32_t weight)
+{
+	double& flowFinish = mFlowFinish[flow];
+	// every job costs the same, since the size of a download is not known before it runs
+	const double finishTag = std::max(mVirtualTime, flowFinish) + 1.0 / std::clamp<uint32_t>(weight, 1, MAX_WEIGHT);
+	flowFinish = finishTag;
+	return finishTag;
+}
+
+/**
+ * Move the virtual time to the tag of a job that was dispatched
+ *
+ * @param[in] finishTag the tag of the dispatched job
+ */
+void FairQueueClock::advance(const double finishTag)
+{
+	if (finishTag <= mVirtualTime)
+		return;
+	mVirtualTime = finishTag;
+
+	// contexts that are behind the virtual time start from it again, so they don't need to be remembered
+	for (auto it = mFlowFinish.begin(); it != mFlowFinish.end();)
+	{
+		if (it->second <= mVirtualTime)
+			it = mFlowFinish.erase(it);
+		else
+			it++;
+	}
+}
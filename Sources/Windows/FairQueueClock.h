@@ -0,0 +1,36 @@
+//==============================================================================
+/**
+@file       FairQueueClock.h
+
+@brief		Virtual clock of a weighted fair queue, with one flow per button context
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include "Common.h"
+
+#include <cstdint>
+#include <unordered_map>
+
+class FairQueueClock
+{
+public:
+	static constexpr uint32_t MAX_WEIGHT = 100;
+
+	double stamp(const contextHandle_t flow, const uint32_t weight);
+	void advance(const double finishTag);
+
+	double getVirtualTime() const
+	{
+		return mVirtualTime;
+	}
+private:
+	// finish tag of the job that was dispatched last
+	double mVirtualTime = 0;
+	// finish tag of the last job queued by each context that is still ahead of the virtual time
+	std::unordered_map<contextHandle_t, double> mFlowFinish;
+};
@@ -14,6 +14,7 @@
 #include <winerror.h> //for HRESULT
 #include <atlbase.h> // for CA2T
 
+#include <atomic>
 #include <regex>
 
 
@@ -113,4 +114,22 @@ std::filesystem::path fileutils::getCurrentExeFolder()
 	wchar_t plugin_exe_path[MAX_PATH];
 	GetModuleFileNameW(NULL, plugin_exe_path, MAX_PATH);
 	return std::filesystem::path(plugin_exe_path);
-}
\ No newline at end of file
+}
+
+/**
+ * Get a unique path for a scratch file in the plugin's temp folder. The file is not created.
+ *
+ * @param[in] extension the extension of the file, including the '.'
+ * @throws filesystem_error if the temp folder cannot be created
+ * @return the path to the file
+ */
+std::filesystem::path fileutils::getTempFilePath(const std::string& extension)
+{
+	static std::atomic<uint32_t> counter = 0;
+
+	std::filesystem::path folder = std::filesystem::temp_directory_path() / "youtube-dl-plugin";
+	std::filesystem::create_directories(folder);
+
+	// the pid keeps two plugin instances apart, the counter keeps the jobs of one instance apart
+	return folder / (std::to_string(GetCurrentProcessId()) + "-" + std::to_string(counter++) + extension);
+}
@@ -16,4 +16,5 @@ namespace fileutils
 	std::filesystem::path getFolder(const std::filesystem::path& path);
 	void openFolder(const std::filesystem::path& path);
 	std::filesystem::path getCurrentExeFolder();
+	std::filesystem::path getTempFilePath(const std::string& extension);
 }
\ No newline at end of file
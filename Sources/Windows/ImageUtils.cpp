@@ -0,0 +1,258 @@
+//==============================================================================
+/**
+@file       ImageUtils.cpp
+@brief      Utility functions for encoding key images
+@copyright  (c) 2020, Zongyi Yang
+**/
+//==============================================================================
+
+#include "pch.h"
+#include "ImageUtils.h"
+
+#include <array>
+#include <stdexcept>
+
+namespace
+{
+	/**
+	 * Writes bits LSB first, as deflate expects
+	 */
+	class BitWriter
+	{
+	public:
+		explicit BitWriter(std::string& out) : mOut(out) {}
+
+		void writeBits(uint32_t value, uint32_t count)
+		{
+			for (uint32_t i = 0; i < count; i++)
+			{
+				mByte |= ((value >> i) & 1) << mBitCount;
+				if (++mBitCount == 8)
+					flush();
+			}
+		}
+
+		// huffman codes are stored MSB first
+		void writeCode(uint32_t code, uint32_t length)
+		{
+			for (uint32_t i = length; i > 0; i--)
+				writeBits((code >> (i - 1)) & 1, 1);
+		}
+
+		void flush()
+		{
+			if (mBitCount == 0)
+				return;
+			mOut.push_back(static_cast<char>(mByte));
+			mByte = 0;
+			mBitCount = 0;
+		}
+	private:
+		std::string& mOut;
+		uint32_t mByte = 0;
+		uint32_t mBitCount = 0;
+	};
+
+	/**
+	 * Write a literal or length symbol with the fixed huffman code of RFC 1951
+	 */
+	void writeFixedSymbol(BitWriter& writer, const uint32_t symbol)
+	{
+		if (symbol <= 143)
+			writer.writeCode(0x30 + symbol, 8);
+		else if (symbol <= 255)
+			writer.writeCode(0x190 + symbol - 144, 9);
+		else if (symbol <= 279)
+			writer.writeCode(symbol - 256, 7);
+		else
+			writer.writeCode(0xC0 + symbol - 280, 8);
+	}
+
+	/**
+	 * Write a match of the previous byte repeated, i.e. a match at distance 1
+	 */
+	void writeRun(BitWriter& writer, const uint32_t length)
+	{
+		static const std::array<uint32_t, 29> BASE = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+			35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const std::array<uint32_t, 29> EXTRA = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+			3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+		size_t code = BASE.size() - 1;
+		while (BASE[code] > length)
+			code--;
+		writeFixedSymbol(writer, 257 + static_cast<uint32_t>(code));
+		writer.writeBits(length - BASE[code], EXTRA[code]);
+		// distance code 0 is distance 1, 5 bits without extra bits
+		writer.writeCode(0, 5);
+	}
+
+	/**
+	 * Compress with a single fixed huffman block. Only runs of the same byte are matched,
+	 * which is enough for flat key images whose rows are filtered against the row above.
+	 */
+	std::string deflateRuns(const std::string& data)
+	{
+		const uint32_t MIN_MATCH = 3;
+		const uint32_t MAX_MATCH = 258;
+
+		std::string out;
+		BitWriter writer(out);
+		// BFINAL = 1, BTYPE = 01 fixed huffman
+		writer.writeBits(1, 1);
+		writer.writeBits(1, 2);
+
+		size_t i = 0;
+		while (i < data.size())
+		{
+			uint32_t run = 0;
+			if (i > 0)
+			{
+				while (run < MAX_MATCH && i + run < data.size() && data[i + run] == data[i - 1])
+					run++;
+			}
+
+			if (run >= MIN_MATCH)
+			{
+				writeRun(writer, run);
+				i += run;
+			}
+			else
+			{
+				writeFixedSymbol(writer, static_cast<uint8_t>(data[i]));
+				i++;
+			}
+		}
+		writeFixedSymbol(writer, 256);
+		writer.flush();
+		return out;
+	}
+
+	uint32_t crc32(const std::string& data, uint32_t crc = 0)
+	{
+		static const std::array<uint32_t, 256> TABLE = []()
+		{
+			std::array<uint32_t, 256> table = {};
+			for (uint32_t n = 0; n < 256; n++)
+			{
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++)
+					c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+				table[n] = c;
+			}
+			return table;
+		}();
+
+		crc = ~crc;
+		for (const char byte : data)
+			crc = TABLE[(crc ^ static_cast<uint8_t>(byte)) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	uint32_t adler32(const std::string& data)
+	{
+		uint32_t a = 1;
+		uint32_t b = 0;
+		for (const char byte : data)
+		{
+			a = (a + static_cast<uint8_t>(byte)) % 65521;
+			b = (b + a) % 65521;
+		}
+		return (b << 16) | a;
+	}
+
+	void appendBigEndian(std::string& out, const uint32_t value)
+	{
+		out.push_back(static_cast<char>((value >> 24) & 0xFF));
+		out.push_back(static_cast<char>((value >> 16) & 0xFF));
+		out.push_back(static_cast<char>((value >> 8) & 0xFF));
+		out.push_back(static_cast<char>(value & 0xFF));
+	}
+
+	void appendChunk(std::string& png, const std::string& type, const std::string& data)
+	{
+		appendBigEndian(png, static_cast<uint32_t>(data.size()));
+		const std::string typeAndData = type + data;
+		png += typeAndData;
+		appendBigEndian(png, crc32(typeAndData));
+	}
+}
+
+/**
+ * Encode an image as PNG. Meant for the small flat images of a key, so the compression is simple.
+ *
+ * @param[in] image the image to encode
+ * @return the PNG file contents
+ * @throws invalid_argument if the pixel count does not match the size
+ */
+std::string imageutils::encodePng(const rgbImage_t& image)
+{
+	const size_t stride = static_cast<size_t>(image.width) * 3;
+	if (image.pixels.size() != stride * image.height)
+		throw std::invalid_argument("Image pixel count does not match its size.");
+
+	// every row uses the Up filter, so a row that repeats the one above becomes a run of zeros
+	std::string filtered;
+	filtered.reserve((stride + 1) * image.height);
+	for (uint32_t y = 0; y < image.height; y++)
+	{
+		filtered.push_back(2);
+		for (size_t x = 0; x < stride; x++)
+		{
+			const uint8_t above = (y > 0) ? image.pixels[(y - 1) * stride + x] : 0;
+			filtered.push_back(static_cast<char>(static_cast<uint8_t>(image.pixels[y * stride + x] - above)));
+		}
+	}
+
+	// zlib stream: header without preset dictionary, deflate data, adler32 of the uncompressed data
+	std::string zlib = { 0x78, 0x01 };
+	zlib += deflateRuns(filtered);
+	appendBigEndian(zlib, adler32(filtered));
+
+	std::string header;
+	appendBigEndian(header, image.width);
+	appendBigEndian(header, image.height);
+	header += { 8, 2, 0, 0, 0 }; // 8 bit depth, RGB, deflate, adaptive filtering, no interlace
+
+	std::string png = "\x89PNG\r\n\x1a\n";
+	appendChunk(png, "IHDR", header);
+	appendChunk(png, "IDAT", zlib);
+	appendChunk(png, "IEND", "");
+	return png;
+}
+
+/**
+ * Encode data as base64 with padding
+ *
+ * @param[in] data the data to encode
+ * @return the base64 string
+ */
+std::string imageutils::encodeBase64(const std::string& data)
+{
+	static const char* ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	std::string out;
+	out.reserve((data.size() + 2) / 3 * 4);
+	size_t i = 0;
+	for (; i + 2 < data.size(); i += 3)
+	{
+		const uint32_t n = (static_cast<uint8_t>(data[i]) << 16) | (static_cast<uint8_t>(data[i + 1]) << 8) | static_cast<uint8_t>(data[i + 2]);
+		out.push_back(ALPHABET[(n >> 18) & 0x3F]);
+		out.push_back(ALPHABET[(n >> 12) & 0x3F]);
+		out.push_back(ALPHABET[(n >> 6) & 0x3F]);
+		out.push_back(ALPHABET[n & 0x3F]);
+	}
+
+	const size_t remaining = data.size() - i;
+	if (remaining > 0)
+	{
+		uint32_t n = static_cast<uint8_t>(data[i]) << 16;
+		if (remaining == 2)
+			n |= static_cast<uint8_t>(data[i + 1]) << 8;
+		out.push_back(ALPHABET[(n >> 18) & 0x3F]);
+		out.push_back(ALPHABET[(n >> 12) & 0x3F]);
+		out.push_back(remaining == 2 ? ALPHABET[(n >> 6) & 0x3F] : '=');
+		out.push_back('=');
+	}
+	return out;
+}
@@ -0,0 +1,27 @@
+//==============================================================================
+/**
+@file       ImageUtils.h
+@brief      Utility functions for encoding key images
+@copyright  (c) 2020, Zongyi Yang
+**/
+//==============================================================================
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace imageutils
+{
+	// 8 bit RGB pixels, row by row without padding
+	struct rgbImage_t
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<uint8_t> pixels;
+	};
+
+	std::string encodePng(const rgbImage_t& image);
+	std::string encodeBase64(const std::string& data);
+}
@@ -0,0 +1,400 @@
+//==============================================================================
+/**
+@file       JobJournal.cpp
+
+@brief		Append-only journal of download jobs, so unfinished jobs are queued again after a restart
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "pch.h"
+
+#include "JobJournal.h"
+#include "WindowsProcessUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+
+JobJournal::JobJournal(const std::filesystem::path& path) :
+	mPath(path)
+{
+	replay();
+
+	// start from a clean file, without finished jobs and without a torn record at the end
+	std::unique_lock<std::mutex> lk(mMutex);
+	if (!compact(lk))
+	{
+		std::string error = windowsprocessutils::getLastErrorAsString();
+		if (mFile != INVALID_HANDLE_VALUE)
+			CloseHandle(mFile);
+		throw std::runtime_error("Cannot open job journal " + mPath.string() + ".\n" + error);
+	}
+
+	mSyncThread = std::thread(&JobJournal::syncLoop, this);
+}
+
+JobJournal::~JobJournal()
+{
+	{
+		std::unique_lock<std::mutex> lk(mMutex);
+		mStopping = true;
+		mSyncCv.notify_all();
+	}
+	if (mSyncThread.joinable())
+		mSyncThread.join();
+
+	std::unique_lock<std::mutex> lk(mMutex);
+	syncLocked(lk);
+	if (mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+}
+
+/**
+ * Get the jobs that were submitted but did not finish
+ *
+ * @return the jobs in the order they were submitted
+ */
+std::vector<JobJournal::entry_t> JobJournal::getUnfinished()
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	std::vector<entry_t> entries;
+	for (const auto& [id, entry] : mUnfinished)
+		entries.push_back(entry);
+	return entries;
+}
+
+/**
+ * Get the highest job id in the journal. New jobs must use higher ids, so they are not mistaken for journaled ones.
+ *
+ * @return the id, 0 if the journal is empty
+ */
+uint64_t JobJournal::getLastJobId()
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	return mLastJobId;
+}
+
+/**
+ * Get the processes recorded for a job
+ *
+ * @param[in] jobId the id of the job
+ * @return the processes, empty if the job is not journaled
+ */
+std::vector<JobJournal::process_t> JobJournal::getProcesses(const uint64_t jobId)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	auto it = mUnfinished.find(jobId);
+	if (it == mUnfinished.end())
+		return {};
+	return it->second.processes;
+}
+
+/**
+ * Record a new job. It must be recorded before it is queued, so its end is never recorded before it.
+ *
+ * @param[in] entry the job
+ * @return false if the record cannot be written
+ */
+bool JobJournal::recordSubmit(const entry_t& entry)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	const json record = getSubmitRecord(entry);
+	applyRecord(record);
+	return append(record, lk);
+}
+
+/**
+ * Record a state change of a job, e.g. a pause
+ *
+ * @param[in] jobId the id of the job
+ * @param[in] state the new state
+ * @return false if the record cannot be written
+ */
+bool JobJournal::recordState(const uint64_t jobId, const std::string& state)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	// jobs that are not journaled, e.g. updates, are ignored
+	if (mUnfinished.count(jobId) == 0)
+		return true;
+
+	const json record = { {"op", "state"}, {"id", jobId}, {"state", state} };
+	applyRecord(record);
+	return append(record, lk);
+}
+
+/**
+ * Record a child process of a job right after it started, so it can be adopted if the plugin restarts while it runs
+ *
+ * @param[in] jobId the id of the job
+ * @param[in] process the process
+ * @return false if the record cannot be written
+ */
+bool JobJournal::recordProcess(const uint64_t jobId, const process_t& process)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	if (mUnfinished.count(jobId) == 0)
+		return true;
+
+	const json record = getProcessRecord(jobId, process);
+	applyRecord(record);
+	return append(record, lk);
+}
+
+/**
+ * Record that the processes recorded for a job so far have exited, so they are not adopted again
+ *
+ * @param[in] jobId the id of the job
+ * @return false if the record cannot be written
+ */
+bool JobJournal::recordProcessesExited(const uint64_t jobId)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	auto it = mUnfinished.find(jobId);
+	if (it == mUnfinished.end() || it->second.processes.empty())
+		return true;
+
+	const json record = { {"op", "exited"}, {"id", jobId} };
+	applyRecord(record);
+	return append(record, lk);
+}
+
+/**
+ * Record the end of a job, whether it succeeded, failed, or was killed
+ *
+ * @param[in] jobId the id of the job
+ * @return false if the record cannot be written
+ */
+bool JobJournal::recordDone(const uint64_t jobId)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	if (mUnfinished.count(jobId) == 0)
+		return true;
+
+	const json record = { {"op", "done"}, {"id", jobId} };
+	applyRecord(record);
+	if (!append(record, lk))
+		return false;
+
+	if (mRecordsSinceCompact >= COMPACT_AFTER_RECORDS)
+		return compact(lk);
+	return true;
+}
+
+/**
+ * Sync the records written so far to the disk, without waiting for the sync thread
+ *
+ * @return false if the file cannot be synced
+ */
+bool JobJournal::sync()
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	return syncLocked(lk);
+}
+
+/**
+ * Read the journal file and rebuild the unfinished jobs from its records. A record is one line of json,
+ * so a record torn by a crash does not parse and is skipped.
+ */
+void JobJournal::replay()
+{
+	std::ifstream file(mPath, std::ios::binary);
+	std::string line;
+	while (std::getline(file, line))
+	{
+		try
+		{
+			applyRecord(json::parse(line));
+		}
+		catch (std::exception&)
+		{
+			continue;
+		}
+	}
+}
+
+/**
+ * Apply a record to the unfinished jobs
+ *
+ * @param[in] record the record
+ * @throws json::exception if the record is missing a field
+ */
+void JobJournal::applyRecord(const json& record)
+{
+	const std::string op = record.at("op").get<std::string>();
+	const uint64_t jobId = record.at("id").get<uint64_t>();
+	if (op == "submit")
+	{
+		entry_t entry;
+		entry.jobId = jobId;
+		entry.context = record.at("context").get<std::string>();
+		entry.url = record.at("url").get<std::string>();
+		entry.settings = record.at("settings");
+		mUnfinished[jobId] = std::move(entry);
+		mLastJobId = std::max(mLastJobId, jobId);
+	}
+	else if (op == "state")
+	{
+		auto it = mUnfinished.find(jobId);
+		if (it != mUnfinished.end())
+			it->second.state = record.at("state").get<std::string>();
+	}
+	else if (op == "process")
+	{
+		process_t process;
+		process.processId = record.at("pid").get<uint32_t>();
+		process.creationTime = record.at("created").get<uint64_t>();
+		process.outputPath = record.at("output").get<std::string>();
+		auto it = mUnfinished.find(jobId);
+		if (it != mUnfinished.end())
+			it->second.processes.push_back(std::move(process));
+	}
+	else if (op == "exited")
+	{
+		auto it = mUnfinished.find(jobId);
+		if (it != mUnfinished.end())
+			it->second.processes.clear();
+	}
+	else if (op == "done")
+		mUnfinished.erase(jobId);
+}
+
+/**
+ * Write a record to the end of the file. It is synced to the disk with the next batch.
+ *
+ * @param[in] record the record
+ * @param[in] lk the lock for mMutex
+ * @return false if the record cannot be written
+ */
+bool JobJournal::append(const json& record, const std::unique_lock<std::mutex>& lk)
+{
+	if (mFile == INVALID_HANDLE_VALUE || !writeAll(mFile, record.dump() + "\n"))
+		return false;
+
+	mRecordsSinceCompact++;
+	mDirty = true;
+	return true;
+}
+
+/**
+ * Rewrite the journal with only the unfinished jobs. The new journal is written and synced next to the old one,
+ * then it replaces it, so a crash at any point leaves one complete journal.
+ *
+ * @param[in] lk the lock for mMutex
+ * @return false if the journal cannot be rewritten, appending to the old one still works in that case
+ */
+bool JobJournal::compact(const std::unique_lock<std::mutex>& lk)
+{
+	std::string data;
+	for (const auto& [id, entry] : mUnfinished)
+	{
+		data += getSubmitRecord(entry).dump() + "\n";
+		if (!entry.state.empty())
+			data += json({ {"op", "state"}, {"id", id}, {"state", entry.state} }).dump() + "\n";
+		for (const auto& process : entry.processes)
+			data += getProcessRecord(id, process).dump() + "\n";
+	}
+
+	std::filesystem::path tempPath = mPath;
+	tempPath += ".tmp";
+	HANDLE tempFile = CreateFile(tempPath.wstring().c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	bool success = (tempFile != INVALID_HANDLE_VALUE);
+	if (success)
+	{
+		success = writeAll(tempFile, data) && FlushFileBuffers(tempFile);
+		CloseHandle(tempFile);
+	}
+
+	// the old journal has to be closed before it can be replaced, it is synced first in case it is kept
+	if (mFile != INVALID_HANDLE_VALUE)
+	{
+		if (mDirty)
+			FlushFileBuffers(mFile);
+		CloseHandle(mFile);
+		mFile = INVALID_HANDLE_VALUE;
+	}
+	if (success)
+		success = MoveFileEx(tempPath.wstring().c_str(), mPath.wstring().c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+
+	mFile = CreateFile(mPath.wstring().c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	// a failed compaction is tried again after another COMPACT_AFTER_RECORDS records, not on every record
+	mRecordsSinceCompact = 0;
+	if (success)
+		mDirty = false;
+	return success && (mFile != INVALID_HANDLE_VALUE);
+}
+
+/**
+ * Sync the written records to the disk, called with mMutex held
+ *
+ * @param[in] lk the lock for mMutex
+ * @return false if the file cannot be synced
+ */
+bool JobJournal::syncLocked(const std::unique_lock<std::mutex>& lk)
+{
+	if (!mDirty)
+		return true;
+	if (mFile == INVALID_HANDLE_VALUE || !FlushFileBuffers(mFile))
+		return false;
+	mDirty = false;
+	return true;
+}
+
+/**
+ * Thread function that syncs the records written since the last sync in one batch, every SYNC_INTERVAL_MILLIS
+ */
+void JobJournal::syncLoop()
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	while (!mStopping)
+	{
+		mSyncCv.wait_for(lk, std::chrono::milliseconds(SYNC_INTERVAL_MILLIS), [this]() { return mStopping; });
+		syncLocked(lk);
+	}
+}
+
+/**
+ * Get the record of a new job
+ *
+ * @param[in] entry the job
+ * @return the record
+ */
+json JobJournal::getSubmitRecord(const entry_t& entry)
+{
+	return { {"op", "submit"}, {"id", entry.jobId}, {"context", entry.context}, {"url", entry.url}, {"settings", entry.settings} };
+}
+
+/**
+ * Get the record of a child process of a job
+ *
+ * @param[in] jobId the id of the job
+ * @param[in] process the process
+ * @return the record
+ */
+json JobJournal::getProcessRecord(const uint64_t jobId, const process_t& process)
+{
+	return { {"op", "process"}, {"id", jobId}, {"pid", process.processId}, {"created", process.creationTime}, {"output", process.outputPath} };
+}
+
+/**
+ * Write a whole string to a file
+ *
+ * @param[in] file handle of the file
+ * @param[in] data the string
+ * @return false if not all of it was written
+ */
+bool JobJournal::writeAll(HANDLE file, const std::string& data)
+{
+	size_t offset = 0;
+	while (offset < data.size())
+	{
+		DWORD written = 0;
+		if (!WriteFile(file, data.data() + offset, static_cast<DWORD>(data.size() - offset), &written, NULL) || written == 0)
+			return false;
+		offset += written;
+	}
+	return true;
+}
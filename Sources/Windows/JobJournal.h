@@ -0,0 +1,106 @@
+//==============================================================================
+/**
+@file       JobJournal.h
+
+@brief		Append-only journal of download jobs, so unfinished jobs are queued again after a restart
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Vendor/json/src/json.hpp"
+using json = nlohmann::json;
+
+class JobJournal
+{
+public:
+	// a child process of a job, recorded so it can be adopted again if the plugin restarts while it runs
+	struct process_t
+	{
+		uint32_t processId = 0;
+		// tells the process apart from a later process that got the same id
+		uint64_t creationTime = 0;
+		// file the process writes its output to
+		std::string outputPath;
+	};
+
+	// a job that was submitted and did not finish yet
+	struct entry_t
+	{
+		uint64_t jobId = 0;
+		std::string context;
+		std::string url;
+		// settings payload of the button at the time of the press
+		json settings;
+		// last state recorded for the job, empty if it never changed state
+		std::string state;
+		// processes started for the job that may still be running
+		std::vector<process_t> processes;
+	};
+
+	// records reach the file right away, so they survive a crash of the plugin. They are synced to the disk this often.
+	static constexpr uint32_t SYNC_INTERVAL_MILLIS = 200;
+	// the journal is rewritten with only the unfinished jobs once this many records were appended
+	static constexpr uint32_t COMPACT_AFTER_RECORDS = 1000;
+
+	/**
+	 * Open the journal and replay it. Records that were torn by a crash are dropped.
+	 *
+	 * @param[in] path the journal file, created if it does not exist
+	 * @throws runtime_error if the journal cannot be opened
+	 */
+	JobJournal(const std::filesystem::path& path);
+	~JobJournal();
+
+	JobJournal(const JobJournal&) = delete;
+	JobJournal& operator=(const JobJournal&) = delete;
+
+	std::vector<entry_t> getUnfinished();
+	uint64_t getLastJobId();
+	std::vector<process_t> getProcesses(const uint64_t jobId);
+
+	bool recordSubmit(const entry_t& entry);
+	bool recordState(const uint64_t jobId, const std::string& state);
+	bool recordProcess(const uint64_t jobId, const process_t& process);
+	bool recordProcessesExited(const uint64_t jobId);
+	bool recordDone(const uint64_t jobId);
+	bool sync();
+private:
+	const std::filesystem::path mPath;
+
+	std::mutex mMutex;
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	// ordered by id, so jobs are queued again in the order they were submitted
+	std::map<uint64_t, entry_t> mUnfinished;
+	uint64_t mLastJobId = 0;
+	uint32_t mRecordsSinceCompact = 0;
+	// records were written since the last sync
+	bool mDirty = false;
+
+	bool mStopping = false;
+	std::condition_variable mSyncCv;
+	std::thread mSyncThread;
+
+	void replay();
+	void applyRecord(const json& record);
+	bool append(const json& record, const std::unique_lock<std::mutex>& lk);
+	bool compact(const std::unique_lock<std::mutex>& lk);
+	bool syncLocked(const std::unique_lock<std::mutex>& lk);
+	void syncLoop();
+
+	static json getSubmitRecord(const entry_t& entry);
+	static json getProcessRecord(const uint64_t jobId, const process_t& process);
+	static bool writeAll(HANDLE file, const std::string& data);
+};
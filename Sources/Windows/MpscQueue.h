@@ -0,0 +1,131 @@
+//==============================================================================
+/**
+@file       MpscQueue.h
+
+@brief		Unbounded lock-free queue with many producers and one consumer
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include "EventCount.h"
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+/**
+ * Producers link a node with a single atomic exchange and never wait for each other or for the consumer.
+ * A producer that was preempted between the exchange and linking its node hides the nodes behind it until it
+ * resumes, so the consumer may see the queue as empty for that moment. Nothing is lost, the producer still
+ * wakes the consumer once its node is linked.
+ */
+template <typename T>
+class MpscQueue
+{
+public:
+	MpscQueue()
+	{
+		mFront = new node_t();
+		mBack.store(mFront, std::memory_order_relaxed);
+	}
+
+	~MpscQueue()
+	{
+		while (mFront != nullptr)
+		{
+			node_t* next = mFront->next.load(std::memory_order_relaxed);
+			delete mFront;
+			mFront = next;
+		}
+	}
+
+	MpscQueue(const MpscQueue&) = delete;
+	MpscQueue& operator=(const MpscQueue&) = delete;
+
+	/**
+	 * Add a value and wake the consumer. Safe to call from any thread.
+	 *
+	 * @param[in] value the value to move into the queue
+	 */
+	void push(T value)
+	{
+		node_t* node = new node_t();
+		node->value.emplace(std::move(value));
+		node_t* prev = mBack.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+		mEvents.notify();
+	}
+
+	/**
+	 * Take the oldest value. Only the consumer thread may call this.
+	 *
+	 * @return the value, or nullopt if the queue is empty
+	 */
+	std::optional<T> tryPop()
+	{
+		node_t* next = mFront->next.load(std::memory_order_acquire);
+		if (next == nullptr)
+			return std::nullopt;
+
+		// next becomes the new empty front node
+		std::optional<T> value = std::move(next->value);
+		next->value.reset();
+		delete mFront;
+		mFront = next;
+		return value;
+	}
+
+	/**
+	 * Check for values. Only the consumer thread may call this.
+	 */
+	bool empty() const
+	{
+		return mFront->next.load(std::memory_order_acquire) == nullptr;
+	}
+
+	/**
+	 * Block the consumer until the queue has a value or stopWaiting returns true.
+	 * Whoever makes stopWaiting true must call notify afterwards.
+	 *
+	 * @param[in] stopWaiting condition besides a value that ends the wait
+	 */
+	template <typename Predicate>
+	void wait(Predicate stopWaiting)
+	{
+		while (empty() && !stopWaiting())
+		{
+			const uint32_t key = mEvents.prepareWait();
+			if (!empty() || stopWaiting())
+			{
+				mEvents.cancelWait();
+				return;
+			}
+			mEvents.commitWait(key);
+		}
+	}
+
+	/**
+	 * Wake the consumer without adding a value, e.g. to shut it down
+	 */
+	void notify()
+	{
+		mEvents.notify();
+	}
+
+private:
+	struct node_t
+	{
+		std::atomic<node_t*> next = nullptr;
+		std::optional<T> value = std::nullopt;
+	};
+
+	// producers append behind mBack, the consumer owns mFront, which is always an empty node.
+	// They are on separate cache lines so producers do not slow down the consumer.
+	alignas(64) std::atomic<node_t*> mBack;
+	alignas(64) node_t* mFront;
+	EventCount mEvents;
+};
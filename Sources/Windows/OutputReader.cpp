@@ -0,0 +1,579 @@
+//==============================================================================
+/**
+@file       OutputReader.cpp
+
+@brief		Single thread that reads the output pipes of many child processes
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "pch.h"
+
+#include "OutputReader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Get the reader shared by all download jobs.
+ * It is never destroyed, so that jobs left running by a detached scheduler can still use it while the plugin exits.
+ *
+ * @return the shared reader
+ */
+OutputReader& OutputReader::getInstance()
+{
+	static OutputReader* instance = new OutputReader();
+	return *instance;
+}
+
+/**
+ * Create the reader and start its thread
+ *
+ * @throws runtime_error if the completion port or epoll cannot be created
+ */
+OutputReader::OutputReader()
+{
+#ifdef _WIN32
+	mPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+	if (mPort == NULL)
+		throw std::runtime_error("Cannot create output reader completion port.");
+#else
+	mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+	mWakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (mEpollFd < 0 || mWakeFd < 0)
+		throw std::runtime_error("Cannot create output reader epoll: " + std::string(strerror(errno)));
+
+	// id 0 is never given to a pipe, so it marks the wake event
+	epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.u64 = 0;
+	epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFd, &ev);
+#endif
+
+	mT = std::thread(&OutputReader::readerLoop, this);
+}
+
+OutputReader::~OutputReader()
+{
+	{
+		std::unique_lock<std::mutex> lk(mMutex);
+		mStopping = true;
+	}
+#ifdef _WIN32
+	PostQueuedCompletionStatus(mPort, 0, 0, NULL);
+#else
+	wake();
+#endif
+	if (mT.joinable())
+		mT.join();
+
+	for (const auto& stream : mStreams)
+	{
+#ifdef _WIN32
+		CancelIoEx(stream.second->hRead, NULL);
+		CloseHandle(stream.second->hRead);
+#else
+		close(stream.second->readFd);
+#endif
+	}
+	mStreams.clear();
+
+#ifdef _WIN32
+	CloseHandle(mPort);
+#else
+	close(mWakeFd);
+	close(mEpollFd);
+#endif
+}
+
+/**
+ * Create a pipe for the output of a child process. The reader thread reads the pipe until every write end is closed.
+ *
+ * @param[in] onData called with every chunk of output
+ * @param[in] onClosed called once after the last chunk, when the pipe is closed or cancelled
+ * @return the pipe id and the write end for the child
+ * @throws runtime_error if the pipe cannot be created
+ */
+OutputReader::pipe_t OutputReader::openPipe(dataCallback_t onData, closedCallback_t onClosed)
+{
+	std::unique_ptr<stream_t> stream = std::make_unique<stream_t>();
+	stream->id = mNextId++;
+	stream->onData = std::move(onData);
+	stream->onClosed = std::move(onClosed);
+
+	pipe_t pipe;
+	pipe.id = stream->id;
+
+#ifdef _WIN32
+	// anonymous pipes cannot do overlapped reads, so use a named pipe with a unique name
+	const std::wstring name = L"\\\\.\\pipe\\youtube-dl-plugin-" + std::to_wstring(GetCurrentProcessId()) + L"-" + std::to_wstring(stream->id);
+	stream->hRead = CreateNamedPipeW(name.c_str(), PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+		PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1, 0, READ_BUFFER_SIZE, 0, NULL);
+	if (stream->hRead == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Cannot create output pipe.");
+
+	SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+	pipe.childEnd = CreateFileW(name.c_str(), GENERIC_WRITE, 0, &sa, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (pipe.childEnd == INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(stream->hRead);
+		throw std::runtime_error("Cannot open write end of output pipe.");
+	}
+
+	if (CreateIoCompletionPort(stream->hRead, mPort, 0, 0) == NULL)
+	{
+		CloseHandle(stream->hRead);
+		CloseHandle(pipe.childEnd);
+		throw std::runtime_error("Cannot attach output pipe to completion port.");
+	}
+#else
+	int fds[2];
+	if (pipe2(fds, O_CLOEXEC) != 0)
+		throw std::runtime_error("Cannot create output pipe: " + std::string(strerror(errno)));
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	stream->readFd = fds[0];
+	pipe.childEnd = fds[1];
+#endif
+
+	{
+		std::unique_lock<std::mutex> lk(mMutex);
+		if (mStopping)
+		{
+#ifdef _WIN32
+			CloseHandle(stream->hRead);
+#else
+			close(stream->readFd);
+#endif
+			closeChildEnd(pipe.childEnd);
+			throw std::runtime_error("Output reader is stopping.");
+		}
+
+#ifndef _WIN32
+		epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.u64 = stream->id;
+		if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, stream->readFd, &ev) != 0)
+		{
+			close(stream->readFd);
+			closeChildEnd(pipe.childEnd);
+			throw std::runtime_error("Cannot watch output pipe: " + std::string(strerror(errno)));
+		}
+#endif
+		mStreams.insert({ stream->id, std::move(stream) });
+	}
+
+#ifdef _WIN32
+	// the first read is started on the reader thread, so every callback runs there
+	PostQueuedCompletionStatus(mPort, 0, static_cast<ULONG_PTR>(pipe.id), NULL);
+#endif
+	return pipe;
+}
+
+/**
+ * Tail a file that a child process writes its output to. Unlike a pipe the file outlives this process,
+ * so a child that is left running when the plugin exits can still write to it, and the output can be read
+ * again after a restart. The file is read until the stream is cancelled.
+ *
+ * @param[in] path the file
+ * @param[in] onData called with every chunk of output
+ * @param[in] onClosed called once after the last chunk, when the stream is cancelled and the file is read to its end
+ * @param[in] forChild create the file and return an inheritable write end for the child,
+ *                     otherwise the file must exist, e.g. when it was created by the last session
+ * @return the stream id and the write end for the child, if requested
+ * @throws runtime_error if the file cannot be opened
+ */
+OutputReader::pipe_t OutputReader::openFile(const std::filesystem::path& path, dataCallback_t onData, closedCallback_t onClosed,
+	const bool forChild)
+{
+	std::unique_ptr<stream_t> stream = std::make_unique<stream_t>();
+	stream->id = mNextId++;
+	stream->isFile = true;
+	stream->onData = std::move(onData);
+	stream->onClosed = std::move(onClosed);
+
+	pipe_t pipe;
+	pipe.id = stream->id;
+
+#ifdef _WIN32
+	pipe.childEnd = INVALID_HANDLE_VALUE;
+	if (forChild)
+	{
+		// the file can be deleted while it is open, by this process or by the next session
+		SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+		pipe.childEnd = CreateFileW(path.wstring().c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, &sa,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (pipe.childEnd == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("Cannot create output file: " + path.string());
+	}
+
+	// the reader thread polls the file, so the handle is not overlapped
+	stream->hRead = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (stream->hRead == INVALID_HANDLE_VALUE)
+	{
+		if (forChild)
+			closeChildEnd(pipe.childEnd);
+		throw std::runtime_error("Cannot open output file: " + path.string());
+	}
+#else
+	pipe.childEnd = -1;
+	if (forChild)
+	{
+		pipe.childEnd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+		if (pipe.childEnd < 0)
+			throw std::runtime_error("Cannot create output file: " + std::string(strerror(errno)));
+	}
+
+	stream->readFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (stream->readFd < 0)
+	{
+		const std::string error = strerror(errno);
+		if (forChild)
+			closeChildEnd(pipe.childEnd);
+		throw std::runtime_error("Cannot open output file: " + error);
+	}
+#endif
+
+	{
+		std::unique_lock<std::mutex> lk(mMutex);
+		if (mStopping)
+		{
+#ifdef _WIN32
+			CloseHandle(stream->hRead);
+#else
+			close(stream->readFd);
+#endif
+			if (forChild)
+				closeChildEnd(pipe.childEnd);
+			throw std::runtime_error("Output reader is stopping.");
+		}
+		mStreams.insert({ stream->id, std::move(stream) });
+	}
+
+	// wake the reader thread, it waits without a timeout while no file is tailed
+#ifdef _WIN32
+	PostQueuedCompletionStatus(mPort, 0, static_cast<ULONG_PTR>(pipe.id), NULL);
+#else
+	wake();
+#endif
+	return pipe;
+}
+
+/**
+ * Stop reading a pipe, even if a write end is still open. Used when a grandchild keeps the pipe open after the child exited,
+ * and to end the tailing of a file once its child exited. The closed callback still runs.
+ *
+ * @param[in] id the pipe to stop reading
+ */
+void OutputReader::cancel(const pipeId_t id)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	auto it = mStreams.find(id);
+	if (it == mStreams.end())
+		return;
+
+	// a file is read to its end first, the output the child wrote before it exited is not lost
+	if (it->second->isFile)
+	{
+		it->second->finishing = true;
+		lk.unlock();
+#ifdef _WIN32
+		PostQueuedCompletionStatus(mPort, 0, static_cast<ULONG_PTR>(id), NULL);
+#else
+		wake();
+#endif
+		return;
+	}
+
+#ifdef _WIN32
+	it->second->cancelled = true;
+	CancelIoEx(it->second->hRead, NULL);
+#else
+	mCancelled.push_back(id);
+	lk.unlock();
+	wake();
+#endif
+}
+
+/**
+ * Close the write end of a pipe in this process
+ *
+ * @param[in] childEnd the write end returned by openPipe
+ */
+void OutputReader::closeChildEnd(const pipeHandle_t childEnd)
+{
+#ifdef _WIN32
+	CloseHandle(childEnd);
+#else
+	close(childEnd);
+#endif
+}
+
+/**
+ * Remove a stream and run its closed callback. Only called on the reader thread.
+ *
+ * @param[in] id the pipe to close
+ */
+void OutputReader::closeStream(const pipeId_t id)
+{
+	std::unique_ptr<stream_t> stream = nullptr;
+	{
+		std::unique_lock<std::mutex> lk(mMutex);
+		auto it = mStreams.find(id);
+		if (it == mStreams.end())
+			return;
+		stream = std::move(it->second);
+		mStreams.erase(it);
+	}
+
+#ifdef _WIN32
+	CloseHandle(stream->hRead);
+#else
+	if (!stream->isFile)
+		epoll_ctl(mEpollFd, EPOLL_CTL_DEL, stream->readFd, nullptr);
+	close(stream->readFd);
+#endif
+	stream->onClosed();
+}
+
+/**
+ * Read what was written to the tailed files since the last poll. A file that was cancelled is closed
+ * once it is read to its end. Only called on the reader thread.
+ *
+ * @return true if any file is still tailed
+ */
+bool OutputReader::pollFiles()
+{
+	// streams are only removed on this thread, so they stay alive outside the lock
+	std::vector<stream_t*> files;
+	{
+		std::unique_lock<std::mutex> lk(mMutex);
+		for (const auto& [id, stream] : mStreams)
+		{
+			if (stream->isFile)
+				files.push_back(stream.get());
+		}
+	}
+
+	bool tailing = false;
+	for (stream_t* stream : files)
+	{
+		// read the flag before the file, so everything written before the cancel is read
+		bool finishing = false;
+		{
+			std::unique_lock<std::mutex> lk(mMutex);
+			finishing = stream->finishing;
+		}
+
+		while (true)
+		{
+#ifdef _WIN32
+			DWORD bytesRead = 0;
+			if (!ReadFile(stream->hRead, stream->buffer.data(), static_cast<DWORD>(stream->buffer.size()), &bytesRead, NULL) || bytesRead == 0)
+				break;
+#else
+			const ssize_t bytesRead = read(stream->readFd, stream->buffer.data(), stream->buffer.size());
+			if (bytesRead < 0 && errno == EINTR)
+				continue;
+			if (bytesRead <= 0)
+				break;
+#endif
+			stream->onData(stream->buffer.data(), static_cast<size_t>(bytesRead));
+		}
+
+		if (finishing)
+			closeStream(stream->id);
+		else
+			tailing = true;
+	}
+	return tailing;
+}
+
+#ifdef _WIN32
+/**
+ * Issue the next overlapped read of a stream
+ *
+ * @param[in] stream the stream to read
+ * @return false if the stream is cancelled or the read failed right away
+ */
+bool OutputReader::startRead(stream_t& stream)
+{
+	// under the lock, so a cancel either sees the pending read or is seen here
+	std::unique_lock<std::mutex> lk(mMutex);
+	if (stream.cancelled)
+		return false;
+
+	ZeroMemory(&stream.overlapped, sizeof(OVERLAPPED));
+	if (!ReadFile(stream.hRead, stream.buffer.data(), static_cast<DWORD>(stream.buffer.size()), NULL, &stream.overlapped) &&
+		GetLastError() != ERROR_IO_PENDING)
+		return false;
+	// a read that completed right away still posts its completion
+	return true;
+}
+#else
+/**
+ * Interrupt the reader thread so it picks up cancels or the stop signal
+ */
+void OutputReader::wake()
+{
+	uint64_t one = 1;
+	ssize_t written = write(mWakeFd, &one, sizeof(one));
+	(void)written;
+}
+#endif
+
+/**
+ * Reader thread function. Waits on all pipes at once and hands their output to the callbacks.
+ * Tailed files are polled in between.
+ */
+void OutputReader::readerLoop()
+{
+	typedef std::chrono::steady_clock steadyClock_t;
+
+	// the files are polled on a timer, busy pipes must not hold the polls off
+	bool tailing = false;
+	steadyClock_t::time_point nextPoll = steadyClock_t::now();
+	auto getTimeoutMillis = [&]()
+	{
+		if (!tailing)
+			return static_cast<int64_t>(-1);
+		return std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(nextPoll - steadyClock_t::now()).count());
+	};
+	auto pollAndReschedule = [&]()
+	{
+		tailing = pollFiles();
+		nextPoll = steadyClock_t::now() + std::chrono::milliseconds(TAIL_POLL_INTERVAL_MILLIS);
+	};
+
+#ifdef _WIN32
+	while (true)
+	{
+		DWORD bytes = 0;
+		ULONG_PTR key = 0;
+		OVERLAPPED* overlapped = NULL;
+		const int64_t timeoutMillis = getTimeoutMillis();
+		const BOOL ok = GetQueuedCompletionStatus(mPort, &bytes, &key, &overlapped,
+			(timeoutMillis < 0) ? INFINITE : static_cast<DWORD>(timeoutMillis));
+
+		bool pollNow = false;
+		if (overlapped == NULL)
+		{
+			// the wait timed out, so it is time to poll the files
+			if (!ok && GetLastError() == WAIT_TIMEOUT)
+				pollNow = true;
+			// posted packets carry the id of a new pipe or file, or of a cancelled file. 0 is the stop signal.
+			else if (!ok || key == 0)
+				break;
+			else
+			{
+				stream_t* stream = nullptr;
+				{
+					std::unique_lock<std::mutex> lk(mMutex);
+					auto it = mStreams.find(static_cast<pipeId_t>(key));
+					if (it != mStreams.end())
+						stream = it->second.get();
+				}
+				if (stream != nullptr && stream->isFile)
+					pollNow = true;
+				else if (stream != nullptr && !startRead(*stream))
+					closeStream(stream->id);
+			}
+		}
+		else
+		{
+			// streams are only removed on this thread, so the stream is still alive
+			stream_t* stream = reinterpret_cast<stream_t*>(overlapped);
+			if (ok && bytes > 0)
+				stream->onData(stream->buffer.data(), bytes);
+			// a broken pipe means every write end is closed
+			if (!ok || !startRead(*stream))
+				closeStream(stream->id);
+		}
+
+		if (pollNow || (tailing && steadyClock_t::now() >= nextPoll))
+			pollAndReschedule();
+	}
+#else
+	const int MAX_EVENTS = 64;
+	epoll_event events[MAX_EVENTS];
+	while (true)
+	{
+		int count = epoll_wait(mEpollFd, events, MAX_EVENTS, static_cast<int>(getTimeoutMillis()));
+		if (count < 0 && errno != EINTR)
+			break;
+
+		// a wake may be for a new or cancelled file, which has to be read right away
+		bool pollNow = false;
+
+		for (int i = 0; i < count; i++)
+		{
+			const pipeId_t id = events[i].data.u64;
+			if (id == 0)
+			{
+				uint64_t value;
+				ssize_t bytesRead = read(mWakeFd, &value, sizeof(value));
+				(void)bytesRead;
+
+				std::vector<pipeId_t> cancelled;
+				{
+					std::unique_lock<std::mutex> lk(mMutex);
+					cancelled.swap(mCancelled);
+				}
+				for (const pipeId_t cancelledId : cancelled)
+					closeStream(cancelledId);
+				pollNow = true;
+				continue;
+			}
+
+			// streams are only removed on this thread, so the stream stays alive outside the lock
+			stream_t* stream = nullptr;
+			{
+				std::unique_lock<std::mutex> lk(mMutex);
+				auto it = mStreams.find(id);
+				if (it != mStreams.end())
+					stream = it->second.get();
+			}
+			if (stream == nullptr)
+				continue;
+
+			// drain everything that is available, end of file means every write end is closed
+			while (true)
+			{
+				const ssize_t bytesRead = read(stream->readFd, stream->buffer.data(), stream->buffer.size());
+				if (bytesRead > 0)
+				{
+					stream->onData(stream->buffer.data(), static_cast<size_t>(bytesRead));
+					continue;
+				}
+				if (bytesRead < 0 && errno == EINTR)
+					continue;
+				if (bytesRead < 0 && errno == EAGAIN)
+					break;
+				closeStream(id);
+				break;
+			}
+		}
+
+		if (pollNow || (tailing && steadyClock_t::now() >= nextPoll))
+			pollAndReschedule();
+
+		std::unique_lock<std::mutex> lk(mMutex);
+		if (mStopping)
+			break;
+	}
+#endif
+}
@@ -0,0 +1,105 @@
+//==============================================================================
+/**
+@file       OutputReader.h
+
+@brief		Single thread that reads the output pipes of many child processes
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class OutputReader
+{
+public:
+#ifdef _WIN32
+	typedef HANDLE pipeHandle_t;
+#else
+	typedef int pipeHandle_t;
+#endif
+	typedef uint64_t pipeId_t;
+
+	// both are called on the reader thread, so they must not block
+	typedef std::function<void(const char* data, const size_t size)> dataCallback_t;
+	typedef std::function<void(void)> closedCallback_t;
+
+	struct pipe_t
+	{
+		pipeId_t id = 0;
+		// inheritable write end that is passed to the child, the caller closes it once the child is started
+		pipeHandle_t childEnd;
+	};
+
+	static constexpr size_t READ_BUFFER_SIZE = 4096;
+	// how often files opened with openFile are checked for new output
+	static constexpr uint32_t TAIL_POLL_INTERVAL_MILLIS = 100;
+
+	static OutputReader& getInstance();
+
+	OutputReader();
+	~OutputReader();
+
+	pipe_t openPipe(dataCallback_t onData, closedCallback_t onClosed);
+	pipe_t openFile(const std::filesystem::path& path, dataCallback_t onData, closedCallback_t onClosed, const bool forChild);
+	void cancel(const pipeId_t id);
+
+	static void closeChildEnd(const pipeHandle_t childEnd);
+
+private:
+	struct stream_t
+	{
+#ifdef _WIN32
+		// must stay the first member, completions are mapped back to their stream through it
+		OVERLAPPED overlapped = {};
+		HANDLE hRead = INVALID_HANDLE_VALUE;
+		// set by cancel, the reader thread then stops issuing reads
+		bool cancelled = false;
+#else
+		int readFd = -1;
+#endif
+		pipeId_t id = 0;
+		// a file is tailed until it is cancelled, instead of being read until every write end is closed
+		bool isFile = false;
+		// set by cancel on a file, the reader thread then reads the rest of the file and closes it
+		bool finishing = false;
+		dataCallback_t onData;
+		closedCallback_t onClosed;
+		std::array<char, READ_BUFFER_SIZE> buffer = {};
+	};
+
+	std::mutex mMutex;
+	bool mStopping = false;
+	std::thread mT;
+	std::atomic<pipeId_t> mNextId = 1;
+	std::unordered_map<pipeId_t, std::unique_ptr<stream_t>> mStreams;
+
+#ifdef _WIN32
+	HANDLE mPort = NULL;
+
+	bool startRead(stream_t& stream);
+#else
+	int mEpollFd = -1;
+	int mWakeFd = -1;
+	// pipes whose cancel has not been handled by the reader thread yet
+	std::vector<pipeId_t> mCancelled;
+
+	void wake();
+#endif
+
+	void readerLoop();
+	void closeStream(const pipeId_t id);
+	bool pollFiles();
+};
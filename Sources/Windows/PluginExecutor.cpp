@@ -0,0 +1,125 @@
+//==============================================================================
+/**
+@file       PluginExecutor.cpp
+
+@brief		Thread pool that runs the plugin's event handlers off the websocket thread
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "pch.h"
+
+#include "PluginExecutor.h"
+
+#include <algorithm>
+#include <optional>
+
+/**
+ * Create the executor and spawn its worker threads
+ *
+ * @param[in] threadCount the number of contexts whose tasks can run at the same time
+ * @param[in] onError gets the message of every task that threw, e.g. to log it. A failed task does not stop the others.
+ */
+PluginExecutor::PluginExecutor(const uint32_t threadCount, errorHandler_t onError) :
+	mOnError(std::move(onError))
+{
+	for (uint32_t i = 0; i < std::max<uint32_t>(threadCount, 1); i++)
+		mWorkers.emplace_back(&PluginExecutor::worker, this);
+}
+
+PluginExecutor::~PluginExecutor()
+{
+	shutdown();
+}
+
+/**
+ * Queue a task behind the other tasks of its context
+ *
+ * @param[in] context the context the task belongs to, tasks without a context share handle 0
+ * @param[in] task the task to run
+ */
+void PluginExecutor::post(const contextHandle_t context, task_t task)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	if (mStopping)
+		return;
+
+	strand_t& strand = mStrands[context];
+	strand.tasks.push_back(std::move(task));
+	if (!strand.running)
+	{
+		strand.running = true;
+		mReady.push_back(context);
+		mCv.notify_one();
+	}
+}
+
+/**
+ * Wait for the running tasks and drop the queued ones. Posting afterwards does nothing.
+ */
+void PluginExecutor::shutdown()
+{
+	{
+		std::unique_lock<std::mutex> lk(mMutex);
+		mStopping = true;
+		mCv.notify_all();
+	}
+	for (auto& t : mWorkers)
+	{
+		if (t.joinable())
+			t.join();
+	}
+
+	std::unique_lock<std::mutex> lk(mMutex);
+	mStrands.clear();
+	mReady.clear();
+}
+
+/**
+ * Runs one task of a ready context at a time, and puts the context back at the end of the ready queue
+ * if it has more, so a context with many queued events does not starve the others.
+ */
+void PluginExecutor::worker()
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	while (true)
+	{
+		mCv.wait(lk, [&] { return mStopping || !mReady.empty(); });
+		if (mStopping)
+			return;
+
+		const contextHandle_t context = mReady.front();
+		mReady.pop_front();
+		task_t task = std::move(mStrands.at(context).tasks.front());
+		mStrands.at(context).tasks.pop_front();
+
+		lk.unlock();
+		std::optional<std::string> error = std::nullopt;
+		try
+		{
+			task();
+		}
+		catch (std::exception& e)
+		{
+			error = "Plugin task failed: " + std::string(e.what());
+		}
+		catch (...)
+		{
+			error = std::string("Plugin task failed with an unknown exception");
+		}
+		if (error && mOnError)
+			mOnError(*error);
+		lk.lock();
+
+		strand_t& strand = mStrands.at(context);
+		if (strand.tasks.empty())
+			mStrands.erase(context);
+		else
+		{
+			mReady.push_back(context);
+			mCv.notify_one();
+		}
+	}
+}
@@ -0,0 +1,62 @@
+//==============================================================================
+/**
+@file       PluginExecutor.h
+
+@brief		Thread pool that runs the plugin's event handlers off the websocket thread
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include "Common.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Tasks posted with the same context run one at a time in the order they were posted, so the events of a
+ * button are handled in order. Tasks of different contexts run in parallel, so a handler that blocks on the
+ * clipboard or a slow drive only holds up its own button.
+ */
+class PluginExecutor
+{
+public:
+	typedef std::function<void(void)> task_t;
+	// gets the message of a task that threw, called on the worker thread
+	typedef std::function<void(const std::string&)> errorHandler_t;
+
+	static constexpr uint32_t DEFAULT_THREAD_COUNT = 4;
+
+	PluginExecutor(const uint32_t threadCount = DEFAULT_THREAD_COUNT, errorHandler_t onError = nullptr);
+	~PluginExecutor();
+
+	void post(const contextHandle_t context, task_t task);
+	void shutdown();
+
+private:
+	// tasks of one context, the context is in mReady while a worker may take its next task
+	struct strand_t
+	{
+		std::deque<task_t> tasks;
+		bool running = false;
+	};
+
+	std::mutex mMutex;
+	std::condition_variable mCv;
+	bool mStopping = false;
+	std::unordered_map<contextHandle_t, strand_t> mStrands;
+	std::deque<contextHandle_t> mReady;
+	std::vector<std::thread> mWorkers;
+	const errorHandler_t mOnError;
+
+	void worker();
+};
@@ -0,0 +1,297 @@
+//==============================================================================
+/**
+@file       ProcessJob.cpp
+
+@brief		Job Object that holds the whole process tree of a download, with priority and resource caps
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "pch.h"
+
+#include "ProcessJob.h"
+#include "WindowsProcessUtils.h"
+
+#include <tlhelp32.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+ProcessJob::ProcessJob(const limits_t& limits)
+{
+	mJob = CreateJobObject(NULL, NULL);
+	if (mJob == NULL)
+		throw std::runtime_error("Cannot create job object.\n" + windowsprocessutils::getLastErrorAsString());
+
+	// ffmpeg and other grandchildren are placed in the job too, so a kill or a crash of the plugin takes the whole tree down
+	mLimitInfo.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE | JOB_OBJECT_LIMIT_PRIORITY_CLASS;
+	switch (limits.priority)
+	{
+	case NORMAL_PRIORITY:
+		mLimitInfo.BasicLimitInformation.PriorityClass = NORMAL_PRIORITY_CLASS;
+		break;
+	case IDLE_PRIORITY:
+		mLimitInfo.BasicLimitInformation.PriorityClass = IDLE_PRIORITY_CLASS;
+		break;
+	default:
+		mLimitInfo.BasicLimitInformation.PriorityClass = BELOW_NORMAL_PRIORITY_CLASS;
+		break;
+	}
+	if (limits.memoryLimitBytes)
+	{
+		mLimitInfo.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_JOB_MEMORY;
+		mLimitInfo.JobMemoryLimit = static_cast<SIZE_T>(*limits.memoryLimitBytes);
+	}
+
+	if (!SetInformationJobObject(mJob, JobObjectExtendedLimitInformation, &mLimitInfo, sizeof(mLimitInfo)))
+	{
+		std::string error = windowsprocessutils::getLastErrorAsString();
+		CloseHandle(mJob);
+		throw std::runtime_error("Cannot set job object limits.\n" + error);
+	}
+
+	if (limits.cpuRatePercent)
+	{
+		// the rate is given in 1/100 of a percent
+		JOBOBJECT_CPU_RATE_CONTROL_INFORMATION cpuInfo = {};
+		cpuInfo.ControlFlags = JOB_OBJECT_CPU_RATE_CONTROL_ENABLE | JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP;
+		cpuInfo.CpuRate = std::clamp<uint32_t>(*limits.cpuRatePercent, 1, 100) * 100;
+		if (!SetInformationJobObject(mJob, JobObjectCpuRateControlInformation, &cpuInfo, sizeof(cpuInfo)))
+		{
+			std::string error = windowsprocessutils::getLastErrorAsString();
+			CloseHandle(mJob);
+			throw std::runtime_error("Cannot set job object cpu rate.\n" + error);
+		}
+	}
+}
+
+ProcessJob::~ProcessJob()
+{
+	for (const auto& [id, thread] : mSuspendedThreads)
+		CloseHandle(thread);
+	CloseHandle(mJob);
+}
+
+/**
+ * Terminate every process in the job, including the ones started by the children
+ *
+ * @param[in] exitCode the exit code of the terminated processes
+ */
+void ProcessJob::terminate(const uint32_t exitCode)
+{
+	TerminateJobObject(mJob, exitCode);
+}
+
+/**
+ * Suspend every thread of every process in the job. Processes that joined the job since the last call
+ * are suspended too, the threads that are already suspended are left alone.
+ *
+ * @return false if the job has no process to suspend
+ */
+bool ProcessJob::suspend()
+{
+	const std::vector<DWORD> processIds = getProcessIds();
+	if (processIds.empty())
+		return false;
+	const std::unordered_set<DWORD> jobProcesses(processIds.begin(), processIds.end());
+
+	// there is no documented call that suspends a whole process, so suspend its threads one by one
+	HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+	if (snapshot == INVALID_HANDLE_VALUE)
+		return false;
+	THREADENTRY32 entry = {};
+	entry.dwSize = sizeof(entry);
+	for (BOOL found = Thread32First(snapshot, &entry); found; found = Thread32Next(snapshot, &entry))
+	{
+		if (jobProcesses.count(entry.th32OwnerProcessID) == 0 || mSuspendedThreads.count(entry.th32ThreadID) > 0)
+			continue;
+		HANDLE thread = OpenThread(THREAD_SUSPEND_RESUME, FALSE, entry.th32ThreadID);
+		if (thread == NULL)
+			continue;
+		if (SuspendThread(thread) == static_cast<DWORD>(-1))
+			CloseHandle(thread);
+		else
+			mSuspendedThreads.emplace(entry.th32ThreadID, thread);
+	}
+	CloseHandle(snapshot);
+
+	mSuspended = true;
+	return true;
+}
+
+/**
+ * Resume the threads suspended by suspend()
+ */
+void ProcessJob::resume()
+{
+	for (const auto& [id, thread] : mSuspendedThreads)
+	{
+		ResumeThread(thread);
+		CloseHandle(thread);
+	}
+	mSuspendedThreads.clear();
+	mSuspended = false;
+}
+
+/**
+ * Set whether the processes of the job are killed once the job is closed, e.g. when the plugin exits
+ *
+ * @param[in] killOnClose true to kill the processes on close
+ */
+void ProcessJob::setKillOnClose(const bool killOnClose)
+{
+	if (killOnClose)
+		mLimitInfo.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+	else
+		mLimitInfo.BasicLimitInformation.LimitFlags &= ~JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+	SetInformationJobObject(mJob, JobObjectExtendedLimitInformation, &mLimitInfo, sizeof(mLimitInfo));
+}
+
+/**
+ * Place a process that was started by the last session of the plugin in this job, along with the processes it started,
+ * e.g. ffmpeg. Their threads are resumed, in case the last session ended while it had them suspended.
+ *
+ * @param[in] process handle to the process, from windowsprocessutils::openProcess
+ * @return false if the process cannot be placed in the job
+ */
+bool ProcessJob::adopt(HANDLE process)
+{
+	// the process stays in the job of the last session too, this job is nested in that one
+	if (!AssignProcessToJobObject(mJob, process))
+		return false;
+
+	// a process id can be reused, so a child only counts if it is younger than its parent
+	std::unordered_map<DWORD, uint64_t> adopted = { { GetProcessId(process), windowsprocessutils::getCreationTime(process) } };
+	HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS | TH32CS_SNAPTHREAD, 0);
+	if (snapshot == INVALID_HANDLE_VALUE)
+		return true;
+
+	std::vector<PROCESSENTRY32> processes;
+	PROCESSENTRY32 processEntry = {};
+	processEntry.dwSize = sizeof(processEntry);
+	for (BOOL found = Process32First(snapshot, &processEntry); found; found = Process32Next(snapshot, &processEntry))
+		processes.push_back(processEntry);
+
+	// the snapshot is not in creation order, so repeat until no grandchild is left
+	bool added = true;
+	while (added)
+	{
+		added = false;
+		for (const auto& entry : processes)
+		{
+			auto parent = adopted.find(entry.th32ParentProcessID);
+			if (parent == adopted.end() || adopted.count(entry.th32ProcessID) > 0)
+				continue;
+			HANDLE child = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | PROCESS_TERMINATE | PROCESS_SET_QUOTA, FALSE, entry.th32ProcessID);
+			if (child == NULL)
+				continue;
+			const uint64_t creationTime = windowsprocessutils::getCreationTime(child);
+			if (creationTime >= parent->second && AssignProcessToJobObject(mJob, child))
+			{
+				adopted.emplace(entry.th32ProcessID, creationTime);
+				added = true;
+			}
+			CloseHandle(child);
+		}
+	}
+
+	// a thread that is not suspended ignores the resume
+	THREADENTRY32 threadEntry = {};
+	threadEntry.dwSize = sizeof(threadEntry);
+	for (BOOL found = Thread32First(snapshot, &threadEntry); found; found = Thread32Next(snapshot, &threadEntry))
+	{
+		if (adopted.count(threadEntry.th32OwnerProcessID) == 0)
+			continue;
+		HANDLE thread = OpenThread(THREAD_SUSPEND_RESUME, FALSE, threadEntry.th32ThreadID);
+		if (thread == NULL)
+			continue;
+		ResumeThread(thread);
+		CloseHandle(thread);
+	}
+	CloseHandle(snapshot);
+	return true;
+}
+
+/**
+ * Get the resources used so far by all processes that were ever in the job
+ *
+ * @return the peak memory and total cpu time, zero if they cannot be queried
+ */
+resourceUsage_t ProcessJob::getUsage() const
+{
+	resourceUsage_t usage;
+
+	JOBOBJECT_EXTENDED_LIMIT_INFORMATION limitInfo = {};
+	if (QueryInformationJobObject(mJob, JobObjectExtendedLimitInformation, &limitInfo, sizeof(limitInfo), NULL))
+		usage.peakMemoryBytes = limitInfo.PeakJobMemoryUsed;
+
+	// the times are counted in 100 ns ticks
+	JOBOBJECT_BASIC_ACCOUNTING_INFORMATION accounting = {};
+	if (QueryInformationJobObject(mJob, JobObjectBasicAccountingInformation, &accounting, sizeof(accounting), NULL))
+		usage.cpuTimeMillis = static_cast<uint64_t>(accounting.TotalUserTime.QuadPart + accounting.TotalKernelTime.QuadPart) / 10000;
+
+	return usage;
+}
+
+/**
+ * Get the number of processes currently in the job
+ *
+ * @return the number of processes, 0 if it cannot be queried
+ */
+uint32_t ProcessJob::getActiveProcessCount() const
+{
+	JOBOBJECT_BASIC_ACCOUNTING_INFORMATION accounting = {};
+	if (!QueryInformationJobObject(mJob, JobObjectBasicAccountingInformation, &accounting, sizeof(accounting), NULL))
+		return 0;
+	return accounting.ActiveProcesses;
+}
+
+/**
+ * Get the ids of the processes currently in the job
+ *
+ * @return the process ids, empty if they cannot be queried
+ */
+std::vector<DWORD> ProcessJob::getProcessIds() const
+{
+	// the list is a header followed by the ids, grow it until all ids fit
+	std::vector<uint8_t> buffer(sizeof(JOBOBJECT_BASIC_PROCESS_ID_LIST) + 16 * sizeof(ULONG_PTR));
+	while (true)
+	{
+		JOBOBJECT_BASIC_PROCESS_ID_LIST* list = reinterpret_cast<JOBOBJECT_BASIC_PROCESS_ID_LIST*>(buffer.data());
+		if (QueryInformationJobObject(mJob, JobObjectBasicProcessIdList, list, static_cast<DWORD>(buffer.size()), NULL) ||
+			GetLastError() == ERROR_MORE_DATA)
+		{
+			if (list->NumberOfProcessIdsInList < list->NumberOfAssignedProcesses)
+			{
+				buffer.resize(sizeof(JOBOBJECT_BASIC_PROCESS_ID_LIST) + list->NumberOfAssignedProcesses * 2 * sizeof(ULONG_PTR));
+				continue;
+			}
+			std::vector<DWORD> ids;
+			for (DWORD i = 0; i < list->NumberOfProcessIdsInList; i++)
+				ids.push_back(static_cast<DWORD>(list->ProcessIdList[i]));
+			return ids;
+		}
+		return {};
+	}
+}
+
+/**
+ * Get the job limits from the settings of a button
+ *
+ * @param[in] settings the settings sent by the PI
+ * @return the limits, a cap of 0 means no cap
+ */
+ProcessJob::limits_t ProcessJob::getLimits(const contextSettings_t& settings)
+{
+	limits_t limits;
+	limits.priority = settings.childPriority;
+	if (settings.maxMemoryMB && *settings.maxMemoryMB > 0)
+		limits.memoryLimitBytes = static_cast<uint64_t>(*settings.maxMemoryMB) * 1024 * 1024;
+	if (settings.maxCpuPercent && *settings.maxCpuPercent > 0 && *settings.maxCpuPercent < 100)
+		limits.cpuRatePercent = *settings.maxCpuPercent;
+	return limits;
+}
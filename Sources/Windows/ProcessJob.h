@@ -0,0 +1,72 @@
+//==============================================================================
+/**
+@file       ProcessJob.h
+
+@brief		Job Object that holds the whole process tree of a download, with priority and resource caps
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+#include "Common.h"
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+class ProcessJob
+{
+public:
+	// caps applied to all processes of the job together
+	struct limits_t
+	{
+		CHILD_PRIORITY priority = BELOW_NORMAL_PRIORITY;
+		std::optional<uint64_t> memoryLimitBytes = std::nullopt;
+		// percent of the time of all cores, 1-100
+		std::optional<uint32_t> cpuRatePercent = std::nullopt;
+	};
+
+	/**
+	 * Create an unnamed job object. Processes in it are killed once the last handle to the job is closed.
+	 *
+	 * @param[in] limits the priority and caps of the processes in the job
+	 * @throws runtime_error if the job object cannot be created or configured
+	 */
+	ProcessJob(const limits_t& limits);
+	~ProcessJob();
+
+	ProcessJob(const ProcessJob&) = delete;
+	ProcessJob& operator=(const ProcessJob&) = delete;
+
+	HANDLE getHandle() const
+	{
+		return mJob;
+	}
+
+	void terminate(const uint32_t exitCode);
+	bool suspend();
+	void resume();
+	bool isSuspended() const
+	{
+		return mSuspended;
+	}
+	void setKillOnClose(const bool killOnClose);
+	bool adopt(HANDLE process);
+
+	resourceUsage_t getUsage() const;
+	uint32_t getActiveProcessCount() const;
+
+	static limits_t getLimits(const contextSettings_t& settings);
+private:
+	HANDLE mJob = NULL;
+	JOBOBJECT_EXTENDED_LIMIT_INFORMATION mLimitInfo = {};
+
+	// threads suspended by suspend(), keyed by thread id, so a thread is never suspended twice
+	std::unordered_map<DWORD, HANDLE> mSuspendedThreads;
+	bool mSuspended = false;
+
+	std::vector<DWORD> getProcessIds() const;
+};
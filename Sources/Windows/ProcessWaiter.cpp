@@ -0,0 +1,256 @@
+//==============================================================================
+/**
+@file       ProcessWaiter.cpp
+
+@brief		Single thread that watches many child processes and runs a callback as soon as one exits
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "pch.h"
+
+#include "ProcessWaiter.h"
+
+#include <future>
+#include <stdexcept>
+#include <string>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#endif
+
+/**
+ * Get the waiter shared by all download jobs.
+ * It is never destroyed, so that jobs left running by a detached scheduler can still use it while the plugin exits.
+ *
+ * @return the shared waiter
+ */
+ProcessWaiter& ProcessWaiter::getInstance()
+{
+	static ProcessWaiter* instance = new ProcessWaiter();
+	return *instance;
+}
+
+/**
+ * Create the waiter and start its thread
+ *
+ * @throws runtime_error if the wait primitives cannot be created
+ */
+ProcessWaiter::ProcessWaiter()
+{
+#ifdef _WIN32
+	mWakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (mWakeEvent == NULL)
+		throw std::runtime_error("Cannot create process waiter event.");
+#else
+	mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+	mWakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (mEpollFd < 0 || mWakeFd < 0)
+		throw std::runtime_error("Cannot create process waiter epoll: " + std::string(strerror(errno)));
+
+	epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.fd = mWakeFd;
+	epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFd, &ev);
+#endif
+
+	mT = std::thread(&ProcessWaiter::waiterLoop, this);
+}
+
+ProcessWaiter::~ProcessWaiter()
+{
+	{
+		std::unique_lock<std::mutex> lk(mMutex);
+		mStopping = true;
+	}
+	wake();
+	if (mT.joinable())
+		mT.join();
+
+#ifdef _WIN32
+	CloseHandle(mWakeEvent);
+#else
+	for (const auto& watched : mWatched)
+		close(watched.first);
+	close(mWakeFd);
+	close(mEpollFd);
+#endif
+}
+
+/**
+ * Interrupt the waiter thread so it picks up new watches or the stop signal
+ */
+void ProcessWaiter::wake()
+{
+#ifdef _WIN32
+	SetEvent(mWakeEvent);
+#else
+	uint64_t one = 1;
+	ssize_t written = write(mWakeFd, &one, sizeof(one));
+	(void)written;
+#endif
+}
+
+/**
+ * Watch a process. The callback runs once on the waiter thread as soon as the process exits.
+ * The caller keeps ownership of the process handle and must keep it open until the callback has run.
+ *
+ * @param[in] process the process to watch
+ * @param[in] onExit the callback to run when the process exits
+ * @throws runtime_error if the process cannot be watched
+ */
+void ProcessWaiter::watch(const processHandle_t process, callback_t onExit)
+{
+#ifdef _WIN32
+	{
+		std::unique_lock<std::mutex> lk(mMutex);
+		if (mStopping)
+			throw std::runtime_error("Process waiter is stopping.");
+		mAdded.push_back({ process, std::move(onExit) });
+	}
+	wake();
+#else
+	// a pidfd becomes readable once the process exits, even if it already exited but is not reaped yet
+	int pidfd = static_cast<int>(syscall(SYS_pidfd_open, process, 0));
+	if (pidfd < 0)
+		throw std::runtime_error("Cannot open pidfd for process " + std::to_string(process) + ": " + std::string(strerror(errno)));
+
+	std::unique_lock<std::mutex> lk(mMutex);
+	if (mStopping)
+	{
+		close(pidfd);
+		throw std::runtime_error("Process waiter is stopping.");
+	}
+	mWatched.insert({ pidfd, { process, std::move(onExit) } });
+
+	epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.fd = pidfd;
+	if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, pidfd, &ev) != 0)
+	{
+		mWatched.erase(pidfd);
+		close(pidfd);
+		throw std::runtime_error("Cannot watch process " + std::to_string(process) + ": " + std::string(strerror(errno)));
+	}
+#endif
+}
+
+/**
+ * Block the calling thread until a process exits
+ *
+ * @param[in] process the process to wait for
+ * @throws runtime_error if the process cannot be watched
+ */
+void ProcessWaiter::wait(const processHandle_t process)
+{
+	// the promise is shared with the callback so it outlives set_value even if this thread wakes up first
+	std::shared_ptr<std::promise<void>> exited = std::make_shared<std::promise<void>>();
+	std::future<void> exitedFuture = exited->get_future();
+	watch(process, [exited]() { exited->set_value(); });
+	exitedFuture.wait();
+}
+
+/**
+ * Waiter thread function. Blocks on all watched processes at once and runs the callback of each one that exits.
+ */
+void ProcessWaiter::waiterLoop()
+{
+#ifdef _WIN32
+	std::vector<watchData_t> watched;
+	std::vector<HANDLE> handles;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lk(mMutex);
+			if (mStopping)
+				break;
+
+			// anything past MAX_WATCHED stays in mAdded until a slot frees up
+			while (!mAdded.empty() && watched.size() < MAX_WATCHED)
+			{
+				watched.push_back(std::move(mAdded.front()));
+				mAdded.erase(mAdded.begin());
+			}
+		}
+
+		handles.clear();
+		handles.push_back(mWakeEvent);
+		for (const auto& w : watched)
+			handles.push_back(w.process);
+
+		DWORD result = WaitForMultipleObjects(static_cast<DWORD>(handles.size()), handles.data(), FALSE, INFINITE);
+		if (result > WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + handles.size())
+		{
+			// remove before running the callback, the owner may close the handle right away
+			const size_t index = result - WAIT_OBJECT_0 - 1;
+			callback_t onExit = std::move(watched[index].onExit);
+			watched.erase(watched.begin() + index);
+			onExit();
+		}
+		else if (result == WAIT_FAILED)
+		{
+			// a handle was closed or is invalid, treat it as exited so its owner does not hang
+			for (auto it = watched.begin(); it != watched.end();)
+			{
+				if (WaitForSingleObject(it->process, 0) == WAIT_FAILED)
+				{
+					callback_t onExit = std::move(it->onExit);
+					it = watched.erase(it);
+					onExit();
+				}
+				else
+					it++;
+			}
+		}
+	}
+#else
+	const int MAX_EVENTS = 64;
+	epoll_event events[MAX_EVENTS];
+	while (true)
+	{
+		int count = epoll_wait(mEpollFd, events, MAX_EVENTS, -1);
+		if (count < 0 && errno != EINTR)
+			break;
+
+		for (int i = 0; i < count; i++)
+		{
+			const int fd = events[i].data.fd;
+			if (fd == mWakeFd)
+			{
+				uint64_t value;
+				ssize_t bytesRead = read(mWakeFd, &value, sizeof(value));
+				(void)bytesRead;
+				continue;
+			}
+
+			callback_t onExit;
+			{
+				std::unique_lock<std::mutex> lk(mMutex);
+				auto it = mWatched.find(fd);
+				if (it == mWatched.end())
+					continue;
+				onExit = std::move(it->second.onExit);
+				mWatched.erase(it);
+				epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, nullptr);
+				close(fd);
+			}
+			onExit();
+		}
+
+		std::unique_lock<std::mutex> lk(mMutex);
+		if (mStopping)
+			break;
+	}
+#endif
+}
@@ -0,0 +1,71 @@
+//==============================================================================
+/**
+@file       ProcessWaiter.h
+
+@brief		Single thread that watches many child processes and runs a callback as soon as one exits
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+class ProcessWaiter
+{
+public:
+#ifdef _WIN32
+	typedef HANDLE processHandle_t;
+#else
+	typedef pid_t processHandle_t;
+#endif
+	// called on the waiter thread once the process has exited, so it must not block
+	typedef std::function<void(void)> callback_t;
+
+	static ProcessWaiter& getInstance();
+
+	ProcessWaiter();
+	~ProcessWaiter();
+
+	void watch(const processHandle_t process, callback_t onExit);
+	void wait(const processHandle_t process);
+
+private:
+	struct watchData_t
+	{
+		processHandle_t process;
+		callback_t onExit;
+	};
+
+	std::mutex mMutex;
+	bool mStopping = false;
+	std::thread mT;
+
+#ifdef _WIN32
+	// WaitForMultipleObjects can watch at most MAXIMUM_WAIT_OBJECTS handles, one slot is used by the wake event
+	static constexpr size_t MAX_WATCHED = MAXIMUM_WAIT_OBJECTS - 1;
+
+	HANDLE mWakeEvent = NULL;
+	// watches added by other threads that the waiter thread has not picked up yet
+	std::vector<watchData_t> mAdded;
+#else
+	int mEpollFd = -1;
+	int mWakeFd = -1;
+	// watched processes keyed by their pidfd
+	std::unordered_map<int, watchData_t> mWatched;
+#endif
+
+	void waiterLoop();
+	void wake();
+};
@@ -0,0 +1,114 @@
+//==============================================================================
+/**
+@file       ProgressImages.cpp
+
+@brief		Pre-rendered progress bar images for the key
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "pch.h"
+
+#include "ProgressImages.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+/**
+ * Get the frames shared by all buttons. They are rendered the first time this is called.
+ *
+ * @return the shared frames
+ */
+const ProgressImages& ProgressImages::getInstance()
+{
+	static const ProgressImages instance;
+	return instance;
+}
+
+/**
+ * Render and encode every frame at both sizes, so updating a key never encodes an image
+ */
+ProgressImages::ProgressImages()
+{
+	const std::string DATA_URL_PREFIX = "data:image/png;base64,";
+
+	mFrames.reserve(FRAME_COUNT);
+	mHighResFrames.reserve(FRAME_COUNT);
+	for (uint32_t i = 0; i < FRAME_COUNT; i++)
+	{
+		mFrames.push_back(DATA_URL_PREFIX + imageutils::encodeBase64(imageutils::encodePng(drawFrame(SIZE, i * STEP_PERCENT))));
+		mHighResFrames.push_back(DATA_URL_PREFIX + imageutils::encodeBase64(imageutils::encodePng(drawFrame(HIGH_RES_SIZE, i * STEP_PERCENT))));
+	}
+}
+
+/**
+ * Get the frame that shows a percentage, rounded down to a step
+ *
+ * @param[in] percent the progress, values over 100 are shown as 100
+ * @return the frame index
+ */
+uint32_t ProgressImages::getFrameIndex(const uint32_t percent)
+{
+	return std::min<uint32_t>(percent, 100) / STEP_PERCENT;
+}
+
+/**
+ * Get an encoded frame
+ *
+ * @param[in] index the frame index from getFrameIndex
+ * @param[in] highRes true for the double resolution frame
+ * @return the frame as a base64 PNG data url
+ * @throws out_of_range if the index is not a frame
+ */
+const std::string& ProgressImages::getFrame(const uint32_t index, const bool highRes) const
+{
+	return highRes ? mHighResFrames.at(index) : mFrames.at(index);
+}
+
+/**
+ * Draw a progress bar near the bottom of the key, below the title lines
+ *
+ * @param[in] size the width and height of the key in pixels
+ * @param[in] percent the filled part of the bar
+ * @return the image
+ */
+imageutils::rgbImage_t ProgressImages::drawFrame(const uint32_t size, const uint32_t percent)
+{
+	const uint8_t BACKGROUND[] = { 0x1A, 0x1A, 0x1A };
+	const uint8_t BORDER[] = { 0x80, 0x80, 0x80 };
+	const uint8_t EMPTY[] = { 0x33, 0x33, 0x33 };
+	const uint8_t FILLED[] = { 0x2E, 0xCC, 0x71 };
+
+	const uint32_t border = std::max<uint32_t>(1, size / 72);
+	const uint32_t left = size / 10;
+	const uint32_t right = size - left;
+	const uint32_t top = size * 76 / 100;
+	const uint32_t bottom = size * 88 / 100;
+	const uint32_t innerWidth = right - left - 2 * border;
+	const uint32_t filledRight = left + border + innerWidth * std::min<uint32_t>(percent, 100) / 100;
+
+	imageutils::rgbImage_t image;
+	image.width = size;
+	image.height = size;
+	image.pixels.resize(static_cast<size_t>(size) * size * 3);
+	for (uint32_t y = 0; y < size; y++)
+	{
+		for (uint32_t x = 0; x < size; x++)
+		{
+			const uint8_t* color = BACKGROUND;
+			if (x >= left && x < right && y >= top && y < bottom)
+			{
+				if (x < left + border || x >= right - border || y < top + border || y >= bottom - border)
+					color = BORDER;
+				else if (x < filledRight)
+					color = FILLED;
+				else
+					color = EMPTY;
+			}
+			std::copy(color, color + 3, image.pixels.begin() + (static_cast<size_t>(y) * size + x) * 3);
+		}
+	}
+	return image;
+}
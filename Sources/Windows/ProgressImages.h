@@ -0,0 +1,42 @@
+//==============================================================================
+/**
+@file       ProgressImages.h
+
+@brief		Pre-rendered progress bar images for the key
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include "ImageUtils.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ProgressImages
+{
+public:
+	// one frame per step, so progress that moves less than a step does not need a new image
+	static constexpr uint32_t STEP_PERCENT = 2;
+	static constexpr uint32_t FRAME_COUNT = 100 / STEP_PERCENT + 1;
+	// key size of the original Stream Deck and its double resolution, used for the XL and mobile devices
+	static constexpr uint32_t SIZE = 72;
+	static constexpr uint32_t HIGH_RES_SIZE = 144;
+
+	static const ProgressImages& getInstance();
+
+	ProgressImages();
+
+	static uint32_t getFrameIndex(const uint32_t percent);
+	const std::string& getFrame(const uint32_t index, const bool highRes) const;
+
+	static imageutils::rgbImage_t drawFrame(const uint32_t size, const uint32_t percent);
+private:
+	// base64 data urls, ready for SetImage
+	std::vector<std::string> mFrames;
+	std::vector<std::string> mHighResFrames;
+};
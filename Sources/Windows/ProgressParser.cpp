@@ -0,0 +1,142 @@
+//==============================================================================
+/**
+@file       ProgressParser.cpp
+
+@brief		Incremental parser of youtube-dl output that extracts the download progress
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "pch.h"
+
+#include "ProgressParser.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+/**
+ * Parse the next field of a progress line
+ *
+ * @param[in,out] pos the start of the field, moved past the field and the following space
+ * @param[in] end the end of the line
+ * @return the value, or nullopt if the field is NA or not a number
+ */
+static std::optional<double> parseField(const char*& pos, const char* end)
+{
+	while (pos < end && *pos == ' ')
+		pos++;
+	const char* fieldEnd = pos;
+	while (fieldEnd < end && *fieldEnd != ' ')
+		fieldEnd++;
+
+	double value = 0;
+	const std::from_chars_result result = std::from_chars(pos, fieldEnd, value);
+	const bool valid = (result.ec == std::errc() && result.ptr == fieldEnd && value >= 0);
+	pos = fieldEnd;
+	if (!valid)
+		return std::nullopt;
+	return value;
+}
+
+/**
+ * Feed output of the process to the parser. Lines may be split across calls in any way.
+ * Does not allocate.
+ *
+ * @param[in] data the output
+ * @param[in] size the number of bytes in data
+ * @return true if at least one progress line was parsed
+ */
+bool ProgressParser::feed(const char* data, const size_t size)
+{
+	bool updated = false;
+	for (size_t i = 0; i < size; i++)
+	{
+		const char c = data[i];
+		if (c != '\n')
+		{
+			if (mSize == CAPACITY)
+				mOverflow = true;
+			else
+			{
+				mRing[(mStart + mSize) % CAPACITY] = c;
+				mSize++;
+			}
+			continue;
+		}
+
+		if (!mOverflow)
+		{
+			// unwrap the line into one piece
+			const size_t firstPart = std::min(mSize, CAPACITY - mStart);
+			std::memcpy(mLine.data(), mRing.data() + mStart, firstPart);
+			std::memcpy(mLine.data() + firstPart, mRing.data(), mSize - firstPart);
+			updated |= parseLine(mLine.data(), mSize);
+		}
+
+		// the next line starts right after this one
+		mStart = (mStart + mSize) % CAPACITY;
+		mSize = 0;
+		mOverflow = false;
+	}
+	return updated;
+}
+
+/**
+ * Parse one complete line. Progress lines update the progress, error lines are kept for the log.
+ *
+ * @param[in] line the line without its newline
+ * @param[in] length the length of the line
+ * @return true if the line was a progress line
+ */
+bool ProgressParser::parseLine(const char* line, size_t length)
+{
+	if (length > 0 && line[length - 1] == '\r')
+		length--;
+
+	const size_t prefixLength = std::strlen(PROGRESS_PREFIX);
+	if (length >= prefixLength && std::memcmp(line, PROGRESS_PREFIX, prefixLength) == 0)
+	{
+		const char* pos = line + prefixLength;
+		const char* end = line + length;
+		const std::optional<double> downloadedBytes = parseField(pos, end);
+		const std::optional<double> totalBytes = parseField(pos, end);
+		const std::optional<double> totalBytesEstimate = parseField(pos, end);
+		const std::optional<double> speed = parseField(pos, end);
+		const std::optional<double> eta = parseField(pos, end);
+
+		mProgress.downloadedBytes = static_cast<uint64_t>(downloadedBytes.value_or(0));
+		if (totalBytes)
+			mProgress.totalBytes = static_cast<uint64_t>(*totalBytes);
+		else if (totalBytesEstimate)
+			mProgress.totalBytes = static_cast<uint64_t>(*totalBytesEstimate);
+		else
+			mProgress.totalBytes = std::nullopt;
+		mProgress.speed = speed;
+		mProgress.eta = eta ? std::optional<uint32_t>(static_cast<uint32_t>(*eta)) : std::nullopt;
+		return true;
+	}
+
+	const char* ERROR_PREFIX = "ERROR:";
+	const size_t errorPrefixLength = std::strlen(ERROR_PREFIX);
+	if (length >= errorPrefixLength && std::memcmp(line, ERROR_PREFIX, errorPrefixLength) == 0)
+	{
+		mLastErrorLength = std::min(length, MAX_ERROR_LENGTH);
+		std::memcpy(mLastError.data(), line, mLastErrorLength);
+	}
+	return false;
+}
+
+/**
+ * Get the last error line printed by the process
+ *
+ * @return the error line, or nullopt if there was none
+ */
+std::optional<std::string> ProgressParser::getLastError() const
+{
+	if (mLastErrorLength == 0)
+		return std::nullopt;
+	return std::string(mLastError.data(), mLastErrorLength);
+}
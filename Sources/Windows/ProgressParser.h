@@ -0,0 +1,68 @@
+//==============================================================================
+/**
+@file       ProgressParser.h
+
+@brief		Incremental parser of youtube-dl output that extracts the download progress
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// progress of a download, as reported by youtube-dl
+struct downloadProgress_t
+{
+	uint64_t downloadedBytes = 0;
+	std::optional<uint64_t> totalBytes = std::nullopt;
+	// bytes per second
+	std::optional<double> speed = std::nullopt;
+	// seconds
+	std::optional<uint32_t> eta = std::nullopt;
+};
+
+class ProgressParser
+{
+public:
+	// every progress line starts with this prefix, followed by the fields of PROGRESS_TEMPLATE
+	static constexpr const char* PROGRESS_PREFIX = "[download-progress]";
+	// passed to youtube-dl with --progress-template. Fields that are not known are printed as NA.
+	static constexpr const char* PROGRESS_TEMPLATE = "download:[download-progress] %(progress.downloaded_bytes)s %(progress.total_bytes)s %(progress.total_bytes_estimate)s %(progress.speed)s %(progress.eta)s";
+
+	// longest line that is parsed, longer lines are skipped
+	static constexpr size_t CAPACITY = 4096;
+	static constexpr size_t MAX_ERROR_LENGTH = 512;
+
+	bool feed(const char* data, const size_t size);
+
+	const downloadProgress_t& getProgress() const
+	{
+		return mProgress;
+	}
+
+	std::optional<std::string> getLastError() const;
+private:
+	// bytes of the line that is not complete yet, starting at mStart
+	std::array<char, CAPACITY> mRing = {};
+	size_t mStart = 0;
+	size_t mSize = 0;
+	// set if the current line did not fit, it is dropped once its newline arrives
+	bool mOverflow = false;
+
+	// a complete line is copied here, so a line that wraps around the ring can be parsed in one piece
+	std::array<char, CAPACITY> mLine = {};
+
+	std::array<char, MAX_ERROR_LENGTH> mLastError = {};
+	size_t mLastErrorLength = 0;
+
+	downloadProgress_t mProgress;
+
+	bool parseLine(const char* line, size_t length);
+};
@@ -16,7 +16,7 @@
 #include "../Vendor/json/src/json.hpp"
 
 
-void redditdlutils::downloadRedditContent(const std::string& url, const std::string& outputFolder)
+std::string redditdlutils::downloadRedditContent(const std::string& url, const std::string& outputFolder)
 {
 	// first get the json metadata from the reddit page using curl
 	std::unique_ptr<std::string> htmlData;
@@ -38,6 +38,7 @@ void redditdlutils::downloadRedditContent(const std::string& url, const std::str
 
 		// download the file
 		curlutils::downloadFile(path.string(), outputFolder + "/" + imgFileName);
+		return j[0]["data"]["children"][0]["data"]["id"].get<std::string>();
 	}
 	else
 		throw std::invalid_argument("Error: reddit webpage does not contain image data.");
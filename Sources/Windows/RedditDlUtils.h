@@ -18,7 +18,8 @@ namespace redditdlutils
 	 *
 	 * @param[in] url the url to the reddit post
 	 * @param[in] outputFolder the output location
+	 * @return the id of the reddit post
 	 * @throws runtime_error if could not read url for json or download image, json::exception on bad json parse, invalid_argument if reddit content is not of image type
 	 */
-	void downloadRedditContent(const std::string& url, const std::string& outputFolder);
+	std::string downloadRedditContent(const std::string& url, const std::string& outputFolder);
 }
\ No newline at end of file
@@ -0,0 +1,177 @@
+#include "pch.h"
+
+#include "../BandwidthBudget.h"
+#include "../CurlUtils.hpp"
+
+#include <asio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Tests
+{
+    // local stand-in for a media server, it answers a single request with a body of the given size as fast as it can
+    class localHttpServer_t
+    {
+    public:
+        localHttpServer_t(const size_t bodySize) :
+            mAcceptor(mIo, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0)),
+            mBody(bodySize, 'x')
+        {
+            mThread = std::thread([this]() { serve(); });
+        }
+
+        ~localHttpServer_t()
+        {
+            // if the client never came, connect once so the accept returns
+            if (!mAccepted)
+            {
+                asio::error_code ec;
+                asio::ip::tcp::socket socket(mIo);
+                socket.connect(mAcceptor.local_endpoint(), ec);
+            }
+            mThread.join();
+        }
+
+        std::string getUrl() const
+        {
+            return "http://127.0.0.1:" + std::to_string(mAcceptor.local_endpoint().port()) + "/video.mp4";
+        }
+
+    private:
+        asio::io_context mIo;
+        asio::ip::tcp::acceptor mAcceptor;
+        const std::string mBody;
+        std::thread mThread;
+        std::atomic<bool> mAccepted = false;
+
+        void serve()
+        {
+            asio::error_code ec;
+            asio::ip::tcp::socket socket(mIo);
+            mAcceptor.accept(socket, ec);
+            mAccepted = true;
+            if (ec)
+                return;
+
+            asio::streambuf request;
+            asio::read_until(socket, request, "\r\n\r\n", ec);
+            const std::string header = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(mBody.size()) +
+                "\r\nConnection: close\r\n\r\n";
+            asio::write(socket, asio::buffer(header), ec);
+            asio::write(socket, asio::buffer(mBody), ec);
+            socket.shutdown(asio::ip::tcp::socket::shutdown_send, ec);
+        }
+    };
+
+    static double timeDownload(const size_t bodySize)
+    {
+        localHttpServer_t server(bodySize);
+        std::string data;
+        const auto start = std::chrono::steady_clock::now();
+        EXPECT_TRUE(curlutils::readHTML(server.getUrl(), &data));
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        EXPECT_EQ(data.size(), bodySize);
+        return seconds;
+    }
+
+    static uint64_t sumRates(const std::vector<const BandwidthBudget::Lease*>& leases)
+    {
+        uint64_t sum = 0;
+        for (const BandwidthBudget::Lease* lease : leases)
+            sum += lease->getRate();
+        return sum;
+    }
+
+    TEST(bandwidthBudgetTest, SplitsLimitBetweenRunningTransfers) {
+        const uint64_t LIMIT = 1024 * 1024;
+        BandwidthBudget budget;
+        budget.setLimit(LIMIT);
+
+        uint32_t firstChanges = 0;
+        BandwidthBudget::Lease first = budget.acquire(0, [&]() { firstChanges++; });
+        EXPECT_EQ(first.getRate(), LIMIT);
+        // the running transfer gives up half of its share to the new one, and is told so
+        BandwidthBudget::Lease second = budget.acquire();
+        EXPECT_EQ(first.getRate(), LIMIT / 2);
+        EXPECT_EQ(second.getRate(), LIMIT / 2);
+        EXPECT_EQ(firstChanges, 1u);
+
+        BandwidthBudget::Lease third = budget.acquire();
+        for (const BandwidthBudget::Lease* lease : { &first, &second, &third })
+            EXPECT_EQ(lease->getRate(), LIMIT / 3);
+        EXPECT_LE(sumRates({ &first, &second, &third }), LIMIT);
+        EXPECT_EQ(firstChanges, 2u);
+
+        // the share of a finished transfer goes to the others
+        first.release();
+        EXPECT_EQ(second.getRate(), LIMIT / 2);
+        EXPECT_EQ(third.getRate(), LIMIT / 2);
+        EXPECT_EQ(budget.getLeaseCount(), 2u);
+
+        // a crowded budget still leaves every transfer a minimum
+        budget.setLimit(BandwidthBudget::MIN_RATE_BYTES);
+        EXPECT_EQ(second.getRate(), BandwidthBudget::MIN_RATE_BYTES);
+        EXPECT_EQ(budget.acquire().getRate(), BandwidthBudget::MIN_RATE_BYTES);
+
+        budget.setLimit(0);
+        EXPECT_EQ(second.getRate(), 0u);
+        EXPECT_EQ(budget.acquire().getRate(), 0u);
+        EXPECT_EQ(budget.getLeaseCount(), 2u);
+    }
+
+    TEST(bandwidthBudgetTest, PausedJobGivesItsShareAway) {
+        const uint64_t LIMIT = 1024 * 1024;
+        BandwidthBudget budget;
+        budget.setLimit(LIMIT);
+
+        uint32_t firstChanges = 0;
+        BandwidthBudget::Lease first = budget.acquire(1, [&]() { firstChanges++; });
+        EXPECT_EQ(first.getRate(), LIMIT);
+
+        // while the first job is paused, a new transfer gets the whole limit
+        budget.setPaused(1, true);
+        BandwidthBudget::Lease second = budget.acquire(2);
+        EXPECT_EQ(second.getRate(), LIMIT);
+        EXPECT_EQ(budget.getLeaseCount(), 2u);
+        EXPECT_EQ(firstChanges, 0u);
+
+        // once the first job reserved its share, the running transfer gives half of it back
+        EXPECT_TRUE(budget.reserve(1));
+        EXPECT_EQ(second.getRate(), LIMIT / 2);
+        budget.setPaused(1, false);
+        EXPECT_EQ(first.getRate(), LIMIT / 2);
+        EXPECT_EQ(firstChanges, 1u);
+
+        // a job cannot be unpaused while the minimums alone would exceed the limit
+        budget.setPaused(1, true);
+        budget.setLimit(BandwidthBudget::MIN_RATE_BYTES);
+        EXPECT_FALSE(budget.reserve(1));
+        second.release();
+        EXPECT_TRUE(budget.reserve(1));
+        budget.setPaused(1, false);
+        EXPECT_EQ(first.getRate(), BandwidthBudget::MIN_RATE_BYTES);
+    }
+
+    TEST(bandwidthBudgetTest, ThrottlesCurlTransfers) {
+        const size_t BODY_SIZE = 4 * 1024 * 1024;
+        const uint64_t LIMIT = 1024 * 1024;
+        BandwidthBudget& budget = BandwidthBudget::getInstance();
+
+        budget.setLimit(0);
+        const double unlimitedSeconds = timeDownload(BODY_SIZE);
+
+        budget.setLimit(LIMIT);
+        const double limitedSeconds = timeDownload(BODY_SIZE);
+        budget.setLimit(0);
+
+        std::cout << "4 MB over loopback: unlimited " << unlimitedSeconds << " s, at 1 MB/s " << limitedSeconds << " s" << std::endl;
+        // the transfer is paced by the bytes that reached curl, the socket buffers can still take a burst
+        EXPECT_GT(limitedSeconds, 0.5 * BODY_SIZE / LIMIT);
+        EXPECT_EQ(budget.getLeaseCount(), 0u);
+    }
+}
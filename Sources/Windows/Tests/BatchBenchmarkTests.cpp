@@ -0,0 +1,190 @@
+#include "pch.h"
+
+#ifdef _WIN32
+#include "../DownloadScheduler.h"
+#include "../FileUtils.h"
+#include "FakeDownloader.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Tests
+{
+    typedef std::chrono::steady_clock steadyClock_t;
+
+    const uint32_t URL_COUNT = 8;
+
+    // get the quoted argument that follows a flag
+    std::string getQuotedArg(const std::string& cmd, const std::string& flag)
+    {
+        size_t pos = cmd.find(flag + " \"");
+        if (pos == std::string::npos)
+            return "";
+        pos += flag.size() + 2;
+        return cmd.substr(pos, cmd.find('"', pos) - pos);
+    }
+
+    // runs before gtest's main, so a fake downloader child never gets to run the tests
+    const bool isFakeDownloader = []()
+    {
+        char logPath[MAX_PATH];
+        if (GetEnvironmentVariableA(FAKE_DOWNLOADER_ENV, logPath, MAX_PATH) == 0)
+            return false;
+
+        {
+            std::ofstream log(logPath, std::ios::app);
+            log << "launch\n";
+        }
+        char millis[32];
+        const bool hasMillis = GetEnvironmentVariableA(FAKE_DOWNLOADER_MILLIS_ENV, millis, sizeof(millis)) != 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(hasMillis ? std::stoul(millis) : FAKE_STARTUP_MILLIS));
+
+        const std::string cmd = GetCommandLineA();
+        const std::string batchFile = getQuotedArg(cmd, "--batch-file");
+        const std::string doneFile = getQuotedArg(cmd, "--print-to-file \"after_move:%(original_url)s\"");
+        if (!batchFile.empty() && !doneFile.empty())
+        {
+            std::ifstream urls(batchFile);
+            std::ofstream done(doneFile, std::ios::app);
+            std::string url;
+            while (std::getline(urls, url))
+                done << url << "\n";
+        }
+        ExitProcess(0);
+        return true;
+    }();
+
+    class batchBenchmarkTest : public ::testing::Test
+    {
+    protected:
+        DownloadJob::resultQueue_t results;
+        std::filesystem::path launchLogPath;
+        contextSettings_t settings;
+
+        void SetUp() override
+        {
+            launchLogPath = fileutils::getTempFilePath(".launches.txt");
+            SetEnvironmentVariableA(FAKE_DOWNLOADER_ENV, launchLogPath.string().c_str());
+
+            settings.youtubeDlExePath = fileutils::getCurrentExeFolder().string();
+            settings.outputFolder = std::filesystem::temp_directory_path().string();
+            settings.downloadFormats = { VIDEO };
+        }
+
+        void TearDown() override
+        {
+            SetEnvironmentVariableA(FAKE_DOWNLOADER_ENV, NULL);
+            SetEnvironmentVariableA(FAKE_DOWNLOADER_MILLIS_ENV, NULL);
+            std::error_code ec;
+            std::filesystem::remove(launchLogPath, ec);
+        }
+
+        std::shared_ptr<DownloadJob> makeJob(const uint32_t i)
+        {
+            std::shared_ptr<DownloadJob> job = std::make_shared<DownloadJob>("https://www.youtube.com/watch?v=stub" + std::to_string(i),
+                settings, i + 1, false, results);
+            job->queue();
+            return job;
+        }
+
+        uint32_t countLaunches()
+        {
+            return countFakeLaunches(launchLogPath);
+        }
+
+        uint32_t countSuccesses()
+        {
+            // the results queue has no timed wait, so poll until every job reported back
+            const steadyClock_t::time_point deadline = steadyClock_t::now() + std::chrono::seconds(30);
+            uint32_t finished = 0;
+            uint32_t successes = 0;
+            while (finished < URL_COUNT && steadyClock_t::now() < deadline)
+            {
+                std::optional<DownloadJob::threadData_t> result = results.tryPop();
+                if (!result)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    continue;
+                }
+                if (result->status == DownloadJob::RUNNING)
+                    continue;
+                finished++;
+                if (result->status == DownloadJob::SUCCESS)
+                    successes++;
+            }
+            return successes;
+        }
+    };
+
+    // a benchmark, run it with --gtest_also_run_disabled_tests
+    TEST_F(batchBenchmarkTest, DISABLED_BenchmarkBatchedAgainstSeparateSpawns) {
+        // one process per url
+        const steadyClock_t::time_point separateStart = steadyClock_t::now();
+        for (uint32_t i = 0; i < URL_COUNT; i++)
+            makeJob(i)->run();
+        const auto separateElapsed = std::chrono::duration_cast<std::chrono::milliseconds>(steadyClock_t::now() - separateStart);
+        EXPECT_EQ(countSuccesses(), URL_COUNT);
+        EXPECT_EQ(countLaunches(), URL_COUNT);
+
+        std::filesystem::remove(launchLogPath);
+
+        // one process for all urls
+        std::vector<std::shared_ptr<DownloadJob>> jobs;
+        for (uint32_t i = 0; i < URL_COUNT; i++)
+            jobs.push_back(makeJob(i));
+        const steadyClock_t::time_point batchedStart = steadyClock_t::now();
+        jobs.front()->run({ jobs.begin() + 1, jobs.end() });
+        const auto batchedElapsed = std::chrono::duration_cast<std::chrono::milliseconds>(steadyClock_t::now() - batchedStart);
+        EXPECT_EQ(countSuccesses(), URL_COUNT);
+        EXPECT_EQ(countLaunches(), 1);
+
+        std::cout << URL_COUNT << " separate spawns: " << separateElapsed.count() << " ms" << std::endl;
+        std::cout << "1 batched spawn: " << batchedElapsed.count() << " ms" << std::endl;
+    }
+
+    TEST_F(batchBenchmarkTest, KillingOneJobOfBatchKeepsOthersRunning) {
+        std::vector<std::shared_ptr<DownloadJob>> jobs;
+        for (uint32_t i = 0; i < URL_COUNT; i++)
+            jobs.push_back(makeJob(i));
+        std::thread lead([&]() { jobs.front()->run({ jobs.begin() + 1, jobs.end() }); });
+
+        // the fake downloader logs the launch before its startup sleep
+        while (countLaunches() == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        const contextHandle_t killedContext = jobs[1]->getContext();
+        jobs[1]->kill();
+        lead.join();
+
+        uint32_t successes = 0;
+        while (std::optional<DownloadJob::threadData_t> result = results.tryPop())
+        {
+            if (result->status == DownloadJob::RUNNING)
+                continue;
+            if (result->context == killedContext)
+                EXPECT_EQ(result->status, DownloadJob::FAILED);
+            else if (result->status == DownloadJob::SUCCESS)
+                successes++;
+        }
+        EXPECT_EQ(successes, URL_COUNT - 1);
+        EXPECT_EQ(countLaunches(), 1);
+    }
+
+    TEST_F(batchBenchmarkTest, SchedulerCoalescesPressesWithinWindow) {
+        std::shared_ptr<DownloadScheduler> scheduler = std::make_shared<DownloadScheduler>(results);
+        scheduler->setCoalesceWindow(500);
+
+        for (uint32_t i = 0; i < URL_COUNT; i++)
+            scheduler->submit("https://www.youtube.com/watch?v=stub" + std::to_string(i), settings, i + 1, false);
+
+        EXPECT_EQ(countSuccesses(), URL_COUNT);
+        EXPECT_EQ(countLaunches(), 1);
+        scheduler = nullptr;
+    }
+}
+#endif
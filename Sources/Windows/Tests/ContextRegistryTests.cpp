@@ -0,0 +1,50 @@
+#include "pch.h"
+
+#include "../ContextRegistry.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Tests
+{
+    TEST(contextRegistryTest, InternsEachContextOnce) {
+        ContextRegistry registry;
+        const contextHandle_t a = registry.intern("0A6E2A4F1C5A4E0F9B1F2D3C4B5A6978");
+        const contextHandle_t b = registry.intern("5D2C8B7A6F5E4D3C2B1A09F8E7D6C5B4");
+        EXPECT_NE(a, ContextRegistry::INVALID_HANDLE);
+        EXPECT_NE(a, b);
+        EXPECT_EQ(registry.intern("0A6E2A4F1C5A4E0F9B1F2D3C4B5A6978"), a);
+        EXPECT_EQ(registry.size(), 2u);
+
+        EXPECT_EQ(registry.find("5D2C8B7A6F5E4D3C2B1A09F8E7D6C5B4"), b);
+        EXPECT_EQ(registry.find("unknown"), std::nullopt);
+        EXPECT_EQ(registry.getString(a), "0A6E2A4F1C5A4E0F9B1F2D3C4B5A6978");
+        EXPECT_THROW(registry.getString(ContextRegistry::INVALID_HANDLE), std::out_of_range);
+        EXPECT_THROW(registry.getString(b + 1), std::out_of_range);
+    }
+
+    TEST(contextRegistryTest, StringsStayValidWhileOtherThreadsIntern) {
+        ContextRegistry registry;
+        const contextHandle_t first = registry.intern("first");
+        const std::string& firstString = registry.getString(first);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++)
+        {
+            threads.emplace_back([&registry]()
+                {
+                    for (int i = 0; i < 1000; i++)
+                    {
+                        const std::string context = "context" + std::to_string(i);
+                        EXPECT_EQ(registry.getString(registry.intern(context)), context);
+                    }
+                });
+        }
+        for (auto& t : threads)
+            t.join();
+
+        EXPECT_EQ(registry.size(), 1001u);
+        EXPECT_EQ(firstString, "first");
+    }
+}
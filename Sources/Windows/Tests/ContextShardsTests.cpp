@@ -0,0 +1,138 @@
+#include "pch.h"
+
+#include "../ContextShards.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Tests
+{
+    typedef std::chrono::steady_clock steadyClock_t;
+
+    const uint32_t CONTEXT_COUNT = 32;
+    const uint32_t PRESS_COUNT = 20000;
+    // time the monitor spends on the title and image of one context
+    const std::chrono::microseconds MONITOR_UPDATE_TIME(5);
+    // time the monitor spends outside the lock between two batches of results
+    const std::chrono::microseconds MONITOR_IDLE_TIME(40);
+
+    struct benchContext_t
+    {
+        std::shared_ptr<const std::string> settings;
+        uint32_t submittedCount = 0;
+        uint32_t progress = 0;
+    };
+    typedef std::unordered_map<contextHandle_t, benchContext_t> benchState_t;
+
+    static void spinFor(const std::chrono::microseconds duration)
+    {
+        const steadyClock_t::time_point end = steadyClock_t::now() + duration;
+        while (steadyClock_t::now() < end)
+            ;
+    }
+
+    // with one shard, the monitor locks once for the whole batch like the single mVisibleContextsMutex did.
+    // With more shards, it only locks the context it is updating.
+    template <size_t SHARD_COUNT>
+    static std::vector<int64_t> measureKeyToSubmit()
+    {
+        ContextShards<benchState_t, SHARD_COUNT> shards;
+        for (contextHandle_t context = 1; context <= CONTEXT_COUNT; context++)
+        {
+            std::unique_lock<std::mutex> lk(shards.get(context).mutex);
+            shards.getState(context, lk)[context].settings = std::make_shared<const std::string>("settings");
+        }
+
+        std::atomic<bool> running = true;
+        std::thread monitor([&]()
+            {
+                while (running.load())
+                {
+                    if (SHARD_COUNT == 1)
+                    {
+                        std::unique_lock<std::mutex> lk(shards.get(1).mutex);
+                        for (contextHandle_t context = 1; context <= CONTEXT_COUNT; context++)
+                        {
+                            shards.getState(context, lk)[context].progress++;
+                            spinFor(MONITOR_UPDATE_TIME);
+                        }
+                    }
+                    else
+                    {
+                        for (contextHandle_t context = 1; context <= CONTEXT_COUNT; context++)
+                        {
+                            std::unique_lock<std::mutex> lk(shards.get(context).mutex);
+                            shards.getState(context, lk)[context].progress++;
+                            spinFor(MONITOR_UPDATE_TIME);
+                        }
+                    }
+                    spinFor(MONITOR_IDLE_TIME);
+                }
+            });
+
+        std::vector<int64_t> latencies;
+        latencies.reserve(PRESS_COUNT);
+        for (uint32_t i = 0; i < PRESS_COUNT; i++)
+        {
+            const contextHandle_t context = 1 + i % CONTEXT_COUNT;
+            const steadyClock_t::time_point start = steadyClock_t::now();
+
+            // KeyUpForAction takes the settings snapshot, works without the lock, then counts the submitted job
+            std::shared_ptr<const std::string> settings;
+            {
+                std::unique_lock<std::mutex> lk(shards.get(context).mutex);
+                settings = shards.getState(context, lk)[context].settings;
+            }
+            {
+                std::unique_lock<std::mutex> lk(shards.get(context).mutex);
+                shards.getState(context, lk)[context].submittedCount++;
+            }
+
+            latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(steadyClock_t::now() - start).count());
+            // spread the presses over the phases of the monitor
+            spinFor(std::chrono::microseconds(1 + i % 7));
+        }
+
+        running = false;
+        monitor.join();
+        std::sort(latencies.begin(), latencies.end());
+        return latencies;
+    }
+
+    static int64_t percentile(const std::vector<int64_t>& sorted, const double p)
+    {
+        return sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+    }
+
+    TEST(contextShardsTest, ContextsGetTheirOwnShard) {
+        ContextShards<benchState_t> shards;
+        for (contextHandle_t a = 1; a <= 64; a++)
+            for (contextHandle_t b = a + 1; b <= 64; b++)
+                EXPECT_NE(&shards.get(a), &shards.get(b));
+        EXPECT_EQ(&shards.get(1), &shards.get(65));
+    }
+
+    // a benchmark, run it with --gtest_also_run_disabled_tests
+    TEST(contextShardsTest, DISABLED_BenchmarkKeyToSubmitLatency) {
+        // on a single core the monitor never runs while a key is handled, so there is nothing to measure
+        if (std::thread::hardware_concurrency() < 2)
+        {
+            std::cout << "skipped, the benchmark needs at least two cores" << std::endl;
+            return;
+        }
+
+        const std::vector<int64_t> single = measureKeyToSubmit<1>();
+        const std::vector<int64_t> sharded = measureKeyToSubmit<64>();
+
+        std::cout << "key to submit with " << CONTEXT_COUNT << " contexts and a busy monitor, p50 / p99 / max:" << std::endl;
+        std::cout << "  single lock: " << percentile(single, 0.5) << " / " << percentile(single, 0.99) << " / " << single.back() << " ns" << std::endl;
+        std::cout << "  sharded:     " << percentile(sharded, 0.5) << " / " << percentile(sharded, 0.99) << " / " << sharded.back() << " ns" << std::endl;
+    }
+}
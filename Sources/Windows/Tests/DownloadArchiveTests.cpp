@@ -0,0 +1,79 @@
+#include "pch.h"
+
+#include "../DownloadArchive.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace Tests
+{
+    static std::filesystem::path getArchivePath(const std::string& name)
+    {
+        const std::filesystem::path path = std::filesystem::temp_directory_path() / ("youtube-dl-plugin-" + name + ".archive.txt");
+        std::filesystem::remove(path);
+        return path;
+    }
+
+    TEST(downloadArchiveTest, KeysOfUrls) {
+        EXPECT_EQ(DownloadArchive::getUrlKey("https://www.youtube.com/watch?v=dQw4w9WgXcQ"), "youtube dQw4w9WgXcQ");
+        EXPECT_EQ(DownloadArchive::getUrlKey("https://youtu.be/dQw4w9WgXcQ?t=42"), "youtube dQw4w9WgXcQ");
+        EXPECT_EQ(DownloadArchive::getUrlKey("https://m.youtube.com/watch?feature=share&v=dQw4w9WgXcQ"), "youtube dQw4w9WgXcQ");
+        EXPECT_EQ(DownloadArchive::getUrlKey("https://www.youtube.com/shorts/dQw4w9WgXcQ"), "youtube dQw4w9WgXcQ");
+        EXPECT_EQ(DownloadArchive::getUrlKey("https://www.reddit.com/r/pics/comments/abc123/some_title/"), "reddit abc123");
+
+        // playlists and unknown sites are only known once yt-dlp extracted them
+        EXPECT_FALSE(DownloadArchive::getUrlKey("https://www.youtube.com/watch?v=dQw4w9WgXcQ&list=PL123"));
+        EXPECT_FALSE(DownloadArchive::getUrlKey("https://www.youtube.com/playlist?list=PL123"));
+        EXPECT_FALSE(DownloadArchive::getUrlKey("https://example.com/videos/123456"));
+
+        EXPECT_EQ(DownloadArchive::getInfoKey(json({ {"extractor_key", "Vimeo"}, {"id", "123456"} })), "vimeo 123456");
+        EXPECT_FALSE(DownloadArchive::getInfoKey(json({ {"_type", "playlist"}, {"extractor_key", "Youtube"}, {"id", "PL123"} })));
+    }
+
+    TEST(downloadArchiveTest, KeepsKeysAcrossSessions) {
+        const std::filesystem::path path = getArchivePath("sessions");
+        {
+            // written by yt-dlp or by hand, without a line break after the last key
+            std::ofstream file(path, std::ios::binary);
+            file << "youtube aaaaaaaaaaa\r\n\nvimeo 123456";
+        }
+        {
+            DownloadArchive archive(path);
+            EXPECT_EQ(archive.size(), 2u);
+            EXPECT_TRUE(archive.contains("youtube aaaaaaaaaaa"));
+            EXPECT_TRUE(archive.contains("vimeo 123456"));
+            EXPECT_FALSE(archive.contains("youtube bbbbbbbbbbb"));
+
+            EXPECT_TRUE(archive.add("youtube bbbbbbbbbbb"));
+            EXPECT_TRUE(archive.add("vimeo 123456"));
+            EXPECT_TRUE(archive.contains("youtube bbbbbbbbbbb"));
+            EXPECT_EQ(archive.size(), 3u);
+        }
+
+        DownloadArchive archive(path);
+        EXPECT_EQ(archive.size(), 3u);
+        EXPECT_TRUE(archive.contains("vimeo 123456"));
+        EXPECT_TRUE(archive.contains("youtube bbbbbbbbbbb"));
+        EXPECT_EQ(DownloadArchive::readKeys(path).size(), 3u);
+    }
+
+    TEST(downloadArchiveTest, GrowsPastBloomCapacity) {
+        const std::filesystem::path path = getArchivePath("grow");
+        const size_t count = 3 * DownloadArchive::MIN_BLOOM_CAPACITY;
+        {
+            DownloadArchive archive(path);
+            for (size_t i = 0; i < count; i++)
+                EXPECT_TRUE(archive.add("generic " + std::to_string(i)));
+            for (size_t i = 0; i < count; i++)
+                ASSERT_TRUE(archive.contains("generic " + std::to_string(i))) << i;
+        }
+
+        DownloadArchive archive(path);
+        EXPECT_EQ(archive.size(), count);
+        for (size_t i = 0; i < count; i++)
+            ASSERT_TRUE(archive.contains("generic " + std::to_string(i))) << i;
+        for (size_t i = count; i < 2 * count; i++)
+            ASSERT_FALSE(archive.contains("generic " + std::to_string(i))) << i;
+    }
+}
@@ -0,0 +1,162 @@
+#include "pch.h"
+
+#ifdef _WIN32
+#include "../DownloadScheduler.h"
+#include "../FileUtils.h"
+#include "FakeDownloader.h"
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace Tests
+{
+    typedef std::chrono::steady_clock steadyClock_t;
+
+    // runs jobs and schedulers against the fake yt-dlp of the batch benchmark
+    class downloadSchedulerTest : public ::testing::Test
+    {
+    protected:
+        DownloadJob::resultQueue_t results;
+        std::filesystem::path launchLogPath;
+        contextSettings_t settings;
+
+        void SetUp() override
+        {
+            launchLogPath = fileutils::getTempFilePath(".launches.txt");
+            SetEnvironmentVariableA(FAKE_DOWNLOADER_ENV, launchLogPath.string().c_str());
+
+            settings.youtubeDlExePath = fileutils::getCurrentExeFolder().string();
+            settings.outputFolder = std::filesystem::temp_directory_path().string();
+            settings.downloadFormats = { VIDEO };
+        }
+
+        void TearDown() override
+        {
+            SetEnvironmentVariableA(FAKE_DOWNLOADER_ENV, NULL);
+            SetEnvironmentVariableA(FAKE_DOWNLOADER_MILLIS_ENV, NULL);
+            std::error_code ec;
+            std::filesystem::remove(launchLogPath, ec);
+        }
+
+        std::shared_ptr<DownloadJob> makeJob(const uint32_t i)
+        {
+            std::shared_ptr<DownloadJob> job = std::make_shared<DownloadJob>("https://www.youtube.com/watch?v=stub" + std::to_string(i),
+                settings, i + 1, false, results);
+            job->queue();
+            return job;
+        }
+
+        uint32_t countLaunches()
+        {
+            return countFakeLaunches(launchLogPath);
+        }
+
+        // wait until the given number of final results arrived, and get the status of each by its context
+        std::map<contextHandle_t, DownloadJob::status_t> waitForResults(const uint32_t count)
+        {
+            // the results queue has no timed wait, so poll until every job reported back
+            const steadyClock_t::time_point deadline = steadyClock_t::now() + std::chrono::seconds(30);
+            std::map<contextHandle_t, DownloadJob::status_t> statuses;
+            uint32_t finished = 0;
+            while (finished < count && steadyClock_t::now() < deadline)
+            {
+                std::optional<DownloadJob::threadData_t> result = results.tryPop();
+                if (!result)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    continue;
+                }
+                if (result->status == DownloadJob::RUNNING)
+                    continue;
+                finished++;
+                statuses[result->context] = result->status;
+            }
+            return statuses;
+        }
+    };
+
+    TEST_F(downloadSchedulerTest, RepeatedPressesShareOneDownload) {
+        SetEnvironmentVariableA(FAKE_DOWNLOADER_MILLIS_ENV, "1000");
+        std::shared_ptr<DownloadScheduler> scheduler = std::make_shared<DownloadScheduler>(results);
+        scheduler->setCoalesceWindow(0);
+
+        // two buttons with the same link and settings, the second press comes while the first one downloads
+        const std::string url = "https://www.youtube.com/watch?v=stub0";
+        scheduler->submit(url, settings, 1, false);
+        const steadyClock_t::time_point deadline = steadyClock_t::now() + std::chrono::seconds(20);
+        while (countLaunches() == 0 && steadyClock_t::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        scheduler->submit(url, settings, 2, false);
+
+        const std::map<contextHandle_t, DownloadJob::status_t> statuses = waitForResults(2);
+        ASSERT_EQ(statuses.size(), 2u);
+        EXPECT_EQ(statuses.at(1), DownloadJob::SUCCESS);
+        EXPECT_EQ(statuses.at(2), DownloadJob::SUCCESS);
+        EXPECT_EQ(countLaunches(), 1);
+        scheduler = nullptr;
+    }
+
+    TEST_F(downloadSchedulerTest, KilledWaiterLeavesJobRunningForOwner) {
+        std::shared_ptr<DownloadJob> job = makeJob(0);
+        const contextHandle_t owner = job->getContext();
+        const contextHandle_t waiter = owner + 1;
+        ASSERT_TRUE(job->attach(waiter, 42));
+
+        // the waiter gets its cancelled result right away, the owner still needs the job
+        EXPECT_FALSE(job->detachContext(waiter));
+        EXPECT_FALSE(job->hasContext(waiter));
+        std::optional<DownloadJob::threadData_t> cancelled = results.tryPop();
+        ASSERT_TRUE(cancelled);
+        EXPECT_EQ(cancelled->context, waiter);
+        EXPECT_EQ(cancelled->jobId, 42u);
+        EXPECT_EQ(cancelled->status, DownloadJob::FAILED);
+
+        job->run();
+        uint32_t finished = 0;
+        while (std::optional<DownloadJob::threadData_t> result = results.tryPop())
+        {
+            if (result->status == DownloadJob::RUNNING)
+                continue;
+            finished++;
+            EXPECT_EQ(result->context, owner);
+            EXPECT_EQ(result->status, DownloadJob::SUCCESS);
+        }
+        EXPECT_EQ(finished, 1u);
+
+        // nobody else waits once the owner is killed too
+        EXPECT_TRUE(job->detachContext(owner));
+    }
+
+    TEST_F(downloadSchedulerTest, PausedBatchesLeaveWorkersForOtherJobs) {
+        SetEnvironmentVariableA(FAKE_DOWNLOADER_MILLIS_ENV, "30000");
+        // a custom command is never batched, so every press gets a batch and a worker of its own
+        settings.customCommand = "--simulate";
+        std::shared_ptr<DownloadScheduler> scheduler = std::make_shared<DownloadScheduler>(results);
+        scheduler->setMaxConcurrent(DownloadScheduler::WORKER_COUNT);
+        scheduler->setCoalesceWindow(0);
+        for (uint32_t i = 0; i <= DownloadScheduler::WORKER_COUNT; i++)
+            scheduler->submit("https://www.youtube.com/watch?v=stub" + std::to_string(i), settings, i + 1, false);
+
+        const steadyClock_t::time_point deadline = steadyClock_t::now() + std::chrono::seconds(20);
+        while (countLaunches() < DownloadScheduler::WORKER_COUNT && steadyClock_t::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        ASSERT_EQ(countLaunches(), DownloadScheduler::WORKER_COUNT);
+
+        // every worker holds a paused batch, the freed slot still gets the last press going.
+        // A batch whose process was not created yet is not paused, so this is repeated.
+        while (countLaunches() <= DownloadScheduler::WORKER_COUNT && steadyClock_t::now() < deadline)
+        {
+            scheduler->pauseAll();
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        EXPECT_EQ(countLaunches(), DownloadScheduler::WORKER_COUNT + 1);
+
+        scheduler->killAll();
+        scheduler = nullptr;
+    }
+}
+#endif
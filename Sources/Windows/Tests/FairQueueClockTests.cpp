@@ -0,0 +1,76 @@
+#include "pch.h"
+
+#include "../FairQueueClock.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace Tests
+{
+    struct queuedJob_t
+    {
+        contextHandle_t flow;
+        double finishTag;
+    };
+
+    // dispatch the queued job with the lowest tag, the way the scheduler does within one priority
+    static contextHandle_t dispatchNext(FairQueueClock& clock, std::vector<queuedJob_t>& queue)
+    {
+        auto next = std::min_element(queue.begin(), queue.end(),
+            [](const queuedJob_t& a, const queuedJob_t& b) { return a.finishTag < b.finishTag; });
+        const contextHandle_t flow = next->flow;
+        clock.advance(next->finishTag);
+        queue.erase(next);
+        return flow;
+    }
+
+    TEST(fairQueueClockTest, LightFlowIsNotStuckBehindHeavyFlow) {
+        FairQueueClock clock;
+        std::vector<queuedJob_t> queue;
+        for (int i = 0; i < 20; i++)
+            queue.push_back({ 1, clock.stamp(1, 1) });
+        EXPECT_EQ(dispatchNext(clock, queue), 1u);
+
+        // a second button queues after the playlist, its jobs still alternate with the playlist
+        queue.push_back({ 2, clock.stamp(2, 1) });
+        queue.push_back({ 2, clock.stamp(2, 1) });
+        std::vector<contextHandle_t> order;
+        for (int i = 0; i < 4; i++)
+            order.push_back(dispatchNext(clock, queue));
+        EXPECT_EQ(std::count(order.begin(), order.end(), 2u), 2);
+    }
+
+    TEST(fairQueueClockTest, WeightsGiveProportionalShares) {
+        FairQueueClock clock;
+        std::vector<queuedJob_t> queue;
+        for (int i = 0; i < 30; i++)
+        {
+            queue.push_back({ 1, clock.stamp(1, 2) });
+            queue.push_back({ 2, clock.stamp(2, 1) });
+        }
+
+        int firstFlowCount = 0;
+        for (int i = 0; i < 30; i++)
+        {
+            if (dispatchNext(clock, queue) == 1u)
+                firstFlowCount++;
+        }
+        EXPECT_EQ(firstFlowCount, 20);
+    }
+
+    TEST(fairQueueClockTest, IdleFlowRestartsAtVirtualTime) {
+        FairQueueClock clock;
+        std::vector<queuedJob_t> queue;
+        queue.push_back({ 1, clock.stamp(1, 1) });
+        for (int i = 0; i < 10; i++)
+            queue.push_back({ 2, clock.stamp(2, 1) });
+        while (queue.size() > 5)
+            dispatchNext(clock, queue);
+
+        // the first button was idle, it does not get credit for the time it had nothing queued
+        const double tag = clock.stamp(1, 1);
+        EXPECT_DOUBLE_EQ(tag, clock.getVirtualTime() + 1.0);
+        // weights above the maximum are clamped
+        EXPECT_DOUBLE_EQ(clock.stamp(3, 1000), clock.getVirtualTime() + 1.0 / FairQueueClock::MAX_WEIGHT);
+    }
+}
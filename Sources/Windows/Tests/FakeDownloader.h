@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace Tests
+{
+    // When this variable is set, the test exe acts as a fake yt-dlp instead of running the tests.
+    // Every launch appends a line to the file named by the variable, sleeps to stand in for the python startup,
+    // and reports every url of a batch file as done. The hook that does so is in BatchBenchmarkTests.cpp.
+    constexpr const char* FAKE_DOWNLOADER_ENV = "YTDL_PLUGIN_FAKE_DOWNLOADER_LOG";
+    // overrides how long the fake yt-dlp sleeps, so a test can keep it running
+    constexpr const char* FAKE_DOWNLOADER_MILLIS_ENV = "YTDL_PLUGIN_FAKE_DOWNLOADER_MILLIS";
+    constexpr uint32_t FAKE_STARTUP_MILLIS = 300;
+
+    // get the number of times the fake yt-dlp was launched
+    inline uint32_t countFakeLaunches(const std::filesystem::path& launchLogPath)
+    {
+        std::ifstream log(launchLogPath);
+        std::string line;
+        uint32_t launches = 0;
+        while (std::getline(log, line))
+            launches++;
+        return launches;
+    }
+}
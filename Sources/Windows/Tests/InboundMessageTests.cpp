@@ -0,0 +1,123 @@
+#include "pch.h"
+
+#include "../../Common/ESDInboundMessage.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace Tests
+{
+    // traffic as sent by the Stream Deck application
+    static std::vector<std::string> getRecordedTraffic()
+    {
+        return {
+            R"({"action":"com.elgato.youtube-dl-plugin.action","context":"0A6E2A4F1C5A4E0F9B1F2D3C4B5A6978","device":"71C5B1E0D4F3A2B1C0D9E8F7A6B5C4D3","event":"keyUp","payload":{"coordinates":{"column":2,"row":1},"isInMultiAction":false,"settings":{"audioDl":"off","batchWindowMillis":"250","customCommand":"","label":"youtube","maxConcurrentDownloads":"4","maxDownloads":"1","maxParallelCommands":"1","outputFolder":"C:\\Users\\me\\Videos","progressDisplay":"bar","redditDl":"off","videoDl":"on","youtubeDlExePath":""},"state":0,"userDesiredState":0}})",
+            R"({"action":"com.elgato.youtube-dl-plugin.action","context":"0A6E2A4F1C5A4E0F9B1F2D3C4B5A6978","event":"sendToPlugin","payload":{"audioDl":"on","batchWindowMillis":"250","customCommand":"-f \"bestvideo[height<=720]\" {url}","label":"music","maxConcurrentDownloads":"4","maxDownloads":"0","maxParallelCommands":"2","outputFolder":"","progressDisplay":"text","redditDl":"off","videoDl":"off","youtubeDlExePath":""}})",
+            R"({"action":"com.elgato.youtube-dl-plugin.action","context":"5D2C8B7A6F5E4D3C2B1A09F8E7D6C5B4","device":"71C5B1E0D4F3A2B1C0D9E8F7A6B5C4D3","event":"willAppear","payload":{"controller":"Keypad","coordinates":{"column":0,"row":0},"isInMultiAction":false,"settings":{"label":"caf\u00e9 \ud83c\udfa5","videoDl":"on"},"state":0}})",
+        };
+    }
+
+    static void expectSameAsDom(const std::string& message)
+    {
+        json receivedJson = json::parse(message);
+        json payload;
+        EPLJSONUtils::GetObjectByName(receivedJson, kESDSDKCommonPayload, payload);
+        json deviceInfo;
+        EPLJSONUtils::GetObjectByName(receivedJson, kESDSDKCommonDeviceInfo, deviceInfo);
+
+        ESDInboundMessage inbound;
+        ASSERT_TRUE(inbound.Parse(message)) << message;
+        EXPECT_EQ(inbound.GetEvent(), EPLJSONUtils::GetStringByName(receivedJson, kESDSDKCommonEvent));
+        EXPECT_EQ(inbound.GetContext(), EPLJSONUtils::GetStringByName(receivedJson, kESDSDKCommonContext));
+        EXPECT_EQ(inbound.GetAction(), EPLJSONUtils::GetStringByName(receivedJson, kESDSDKCommonAction));
+        EXPECT_EQ(inbound.GetDevice(), EPLJSONUtils::GetStringByName(receivedJson, kESDSDKCommonDevice));
+        EXPECT_EQ(inbound.GetPayload(), payload);
+        EXPECT_EQ(inbound.GetDeviceInfo(), deviceInfo);
+    }
+
+    TEST(inboundMessageTest, MatchesDomParse) {
+        for (const std::string& message : getRecordedTraffic())
+            expectSameAsDom(message);
+
+        expectSameAsDom(R"( { "event" : "deviceDidConnect" , "device":"D1", "deviceInfo":{"name":"Stream Deck XL","size":{"columns":8,"rows":4},"type":2} } )");
+        expectSameAsDom(R"({"event":"systemDidWakeUp"})");
+        expectSameAsDom(R"({})");
+        // escaped keys and values, braces inside strings, and a later duplicate key
+        expectSameAsDom(R"({"ev\u0065nt":"keyDown","context":"a\"b\\c\/d\n","payload":{"s":"} ] { [","a":[1,{"b":null}]},"event":"keyUp"})");
+        // fields of the wrong type are empty or null
+        expectSameAsDom(R"({"event":"keyUp","context":5,"action":null,"device":["x"],"payload":[1,2],"deviceInfo":"none"})");
+    }
+
+    TEST(inboundMessageTest, RejectsMessagesThatAreNotObjects) {
+        ESDInboundMessage inbound;
+        EXPECT_FALSE(inbound.Parse(""));
+        EXPECT_FALSE(inbound.Parse("[1,2]"));
+        EXPECT_FALSE(inbound.Parse(R"({"event":"keyUp")"));
+        EXPECT_FALSE(inbound.Parse(R"({"event":"keyUp","payload":{"a":1})"));
+        EXPECT_FALSE(inbound.Parse(R"({"event" "keyUp"})"));
+        EXPECT_FALSE(inbound.Parse(R"({"event":"\ud83c"})"));
+        EXPECT_FALSE(inbound.Parse(R"({"event":"keyUp",})"));
+    }
+
+    TEST(inboundMessageTest, MalformedPayloadThrowsOnlyWhenUsed) {
+        ESDInboundMessage inbound;
+        ASSERT_TRUE(inbound.Parse(R"({"event":"keyUp","payload":{"a":tru}})"));
+        EXPECT_EQ(inbound.GetEvent(), "keyUp");
+        EXPECT_THROW(inbound.GetPayload(), json::parse_error);
+    }
+
+    // a benchmark, run it with --gtest_also_run_disabled_tests
+    TEST(inboundMessageTest, DISABLED_BenchmarkThroughput) {
+        const int ROUNDS = 20000;
+        const std::vector<std::string> traffic = getRecordedTraffic();
+
+        // the way OnMessage decoded every message before
+        size_t checksum = 0;
+        const auto domStart = std::chrono::steady_clock::now();
+        for (int i = 0; i < ROUNDS; i++)
+        {
+            for (const std::string& message : traffic)
+            {
+                json receivedJson = json::parse(message);
+                std::string event = EPLJSONUtils::GetStringByName(receivedJson, kESDSDKCommonEvent);
+                std::string context = EPLJSONUtils::GetStringByName(receivedJson, kESDSDKCommonContext);
+                std::string action = EPLJSONUtils::GetStringByName(receivedJson, kESDSDKCommonAction);
+                std::string deviceID = EPLJSONUtils::GetStringByName(receivedJson, kESDSDKCommonDevice);
+                json payload;
+                EPLJSONUtils::GetObjectByName(receivedJson, kESDSDKCommonPayload, payload);
+                checksum += event.size() + context.size() + payload.size();
+            }
+        }
+        const double domSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - domStart).count();
+
+        // every one of these events has a handler that takes the payload
+        size_t onDemandChecksum = 0;
+        ESDInboundMessage inbound;
+        const auto onDemandStart = std::chrono::steady_clock::now();
+        for (int i = 0; i < ROUNDS; i++)
+        {
+            for (const std::string& message : traffic)
+            {
+                inbound.Parse(message);
+                const json payload = inbound.GetPayload();
+                onDemandChecksum += inbound.GetEvent().size() + inbound.GetContext().size() + payload.size();
+            }
+        }
+        const double onDemandSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - onDemandStart).count();
+
+        // events without a handler are only scanned
+        const std::string unhandled = R"({"action":"com.elgato.youtube-dl-plugin.action","context":"0A6E2A4F1C5A4E0F9B1F2D3C4B5A6978","device":"71C5B1E0D4F3A2B1C0D9E8F7A6B5C4D3","event":"titleParametersDidChange","payload":{"coordinates":{"column":2,"row":1},"settings":{"label":"youtube"},"state":0,"title":"youtube\nPending: 0\n","titleParameters":{"fontFamily":"","fontSize":7,"fontStyle":"","fontUnderline":false,"showTitle":true,"titleAlignment":"middle","titleColor":"#ffffff"}}})";
+        const auto scanStart = std::chrono::steady_clock::now();
+        for (int i = 0; i < ROUNDS; i++)
+            inbound.Parse(unhandled);
+        const double scanSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - scanStart).count();
+
+        EXPECT_EQ(checksum, onDemandChecksum);
+        const double messages = static_cast<double>(ROUNDS) * traffic.size();
+        std::cout << "messages per second: dom " << static_cast<uint64_t>(messages / domSeconds)
+            << ", on-demand " << static_cast<uint64_t>(messages / onDemandSeconds)
+            << ", unhandled events " << static_cast<uint64_t>(ROUNDS / scanSeconds) << std::endl;
+    }
+}
@@ -0,0 +1,166 @@
+#include "pch.h"
+
+#include "../FileUtils.h"
+#include "../JobJournal.h"
+#include "../WindowsProcessUtils.h"
+
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+
+namespace Tests
+{
+    static std::filesystem::path getJournalPath(const std::string& name)
+    {
+        const std::filesystem::path path = std::filesystem::temp_directory_path() / ("youtube-dl-plugin-" + name + ".journal");
+        std::filesystem::remove(path);
+        return path;
+    }
+
+    static JobJournal::entry_t makeEntry(const uint64_t jobId)
+    {
+        return { jobId, "context", "https://www.youtube.com/watch?v=" + std::to_string(jobId), { {"outputFolder", "C:\\Downloads"} } };
+    }
+
+    TEST(jobJournalTest, ReplaysUnfinishedJobs) {
+        const std::filesystem::path path = getJournalPath("replay");
+        {
+            JobJournal journal(path);
+            EXPECT_TRUE(journal.recordSubmit(makeEntry(1)));
+            EXPECT_TRUE(journal.recordSubmit(makeEntry(2)));
+            EXPECT_TRUE(journal.recordSubmit(makeEntry(3)));
+            EXPECT_TRUE(journal.recordDone(2));
+            EXPECT_TRUE(journal.recordState(3, "paused"));
+        }
+
+        JobJournal journal(path);
+        const std::vector<JobJournal::entry_t> unfinished = journal.getUnfinished();
+        ASSERT_EQ(unfinished.size(), 2u);
+        EXPECT_EQ(unfinished[0].jobId, 1u);
+        EXPECT_EQ(unfinished[0].url, makeEntry(1).url);
+        EXPECT_EQ(unfinished[0].settings, makeEntry(1).settings);
+        EXPECT_EQ(unfinished[1].jobId, 3u);
+        EXPECT_EQ(unfinished[1].state, "paused");
+        EXPECT_EQ(journal.getLastJobId(), 3u);
+    }
+
+    TEST(jobJournalTest, DropsRecordTornByCrash) {
+        const std::filesystem::path path = getJournalPath("torn");
+        {
+            JobJournal journal(path);
+            journal.recordSubmit(makeEntry(1));
+            journal.recordSubmit(makeEntry(2));
+        }
+        {
+            // the process died in the middle of writing the end of job 1
+            std::ofstream file(path, std::ios::binary | std::ios::app);
+            file << "{\"op\":\"done\",\"id\":1";
+        }
+        {
+            JobJournal journal(path);
+            EXPECT_EQ(journal.getUnfinished().size(), 2u);
+            // a record after the torn one is not lost
+            journal.recordDone(2);
+        }
+
+        JobJournal journal(path);
+        const std::vector<JobJournal::entry_t> unfinished = journal.getUnfinished();
+        ASSERT_EQ(unfinished.size(), 1u);
+        EXPECT_EQ(unfinished[0].jobId, 1u);
+    }
+
+    TEST(jobJournalTest, CompactsFinishedJobs) {
+        const std::filesystem::path path = getJournalPath("compact");
+        {
+            JobJournal journal(path);
+            journal.recordSubmit(makeEntry(1));
+            for (uint64_t id = 2; id < 2 + JobJournal::COMPACT_AFTER_RECORDS; id++)
+            {
+                journal.recordSubmit(makeEntry(id));
+                journal.recordDone(id);
+            }
+            // only job 1 is left, along with the records since the compaction
+            EXPECT_LT(std::filesystem::file_size(path), 200u * JobJournal::COMPACT_AFTER_RECORDS / 2);
+        }
+
+        JobJournal journal(path);
+        ASSERT_EQ(journal.getUnfinished().size(), 1u);
+        EXPECT_EQ(journal.getUnfinished()[0].jobId, 1u);
+    }
+
+    TEST(jobJournalTest, KeepsProcessesUntilTheyExited) {
+        const std::filesystem::path path = getJournalPath("processes");
+        {
+            JobJournal journal(path);
+            journal.recordSubmit(makeEntry(1));
+            journal.recordSubmit(makeEntry(2));
+            EXPECT_TRUE(journal.recordProcess(1, { 100, 1234, "C:\\Temp\\1-0.output.txt" }));
+            EXPECT_TRUE(journal.recordProcess(2, { 200, 5678, "C:\\Temp\\1-1.output.txt" }));
+            EXPECT_TRUE(journal.recordProcessesExited(2));
+        }
+
+        // the processes are kept through the compaction when the journal is opened again
+        JobJournal journal(path);
+        const std::vector<JobJournal::process_t> processes = journal.getProcesses(1);
+        ASSERT_EQ(processes.size(), 1u);
+        EXPECT_EQ(processes[0].processId, 100u);
+        EXPECT_EQ(processes[0].creationTime, 1234u);
+        EXPECT_EQ(processes[0].outputPath, "C:\\Temp\\1-0.output.txt");
+        EXPECT_TRUE(journal.getProcesses(2).empty());
+        EXPECT_TRUE(journal.getProcesses(3).empty());
+    }
+
+#ifdef _WIN32
+    static const char* JOURNAL_PATH_VARIABLE = "YOUTUBE_DL_PLUGIN_TEST_JOURNAL";
+
+    // started by NothingLostOrDuplicatedWhenKilled in a child process, it journals jobs until it is killed.
+    // Every even job finishes right away, every odd job stays queued.
+    TEST(jobJournalTest, DISABLED_JournalUntilKilled) {
+        char path[MAX_PATH] = {};
+        if (GetEnvironmentVariableA(JOURNAL_PATH_VARIABLE, path, MAX_PATH) == 0)
+            return;
+
+        JobJournal journal(path);
+        for (uint64_t id = 1; ; id++)
+        {
+            journal.recordSubmit(makeEntry(id));
+            if (id % 2 == 0)
+                journal.recordDone(id);
+        }
+    }
+
+    TEST(jobJournalTest, NothingLostOrDuplicatedWhenKilled) {
+        const std::filesystem::path path = getJournalPath("killed");
+        SetEnvironmentVariableA(JOURNAL_PATH_VARIABLE, path.string().c_str());
+
+        // the child is this test exe, running only the disabled test
+        PROCESS_INFORMATION pi = windowsprocessutils::startProcess(fileutils::getCurrentExeFolder(),
+            " --gtest_also_run_disabled_tests --gtest_filter=jobJournalTest.DISABLED_JournalUntilKilled");
+
+        // kill it in the middle of the queue, after several compactions
+        Sleep(2000);
+        TerminateProcess(pi.hProcess, 1);
+        WaitForSingleObject(pi.hProcess, INFINITE);
+        CloseHandle(pi.hProcess);
+        CloseHandle(pi.hThread);
+        SetEnvironmentVariableA(JOURNAL_PATH_VARIABLE, NULL);
+
+        JobJournal journal(path);
+        const uint64_t lastJobId = journal.getLastJobId();
+        ASSERT_GT(lastJobId, 2u * JobJournal::COMPACT_AFTER_RECORDS);
+
+        std::set<uint64_t> ids;
+        for (const auto& entry : journal.getUnfinished())
+            EXPECT_TRUE(ids.insert(entry.jobId).second);
+        for (uint64_t id = 1; id <= lastJobId; id++)
+        {
+            // the last job may have been killed before its end was journaled
+            if (id % 2 == 1)
+                EXPECT_EQ(ids.count(id), 1u) << "lost job " << id;
+            else if (id < lastJobId)
+                EXPECT_EQ(ids.count(id), 0u) << "finished job " << id << " would run again";
+        }
+    }
+#endif
+}
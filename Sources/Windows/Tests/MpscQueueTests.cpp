@@ -0,0 +1,109 @@
+#include "pch.h"
+
+#include "../MpscQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Tests
+{
+    struct record_t
+    {
+        uint32_t producer = 0;
+        uint32_t sequence = 0;
+        // makes records move-only like the job results with their strings and vectors
+        std::unique_ptr<std::string> payload;
+    };
+
+    TEST(mpscQueueTest, KeepsOrderOfSingleProducer) {
+        MpscQueue<std::string> queue;
+        EXPECT_TRUE(queue.empty());
+        EXPECT_EQ(queue.tryPop(), std::nullopt);
+
+        queue.push("a");
+        queue.push("b");
+        EXPECT_FALSE(queue.empty());
+        EXPECT_EQ(queue.tryPop(), "a");
+        EXPECT_EQ(queue.tryPop(), "b");
+        EXPECT_TRUE(queue.empty());
+
+        // values left in the queue are freed with it
+        queue.push("c");
+    }
+
+    TEST(mpscQueueTest, WaitEndsOnStopCondition) {
+        MpscQueue<int> queue;
+        std::atomic<bool> running = true;
+        std::thread consumer([&]()
+            {
+                queue.wait([&] { return !running.load(); });
+            });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        running = false;
+        queue.notify();
+        consumer.join();
+        EXPECT_TRUE(queue.empty());
+    }
+
+    TEST(mpscQueueTest, StressManyProducers) {
+        const uint32_t PRODUCER_COUNT = 2000;
+        const uint32_t RECORDS_PER_PRODUCER = 50;
+        MpscQueue<record_t> queue;
+
+        // the consumer sleeps whenever it drained the queue, so every wakeup goes through the event count
+        std::vector<uint32_t> nextSequence(PRODUCER_COUNT, 0);
+        uint64_t received = 0;
+        uint64_t outOfOrder = 0;
+        uint64_t sleeps = 0;
+        const uint64_t expected = static_cast<uint64_t>(PRODUCER_COUNT) * RECORDS_PER_PRODUCER;
+        const auto start = std::chrono::steady_clock::now();
+        std::thread consumer([&]()
+            {
+                while (received < expected)
+                {
+                    if (queue.empty())
+                        sleeps++;
+                    queue.wait([] { return false; });
+                    while (std::optional<record_t> record = queue.tryPop())
+                    {
+                        if (record->sequence != nextSequence[record->producer] || *record->payload != std::to_string(record->sequence))
+                            outOfOrder++;
+                        nextSequence[record->producer] = record->sequence + 1;
+                        received++;
+                    }
+                }
+            });
+
+        std::vector<std::thread> producers;
+        for (uint32_t p = 0; p < PRODUCER_COUNT; p++)
+        {
+            producers.emplace_back([&queue, p, RECORDS_PER_PRODUCER]()
+                {
+                    for (uint32_t i = 0; i < RECORDS_PER_PRODUCER; i++)
+                    {
+                        queue.push({ p, i, std::make_unique<std::string>(std::to_string(i)) });
+                        if (i % 8 == 0)
+                            std::this_thread::yield();
+                    }
+                });
+        }
+        for (auto& t : producers)
+            t.join();
+        consumer.join();
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+        EXPECT_EQ(received, expected);
+        EXPECT_EQ(outOfOrder, 0u);
+        for (uint32_t p = 0; p < PRODUCER_COUNT; p++)
+            EXPECT_EQ(nextSequence[p], RECORDS_PER_PRODUCER);
+        EXPECT_TRUE(queue.empty());
+
+        std::cout << PRODUCER_COUNT << " producers, " << received << " records in " << elapsed.count()
+            << " ms, consumer found the queue empty " << sleeps << " times" << std::endl;
+    }
+}
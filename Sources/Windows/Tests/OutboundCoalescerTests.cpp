@@ -0,0 +1,106 @@
+#include "pch.h"
+
+#include "../../Common/ESDOutboundCoalescer.h"
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Tests
+{
+    static ESDOutboundCoalescer::message_t makeTitle(const std::string& context, const std::string& title)
+    {
+        return { ESDOutboundCoalescer::TITLE, context, kESDSDKTarget_HardwareAndSoftware, title };
+    }
+
+    TEST(outboundCoalescerTest, DropsUpdatesThatMatchWhatTheKeyShows) {
+        ESDOutboundCoalescer coalescer;
+        EXPECT_TRUE(coalescer.submit(makeTitle("a", "Pending: 1")));
+        ASSERT_EQ(coalescer.takePending().size(), 1u);
+
+        // same title again is dropped, and needs no flush
+        EXPECT_FALSE(coalescer.submit(makeTitle("a", "Pending: 1")));
+        EXPECT_TRUE(coalescer.takePending().empty());
+
+        // an image of the same context is tracked separately
+        EXPECT_TRUE(coalescer.submit({ ESDOutboundCoalescer::IMAGE, "a", kESDSDKTarget_HardwareAndSoftware, "Pending: 1" }));
+        EXPECT_EQ(coalescer.takePending().size(), 1u);
+
+        // a key that appears again is reset, so the same title is sent again
+        coalescer.forgetContext("a");
+        EXPECT_TRUE(coalescer.submit(makeTitle("a", "Pending: 1")));
+        EXPECT_EQ(coalescer.takePending().size(), 1u);
+
+        EXPECT_EQ(coalescer.getStats().sent, 3u);
+        EXPECT_EQ(coalescer.getStats().dropped, 1u);
+    }
+
+    TEST(outboundCoalescerTest, MergesBurstIntoLatestUpdatePerContext) {
+        ESDOutboundCoalescer coalescer;
+        EXPECT_TRUE(coalescer.submit(makeTitle("a", "1%")));
+        EXPECT_FALSE(coalescer.submit(makeTitle("b", "1%")));
+        EXPECT_FALSE(coalescer.submit(makeTitle("a", "2%")));
+        EXPECT_FALSE(coalescer.submit(makeTitle("a", "3%")));
+
+        std::vector<ESDOutboundCoalescer::message_t> messages = coalescer.takePending();
+        ASSERT_EQ(messages.size(), 2u);
+        EXPECT_EQ(messages[0].context, "a");
+        EXPECT_EQ(messages[0].value, "3%");
+        EXPECT_EQ(messages[1].context, "b");
+
+        // a burst that ends on what the key already shows sends nothing
+        EXPECT_TRUE(coalescer.submit(makeTitle("a", "4%")));
+        EXPECT_FALSE(coalescer.submit(makeTitle("a", "3%")));
+        EXPECT_TRUE(coalescer.takePending().empty());
+        EXPECT_EQ(coalescer.getStats().dropped, 4u);
+    }
+
+    TEST(outboundCoalescerTest, CancelledFlushIsScheduledAgain) {
+        ESDOutboundCoalescer coalescer;
+        EXPECT_TRUE(coalescer.submit(makeTitle("a", "1%")));
+        coalescer.cancelFlush();
+
+        // the update of the failed timer is still pending, and goes out with the next flush
+        EXPECT_TRUE(coalescer.submit(makeTitle("b", "1%")));
+        EXPECT_EQ(coalescer.takePending().size(), 2u);
+    }
+
+    TEST(outboundCoalescerTest, LoadTestSendsFarFewerMessages) {
+        // 32 keys downloading at once. Every progress result, press and settings change redraws a key,
+        // but the shown percentage only changes every few redraws, and a frame flush happens every 64 redraws.
+        const int CONTEXT_COUNT = 32;
+        const int UPDATE_COUNT = 100000;
+        const int UPDATES_PER_FRAME = 64;
+
+        ESDOutboundCoalescer coalescer;
+        std::unordered_map<std::string, std::string> lastSubmitted;
+        std::unordered_map<std::string, std::string> shown;
+        uint64_t flushes = 0;
+        for (int i = 0; i < UPDATE_COUNT; i++)
+        {
+            const std::string context = "context" + std::to_string(i % CONTEXT_COUNT);
+            const std::string title = "Pending: 1\n" + std::to_string(i / (CONTEXT_COUNT * 5) % 101) + "%";
+            lastSubmitted[context] = title;
+            coalescer.submit(makeTitle(context, title));
+
+            if (i % UPDATES_PER_FRAME == UPDATES_PER_FRAME - 1)
+            {
+                for (const auto& message : coalescer.takePending())
+                    shown[message.context] = message.value;
+                flushes++;
+            }
+        }
+        for (const auto& message : coalescer.takePending())
+            shown[message.context] = message.value;
+
+        // every key ends up showing its latest title
+        EXPECT_EQ(shown, lastSubmitted);
+
+        const ESDOutboundCoalescer::stats_t stats = coalescer.getStats();
+        EXPECT_EQ(stats.sent + stats.dropped, static_cast<uint64_t>(UPDATE_COUNT));
+        EXPECT_LT(stats.sent, static_cast<uint64_t>(UPDATE_COUNT) / 4);
+        std::cout << "submitted " << UPDATE_COUNT << ", sent " << stats.sent << ", dropped " << stats.dropped
+            << " over " << flushes << " frames" << std::endl;
+    }
+}
@@ -0,0 +1,178 @@
+#include "pch.h"
+
+#include "../../Common/ESDOutboundEncoder.h"
+#include "../../Vendor/json/src/json.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+// count the allocations of each thread, so the benchmark is not disturbed by other threads
+static thread_local uint64_t tAllocationCount = 0;
+
+void* operator new(size_t size)
+{
+    tAllocationCount++;
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace Tests
+{
+    using nlohmann::json;
+
+    // the way ESDConnectionManager built these events before the encoder
+    static std::string dumpSetTitle(const std::string& title, const std::string& context, ESDSDKTarget target)
+    {
+        json jsonObject;
+        jsonObject[kESDSDKCommonEvent] = kESDSDKEventSetTitle;
+        jsonObject[kESDSDKCommonContext] = context;
+        json payload;
+        payload[kESDSDKPayloadTarget] = target;
+        payload[kESDSDKPayloadTitle] = title;
+        jsonObject[kESDSDKCommonPayload] = payload;
+        return jsonObject.dump();
+    }
+
+    static std::string dumpSetImage(const std::string& image, const std::string& context, ESDSDKTarget target)
+    {
+        json jsonObject;
+        jsonObject[kESDSDKCommonEvent] = kESDSDKEventSetImage;
+        jsonObject[kESDSDKCommonContext] = context;
+        json payload;
+        payload[kESDSDKPayloadTarget] = target;
+        const std::string prefix = "data:image/png;base64,";
+        if (image.empty() || image.substr(0, prefix.length()).find(prefix) == 0)
+            payload[kESDSDKPayloadImage] = image;
+        else
+            payload[kESDSDKPayloadImage] = "data:image/png;base64," + image;
+        jsonObject[kESDSDKCommonPayload] = payload;
+        return jsonObject.dump();
+    }
+
+    static std::string dumpLogMessage(const std::string& message)
+    {
+        json jsonObject;
+        jsonObject[kESDSDKCommonEvent] = kESDSDKEventLogMessage;
+        json payload;
+        payload[kESDSDKPayloadMessage] = message;
+        jsonObject[kESDSDKCommonPayload] = payload;
+        return jsonObject.dump();
+    }
+
+    static std::vector<std::string> getSampleStrings()
+    {
+        std::vector<std::string> samples = {
+            "",
+            "Label\nPending: 3\n42% 1.5MB/s\nETA 1:05",
+            "quote \" backslash \\ slash / tab \t cr \r bs \b ff \f del \x7f",
+            "caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x8E\xA5 \xEF\xBF\xBF \xF4\x8F\xBF\xBF",
+            "data:image/png;base64,iVBORw0KGgo=",
+            "iVBORw0KGgo=",
+            std::string(5000, 'x') + "\"",
+        };
+        std::string controls;
+        for (int c = 0; c < 0x20; c++)
+            controls += static_cast<char>(c);
+        samples.push_back(controls);
+        return samples;
+    }
+
+    TEST(outboundEncoderTest, MatchesJsonDump) {
+        std::string buffer;
+        for (const std::string& sample : getSampleStrings())
+        {
+            for (const ESDSDKTarget target : { kESDSDKTarget_HardwareAndSoftware, kESDSDKTarget_HardwareOnly, kESDSDKTarget_SoftwareOnly })
+            {
+                ASSERT_TRUE(ESDOutboundEncoder::EncodeSetTitle(buffer, sample, "ctx\"1", target));
+                EXPECT_EQ(buffer, dumpSetTitle(sample, "ctx\"1", target));
+                ASSERT_TRUE(ESDOutboundEncoder::EncodeSetImage(buffer, sample, "0123ABCD", target));
+                EXPECT_EQ(buffer, dumpSetImage(sample, "0123ABCD", target));
+            }
+            ASSERT_TRUE(ESDOutboundEncoder::EncodeLogMessage(buffer, sample));
+            EXPECT_EQ(buffer, dumpLogMessage(sample));
+        }
+    }
+
+    TEST(outboundEncoderTest, RejectsInvalidUtf8LikeJsonDump) {
+        const std::vector<std::string> invalid = {
+            "\x80",             // lone continuation byte
+            "\xC0\xAF",         // overlong
+            "\xE0\x80\xAF",     // overlong
+            "\xED\xA0\x80",     // surrogate
+            "\xF4\x90\x80\x80", // above U+10FFFF
+            "\xF8\x88\x80\x80\x80",
+            "abc\xE2\x82",      // truncated at the end
+        };
+        std::string buffer;
+        for (const std::string& sample : invalid)
+        {
+            EXPECT_FALSE(ESDOutboundEncoder::EncodeSetTitle(buffer, sample, "ctx", kESDSDKTarget_HardwareAndSoftware));
+            EXPECT_FALSE(ESDOutboundEncoder::EncodeLogMessage(buffer, sample));
+            EXPECT_THROW(dumpSetTitle(sample, "ctx", kESDSDKTarget_HardwareAndSoftware), json::type_error);
+        }
+    }
+
+    TEST(outboundEncoderTest, BenchmarkSetTitleAllocations) {
+        const int ITERATIONS = 20000;
+        const std::string title = "youtube\nPending: 2\n37% 2.4MB/s\nETA 0:41";
+        const std::string context = "A1B2C3D4E5F60718293A4B5C6D7E8F90";
+
+        // the buffer grows on the first encode and is reused after that
+        std::string buffer;
+        ESDOutboundEncoder::EncodeSetTitle(buffer, title, context, kESDSDKTarget_HardwareAndSoftware);
+
+        const uint64_t encoderStartCount = tAllocationCount;
+        const auto encoderStart = std::chrono::steady_clock::now();
+        for (int i = 0; i < ITERATIONS; i++)
+            ESDOutboundEncoder::EncodeSetTitle(buffer, title, context, kESDSDKTarget_HardwareAndSoftware);
+        const auto encoderTime = std::chrono::steady_clock::now() - encoderStart;
+        const uint64_t encoderAllocations = tAllocationCount - encoderStartCount;
+
+        const uint64_t dumpStartCount = tAllocationCount;
+        const auto dumpStart = std::chrono::steady_clock::now();
+        size_t dumpedBytes = 0;
+        for (int i = 0; i < ITERATIONS; i++)
+            dumpedBytes += dumpSetTitle(title, context, kESDSDKTarget_HardwareAndSoftware).size();
+        const auto dumpTime = std::chrono::steady_clock::now() - dumpStart;
+        const uint64_t dumpAllocations = tAllocationCount - dumpStartCount;
+
+        EXPECT_EQ(encoderAllocations, 0u);
+        EXPECT_GT(dumpAllocations, 0u);
+        EXPECT_EQ(dumpedBytes, buffer.size() * ITERATIONS);
+
+        std::cout << "allocations per SetTitle: json dump " << static_cast<double>(dumpAllocations) / ITERATIONS
+            << ", encoder " << static_cast<double>(encoderAllocations) / ITERATIONS << std::endl;
+        std::cout << "time per SetTitle: json dump " << std::chrono::duration_cast<std::chrono::nanoseconds>(dumpTime).count() / ITERATIONS
+            << "ns, encoder " << std::chrono::duration_cast<std::chrono::nanoseconds>(encoderTime).count() / ITERATIONS << "ns" << std::endl;
+    }
+}
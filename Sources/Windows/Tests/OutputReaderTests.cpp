@@ -0,0 +1,160 @@
+#include "pch.h"
+
+#include "../OutputReader.h"
+#include "../ProgressParser.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include "../WindowsProcessUtils.h"
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
+
+namespace Tests
+{
+    TEST(progressParserTest, ParsesProgressLinesSplitAcrossReads) {
+        ProgressParser parser;
+        const std::string output = "[download] Destination: video.mp4\n"
+            "[download-progress] 1048576 4194304 NA 524288.5 6\r\n";
+
+        // feed one byte at a time, the line only counts once its newline arrives
+        bool updated = false;
+        for (size_t i = 0; i < output.size(); i++)
+            updated |= parser.feed(&output[i], 1);
+
+        EXPECT_TRUE(updated);
+        EXPECT_EQ(parser.getProgress().downloadedBytes, 1048576);
+        EXPECT_EQ(parser.getProgress().totalBytes, 4194304);
+        ASSERT_TRUE(parser.getProgress().speed.has_value());
+        EXPECT_DOUBLE_EQ(*parser.getProgress().speed, 524288.5);
+        EXPECT_EQ(parser.getProgress().eta, 6);
+    }
+
+    TEST(progressParserTest, FallsBackToEstimateAndHandlesUnknownFields) {
+        ProgressParser parser;
+        const std::string line = "[download-progress] 2048 NA 8192.0 NA NA\n";
+        EXPECT_TRUE(parser.feed(line.data(), line.size()));
+        EXPECT_EQ(parser.getProgress().downloadedBytes, 2048);
+        EXPECT_EQ(parser.getProgress().totalBytes, 8192);
+        EXPECT_FALSE(parser.getProgress().speed.has_value());
+        EXPECT_FALSE(parser.getProgress().eta.has_value());
+    }
+
+    TEST(progressParserTest, KeepsParsingAcrossRingWrapAndOverflow) {
+        ProgressParser parser;
+        // push the ring start close to the end so the next line wraps around
+        const std::string filler(ProgressParser::CAPACITY - 10, 'x');
+        const std::string fillerLine = filler + "\n";
+        EXPECT_FALSE(parser.feed(fillerLine.data(), fillerLine.size()));
+
+        const std::string line = "[download-progress] 100 200 NA 50 2\n";
+        EXPECT_TRUE(parser.feed(line.data(), line.size()));
+        EXPECT_EQ(parser.getProgress().downloadedBytes, 100);
+
+        // a line that does not fit is dropped, the next one is parsed again
+        const std::string longLine = std::string(ProgressParser::CAPACITY * 2, 'y') + "\n";
+        EXPECT_FALSE(parser.feed(longLine.data(), longLine.size()));
+        const std::string nextLine = "[download-progress] 300 400 NA 50 2\n";
+        EXPECT_TRUE(parser.feed(nextLine.data(), nextLine.size()));
+        EXPECT_EQ(parser.getProgress().downloadedBytes, 300);
+    }
+
+    TEST(progressParserTest, KeepsLastErrorLine) {
+        ProgressParser parser;
+        EXPECT_FALSE(parser.getLastError().has_value());
+        const std::string output = "ERROR: first\nWARNING: not an error\nERROR: [youtube] stub: Video unavailable\n";
+        parser.feed(output.data(), output.size());
+        EXPECT_EQ(parser.getLastError(), std::string("ERROR: [youtube] stub: Video unavailable"));
+    }
+
+    TEST(outputReaderTest, ReadsChildOutputUntilExit) {
+        OutputReader reader;
+        ProgressParser parser;
+        std::promise<void> closed;
+        std::future<void> closedFuture = closed.get_future();
+        OutputReader::pipe_t pipe = reader.openPipe(
+            [&](const char* data, const size_t size) { parser.feed(data, size); },
+            [&]() { closed.set_value(); });
+
+#ifdef _WIN32
+        PROCESS_INFORMATION pi = windowsprocessutils::startProcess("C:\\Windows\\System32\\cmd.exe",
+            " /c echo [download-progress] 10 20 NA 5 2", pipe.childEnd, pipe.childEnd);
+        OutputReader::closeChildEnd(pipe.childEnd);
+        windowsprocessutils::waitForProcess(pi);
+#else
+        char arg0[] = "/bin/echo";
+        char arg1[] = "[download-progress] 10 20 NA 5 2";
+        char* argv[] = { arg0, arg1, nullptr };
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, pipe.childEnd, 1);
+        pid_t pid;
+        ASSERT_EQ(posix_spawn(&pid, arg0, &actions, nullptr, argv, environ), 0);
+        posix_spawn_file_actions_destroy(&actions);
+        OutputReader::closeChildEnd(pipe.childEnd);
+        int status;
+        waitpid(pid, &status, 0);
+#endif
+
+        ASSERT_EQ(closedFuture.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        EXPECT_EQ(parser.getProgress().downloadedBytes, 10);
+        EXPECT_EQ(parser.getProgress().totalBytes, 20);
+    }
+
+    TEST(outputReaderTest, CancelClosesPipeThatIsStillOpen) {
+        OutputReader reader;
+        std::promise<void> closed;
+        std::future<void> closedFuture = closed.get_future();
+        OutputReader::pipe_t pipe = reader.openPipe([](const char*, const size_t) {}, [&]() { closed.set_value(); });
+
+        // the write end stays open, as if a grandchild still held it
+        reader.cancel(pipe.id);
+        EXPECT_EQ(closedFuture.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        OutputReader::closeChildEnd(pipe.childEnd);
+    }
+
+    TEST(outputReaderTest, TailsFileUntilCancelled) {
+        const std::filesystem::path path = std::filesystem::temp_directory_path() / "youtube-dl-plugin-tail.txt";
+        OutputReader reader;
+        std::mutex outputMutex;
+        std::string output;
+        std::promise<void> closed;
+        std::future<void> closedFuture = closed.get_future();
+        OutputReader::pipe_t file = reader.openFile(path,
+            [&](const char* data, const size_t size)
+            {
+                std::unique_lock<std::mutex> lk(outputMutex);
+                output.append(data, size);
+            },
+            [&]() { closed.set_value(); }, true);
+
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::app);
+            out << "[download-progress] 10 20 NA 5 2\n";
+        }
+        // the end of the file is not the end of the output, a write after a few polls is read too
+        std::this_thread::sleep_for(std::chrono::milliseconds(3 * OutputReader::TAIL_POLL_INTERVAL_MILLIS));
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::app);
+            out << "done\n";
+        }
+        reader.cancel(file.id);
+
+        ASSERT_EQ(closedFuture.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        {
+            std::unique_lock<std::mutex> lk(outputMutex);
+            EXPECT_EQ(output, "[download-progress] 10 20 NA 5 2\ndone\n");
+        }
+        OutputReader::closeChildEnd(file.childEnd);
+        std::filesystem::remove(path);
+    }
+}
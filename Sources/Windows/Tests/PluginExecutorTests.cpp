@@ -0,0 +1,115 @@
+#include "pch.h"
+
+#include "../PluginExecutor.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Tests
+{
+    TEST(pluginExecutorTest, RunsTasksOfAContextInOrder) {
+        const uint32_t CONTEXT_COUNT = 8;
+        const uint32_t TASK_COUNT = 1000;
+        std::mutex mutex;
+        std::vector<std::vector<uint32_t>> order(CONTEXT_COUNT + 1);
+        {
+            PluginExecutor executor;
+            for (uint32_t i = 0; i < TASK_COUNT; i++)
+            {
+                for (contextHandle_t context = 1; context <= CONTEXT_COUNT; context++)
+                {
+                    executor.post(context, [&, context, i]()
+                        {
+                            std::unique_lock<std::mutex> lk(mutex);
+                            order[context].push_back(i);
+                        });
+                }
+            }
+
+            // the last task of each context runs after all others of the context
+            std::vector<std::future<void>> done;
+            for (contextHandle_t context = 1; context <= CONTEXT_COUNT; context++)
+            {
+                std::shared_ptr<std::promise<void>> promise = std::make_shared<std::promise<void>>();
+                done.push_back(promise->get_future());
+                executor.post(context, [promise]() { promise->set_value(); });
+            }
+            for (auto& f : done)
+                f.wait();
+        }
+
+        for (contextHandle_t context = 1; context <= CONTEXT_COUNT; context++)
+        {
+            ASSERT_EQ(order[context].size(), TASK_COUNT);
+            for (uint32_t i = 0; i < TASK_COUNT; i++)
+                EXPECT_EQ(order[context][i], i);
+        }
+    }
+
+    TEST(pluginExecutorTest, BlockedContextDoesNotHoldUpOthers) {
+        PluginExecutor executor;
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        std::promise<void> otherRan;
+
+        // stands in for a key up that waits on a slow clipboard owner
+        executor.post(1, [released]() { released.wait(); });
+        executor.post(1, []() {});
+        executor.post(2, [&]() { otherRan.set_value(); });
+
+        EXPECT_EQ(otherRan.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        release.set_value();
+    }
+
+    TEST(pluginExecutorTest, ShutdownDropsQueuedTasks) {
+        std::atomic<uint32_t> ran = 0;
+        std::promise<void> started;
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+
+        PluginExecutor executor(1);
+        executor.post(1, [&, released]()
+            {
+                started.set_value();
+                released.wait();
+                ran++;
+            });
+        executor.post(1, [&]() { ran++; });
+        started.get_future().wait();
+
+        std::thread stopper([&]() { executor.shutdown(); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        release.set_value();
+        stopper.join();
+
+        // the running task finished, the queued one was dropped, and new ones are ignored
+        executor.post(1, [&]() { ran++; });
+        EXPECT_EQ(ran.load(), 1u);
+    }
+
+    TEST(pluginExecutorTest, ReportsFailedTasksAndKeepsRunning) {
+        std::mutex mutex;
+        std::vector<std::string> errors;
+        std::promise<void> done;
+        {
+            PluginExecutor executor(1, [&](const std::string& message)
+                {
+                    std::unique_lock<std::mutex> lk(mutex);
+                    errors.push_back(message);
+                });
+            executor.post(1, []() { throw std::runtime_error("no clipboard"); });
+            // not derived from std::exception, it must not end the worker thread
+            executor.post(1, []() { throw 42; });
+            executor.post(1, [&]() { done.set_value(); });
+            EXPECT_EQ(done.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        }
+
+        ASSERT_EQ(errors.size(), 2u);
+        EXPECT_NE(errors[0].find("no clipboard"), std::string::npos);
+    }
+}
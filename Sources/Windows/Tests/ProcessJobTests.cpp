@@ -0,0 +1,72 @@
+#include "pch.h"
+
+#ifdef _WIN32
+#include "../ProcessJob.h"
+#include "../WindowsProcessUtils.h"
+
+#include <chrono>
+#include <memory>
+#include <thread>
+
+namespace Tests
+{
+    // cmd starts ping as its own child, like yt-dlp starts ffmpeg
+    static PROCESS_INFORMATION startProcessTree(const ProcessJob& job)
+    {
+        return windowsprocessutils::startProcess("C:\\Windows\\System32\\cmd.exe", " /c ping -n 30 127.0.0.1 >NUL",
+            NULL, NULL, job.getHandle());
+    }
+
+    static bool waitForProcessCount(const ProcessJob& job, const uint32_t count)
+    {
+        for (int i = 0; i < 500; i++)
+        {
+            if (job.getActiveProcessCount() == count)
+                return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    }
+
+    TEST(processJobTest, TerminateStopsTheWholeTree) {
+        ProcessJob job{ ProcessJob::limits_t() };
+        PROCESS_INFORMATION pi = startProcessTree(job);
+        ASSERT_TRUE(waitForProcessCount(job, 2));
+
+        job.terminate(0);
+        EXPECT_TRUE(waitForProcessCount(job, 0));
+        EXPECT_EQ(WaitForSingleObject(pi.hProcess, 5000), WAIT_OBJECT_0);
+        CloseHandle(pi.hProcess);
+        CloseHandle(pi.hThread);
+    }
+
+    TEST(processJobTest, ClosingTheJobKillsItsProcesses) {
+        std::unique_ptr<ProcessJob> job = std::make_unique<ProcessJob>(ProcessJob::limits_t());
+        PROCESS_INFORMATION pi = startProcessTree(*job);
+        ASSERT_TRUE(waitForProcessCount(*job, 2));
+
+        job.reset();
+        EXPECT_EQ(WaitForSingleObject(pi.hProcess, 5000), WAIT_OBJECT_0);
+        CloseHandle(pi.hProcess);
+        CloseHandle(pi.hThread);
+    }
+
+    TEST(processJobTest, ReportsUsageOfExitedProcesses) {
+        ProcessJob::limits_t limits;
+        limits.priority = IDLE_PRIORITY;
+        limits.memoryLimitBytes = 256 * 1024 * 1024;
+        limits.cpuRatePercent = 50;
+        ProcessJob job(limits);
+
+        PROCESS_INFORMATION pi = windowsprocessutils::startProcess("C:\\Windows\\System32\\cmd.exe", " /c exit 0",
+            NULL, NULL, job.getHandle());
+        windowsprocessutils::waitForProcess(pi);
+        windowsprocessutils::closeProcess(pi);
+
+        const resourceUsage_t usage = job.getUsage();
+        EXPECT_GT(usage.peakMemoryBytes, 0u);
+        EXPECT_LT(usage.peakMemoryBytes, *limits.memoryLimitBytes);
+        EXPECT_EQ(job.getActiveProcessCount(), 0u);
+    }
+}
+#endif
@@ -0,0 +1,158 @@
+#include "pch.h"
+
+#include "../ProcessWaiter.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#include "../DownloadJob.h"
+#include "../WindowsProcessUtils.h"
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+namespace Tests
+{
+    typedef std::chrono::steady_clock steadyClock_t;
+
+    // stub child process that exits immediately
+    struct stubChild_t
+    {
+        ProcessWaiter::processHandle_t process;
+#ifdef _WIN32
+        PROCESS_INFORMATION pi;
+#endif
+    };
+
+    static stubChild_t spawnStubChild()
+    {
+        stubChild_t child = {};
+#ifdef _WIN32
+        child.pi = windowsprocessutils::startProcess("C:\\Windows\\System32\\cmd.exe", " /c exit 0");
+        child.process = child.pi.hProcess;
+#else
+        char arg0[] = "/bin/true";
+        char* argv[] = { arg0, nullptr };
+        pid_t pid;
+        if (posix_spawn(&pid, arg0, nullptr, nullptr, argv, environ) != 0)
+            throw std::runtime_error("Cannot spawn stub child");
+        child.process = pid;
+#endif
+        return child;
+    }
+
+    static void reapStubChild(const stubChild_t& child)
+    {
+#ifdef _WIN32
+        windowsprocessutils::closeProcess(child.pi);
+#else
+        int status;
+        waitpid(child.process, &status, 0);
+#endif
+    }
+
+#ifndef _WIN32
+    TEST(processWaiterTest, DeliversExitOfChildWithoutPolling) {
+        ProcessWaiter waiter;
+
+        // the child writes to the pipe right before it exits, so the read marks the exit without the spawn time
+        int fds[2];
+        ASSERT_EQ(pipe(fds), 0);
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+        posix_spawn_file_actions_addclose(&actions, fds[0]);
+        char arg0[] = "/bin/sh";
+        char arg1[] = "-c";
+        char arg2[] = "sleep 0.2; printf x";
+        char* argv[] = { arg0, arg1, arg2, nullptr };
+        pid_t pid;
+        ASSERT_EQ(posix_spawn(&pid, arg0, &actions, nullptr, argv, environ), 0);
+        posix_spawn_file_actions_destroy(&actions);
+        close(fds[1]);
+
+        std::promise<steadyClock_t::time_point> notified;
+        waiter.watch(pid, [&]() { notified.set_value(steadyClock_t::now()); });
+        char signal;
+        ASSERT_EQ(read(fds[0], &signal, 1), 1);
+        const steadyClock_t::time_point exited = steadyClock_t::now();
+        std::future<steadyClock_t::time_point> notifiedAt = notified.get_future();
+        ASSERT_EQ(notifiedAt.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(notifiedAt.get() - exited);
+        close(fds[0]);
+        reapStubChild({ pid });
+
+        std::cout << "exit to notification: " << elapsed.count() << " ms" << std::endl;
+        // generous for a loaded machine, but a poll every second would miss it most of the time
+        EXPECT_LT(elapsed.count(), 500);
+    }
+#endif
+
+    TEST(processWaiterTest, WatchesManyChildrenOnOneThread) {
+        ProcessWaiter waiter;
+        const size_t CHILD_COUNT = 32;
+
+        std::vector<stubChild_t> children;
+        std::atomic<size_t> exited = 0;
+        std::promise<void> allExited;
+        for (size_t i = 0; i < CHILD_COUNT; i++)
+        {
+            children.push_back(spawnStubChild());
+            waiter.watch(children.back().process, [&]()
+                {
+                    if (++exited == CHILD_COUNT)
+                        allExited.set_value();
+                });
+        }
+
+        EXPECT_EQ(allExited.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        for (const auto& child : children)
+            reapStubChild(child);
+        EXPECT_EQ(exited.load(), CHILD_COUNT);
+    }
+
+#ifdef _WIN32
+    TEST(processWaiterTest, JobReportsSuccessWithoutPolling) {
+        DownloadJob::resultQueue_t results;
+        const std::filesystem::path exitMarker = std::filesystem::temp_directory_path() / "process-waiter-exit.txt";
+        std::error_code ec;
+        std::filesystem::remove(exitMarker, ec);
+
+        // cmd.exe stands in for yt-dlp. It writes the marker right before it exits, "rem" ignores the url that is appended.
+        contextSettings_t settings;
+        settings.youtubeDlExePath = "C:\\Windows\\System32\\cmd.exe";
+        settings.customCommand = "/c copy nul \"" + exitMarker.string() + "\" >nul & rem";
+
+        DownloadJob job("https://www.youtube.com/watch?v=stub", settings, 1, false, results);
+        ASSERT_TRUE(job.queue());
+
+        job.run();
+        FILETIME now;
+        GetSystemTimeAsFileTime(&now);
+
+        std::optional<DownloadJob::threadData_t> result = results.tryPop();
+        ASSERT_TRUE(result);
+        EXPECT_EQ(result->status, DownloadJob::SUCCESS);
+        EXPECT_TRUE(results.empty());
+
+        WIN32_FILE_ATTRIBUTE_DATA marker;
+        ASSERT_TRUE(GetFileAttributesExA(exitMarker.string().c_str(), GetFileExInfoStandard, &marker));
+        std::filesystem::remove(exitMarker, ec);
+        auto toTicks = [](const FILETIME& time) { return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime; };
+        // FILETIME counts 100 ns ticks
+        const uint64_t elapsedMillis = (toTicks(now) - toTicks(marker.ftLastWriteTime)) / 10000;
+
+        std::cout << "exit to SUCCESS result: " << elapsedMillis << " ms" << std::endl;
+        // generous for a loaded machine, but the old poll slept a full second between checks
+        EXPECT_LT(elapsedMillis, 500u);
+    }
+#endif
+}
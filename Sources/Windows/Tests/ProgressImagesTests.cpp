@@ -0,0 +1,66 @@
+#include "pch.h"
+
+#include "../ImageUtils.h"
+#include "../ProgressImages.h"
+
+#include <string>
+
+namespace Tests
+{
+    static uint32_t readBigEndian(const std::string& data, const size_t offset)
+    {
+        return (static_cast<uint8_t>(data[offset]) << 24) | (static_cast<uint8_t>(data[offset + 1]) << 16) |
+            (static_cast<uint8_t>(data[offset + 2]) << 8) | static_cast<uint8_t>(data[offset + 3]);
+    }
+
+    TEST(imageUtilsTest, EncodesBase64WithPadding) {
+        EXPECT_EQ(imageutils::encodeBase64(""), "");
+        EXPECT_EQ(imageutils::encodeBase64("f"), "Zg==");
+        EXPECT_EQ(imageutils::encodeBase64("fo"), "Zm8=");
+        EXPECT_EQ(imageutils::encodeBase64("foo"), "Zm9v");
+        EXPECT_EQ(imageutils::encodeBase64("foobar"), "Zm9vYmFy");
+        EXPECT_EQ(imageutils::encodeBase64(std::string("\xFF\xFE\x00", 3)), "//4A");
+    }
+
+    TEST(imageUtilsTest, EncodesPngChunks) {
+        const std::string png = imageutils::encodePng(ProgressImages::drawFrame(ProgressImages::SIZE, 50));
+
+        ASSERT_GT(png.size(), 8u + 25u + 12u + 12u);
+        EXPECT_EQ(png.substr(0, 8), "\x89PNG\r\n\x1a\n");
+        EXPECT_EQ(readBigEndian(png, 8), 13u);
+        EXPECT_EQ(png.substr(12, 4), "IHDR");
+        EXPECT_EQ(readBigEndian(png, 16), ProgressImages::SIZE);
+        EXPECT_EQ(readBigEndian(png, 20), ProgressImages::SIZE);
+        // crc of "IEND" without data
+        EXPECT_EQ(png.substr(png.size() - 12), std::string("\x00\x00\x00\x00IEND\xAE\x42\x60\x82", 12));
+        // flat images compress far below their raw size
+        EXPECT_LT(png.size(), ProgressImages::SIZE * ProgressImages::SIZE * 3 / 10);
+    }
+
+    TEST(imageUtilsTest, RejectsMismatchedPixelCount) {
+        imageutils::rgbImage_t image;
+        image.width = 2;
+        image.height = 2;
+        image.pixels.resize(3);
+        EXPECT_THROW(imageutils::encodePng(image), std::invalid_argument);
+    }
+
+    TEST(progressImagesTest, HasOneDistinctFramePerStep) {
+        const ProgressImages& images = ProgressImages::getInstance();
+        EXPECT_EQ(ProgressImages::getFrameIndex(0), 0u);
+        EXPECT_EQ(ProgressImages::getFrameIndex(3), 1u);
+        EXPECT_EQ(ProgressImages::getFrameIndex(100), ProgressImages::FRAME_COUNT - 1);
+        EXPECT_EQ(ProgressImages::getFrameIndex(250), ProgressImages::FRAME_COUNT - 1);
+
+        for (uint32_t i = 0; i < ProgressImages::FRAME_COUNT; i++)
+        {
+            EXPECT_EQ(images.getFrame(i, false).rfind("data:image/png;base64,", 0), 0u);
+            EXPECT_NE(images.getFrame(i, false), images.getFrame(i, true));
+            if (i > 0)
+            {
+                EXPECT_NE(images.getFrame(i, false), images.getFrame(i - 1, false));
+            }
+        }
+        EXPECT_THROW(images.getFrame(ProgressImages::FRAME_COUNT, false), std::out_of_range);
+    }
+}
@@ -0,0 +1,69 @@
+#include "pch.h"
+
+#include "../TimerService.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Tests
+{
+    TEST(timerServiceTest, FiresInDeadlineOrderOnTheExecutor) {
+        PluginExecutor executor(1);
+        TimerService timers(executor);
+        std::mutex mutex;
+        std::vector<int> fired;
+        std::promise<void> done;
+        const std::thread::id testThread = std::this_thread::get_id();
+        std::atomic<bool> ranOnTestThread = false;
+
+        for (int delay : { 60, 20, 40 })
+        {
+            timers.schedule(1, std::chrono::milliseconds(delay), [&, delay]()
+                {
+                    ranOnTestThread = ranOnTestThread || std::this_thread::get_id() == testThread;
+                    std::unique_lock<std::mutex> lk(mutex);
+                    fired.push_back(delay);
+                    if (fired.size() == 3)
+                        done.set_value();
+                });
+        }
+
+        ASSERT_EQ(done.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        EXPECT_EQ(fired, std::vector<int>({ 20, 40, 60 }));
+        EXPECT_FALSE(ranOnTestThread);
+        EXPECT_EQ(timers.getPendingCount(), 0u);
+    }
+
+    TEST(timerServiceTest, CancelledTimersNeverFire) {
+        PluginExecutor executor;
+        TimerService timers(executor);
+        std::atomic<uint32_t> fired = 0;
+        std::promise<void> last;
+
+        // a key down and key up for every press, like short presses on many buttons
+        const uint32_t PRESS_COUNT = 10000;
+        for (uint32_t i = 0; i < PRESS_COUNT; i++)
+        {
+            const TimerService::timerId_t id = timers.schedule(1 + i % 32, std::chrono::milliseconds(50), [&]() { fired++; });
+            EXPECT_TRUE(timers.cancel(id));
+            EXPECT_FALSE(timers.cancel(id));
+        }
+        timers.schedule(1, std::chrono::milliseconds(100), [&]() { last.set_value(); });
+
+        ASSERT_EQ(last.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        EXPECT_EQ(fired.load(), 0u);
+    }
+
+    TEST(timerServiceTest, CancelAfterFiringFails) {
+        PluginExecutor executor;
+        TimerService timers(executor);
+        std::promise<void> fired;
+        const TimerService::timerId_t id = timers.schedule(1, std::chrono::milliseconds(0), [&]() { fired.set_value(); });
+        ASSERT_EQ(fired.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        EXPECT_FALSE(timers.cancel(id));
+    }
+}
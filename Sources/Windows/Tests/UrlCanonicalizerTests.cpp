@@ -0,0 +1,89 @@
+#include "pch.h"
+
+#include "../UrlCanonicalizer.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace Tests
+{
+    static std::string canonicalUrl(const std::string& url)
+    {
+        const std::optional<canonicalUrl_t> canonical = UrlCanonicalizer::canonicalize(url);
+        return canonical ? canonical->url : "";
+    }
+
+    TEST(urlCanonicalizerTest, SameMediaSameKey) {
+        const std::string youtube = "https://youtube.com/watch?v=dQw4w9WgXcQ";
+        EXPECT_EQ(canonicalUrl("https://youtu.be/dQw4w9WgXcQ"), youtube);
+        EXPECT_EQ(canonicalUrl("https://www.youtube.com/watch?v=dQw4w9WgXcQ&t=30&si=AbCdEf"), youtube);
+        EXPECT_EQ(canonicalUrl("http://m.youtube.com/watch?feature=share&v=dQw4w9WgXcQ#comments"), youtube);
+        EXPECT_EQ(canonicalUrl("https://WWW.YouTube.com/shorts/dQw4w9WgXcQ?feature=share"), youtube);
+        EXPECT_EQ(canonicalUrl("https://music.youtube.com/watch?v=dQw4w9WgXcQ&list=RDdQw4w9WgXcQ"),
+            "https://youtube.com/watch?v=dQw4w9WgXcQ&list=RDdQw4w9WgXcQ");
+
+        const std::string reddit = "https://reddit.com/comments/abc123";
+        EXPECT_EQ(canonicalUrl("https://old.reddit.com/r/pics/comments/abc123/some_title/?utm_source=share"), reddit);
+        EXPECT_EQ(canonicalUrl("https://www.reddit.com/r/pics/comments/abc123/"), reddit);
+        EXPECT_EQ(canonicalUrl("https://redd.it/abc123"), reddit);
+
+        EXPECT_EQ(canonicalUrl("https://player.vimeo.com/video/123456?h=1"), "https://vimeo.com/123456");
+        EXPECT_EQ(canonicalUrl("https://twitter.com/someone/status/1234567890?s=20"), "https://x.com/i/status/1234567890");
+    }
+
+    TEST(urlCanonicalizerTest, ExtractsIdsOfSingleMedia) {
+        const std::optional<canonicalUrl_t> video = UrlCanonicalizer::canonicalize("https://youtu.be/dQw4w9WgXcQ?t=42");
+        ASSERT_TRUE(video);
+        EXPECT_EQ(video->extractor, "Youtube");
+        EXPECT_EQ(video->id, "dQw4w9WgXcQ");
+
+        // a playlist is not a single media
+        const std::optional<canonicalUrl_t> playlist = UrlCanonicalizer::canonicalize("https://www.youtube.com/playlist?list=PL123");
+        ASSERT_TRUE(playlist);
+        EXPECT_EQ(playlist->url, "https://youtube.com/playlist?list=PL123");
+        EXPECT_FALSE(playlist->id);
+    }
+
+    TEST(urlCanonicalizerTest, NormalizesOtherSites) {
+        // an unknown site keeps its scheme and its parameters, they may change what it serves
+        EXPECT_EQ(canonicalUrl("HTTP://Example.COM.:80/a/b/?z=1&ref=x&a=2#top"), "http://example.com/a/b?a=2&ref=x&z=1");
+        EXPECT_EQ(canonicalUrl("https://example.com/a?utm_medium=x"), "https://example.com/a?utm_medium=x");
+        EXPECT_EQ(canonicalUrl("https://example.com:8443/%7euser"), "https://example.com:8443/%7Euser");
+        EXPECT_EQ(canonicalUrl("https://example.com"), "https://example.com/");
+        // an unknown path of a known site keeps its path
+        EXPECT_EQ(canonicalUrl("http://www.youtube.com/@channel/videos?si=1&view=0"), "https://youtube.com/@channel/videos?view=0");
+
+        EXPECT_FALSE(UrlCanonicalizer::canonicalize("ftp://example.com/file"));
+        EXPECT_FALSE(UrlCanonicalizer::canonicalize("not a url"));
+        EXPECT_FALSE(UrlCanonicalizer::canonicalize("https://example.com:abc/"));
+    }
+
+    // a benchmark, run it with --gtest_also_run_disabled_tests
+    TEST(urlCanonicalizerTest, DISABLED_BenchmarkCanonicalize) {
+        const int ITERATIONS = 20000;
+        const std::vector<std::string> urls =
+        {
+            "https://www.youtube.com/watch?v=dQw4w9WgXcQ&t=30&si=AbCdEfGhIjKlMnOp",
+            "https://youtu.be/dQw4w9WgXcQ",
+            "https://m.youtube.com/shorts/dQw4w9WgXcQ?feature=share",
+            "https://old.reddit.com/r/pics/comments/abc123/some_title/?utm_source=share&utm_medium=web2x",
+            "https://twitter.com/someone/status/1234567890?s=20",
+            "https://example.com/some/long/path/to/a/video.mp4?b=2&a=1&fbclid=XYZ",
+        };
+
+        size_t totalSize = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ITERATIONS; i++)
+        {
+            for (const auto& url : urls)
+                totalSize += UrlCanonicalizer::canonicalize(url)->url.size();
+        }
+        const auto time = std::chrono::steady_clock::now() - start;
+        EXPECT_GT(totalSize, 0u);
+
+        std::cout << "time per url: " << std::chrono::duration_cast<std::chrono::nanoseconds>(time).count() / (ITERATIONS * urls.size())
+            << "ns" << std::endl;
+    }
+}
@@ -0,0 +1,91 @@
+#include "pch.h"
+
+#include "../YoutubeDlUtils.h"
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace Tests
+{
+    TEST(youtubeDlUtilsTest, ResolveCommandDumpsSingleJson) {
+        const std::string cmd = youtubedlutils::getResolveCommand("https://www.youtube.com/watch?v=stub", 3);
+        EXPECT_NE(cmd.find("--dump-single-json"), std::string::npos);
+        EXPECT_NE(cmd.find("--playlist-end 3"), std::string::npos);
+        EXPECT_NE(cmd.find("https://www.youtube.com/watch?v=stub"), std::string::npos);
+
+        // 0 means no limit
+        EXPECT_EQ(youtubedlutils::getResolveCommand("url", 0).find("--playlist-end"), std::string::npos);
+    }
+
+    TEST(youtubeDlUtilsTest, FormatCommandsLoadInfoJsonInsteadOfUrl) {
+        const std::string url = "https://www.youtube.com/watch?v=stub";
+        std::vector<std::string> cmds = youtubedlutils::getCommandQueue(url, std::nullopt, std::nullopt, std::nullopt,
+            { VIDEO, AUDIO_ONLY }, std::string("--simulate"), std::string("C:\\temp\\job.info.json"));
+
+        ASSERT_EQ(cmds.size(), 3);
+        // the two format commands share the info json, the custom command still extracts the url itself
+        size_t loadCount = 0;
+        for (const auto& cmd : cmds)
+        {
+            if (cmd.find("--load-info-json \"C:\\temp\\job.info.json\"") != std::string::npos)
+            {
+                loadCount++;
+                EXPECT_EQ(cmd.find(url), std::string::npos);
+            }
+            else
+                EXPECT_NE(cmd.find(url), std::string::npos);
+        }
+        EXPECT_EQ(loadCount, 2);
+    }
+
+    TEST(youtubeDlUtilsTest, ParallelFormatsWriteFilesOfTheirOwn) {
+        const std::string url = "https://www.youtube.com/watch?v=stub";
+        std::vector<std::string> cmds = youtubedlutils::getCommandQueue(url, std::string("C:\\out"), std::nullopt, std::nullopt,
+            { VIDEO, VIDEO_ONLY, AUDIO_ONLY }, std::nullopt, std::nullopt, true);
+
+        std::unordered_set<std::string> outputs;
+        for (const auto& cmd : cmds)
+        {
+            const size_t start = cmd.find(" -o \"");
+            ASSERT_NE(start, std::string::npos);
+            outputs.insert(cmd.substr(start, cmd.find('"', start + 5) - start));
+        }
+        EXPECT_EQ(outputs.size(), 3);
+
+        // one after another, every format keeps the plain title
+        cmds = youtubedlutils::getCommandQueue(url, std::string("C:\\out"), std::nullopt, std::nullopt,
+            { VIDEO_ONLY, AUDIO_ONLY }, std::nullopt);
+        for (const auto& cmd : cmds)
+            EXPECT_NE(cmd.find("-o \"C:\\out/%(title)s.%(ext)s\""), std::string::npos);
+    }
+
+    TEST(youtubeDlUtilsTest, BatchCommandLimitsEachUrlInsteadOfWholeBatch) {
+        const std::string cmd = youtubedlutils::getBatchCommand("batch.txt", "done.txt", std::string("C:\\out"), 2, AUDIO_ONLY);
+        EXPECT_NE(cmd.find("--batch-file \"batch.txt\""), std::string::npos);
+        EXPECT_NE(cmd.find("--print-to-file \"after_move:%(original_url)s\" \"done.txt\""), std::string::npos);
+        EXPECT_NE(cmd.find("--playlist-end 2"), std::string::npos);
+        EXPECT_EQ(cmd.find("--max-downloads"), std::string::npos);
+    }
+
+    TEST(youtubeDlUtilsTest, RateLimitArgsAreInBytesPerSecond) {
+        EXPECT_EQ(youtubedlutils::getRateLimitArgs(256 * 1024), " --limit-rate 262144");
+        // 0 means no limit
+        EXPECT_EQ(youtubedlutils::getRateLimitArgs(0), "");
+    }
+
+    TEST(youtubeDlUtilsTest, KeysDoNotDependOnSpelling) {
+        EXPECT_EQ(youtubedlutils::getOutputFolderKey(std::string("C:\\Users\\Me\\Videos\\")),
+            youtubedlutils::getOutputFolderKey(std::string("c:/users/me/videos")));
+        EXPECT_NE(youtubedlutils::getOutputFolderKey(std::string("C:\\Videos")),
+            youtubedlutils::getOutputFolderKey(std::string("C:\\Music")));
+
+        EXPECT_EQ(youtubedlutils::getFormatsKey({ AUDIO_ONLY, VIDEO }), youtubedlutils::getFormatsKey({ VIDEO, AUDIO_ONLY }));
+        EXPECT_NE(youtubedlutils::getFormatsKey({ VIDEO }), youtubedlutils::getFormatsKey({ AUDIO_ONLY }));
+    }
+
+    TEST(youtubeDlUtilsTest, OnlyResolvesForSeveralFormats) {
+        EXPECT_FALSE(youtubedlutils::shouldResolve({ VIDEO }));
+        EXPECT_TRUE(youtubedlutils::shouldResolve({ VIDEO, AUDIO_ONLY }));
+    }
+}
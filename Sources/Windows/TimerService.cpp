@@ -0,0 +1,136 @@
+//==============================================================================
+/**
+@file       TimerService.cpp
+
+@brief		Single thread that runs the deadlines of all contexts on the plugin executor
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "pch.h"
+
+#include "TimerService.h"
+
+/**
+ * Create the service and start its thread
+ *
+ * @param[in] executor the executor that runs the callbacks
+ */
+TimerService::TimerService(PluginExecutor& executor) :
+	mExecutor(executor)
+{
+	mT = std::thread(&TimerService::run, this);
+}
+
+TimerService::~TimerService()
+{
+	shutdown();
+}
+
+/**
+ * Run a callback on the executor once a delay passed
+ *
+ * @param[in] context the context the callback is posted with, 0 if it belongs to none
+ * @param[in] delay the time to wait
+ * @param[in] callback the callback to run
+ * @return the id to cancel the timer with
+ */
+TimerService::timerId_t TimerService::schedule(const contextHandle_t context, const std::chrono::milliseconds delay, callback_t callback)
+{
+	const timePoint_t time = std::chrono::steady_clock::now() + delay;
+
+	std::unique_lock<std::mutex> lk(mMutex);
+	const timerId_t id = mNextId++;
+	mTimers.emplace(id, pendingTimer_t{ context, time, std::move(callback) });
+	mDeadlines.push({ time, id });
+	// only wake the thread if it sleeps past the new deadline
+	if (mDeadlines.top().id == id)
+		mCv.notify_one();
+	return id;
+}
+
+/**
+ * Cancel a timer
+ *
+ * @param[in] id the id returned by schedule
+ * @return true if the callback will not run, false if it was already posted to the executor
+ */
+bool TimerService::cancel(const timerId_t id)
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	if (mTimers.erase(id) == 0)
+		return false;
+
+	// cancelled timers leave their deadline behind, rebuild the heap before those pile up
+	if (mDeadlines.size() > 64 && mDeadlines.size() > 2 * mTimers.size())
+		compact();
+	return true;
+}
+
+/**
+ * Stop the thread, timers that did not fire yet never will
+ */
+void TimerService::shutdown()
+{
+	{
+		std::unique_lock<std::mutex> lk(mMutex);
+		mStopping = true;
+		mCv.notify_all();
+	}
+	if (mT.joinable())
+		mT.join();
+}
+
+size_t TimerService::getPendingCount()
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	return mTimers.size();
+}
+
+/**
+ * Rebuild the heap from the timers that are still pending. mMutex must be locked.
+ */
+void TimerService::compact()
+{
+	std::vector<deadline_t> deadlines;
+	deadlines.reserve(mTimers.size());
+	for (const auto& timer : mTimers)
+		deadlines.push_back({ timer.second.time, timer.first });
+	mDeadlines = decltype(mDeadlines)(std::greater<deadline_t>(), std::move(deadlines));
+}
+
+/**
+ * Thread function that sleeps until the earliest deadline and posts the callbacks that are due
+ */
+void TimerService::run()
+{
+	std::unique_lock<std::mutex> lk(mMutex);
+	while (!mStopping)
+	{
+		if (mDeadlines.empty())
+		{
+			mCv.wait(lk);
+			continue;
+		}
+
+		const deadline_t next = mDeadlines.top();
+		if (std::chrono::steady_clock::now() < next.time)
+		{
+			mCv.wait_until(lk, next.time);
+			continue;
+		}
+
+		mDeadlines.pop();
+		const auto it = mTimers.find(next.id);
+		if (it == mTimers.end())
+			continue; // cancelled
+
+		pendingTimer_t timer = std::move(it->second);
+		mTimers.erase(it);
+		lk.unlock();
+		mExecutor.post(timer.context, std::move(timer.callback));
+		lk.lock();
+	}
+}
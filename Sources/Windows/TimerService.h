@@ -0,0 +1,80 @@
+//==============================================================================
+/**
+@file       TimerService.h
+
+@brief		Single thread that runs the deadlines of all contexts on the plugin executor
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include "Common.h"
+#include "PluginExecutor.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Deadlines are kept in a min-heap that one thread sleeps on. A callback is posted to the executor with its
+ * context once its deadline passed, so it runs in order with the other events of that context.
+ * Cancelling only forgets the callback, the heap entry is skipped when it comes up.
+ */
+class TimerService
+{
+public:
+	typedef uint64_t timerId_t;
+	typedef std::function<void(void)> callback_t;
+
+	TimerService(PluginExecutor& executor);
+	~TimerService();
+
+	timerId_t schedule(const contextHandle_t context, const std::chrono::milliseconds delay, callback_t callback);
+	bool cancel(const timerId_t id);
+	void shutdown();
+
+	size_t getPendingCount();
+
+private:
+	typedef std::chrono::steady_clock::time_point timePoint_t;
+
+	struct deadline_t
+	{
+		timePoint_t time;
+		timerId_t id;
+
+		bool operator>(const deadline_t& other) const
+		{
+			return time > other.time || (time == other.time && id > other.id);
+		}
+	};
+
+	struct pendingTimer_t
+	{
+		contextHandle_t context;
+		timePoint_t time;
+		callback_t callback;
+	};
+
+	PluginExecutor& mExecutor;
+
+	std::mutex mMutex;
+	std::condition_variable mCv;
+	bool mStopping = false;
+	timerId_t mNextId = 1;
+	std::priority_queue<deadline_t, std::vector<deadline_t>, std::greater<deadline_t>> mDeadlines;
+	// timers that are neither fired nor cancelled
+	std::unordered_map<timerId_t, pendingTimer_t> mTimers;
+	std::thread mT;
+
+	void run();
+	void compact();
+};
@@ -0,0 +1,371 @@
+//==============================================================================
+/**
+@file       UrlCanonicalizer.cpp
+
+@brief		Rewrites the different links to the same media into one url, used as the key of caches and deduplication
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#include "pch.h"
+
+#include "UrlCanonicalizer.h"
+#include "../Vendor/htmlcxx/html/Uri.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+
+namespace
+{
+	// gives access to the parsed parts without copying them out of the parser
+	class ParsedUri : public htmlcxx::Uri
+	{
+	public:
+		ParsedUri(const std::string& uri) :
+			htmlcxx::Uri(uri)
+		{
+		}
+
+		const std::string& getScheme() const { return mScheme; }
+		const std::string& getHostname() const { return mHostname; }
+		const std::string& getPortStr() const { return mPortStr; }
+		const std::string& getPath() const { return mPath; }
+		const std::string& getQuery() const { return mQuery; }
+	};
+
+	// the parameters of a query, each one as "name=value"
+	struct query_t
+	{
+		std::array<std::string_view, UrlCanonicalizer::MAX_QUERY_PARAMS> params = {};
+		size_t count = 0;
+		// parameters past MAX_QUERY_PARAMS, kept as they are
+		std::string_view rest;
+	};
+
+	// rewrites the path and query of a known site, returns false to fall back to the generic form
+	typedef bool (*rewrite_t)(std::string_view path, const query_t& query, canonicalUrl_t& result);
+	// checks if a query parameter only tracks where a link of a site was shared, so the generic form can drop it
+	typedef bool (*trackingParam_t)(std::string_view name);
+
+	struct hostRule_t
+	{
+		// the hostname without www.
+		std::string_view host;
+		rewrite_t rewrite;
+		trackingParam_t isTrackingParam;
+	};
+}
+
+/**
+ * Split a query into its parameters, without the empty ones
+ *
+ * @param[in] query the query, without the '?'
+ * @return the parameters
+ */
+static query_t splitQuery(std::string_view query)
+{
+	query_t result;
+	while (!query.empty())
+	{
+		const size_t end = std::min(query.find('&'), query.size());
+		if (end > 0)
+		{
+			if (result.count == result.params.size())
+			{
+				result.rest = query;
+				break;
+			}
+			result.params[result.count++] = query.substr(0, end);
+		}
+		query.remove_prefix(std::min(end + 1, query.size()));
+	}
+	return result;
+}
+
+/**
+ * Find the value of a query parameter
+ *
+ * @param[in] query the parameters
+ * @param[in] name the name of the parameter
+ * @return the value of its first occurrence, or nullopt if the query does not have it
+ */
+static std::optional<std::string_view> findParam(const query_t& query, const std::string_view name)
+{
+	for (size_t i = 0; i < query.count; i++)
+	{
+		const std::string_view param = query.params[i];
+		if (param.size() > name.size() && param[name.size()] == '=' && param.compare(0, name.size(), name) == 0)
+			return param.substr(name.size() + 1);
+	}
+	return std::nullopt;
+}
+
+/**
+ * Take the next segment off a path
+ *
+ * @param[in,out] path the path, the segment and the slash in front of it are removed
+ * @return the segment, empty if there is none
+ */
+static std::string_view takeSegment(std::string_view& path)
+{
+	if (!path.empty() && path.front() == '/')
+		path.remove_prefix(1);
+	const size_t end = std::min(path.find('/'), path.size());
+	const std::string_view segment = path.substr(0, end);
+	path.remove_prefix(end);
+	return segment;
+}
+
+/**
+ * Check if every character of an id is allowed
+ *
+ * @param[in] id the id
+ * @param[in] extra characters that are allowed besides ASCII letters and digits
+ * @return false if the id is empty or has another character
+ */
+static bool isId(const std::string_view id, const std::string_view extra = "")
+{
+	return !id.empty() && std::all_of(id.begin(), id.end(),
+		[&](const char c) { return std::isalnum(static_cast<unsigned char>(c)) || extra.find(c) != std::string_view::npos; });
+}
+
+/**
+ * Write the canonical url of a youtube video, or of a playlist that starts at the video
+ *
+ * @param[in] id the video id
+ * @param[in] query the parameters of the url
+ * @param[out] result the canonical url
+ * @return false if the id is not a video id
+ */
+static bool rewriteYoutubeVideo(const std::string_view id, const query_t& query, canonicalUrl_t& result)
+{
+	if (id.size() != 11 || !isId(id, "-_"))
+		return false;
+
+	result.url.append("https://youtube.com/watch?v=").append(id);
+	// the whole playlist is downloaded, so the url is not a single media
+	if (const std::optional<std::string_view> list = findParam(query, "list"))
+	{
+		result.url.append("&list=").append(*list);
+		return true;
+	}
+	result.extractor = "Youtube";
+	result.id = std::string(id);
+	return true;
+}
+
+static bool rewriteYoutube(std::string_view path, const query_t& query, canonicalUrl_t& result)
+{
+	const std::string_view first = takeSegment(path);
+	if (first == "watch")
+	{
+		const std::optional<std::string_view> id = findParam(query, "v");
+		return id && rewriteYoutubeVideo(*id, query, result);
+	}
+	if (first == "shorts" || first == "embed" || first == "live" || first == "v")
+		return rewriteYoutubeVideo(takeSegment(path), query, result);
+	if (first == "playlist")
+	{
+		const std::optional<std::string_view> list = findParam(query, "list");
+		if (!list || !isId(*list, "-_"))
+			return false;
+		result.url.append("https://youtube.com/playlist?list=").append(*list);
+		return true;
+	}
+	return false;
+}
+
+static bool rewriteYoutuBe(std::string_view path, const query_t& query, canonicalUrl_t& result)
+{
+	return rewriteYoutubeVideo(takeSegment(path), query, result);
+}
+
+/**
+ * Write the canonical url of a reddit post
+ *
+ * @param[in] id the id of the post
+ * @param[out] result the canonical url
+ * @return false if the id is not a post id
+ */
+static bool rewriteRedditPost(const std::string_view id, canonicalUrl_t& result)
+{
+	if (!isId(id))
+		return false;
+	result.url.append("https://reddit.com/comments/").append(id);
+	result.extractor = "Reddit";
+	result.id = std::string(id);
+	return true;
+}
+
+static bool rewriteReddit(std::string_view path, const query_t&, canonicalUrl_t& result)
+{
+	// /r/<subreddit>/comments/<id>/<title>, /user/<name>/comments/<id> or /comments/<id>
+	std::string_view segment = takeSegment(path);
+	if (segment == "r" || segment == "u" || segment == "user")
+	{
+		takeSegment(path);
+		segment = takeSegment(path);
+	}
+	if (segment != "comments")
+		return false;
+	return rewriteRedditPost(takeSegment(path), result);
+}
+
+static bool rewriteReddIt(std::string_view path, const query_t&, canonicalUrl_t& result)
+{
+	return rewriteRedditPost(takeSegment(path), result);
+}
+
+static bool rewriteVimeo(std::string_view path, const query_t&, canonicalUrl_t& result)
+{
+	// /<id> or /video/<id> on the player
+	std::string_view id = takeSegment(path);
+	if (id == "video")
+		id = takeSegment(path);
+	if (!isId(id) || !std::all_of(id.begin(), id.end(), [](const char c) { return std::isdigit(static_cast<unsigned char>(c)); }))
+		return false;
+	result.url.append("https://vimeo.com/").append(id);
+	result.extractor = "Vimeo";
+	result.id = std::string(id);
+	return true;
+}
+
+static bool rewriteTwitter(std::string_view path, const query_t&, canonicalUrl_t& result)
+{
+	// /<user>/status/<id>, the user does not matter and can change
+	takeSegment(path);
+	if (takeSegment(path) != "status")
+		return false;
+	const std::string_view id = takeSegment(path);
+	if (!isId(id))
+		return false;
+	result.url.append("https://x.com/i/status/").append(id);
+	result.extractor = "Twitter";
+	result.id = std::string(id);
+	return true;
+}
+
+static bool isYoutubeTrackingParam(const std::string_view name)
+{
+	return name == "si" || name == "feature" || name == "pp";
+}
+
+static bool isRedditTrackingParam(const std::string_view name)
+{
+	return name.compare(0, 4, "utm_") == 0 || name == "share_id" || name == "ref" || name == "ref_source";
+}
+
+static bool isVimeoTrackingParam(const std::string_view name)
+{
+	return name == "share";
+}
+
+static bool isTwitterTrackingParam(const std::string_view name)
+{
+	return name == "s" || name == "t" || name == "ref_src" || name == "ref_url";
+}
+
+// known sites, by every hostname they are reached under
+static const std::array<hostRule_t, 16> HOST_RULES =
+{ {
+	{ "youtube.com", rewriteYoutube, isYoutubeTrackingParam },
+	{ "m.youtube.com", rewriteYoutube, isYoutubeTrackingParam },
+	{ "music.youtube.com", rewriteYoutube, isYoutubeTrackingParam },
+	{ "youtube-nocookie.com", rewriteYoutube, isYoutubeTrackingParam },
+	{ "youtu.be", rewriteYoutuBe, isYoutubeTrackingParam },
+	{ "reddit.com", rewriteReddit, isRedditTrackingParam },
+	{ "old.reddit.com", rewriteReddit, isRedditTrackingParam },
+	{ "new.reddit.com", rewriteReddit, isRedditTrackingParam },
+	{ "np.reddit.com", rewriteReddit, isRedditTrackingParam },
+	{ "m.reddit.com", rewriteReddit, isRedditTrackingParam },
+	{ "redd.it", rewriteReddIt, isRedditTrackingParam },
+	{ "vimeo.com", rewriteVimeo, isVimeoTrackingParam },
+	{ "player.vimeo.com", rewriteVimeo, isVimeoTrackingParam },
+	{ "twitter.com", rewriteTwitter, isTwitterTrackingParam },
+	{ "mobile.twitter.com", rewriteTwitter, isTwitterTrackingParam },
+	{ "x.com", rewriteTwitter, isTwitterTrackingParam },
+} };
+
+/**
+ * Get the canonical form of a url. Links of a known site that point to the same media, e.g. youtu.be and
+ * youtube.com/watch links, get the same url. Other urls are normalized: lowercase scheme and host without www,
+ * no default port, fragment or trailing slash, and the parameters sorted. Only the other links of a known site
+ * are moved to https and lose the tracking parameters of the site, an unknown site may serve other content on them.
+ *
+ * @param[in] url the url
+ * @return the canonical url, or nullopt if the url is not an http or https url
+ */
+std::optional<canonicalUrl_t> UrlCanonicalizer::canonicalize(const std::string& url)
+{
+	std::optional<ParsedUri> uri;
+	try
+	{
+		uri.emplace(url);
+	}
+	catch (htmlcxx::Uri::Exception&)
+	{
+		return std::nullopt;
+	}
+
+	const std::string& scheme = uri->getScheme();
+	auto equalsIgnoreCase = [](const std::string_view a, const std::string_view b)
+	{
+		return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+			[](const char x, const char y) { return std::tolower(static_cast<unsigned char>(x)) == y; });
+	};
+	const bool isHttps = equalsIgnoreCase(scheme, "https");
+	if ((!isHttps && !equalsIgnoreCase(scheme, "http")) || uri->getHostname().empty())
+		return std::nullopt;
+
+	// hostnames are not case sensitive, and may end with the dot of the root domain
+	std::string host = uri->getHostname();
+	std::transform(host.begin(), host.end(), host.begin(), [](const unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	if (host.back() == '.')
+		host.pop_back();
+	std::string_view hostView = host;
+	if (hostView.compare(0, 4, "www.") == 0)
+		hostView.remove_prefix(4);
+
+	const query_t query = splitQuery(uri->getQuery());
+	canonicalUrl_t result;
+	auto rule = std::find_if(HOST_RULES.begin(), HOST_RULES.end(), [&](const hostRule_t& r) { return r.host == hostView; });
+	if (rule != HOST_RULES.end() && rule->rewrite(uri->getPath(), query, result))
+		return result;
+	result = {};
+	const trackingParam_t isTrackingParam = (rule != HOST_RULES.end()) ? rule->isTrackingParam : nullptr;
+
+	result.url.reserve(url.size() + 8);
+	result.url.append((isHttps || rule != HOST_RULES.end()) ? "https://" : "http://").append(hostView);
+	const std::string& port = uri->getPortStr();
+	if (!port.empty() && port != (isHttps ? "443" : "80"))
+		result.url.append(":").append(port);
+
+	// the path is case sensitive, but the hex digits of percent escapes are not
+	const std::string& path = uri->getPath();
+	const size_t pathEnd = (path.size() > 1 && path.back() == '/') ? path.size() - 1 : path.size();
+	if (pathEnd == 0)
+		result.url += '/';
+	for (size_t i = 0; i < pathEnd; i++)
+	{
+		const bool isEscape = (i > 0 && path[i - 1] == '%') || (i > 1 && path[i - 2] == '%');
+		result.url += isEscape ? static_cast<char>(std::toupper(static_cast<unsigned char>(path[i]))) : path[i];
+	}
+
+	std::array<std::string_view, MAX_QUERY_PARAMS> kept = {};
+	size_t keptCount = 0;
+	for (size_t i = 0; i < query.count; i++)
+	{
+		const std::string_view param = query.params[i];
+		if (isTrackingParam == nullptr || !isTrackingParam(param.substr(0, param.find('='))))
+			kept[keptCount++] = param;
+	}
+	std::sort(kept.begin(), kept.begin() + keptCount);
+	for (size_t i = 0; i < keptCount; i++)
+		result.url.append(i == 0 ? "?" : "&").append(kept[i]);
+	if (!query.rest.empty())
+		result.url.append(keptCount == 0 ? "?" : "&").append(query.rest);
+	return result;
+}
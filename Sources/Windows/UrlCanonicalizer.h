@@ -0,0 +1,37 @@
+//==============================================================================
+/**
+@file       UrlCanonicalizer.h
+
+@brief		Rewrites the different links to the same media into one url, used as the key of caches and deduplication
+
+@copyright  (c) 2020, Zongyi Yang.
+
+**/
+//==============================================================================
+
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// a url in its canonical form, with the media it points to if the site is known
+struct canonicalUrl_t
+{
+	// lowercase scheme and host without www, no fragment, parameters sorted.
+	// Links of a known site are rewritten to https and lose the tracking parameters of the site.
+	std::string url;
+	// name of the yt-dlp extractor and the media id, set if the url is a single media of a known site
+	std::optional<std::string> extractor = std::nullopt;
+	std::optional<std::string> id = std::nullopt;
+};
+
+class UrlCanonicalizer
+{
+public:
+	// query parameters are sorted in place on the stack, a url with more keeps its remaining ones in their order
+	static constexpr size_t MAX_QUERY_PARAMS = 32;
+
+	static std::optional<canonicalUrl_t> canonicalize(const std::string& url);
+};
@@ -11,7 +11,326 @@
 
 #include "UrlUtils.h"
 
-bool urlutils::isValidUrl(const std::string& url)
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+// character classes of RFC 3986
+enum CHAR_CLASS : uint8_t
+{
+	CHAR_ALPHA = 1,
+	CHAR_DIGIT = 2,
+	CHAR_HEXDIG = 4,
+	// "-" / "." / "_" / "~", the rest of unreserved is ALPHA and DIGIT
+	CHAR_UNRESERVED_MARK = 8,
+	// "!" / "$" / "&" / "'" / "(" / ")" / "*" / "+" / "," / ";" / "="
+	CHAR_SUB_DELIM = 16,
+	// "+" / "-" / ".", the rest of a scheme is ALPHA and DIGIT
+	CHAR_SCHEME_MARK = 32,
+};
+
+static constexpr std::array<uint8_t, 256> getCharClasses()
+{
+	std::array<uint8_t, 256> classes = {};
+	for (int c = 'a'; c <= 'z'; c++)
+		classes[c] |= CHAR_ALPHA;
+	for (int c = 'A'; c <= 'Z'; c++)
+		classes[c] |= CHAR_ALPHA;
+	for (int c = '0'; c <= '9'; c++)
+		classes[c] |= CHAR_DIGIT | CHAR_HEXDIG;
+	for (int c = 'a'; c <= 'f'; c++)
+		classes[c] |= CHAR_HEXDIG;
+	for (int c = 'A'; c <= 'F'; c++)
+		classes[c] |= CHAR_HEXDIG;
+	for (const char c : { '-', '.', '_', '~' })
+		classes[static_cast<unsigned char>(c)] |= CHAR_UNRESERVED_MARK;
+	for (const char c : { '!', '$', '&', '\'', '(', ')', '*', '+', ',', ';', '=' })
+		classes[static_cast<unsigned char>(c)] |= CHAR_SUB_DELIM;
+	for (const char c : { '+', '-', '.' })
+		classes[static_cast<unsigned char>(c)] |= CHAR_SCHEME_MARK;
+	return classes;
+}
+
+static constexpr std::array<uint8_t, 256> CHAR_CLASSES = getCharClasses();
+
+static bool isClass(const char c, const uint8_t classes)
+{
+	return (CHAR_CLASSES[static_cast<unsigned char>(c)] & classes) != 0;
+}
+
+/**
+ * Check the character at a position of a url and step over it. A percent escape is stepped over as a whole.
+ *
+ * @param[in] url the url
+ * @param[in,out] i the position, moved past the character
+ * @param[in] classes the character classes that are allowed besides percent escapes
+ * @param[in] extra characters that are allowed besides the classes
+ * @return false if the character is not allowed, or the percent escape is not complete
+ */
+static bool scanChar(const std::string_view url, size_t& i, const uint8_t classes, const std::string_view extra)
+{
+	const char c = url[i];
+	if (c == '%')
+	{
+		if (i + 2 >= url.size() || !isClass(url[i + 1], CHAR_HEXDIG) || !isClass(url[i + 2], CHAR_HEXDIG))
+			return false;
+		i += 3;
+		return true;
+	}
+	if (!isClass(c, classes) && extra.find(c) == std::string_view::npos)
+		return false;
+	i++;
+	return true;
+}
+
+/**
+ * Check that every character of a part of a url is allowed
+ *
+ * @param[in] part the part
+ * @param[in] classes the character classes that are allowed besides percent escapes
+ * @param[in] extra characters that are allowed besides the classes
+ * @return true if all characters are allowed
+ */
+static bool scanAll(const std::string_view part, const uint8_t classes, const std::string_view extra)
+{
+	size_t i = 0;
+	while (i < part.size())
+	{
+		if (!scanChar(part, i, classes, extra))
+			return false;
+	}
+	return true;
+}
+
+static constexpr uint8_t UNRESERVED = CHAR_ALPHA | CHAR_DIGIT | CHAR_UNRESERVED_MARK;
+
+/**
+ * Check that every character of a part of a url is in a class, percent escapes are not allowed
+ *
+ * @param[in] part the part
+ * @param[in] classes the character classes that are allowed
+ * @return true if all characters are in the classes
+ */
+static bool isAll(const std::string_view part, const uint8_t classes)
+{
+	return std::all_of(part.begin(), part.end(), [&](const char c) { return isClass(c, classes); });
+}
+
+/**
+ * Check an IPv4 address, four decimal octets without leading zeros
+ *
+ * @param[in] address the address
+ * @return true if valid
+ */
+static bool isIpv4(const std::string_view address)
+{
+	size_t i = 0;
+	for (int octet = 0; octet < 4; octet++)
+	{
+		if (octet > 0)
+		{
+			if (i == address.size() || address[i] != '.')
+				return false;
+			i++;
+		}
+		const size_t start = i;
+		uint32_t value = 0;
+		while (i < address.size() && isClass(address[i], CHAR_DIGIT) && i - start < 3)
+			value = value * 10 + (address[i++] - '0');
+		if (i == start || value > 255 || (i - start > 1 && address[start] == '0'))
+			return false;
+	}
+	return i == address.size();
+}
+
+/**
+ * Check an IPv6 address, eight groups of up to four hex digits, or fewer with one "::".
+ * The last two groups may be written as an IPv4 address.
+ *
+ * @param[in] address the address, without the brackets
+ * @return true if valid
+ */
+static bool isIpv6(const std::string_view address)
+{
+	size_t groups = 0;
+	bool compressed = false;
+	size_t i = 0;
+	if (address.compare(0, 2, "::") == 0)
+	{
+		compressed = true;
+		i = 2;
+	}
+	else if (address.empty() || address[0] == ':')
+		return false;
+
+	while (i < address.size())
+	{
+		const size_t end = std::min(address.find(':', i), address.size());
+		const std::string_view group = address.substr(i, end - i);
+		if (group.find('.') != std::string_view::npos)
+		{
+			if (end != address.size() || !isIpv4(group))
+				return false;
+			groups += 2;
+			break;
+		}
+		if (group.empty() || group.size() > 4 || !isAll(group, CHAR_HEXDIG))
+			return false;
+		groups++;
+
+		i = end;
+		if (i == address.size())
+			break;
+		// a single ':' separates groups and must be followed by one, "::" stands for the missing groups once
+		i++;
+		if (i < address.size() && address[i] == ':')
+		{
+			if (compressed)
+				return false;
+			compressed = true;
+			i++;
+		}
+		else if (i == address.size())
+			return false;
+	}
+	return compressed ? (groups <= 7) : (groups == 8);
+}
+
+/**
+ * Check the host and port of an authority and split them
+ *
+ * @param[in] hostPort the authority without the userinfo
+ * @param[out] parts receives the host and port
+ * @return true if valid
+ */
+static bool parseHostPort(const std::string_view hostPort, urlutils::urlParts_t& parts)
+{
+	size_t hostEnd = 0;
+	if (!hostPort.empty() && hostPort[0] == '[')
+	{
+		// IP-literal, an IPv6 address or "v" 1*HEXDIG "." 1*( unreserved / sub-delims / ":" )
+		hostEnd = hostPort.find(']');
+		if (hostEnd == std::string_view::npos)
+			return false;
+		hostEnd++;
+		const std::string_view literal = hostPort.substr(1, hostEnd - 2);
+		if (!literal.empty() && (literal[0] == 'v' || literal[0] == 'V'))
+		{
+			const size_t dot = literal.find('.');
+			if (dot == std::string_view::npos || dot < 2 || dot + 1 == literal.size() ||
+				!isAll(literal.substr(1, dot - 1), CHAR_HEXDIG) || literal.find('%') != std::string_view::npos ||
+				!scanAll(literal.substr(dot + 1), UNRESERVED | CHAR_SUB_DELIM, ":"))
+				return false;
+		}
+		else if (!isIpv6(literal))
+			return false;
+		if (hostEnd < hostPort.size() && hostPort[hostEnd] != ':')
+			return false;
+	}
+	else
+	{
+		// reg-name, which includes IPv4 addresses
+		hostEnd = std::min(hostPort.find(':'), hostPort.size());
+		if (!scanAll(hostPort.substr(0, hostEnd), UNRESERVED | CHAR_SUB_DELIM, ""))
+			return false;
+	}
+	parts.host = hostPort.substr(0, hostEnd);
+
+	if (hostEnd < hostPort.size())
+	{
+		const std::string_view port = hostPort.substr(hostEnd + 1);
+		if (!isAll(port, CHAR_DIGIT))
+			return false;
+		parts.port = port;
+	}
+	return true;
+}
+
+std::optional<urlutils::urlParts_t> urlutils::parseUrl(const std::string_view url)
+{
+	urlParts_t parts;
+	const size_t size = url.size();
+
+	// scheme = ALPHA *( ALPHA / DIGIT / "+" / "-" / "." ), followed by ":"
+	size_t i = 0;
+	if (size == 0 || !isClass(url[0], CHAR_ALPHA))
+		return std::nullopt;
+	while (i < size && isClass(url[i], CHAR_ALPHA | CHAR_DIGIT | CHAR_SCHEME_MARK))
+		i++;
+	if (i == size || url[i] != ':')
+		return std::nullopt;
+	parts.scheme = url.substr(0, i);
+	i++;
+
+	// "//" authority, which ends at the next "/", "?" or "#". The userinfo ends at the first "@", it has none itself.
+	if (url.compare(i, 2, "//") == 0)
+	{
+		i += 2;
+		const size_t start = i;
+		size_t at = std::string_view::npos;
+		while (i < size && url[i] != '/' && url[i] != '?' && url[i] != '#')
+		{
+			if (url[i] == '@' && at == std::string_view::npos)
+				at = i;
+			i++;
+		}
+		parts.authority = url.substr(start, i - start);
+
+		size_t hostStart = start;
+		if (at != std::string_view::npos)
+		{
+			parts.userinfo = url.substr(start, at - start);
+			if (!scanAll(*parts.userinfo, UNRESERVED | CHAR_SUB_DELIM, ":"))
+				return std::nullopt;
+			hostStart = at + 1;
+		}
+		if (!parseHostPort(url.substr(hostStart, i - hostStart), parts))
+			return std::nullopt;
+	}
+
+	// path, a url with an authority has an absolute or empty path here
+	const size_t pathStart = i;
+	while (i < size && url[i] != '?' && url[i] != '#')
+	{
+		if (!scanChar(url, i, UNRESERVED | CHAR_SUB_DELIM, ":@/"))
+			return std::nullopt;
+	}
+	parts.path = url.substr(pathStart, i - pathStart);
+
+	if (i < size && url[i] == '?')
+	{
+		const size_t queryStart = ++i;
+		while (i < size && url[i] != '#')
+		{
+			if (!scanChar(url, i, UNRESERVED | CHAR_SUB_DELIM, ":@/?"))
+				return std::nullopt;
+		}
+		parts.query = url.substr(queryStart, i - queryStart);
+	}
+
+	if (i < size && url[i] == '#')
+	{
+		const size_t fragmentStart = ++i;
+		while (i < size)
+		{
+			if (!scanChar(url, i, UNRESERVED | CHAR_SUB_DELIM, ":@/?"))
+				return std::nullopt;
+		}
+		parts.fragment = url.substr(fragmentStart, i - fragmentStart);
+	}
+	return parts;
+}
+
+bool urlutils::isValidUrl(const std::string_view url)
+{
+	return parseUrl(url).has_value();
+}
+
+std::string_view urlutils::trimWhitespace(const std::string_view text)
 {
-	return (IsValidURL(NULL, CA2T(url.c_str()), 0) == S_OK);
-}
\ No newline at end of file
+	const std::string_view WHITESPACE = " \t\r\n";
+	const size_t start = text.find_first_not_of(WHITESPACE);
+	if (start == std::string_view::npos)
+		return {};
+	return text.substr(start, text.find_last_not_of(WHITESPACE) - start + 1);
+}
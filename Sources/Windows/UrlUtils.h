@@ -8,19 +8,47 @@
 
 #pragma once
 
-#include <string>
-#include <urlmon.h> // for IsValidURL
-#pragma comment(lib, "urlmon.lib")
-
-#include <atlbase.h> // for CA2T
+#include <optional>
+#include <string_view>
 
 namespace urlutils
 {
+	// the parts of a url, as views into the string that was parsed
+	struct urlParts_t
+	{
+		std::string_view scheme;
+		// set if the url has "//" after the scheme, the host may still be empty
+		std::optional<std::string_view> authority = std::nullopt;
+		std::optional<std::string_view> userinfo = std::nullopt;
+		std::string_view host;
+		std::optional<std::string_view> port = std::nullopt;
+		std::string_view path;
+		std::optional<std::string_view> query = std::nullopt;
+		std::optional<std::string_view> fragment = std::nullopt;
+	};
+
+	/**
+	 * Check a url against the RFC 3986 syntax of an absolute uri and split it into its parts, in a single pass
+	 * and without allocating
+	 *
+	 * @param[in] url the url to parse
+	 * @return the parts of the url, or nullopt if it is not valid
+	 */
+	std::optional<urlParts_t> parseUrl(const std::string_view url);
+
 	/**
 	 * Check if a url is valid
 	 *
 	 * @param[in] url the url to check
 	 * @return true if valid, false if not
 	 */
-	bool isValidUrl(const std::string& url);
-}
\ No newline at end of file
+	bool isValidUrl(const std::string_view url);
+
+	/**
+	 * Remove the spaces, tabs and line breaks around a link, e.g. the line break a copied table cell ends with
+	 *
+	 * @param[in] text the text to trim
+	 * @return the text without the whitespace around it, as a view into text
+	 */
+	std::string_view trimWhitespace(const std::string_view text);
+}
@@ -8,71 +8,135 @@
 #pragma once
 #include "pch.h"
 #include "WindowsProcessUtils.h"
+#include "ProcessWaiter.h"
 
 #include <atlbase.h> // for CA2T
+#include <algorithm>
 #include <filesystem>
+#include <vector>
 
 /**
  * Launch a exe with given commmand
  *
  * @param[in] exePath path to exe
  * @param[in] cmd the command line command passed to exe
+ * @param[in] hStdOutput optional inheritable handle that receives the child's stdout
+ * @param[in] hStdError optional inheritable handle that receives the child's stderr
+ * @param[in] hJob optional job object the process is placed in before it runs
  * @throws runtime_error if process could not launch,
  *         filesystem_error if filesystem exists fails,
  *         invalid_argument if exe path does not exist
  */
-PROCESS_INFORMATION windowsprocessutils::startProcess(const std::filesystem::path& exePath, const std::string& cmd)
+PROCESS_INFORMATION windowsprocessutils::startProcess(const std::filesystem::path& exePath, const std::string& cmd,
+	HANDLE hStdOutput, HANDLE hStdError, HANDLE hJob)
 {
 	if (!std::filesystem::exists(exePath))
 		throw std::invalid_argument("Cannot find exe at path: " + exePath.string());
 
-	STARTUPINFO si;
+	STARTUPINFOEX si;
 	PROCESS_INFORMATION pi;
 
 	ZeroMemory(&si, sizeof(si));
-	si.cb = sizeof(si);
+	si.StartupInfo.cb = sizeof(si);
 	ZeroMemory(&pi, sizeof(pi));
 
+	// Redirect the std handles if requested. Only the given handles are inherited, so handles
+	// that other threads create at the same time don't leak into this child.
+	const bool redirect = (hStdOutput != NULL || hStdError != NULL);
+	HANDLE hNul = INVALID_HANDLE_VALUE;
+	std::vector<HANDLE> inheritedHandles;
+	std::vector<uint8_t> attributeListBuffer;
+	DWORD creationFlags = 0;
+	if (redirect)
+	{
+		// std handles that are not redirected point to NUL, the child may not have a console to fall back on
+		SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+		hNul = CreateFile(L"NUL", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, NULL);
+		if (hNul == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("Cannot open NUL for child process.\n" + getLastErrorAsString());
+
+		si.StartupInfo.dwFlags |= STARTF_USESTDHANDLES;
+		si.StartupInfo.hStdInput = hNul;
+		si.StartupInfo.hStdOutput = (hStdOutput != NULL) ? hStdOutput : hNul;
+		si.StartupInfo.hStdError = (hStdError != NULL) ? hStdError : hNul;
+
+		for (HANDLE h : { si.StartupInfo.hStdInput, si.StartupInfo.hStdOutput, si.StartupInfo.hStdError })
+		{
+			// the handle list must not contain duplicates
+			if (std::find(inheritedHandles.begin(), inheritedHandles.end(), h) == inheritedHandles.end())
+				inheritedHandles.push_back(h);
+		}
+
+		SIZE_T attributeListSize = 0;
+		InitializeProcThreadAttributeList(NULL, 1, 0, &attributeListSize);
+		attributeListBuffer.resize(attributeListSize);
+		si.lpAttributeList = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attributeListBuffer.data());
+		if (!InitializeProcThreadAttributeList(si.lpAttributeList, 1, 0, &attributeListSize) ||
+			!UpdateProcThreadAttribute(si.lpAttributeList, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST,
+				inheritedHandles.data(), inheritedHandles.size() * sizeof(HANDLE), NULL, NULL))
+		{
+			std::string error = getLastErrorAsString();
+			CloseHandle(hNul);
+			throw std::runtime_error("Cannot set up handle inheritance for child process.\n" + error);
+		}
+		creationFlags |= EXTENDED_STARTUPINFO_PRESENT;
+	}
+	// the child must not start any process of its own before it is in the job, or that process escapes it
+	if (hJob != NULL)
+		creationFlags |= CREATE_SUSPENDED;
+
 	// Start the child process. 
 	LPTSTR szAppName = CA2T(exePath.string().c_str());
 
-	if (!CreateProcess(szAppName,
+	BOOL created = CreateProcess(szAppName,
 		CA2T(cmd.c_str()),        // Command line
 		NULL,           // Process handle not inheritable
 		NULL,           // Thread handle not inheritable
-		FALSE,          // Set handle inheritance to FALSE
-		0,              // No creation flags
+		redirect,       // Inherit only the handles in the attribute list
+		creationFlags,  // Extended startup info if redirecting, suspended if placed in a job
 		NULL,           // Use parent's environment block
 		NULL,           // Use parent's starting directory 
-		&si,            // Pointer to STARTUPINFO structure
-		&pi)           // Pointer to PROCESS_INFORMATION structure
-		)
+		&si.StartupInfo,// Pointer to STARTUPINFO structure
+		&pi);           // Pointer to PROCESS_INFORMATION structure
+	std::string error = created ? std::string() : getLastErrorAsString();
+
+	if (redirect)
+	{
+		DeleteProcThreadAttributeList(si.lpAttributeList);
+		CloseHandle(hNul);
+	}
+
+	if (!created)
 	{
-		throw std::runtime_error("Cannot run exe.\nExe path: " + exePath.string() + "\nCommand:\n" + cmd + "\n" + getLastErrorAsString());
+		throw std::runtime_error("Cannot run exe.\nExe path: " + exePath.string() + "\nCommand:\n" + cmd + "\n" + error);
+	}
+
+	if (hJob != NULL)
+	{
+		if (!AssignProcessToJobObject(hJob, pi.hProcess))
+		{
+			error = getLastErrorAsString();
+			TerminateProcess(pi.hProcess, 1);
+			CloseHandle(pi.hProcess);
+			CloseHandle(pi.hThread);
+			throw std::runtime_error("Cannot place exe in job object.\nExe path: " + exePath.string() + "\n" + error);
+		}
+		ResumeThread(pi.hThread);
 	}
 
 	return pi;
 }
 
 /**
- * Wait for process to complete
+ * Wait for process to complete. The calling thread is woken by the shared ProcessWaiter as soon as the process exits.
  *
  * @param[in] pi the process information struct
- * @throws runtime_error if failed to get exit code
+ * @throws runtime_error if the process cannot be watched
  */
 void windowsprocessutils::waitForProcess(PROCESS_INFORMATION pi)
 {
-	// Wait until child process exits.
 	// Note: this is only safe for processes that do not create windows. Otherwise MsgWaitForMultipleObjects may be needed.
-	//WaitForSingleObject(pi.hProcess, INFINITE);
-
-	DWORD exit_code = STILL_ACTIVE;
-	while (exit_code == STILL_ACTIVE)
-	{
-		if (FALSE == GetExitCodeProcess(pi.hProcess, &exit_code))
-			throw std::runtime_error("Cannot get exit code.");
-		Sleep(1000);
-	}
+	ProcessWaiter::getInstance().wait(pi.hProcess);
 }
 
 /**
@@ -95,6 +159,44 @@ void windowsprocessutils::closeProcess(PROCESS_INFORMATION pi)
 		throw std::runtime_error("Process returned non-zero error code: " + std::to_string(exit_code));
 }
 
+/**
+ * Get the time a process was created, which tells it apart from a later process that got the same id
+ *
+ * @param[in] hProcess handle to the process
+ * @return the creation time in 100 ns ticks, 0 if it cannot be queried
+ */
+uint64_t windowsprocessutils::getCreationTime(HANDLE hProcess)
+{
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(hProcess, &creation, &exit, &kernel, &user))
+		return 0;
+	return (static_cast<uint64_t>(creation.dwHighDateTime) << 32) | creation.dwLowDateTime;
+}
+
+/**
+ * Open a process that was started earlier, e.g. by the last session of the plugin, so it can be waited for,
+ * killed, and placed in a job object
+ *
+ * @param[in] processId the id of the process
+ * @param[in] creationTime the creation time from getCreationTime
+ * @return handle to the process, NULL if it exited and its id is gone or was given to another process
+ */
+HANDLE windowsprocessutils::openProcess(const uint32_t processId, const uint64_t creationTime)
+{
+	HANDLE hProcess = OpenProcess(SYNCHRONIZE | PROCESS_QUERY_LIMITED_INFORMATION | PROCESS_TERMINATE | PROCESS_SET_QUOTA,
+		FALSE, processId);
+	if (hProcess == NULL)
+		return NULL;
+
+	DWORD exitCode = 0;
+	if (getCreationTime(hProcess) != creationTime || !GetExitCodeProcess(hProcess, &exitCode) || exitCode != STILL_ACTIVE)
+	{
+		CloseHandle(hProcess);
+		return NULL;
+	}
+	return hProcess;
+}
+
 /**
 * Gets the last windows error message as a string
 *
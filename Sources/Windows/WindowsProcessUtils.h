@@ -15,9 +15,13 @@
 
 namespace windowsprocessutils
 {
-	PROCESS_INFORMATION startProcess(const std::filesystem::path& exePath, const std::string& cmd);
+	PROCESS_INFORMATION startProcess(const std::filesystem::path& exePath, const std::string& cmd,
+		HANDLE hStdOutput = NULL, HANDLE hStdError = NULL, HANDLE hJob = NULL);
 	void waitForProcess(PROCESS_INFORMATION pi);
 	void closeProcess(PROCESS_INFORMATION pi);
 
+	uint64_t getCreationTime(HANDLE hProcess);
+	HANDLE openProcess(const uint32_t processId, const uint64_t creationTime);
+
 	std::string getLastErrorAsString();
 }
\ No newline at end of file
@@ -11,6 +11,9 @@
 
 #include "YoutubeDlUtils.h"
 #include "WindowsProcessUtils.h"
+#include "ProgressParser.h"
+#include <algorithm>
+#include <cctype>
 #include <filesystem>
 #include <atlbase.h>
 
@@ -29,6 +32,93 @@ std::string youtubedlutils::getOutputFolderName(const std::optional<std::string>
 		return fileutils::getDesktopPath();
 }
 
+/**
+ * Get the output folder in a form that is the same for every spelling of it.
+ * Windows paths are not case sensitive and take both kinds of slashes.
+ *
+ * @param[in] optOutputFolder optional output folder. Defaults to desktop if not provided.
+ * @return the normalized output folder
+ */
+std::string youtubedlutils::getOutputFolderKey(const std::optional<std::string>& optOutputFolder)
+{
+	std::string outputFolder = optOutputFolder.value_or("");
+	try
+	{
+		outputFolder = getOutputFolderName(optOutputFolder);
+	}
+	catch (std::runtime_error&)
+	{
+	}
+	std::replace(outputFolder.begin(), outputFolder.end(), '\\', '/');
+	while (outputFolder.size() > 1 && outputFolder.back() == '/')
+		outputFolder.pop_back();
+	std::transform(outputFolder.begin(), outputFolder.end(), outputFolder.begin(),
+		[](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return outputFolder;
+}
+
+/**
+ * Get the download types in a form that does not depend on the order of the set
+ *
+ * @param[in] types the types of download to perform
+ * @return the sorted types, separated by commas
+ */
+std::string youtubedlutils::getFormatsKey(const std::unordered_set<DL_TYPE>& types)
+{
+	std::vector<int> formats(types.begin(), types.end());
+	std::sort(formats.begin(), formats.end());
+	std::string key;
+	for (const int format : formats)
+		key += std::to_string(format) + ",";
+	return key;
+}
+
+/**
+ * Get the format selection arguments of a download type
+ *
+ * @param[in] type the type of download to perform
+ * @return string containing the arguments
+ */
+static std::string getFormatArgs(const DL_TYPE type)
+{
+	switch (type)
+	{
+	case VIDEO_ONLY:
+		return " -f bestvideo[ext!=webm]/mp4";
+	case AUDIO_ONLY:
+		return " -f bestaudio/best -v --extract-audio --audio-quality 320k --audio-format mp3";
+	default:
+		return " -f bestvideo[ext!=webm]+bestaudio[ext!=webm]/mp4";
+	}
+}
+
+/**
+ * Get the output filename of a download type. Formats that run at the same time need names of their own,
+ * otherwise two of them can write the same file, e.g. a video and an audio download that fell back to the same mp4.
+ *
+ * @param[in] type the type of download to perform
+ * @param[in] parallelFormats true if other formats of the same url are downloaded at the same time
+ * @return string containing the output filename template
+ */
+static std::string getFormatFilename(const DL_TYPE type, const bool parallelFormats)
+{
+	if (parallelFormats && type == VIDEO_ONLY)
+		return "%(title)s.video.%(ext)s";
+	if (parallelFormats && type == AUDIO_ONLY)
+		return "%(title)s.audio.%(ext)s";
+	return "%(title)s.%(ext)s";
+}
+
+/**
+ * Get the arguments that make youtube-dl print one machine readable progress line per update
+ *
+ * @return string containing the arguments
+ */
+static std::string getProgressArgs()
+{
+	return " --newline --progress-template \"" + std::string(ProgressParser::PROGRESS_TEMPLATE) + "\"";
+}
+
 /**
  * Construct a youtube-dl command string that is passed as command line arguments to youtube-dl
  *
@@ -37,13 +127,15 @@ std::string youtubedlutils::getOutputFolderName(const std::optional<std::string>
  * @param[in] optFilename optional filename. Defaults to "%(title)s.%(ext)s" if not provided.
  * @param[in] optMaxDownloads optional max downloads count. Defaults to 1 if not provided. Set to 0 for infinity.
  * @param[in] optType the type of download to perform
+ * @param[in] optInfoJsonPath optional info json written by the resolve command. If provided, it is loaded instead of extracting the url again.
  * @return string containing the command
  */
 std::string youtubedlutils::getDownloadCommand(const std::string& url,
 	const std::optional<std::string>& optOutputFolder,
 	const std::optional<std::string>& optFilename,
 	const std::optional<uint32_t>& optMaxDownloads,
-	const std::optional<uint32_t> optType)
+	const std::optional<uint32_t> optType,
+	const std::optional<std::string>& optInfoJsonPath)
 {
 	// default values
 	std::string outputFolder = getOutputFolderName(optOutputFolder);
@@ -60,23 +152,14 @@ std::string youtubedlutils::getDownloadCommand(const std::string& url,
 		type = static_cast<DL_TYPE>(*optType);
 
 	//setup command
-	std::string cmd;
-	switch (type)
-	{
-	case VIDEO_ONLY:
-		cmd = " -f bestvideo[ext!=webm]/mp4";
-		break;
-	case AUDIO_ONLY:
-		cmd = " -f bestaudio/best -v --extract-audio --audio-quality 320k --audio-format mp3";
-		break;
-	default:
-		cmd = " -f bestvideo[ext!=webm]+bestaudio[ext!=webm]/mp4";
-		break;
-	}
+	std::string cmd = getFormatArgs(type) + getProgressArgs();
 	if (maxDownloads != 0)
 		cmd += " --max-downloads " + std::to_string(maxDownloads);
 	cmd += " -o \"" + outputFolder + "/" + filename + "\"";
-	cmd += " " + url;
+	if (optInfoJsonPath)
+		cmd += " --load-info-json \"" + *optInfoJsonPath + "\"";
+	else
+		cmd += " " + url;
 
 	return cmd;
 }
@@ -90,6 +173,8 @@ std::string youtubedlutils::getDownloadCommand(const std::string& url,
  * @param[in] optMaxDownloads optional max downloads count. Defaults to 1 if not provided. Set to 0 for infinity.
  * @param[in] optType set of types of downloads to perform. A command will be created per type.
  * @param[in] optCustomCommand optional custom command.
+ * @param[in] optInfoJsonPath optional info json written by the resolve command, used by the format commands. The custom command always gets the url.
+ * @param[in] parallelFormats true if the commands run at the same time, each format then writes files of its own name
  * @return vector containing all the commands
  */
 std::vector <std::string> youtubedlutils::getCommandQueue(const std::string& url,
@@ -97,11 +182,16 @@ std::vector <std::string> youtubedlutils::getCommandQueue(const std::string& url
 	const std::optional<std::string>& optFilename,
 	const std::optional<uint32_t>& optMaxDownloads,
 	const std::unordered_set<DL_TYPE>& optType,
-	const std::optional<std::string>& optCustomCommand)
+	const std::optional<std::string>& optCustomCommand,
+	const std::optional<std::string>& optInfoJsonPath,
+	const bool parallelFormats)
 {
 	std::vector <std::string> cmds;
 	for (const auto& format : optType)
-		cmds.push_back(youtubedlutils::getDownloadCommand(url, optOutputFolder, optFilename, optMaxDownloads, format));
+	{
+		const std::string filename = optFilename ? *optFilename : getFormatFilename(format, parallelFormats && optType.size() > 1);
+		cmds.push_back(youtubedlutils::getDownloadCommand(url, optOutputFolder, filename, optMaxDownloads, format, optInfoJsonPath));
+	}
 
 	if (optCustomCommand && !(*optCustomCommand).empty())
 		cmds.push_back(" " + *optCustomCommand + " " + url);
@@ -109,6 +199,102 @@ std::vector <std::string> youtubedlutils::getCommandQueue(const std::string& url
 	return cmds;
 }
 
+/**
+ * Construct a command that downloads every url listed in a batch file with one youtube-dl process.
+ * Errors of one url don't stop the others, and the url of every finished download is appended to the done file,
+ * so the outcome of each url can be read back.
+ *
+ * @param[in] batchFilePath file with one url per line
+ * @param[in] doneFilePath file that receives the original url of every finished download
+ * @param[in] optOutputFolder optional output folder. Defaults to desktop if not provided.
+ * @param[in] optMaxDownloads optional max downloads count per url. Defaults to 1 if not provided. Set to 0 for infinity.
+ * @param[in] type the type of download to perform
+ * @param[in] parallelFormats true if the other formats of the batch are downloaded at the same time
+ * @return string containing the command
+ */
+std::string youtubedlutils::getBatchCommand(const std::string& batchFilePath,
+	const std::string& doneFilePath,
+	const std::optional<std::string>& optOutputFolder,
+	const std::optional<uint32_t>& optMaxDownloads,
+	const DL_TYPE type,
+	const bool parallelFormats)
+{
+	std::string outputFolder = getOutputFolderName(optOutputFolder);
+	uint32_t maxDownloads = 1;
+	if (optMaxDownloads)
+		maxDownloads = *optMaxDownloads;
+
+	std::string cmd = getFormatArgs(type) + getProgressArgs();
+	// --max-downloads counts across the whole batch, limit each url's playlist instead
+	if (maxDownloads != 0)
+		cmd += " --playlist-end " + std::to_string(maxDownloads);
+	cmd += " -o \"" + outputFolder + "/" + getFormatFilename(type, parallelFormats) + "\"";
+	cmd += " --ignore-errors --print-to-file \"after_move:%(original_url)s\" \"" + doneFilePath + "\"";
+	cmd += " --batch-file \"" + batchFilePath + "\"";
+
+	return cmd;
+}
+
+/**
+ * Construct the arguments that cap the download rate of a command. They go in front of the command,
+ * so a --limit-rate in a custom command still overrides them.
+ *
+ * @param[in] bytesPerSecond the rate limit, 0 for no limit
+ * @return string containing the arguments, empty if there is no limit
+ */
+std::string youtubedlutils::getRateLimitArgs(const uint64_t bytesPerSecond)
+{
+	if (bytesPerSecond == 0)
+		return "";
+	return " --limit-rate " + std::to_string(bytesPerSecond);
+}
+
+/**
+ * Construct the arguments that make a command record the key of every finished download in an archive file.
+ * Media that are already in the file are skipped by the command.
+ *
+ * @param[in] archiveFilePath the archive file
+ * @return string containing the arguments
+ */
+std::string youtubedlutils::getArchiveArgs(const std::string& archiveFilePath)
+{
+	return " --download-archive \"" + archiveFilePath + "\"";
+}
+
+/**
+ * Construct the command that extracts the metadata of a url once, so it can be shared by all format commands.
+ * The single json is written to stdout.
+ *
+ * @param[in] url the url to extract
+ * @param[in] optMaxDownloads optional max downloads count. Defaults to 1 if not provided. Set to 0 for infinity.
+ *                            Limits how many playlist entries are extracted.
+ * @return string containing the command
+ */
+std::string youtubedlutils::getResolveCommand(const std::string& url,
+	const std::optional<uint32_t>& optMaxDownloads)
+{
+	uint32_t maxDownloads = 1;
+	if (optMaxDownloads)
+		maxDownloads = *optMaxDownloads;
+
+	std::string cmd = " --dump-single-json --no-warnings";
+	if (maxDownloads != 0)
+		cmd += " --playlist-end " + std::to_string(maxDownloads);
+	cmd += " " + url;
+
+	return cmd;
+}
+
+/**
+ * Check if a resolve pass is worth it. It only pays off if more than one format command extracts the same url.
+ *
+ * @param[in] optType set of types of downloads to perform
+ * @return true if the format commands should share one info json
+ */
+bool youtubedlutils::shouldResolve(const std::unordered_set<DL_TYPE>& optType)
+{
+	return optType.size() > 1;
+}
 
 /**
  * Convert an optional downloader exe path to actual string path.
@@ -20,18 +20,34 @@
 namespace youtubedlutils
 {
 	std::string getOutputFolderName(const std::optional<std::string>& optOutputFolder);
+	std::string getOutputFolderKey(const std::optional<std::string>& optOutputFolder);
+	std::string getFormatsKey(const std::unordered_set<DL_TYPE>& types);
 
 	std::string getDownloadCommand(const std::string& url,
 		const std::optional<std::string>& optOutputFolder,
 		const std::optional<std::string>& optFilename,
 		const std::optional<uint32_t>& optMaxDownloads,
-		const std::optional<uint32_t> optType);
+		const std::optional<uint32_t> optType,
+		const std::optional<std::string>& optInfoJsonPath = std::nullopt);
 	std::vector <std::string> getCommandQueue(const std::string& url,
 		const std::optional<std::string>& optOutputFolder,
 		const std::optional<std::string>& optFilename,
 		const std::optional<uint32_t>& optMaxDownloads,
 		const std::unordered_set<DL_TYPE>& optType,
-		const std::optional<std::string>& optCustomCommand);
+		const std::optional<std::string>& optCustomCommand,
+		const std::optional<std::string>& optInfoJsonPath = std::nullopt,
+		const bool parallelFormats = false);
+	std::string getBatchCommand(const std::string& batchFilePath,
+		const std::string& doneFilePath,
+		const std::optional<std::string>& optOutputFolder,
+		const std::optional<uint32_t>& optMaxDownloads,
+		const DL_TYPE type,
+		const bool parallelFormats = false);
+	std::string getResolveCommand(const std::string& url,
+		const std::optional<uint32_t>& optMaxDownloads);
+	std::string getRateLimitArgs(const uint64_t bytesPerSecond);
+	std::string getArchiveArgs(const std::string& archiveFilePath);
+	bool shouldResolve(const std::unordered_set<DL_TYPE>& optType);
 
 	std::filesystem::path getDownloaderExePath(const std::optional<std::string>& optyoutubeDlExePath);
 }
\ No newline at end of file
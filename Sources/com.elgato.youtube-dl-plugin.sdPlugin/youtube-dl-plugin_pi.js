@@ -26,6 +26,12 @@ function connectElgatoStreamDeckSocket(inPort, inUUID, inRegisterEvent, inInfo,
             "context": uuid,
         };
         websocket.send(JSON.stringify(json));
+
+        json = {
+            "event": "getGlobalSettings",
+            "context": uuid,
+        };
+        websocket.send(JSON.stringify(json));
     };
 
     // retrieve saved settings if there are any
@@ -54,11 +60,51 @@ function connectElgatoStreamDeckSocket(inPort, inUUID, inRegisterEvent, inInfo,
 			else
 				checkRadioButton('rrdio', 'off');
 
+			if (payload.progressDisplay !== undefined)
+				checkRadioButton('prdio', payload.progressDisplay);
+			else
+				checkRadioButton('prdio', 'text');
+
+			if (payload.skipDownloaded !== undefined)
+				checkRadioButton('sdrdio', payload.skipDownloaded);
+			else
+				checkRadioButton('sdrdio', 'on');
+
+			if (payload.childPriority !== undefined)
+				checkRadioButton('cprdio', payload.childPriority);
+			else
+				checkRadioButton('cprdio', 'below');
+
             if (payload.maxDownloads !== undefined)
                 document.getElementById('max_downloads_textbox').value = payload.maxDownloads;
             else
                 document.getElementById('max_downloads_textbox').value = 1;
 
+            if (payload.maxParallelCommands !== undefined)
+                document.getElementById('max_parallel_commands_textbox').value = payload.maxParallelCommands;
+            else
+                document.getElementById('max_parallel_commands_textbox').value = 1;
+
+            if (payload.maxMemoryMB !== undefined)
+                document.getElementById('max_memory_textbox').value = payload.maxMemoryMB;
+            else
+                document.getElementById('max_memory_textbox').value = 0;
+
+            if (payload.maxCpuPercent !== undefined)
+                document.getElementById('max_cpu_textbox').value = payload.maxCpuPercent;
+            else
+                document.getElementById('max_cpu_textbox').value = 0;
+
+			if (payload.queuePriority !== undefined)
+				checkRadioButton('qprdio', payload.queuePriority);
+			else
+				checkRadioButton('qprdio', 'normal');
+
+            if (payload.queueWeight !== undefined)
+                document.getElementById('queue_weight_textbox').value = payload.queueWeight;
+            else
+                document.getElementById('queue_weight_textbox').value = 1;
+
             if (payload.outputFolder !== undefined)
                 document.getElementById('output_folder_textbox').value = payload.outputFolder;
 
@@ -71,6 +117,26 @@ function connectElgatoStreamDeckSocket(inPort, inUUID, inRegisterEvent, inInfo,
             updateSettingsToPlugin();
         }
 
+        // settings shared by all buttons
+        if (jsonObj.event === 'didReceiveGlobalSettings') {
+            const payload = jsonObj.payload.settings;
+
+            if (payload.maxConcurrentDownloads !== undefined)
+                document.getElementById('max_concurrent_textbox').value = payload.maxConcurrentDownloads;
+            else
+                document.getElementById('max_concurrent_textbox').value = 4;
+
+            if (payload.batchWindowMillis !== undefined)
+                document.getElementById('batch_window_textbox').value = payload.batchWindowMillis;
+            else
+                document.getElementById('batch_window_textbox').value = 250;
+
+            if (payload.bandwidthLimitKBps !== undefined)
+                document.getElementById('bandwidth_limit_textbox').value = payload.bandwidthLimitKBps;
+            else
+                document.getElementById('bandwidth_limit_textbox').value = 0;
+        }
+
 		if (jsonObj.event === 'sendToPropertyInspector') {
 			const payload = jsonObj.payload;
 			if (payload.sampleCommand !== undefined)
@@ -95,7 +161,15 @@ function updateSettingsToPlugin() {
 			'videoDl':getRadioValue('vrdio'),
 			'audioDl':getRadioValue('ardio'),
 			'redditDl':getRadioValue('rrdio'),
+			'progressDisplay':getRadioValue('prdio'),
+			'skipDownloaded':getRadioValue('sdrdio'),
+			'childPriority':getRadioValue('cprdio'),
             'maxDownloads':document.getElementById('max_downloads_textbox').value,
+            'maxParallelCommands':document.getElementById('max_parallel_commands_textbox').value,
+            'maxMemoryMB':document.getElementById('max_memory_textbox').value,
+            'maxCpuPercent':document.getElementById('max_cpu_textbox').value,
+			'queuePriority':getRadioValue('qprdio'),
+            'queueWeight':document.getElementById('queue_weight_textbox').value,
             'customCommand':document.getElementById('cmd_textbox').value,
             'outputFolder':document.getElementById('output_folder_textbox').value,
             'youtubeDlExePath':document.getElementById('youtubedl_path_textbox').value,
@@ -106,6 +180,25 @@ function updateSettingsToPlugin() {
 	sendCommand('getSampleCommand'); // retrieve sample command
 }
 
+// update the settings shared by all buttons, an empty value goes back to the default
+function updateGlobalSettingsToPlugin() {
+    payload = {
+            'maxConcurrentDownloads':document.getElementById('max_concurrent_textbox').value,
+            'batchWindowMillis':document.getElementById('batch_window_textbox').value,
+            'bandwidthLimitKBps':document.getElementById('bandwidth_limit_textbox').value,
+	};
+
+    // the plugin receives them with didReceiveGlobalSettings
+    if (websocket) {
+        const json = {
+                "event": "setGlobalSettings",
+                "context": uuid,
+                "payload": payload
+        };
+        websocket.send(JSON.stringify(json));
+    }
+}
+
 // send a payload to plugin
 function sendValueToPlugin(payload) {
     if (websocket) {